@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -32,6 +32,7 @@ var (
 	VMIP            string
 	ContainLibsPath []string
 	FuseMount       []string
+	TraceFile       string
 
 	IsBoot          bool
 	IsFakeroot      bool
@@ -614,6 +615,17 @@ var actionAllowSetuidFlag = cmdline.Flag{
 	ExcludedOS:   []string{cmdline.Darwin},
 }
 
+// --trace
+var actionTraceFlag = cmdline.Flag{
+	ID:           "actionTraceFlag",
+	Value:        &TraceFile,
+	DefaultValue: "",
+	Name:         "trace",
+	Usage:        "record the timeline of the container startup phases in the given file (Chrome trace event format)",
+	EnvKeys:      []string{"TRACE"},
+	ExcludedOS:   []string{cmdline.Darwin},
+}
+
 func init() {
 	addCmdInit(func(cmdManager *cmdline.CommandManager) {
 		cmdManager.RegisterCmd(ExecCmd)
@@ -673,6 +685,7 @@ func init() {
 		cmdManager.RegisterFlagForCmd(&actionShellFlag, ShellCmd)
 		cmdManager.RegisterFlagForCmd(&actionSyOSFlag, ShellCmd)
 		cmdManager.RegisterFlagForCmd(&actionTmpDirFlag, actionsInstanceCmd...)
+		cmdManager.RegisterFlagForCmd(&actionTraceFlag, actionsInstanceCmd...)
 		cmdManager.RegisterFlagForCmd(&actionUserNamespaceFlag, actionsInstanceCmd...)
 		cmdManager.RegisterFlagForCmd(&actionUtsNamespaceFlag, actionsInstanceCmd...)
 		cmdManager.RegisterFlagForCmd(&actionVMCPUFlag, actionsCmd...)
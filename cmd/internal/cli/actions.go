@@ -122,6 +122,12 @@ func handleOCI(ctx context.Context, imgCache *cache.Handle, cmd *cobra.Command,
 		}
 		imgabs = imgCache.OciTempImage(sum, name)
 
+		unlock, err := imgCache.LockEntry(imgabs)
+		if err != nil {
+			return "", fmt.Errorf("unable to lock cache entry %s: %s", imgabs, err)
+		}
+		defer unlock()
+
 		exists, err := imgCache.OciTempExists(sum, name)
 		if err != nil {
 			return "", fmt.Errorf("unable to check if %s exists: %s", name, err)
@@ -170,6 +176,12 @@ func handleOras(ctx context.Context, imgCache *cache.Handle, cmd *cobra.Command,
 
 	imageName := uri.GetName(u)
 	cacheImagePath := imgCache.OrasImage(sum, imageName)
+	unlock, err := imgCache.LockEntry(cacheImagePath)
+	if err != nil {
+		return "", fmt.Errorf("unable to lock cache entry %s: %s", cacheImagePath, err)
+	}
+	defer unlock()
+
 	if exists, err := imgCache.OrasImageExists(sum, imageName); err != nil {
 		return "", fmt.Errorf("unable to check if %v exists: %v", cacheImagePath, err)
 	} else if !exists {
@@ -184,6 +196,7 @@ func handleOras(ctx context.Context, imgCache *cache.Handle, cmd *cobra.Command,
 		} else if cacheFileHash != sum {
 			return "", fmt.Errorf("cached file hash(%s) and expected hash(%s) does not match", cacheFileHash, sum)
 		}
+		cache.SetImageDigest(cacheImagePath, sum)
 	}
 
 	return cacheImagePath, nil
@@ -217,7 +230,7 @@ func handleLibrary(ctx context.Context, imgCache *cache.Handle, u, libraryURL st
 		imagePath = file.Name()
 		sylog.Infof("Downloading library image to tmp cache: %s", imagePath)
 
-		if err = libraryhelper.DownloadImageNoProgress(ctx, c, imagePath, runtime.GOARCH, imageRef); err != nil {
+		if _, err = libraryhelper.DownloadImageNoProgress(ctx, c, imagePath, runtime.GOARCH, imageRef); err != nil {
 			return "", fmt.Errorf("unable to download image: %v", err)
 		}
 
@@ -225,20 +238,24 @@ func handleLibrary(ctx context.Context, imgCache *cache.Handle, u, libraryURL st
 		imageName := uri.GetName("library://" + imageRef)
 		imagePath = imgCache.LibraryImage(libraryImage.Hash, imageName)
 
+		unlock, err := imgCache.LockEntry(imagePath)
+		if err != nil {
+			return "", fmt.Errorf("unable to lock cache entry %s: %s", imagePath, err)
+		}
+		defer unlock()
+
 		if exists, err := imgCache.LibraryImageExists(libraryImage.Hash, imageName); err != nil {
 			return "", fmt.Errorf("unable to check if %v exists: %v", imagePath, err)
 		} else if !exists {
 			sylog.Infof("Downloading library image")
 
-			if err := libraryhelper.DownloadImageNoProgress(ctx, c, imagePath, runtime.GOARCH, imageRef); err != nil {
+			// the image is hashed while downloaded
+			if cacheFileHash, err := libraryhelper.DownloadImageNoProgress(ctx, c, imagePath, runtime.GOARCH, imageRef); err != nil {
 				return "", fmt.Errorf("unable to download image: %v", err)
-			}
-
-			if cacheFileHash, err := library.ImageHash(imagePath); err != nil {
-				return "", fmt.Errorf("error getting image hash: %v", err)
 			} else if cacheFileHash != libraryImage.Hash {
 				return "", fmt.Errorf("cached file hash(%s) and expected hash(%s) does not match", cacheFileHash, libraryImage.Hash)
 			}
+			cache.SetImageDigest(imagePath, libraryImage.Hash)
 		}
 	}
 
@@ -275,6 +292,12 @@ func handleShub(imgCache *cache.Handle, u string) (string, error) {
 		imageName := uri.GetName(u)
 		imagePath = imgCache.ShubImage(manifest.Commit, imageName)
 
+		unlock, err := imgCache.LockEntry(imagePath)
+		if err != nil {
+			return "", fmt.Errorf("unable to lock cache entry %s: %s", imagePath, err)
+		}
+		defer unlock()
+
 		exists, err := imgCache.ShubImageExists(manifest.Commit, imageName)
 		if err != nil {
 			return "", fmt.Errorf("unable to check if %v exists: %v", imagePath, err)
@@ -322,6 +345,12 @@ func handleNet(imgCache *cache.Handle, u string) (string, error) {
 
 	imagePath := imgCache.NetImage("hash", imageHash)
 
+	unlock, err := imgCache.LockEntry(imagePath)
+	if err != nil {
+		return "", fmt.Errorf("unable to lock cache entry %s: %s", imagePath, err)
+	}
+	defer unlock()
+
 	exists, err := imgCache.NetImageExists("hash", imageHash)
 	if err != nil {
 		return "", fmt.Errorf("unable to check if %v exists: %v", imagePath, err)
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -19,6 +19,7 @@ import (
 	"github.com/opencontainers/runtime-tools/generate"
 	"github.com/spf13/cobra"
 	"github.com/sylabs/singularity/internal/pkg/buildcfg"
+	"github.com/sylabs/singularity/internal/pkg/client/cache"
 	"github.com/sylabs/singularity/internal/pkg/instance"
 	"github.com/sylabs/singularity/internal/pkg/plugin"
 	"github.com/sylabs/singularity/internal/pkg/runtime/engine/config/oci"
@@ -27,6 +28,7 @@ import (
 	"github.com/sylabs/singularity/internal/pkg/util/env"
 	"github.com/sylabs/singularity/internal/pkg/util/fs"
 	"github.com/sylabs/singularity/internal/pkg/util/starter"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 	"github.com/sylabs/singularity/internal/pkg/util/user"
 	imgutil "github.com/sylabs/singularity/pkg/image"
 	"github.com/sylabs/singularity/pkg/image/unpacker"
@@ -37,6 +39,7 @@ import (
 	"github.com/sylabs/singularity/pkg/util/gpu"
 	"github.com/sylabs/singularity/pkg/util/namespaces"
 	"github.com/sylabs/singularity/pkg/util/rlimit"
+	"golang.org/x/crypto/ssh/terminal"
 )
 
 // EnsureRootPriv ensures that a command is executed with root privileges.
@@ -121,6 +124,13 @@ func hidepidProc() bool {
 func execStarter(cobraCmd *cobra.Command, image string, args []string, name string) {
 	var err error
 
+	if TraceFile != "" {
+		if err := trace.Start(TraceFile); err != nil {
+			sylog.Fatalf("while starting trace: %s", err)
+		}
+	}
+	prepare := trace.Begin("cli: prepare configuration")
+
 	targetUID := 0
 	targetGID := make([]int, 0)
 
@@ -604,7 +614,22 @@ func execStarter(cobraCmd *cobra.Command, image string, args []string, name stri
 		m.Mutate(cfg)
 	}
 
+	// the shared locks held on the cached images used by the container
+	// are passed to starter
+	engineConfig.SetCacheLockFds(cache.InheritLocks())
+
+	prepare.End()
+
 	if engineConfig.GetInstance() {
+		if instanceStartExecAgent && !IsBoot {
+			agent, err := instance.ListenExecAgent(name)
+			if err != nil {
+				sylog.Fatalf("failed to create exec agent socket: %s", err)
+			}
+			defer agent.Close()
+			engineConfig.SetExecAgentFd(int(agent.Fd()))
+		}
+
 		stdout, stderr, err := instance.SetLogFile(name, int(uid), instance.LogSubDir)
 		if err != nil {
 			sylog.Fatalf("failed to create instance log files: %s", err)
@@ -648,6 +673,10 @@ func execStarter(cobraCmd *cobra.Command, image string, args []string, name stri
 			sylog.Infof("instance started successfully")
 		}
 	} else {
+		if engineConfig.GetInstanceJoin() {
+			execWithInstanceAgent(engineConfig)
+		}
+
 		err := starter.Exec(
 			procname,
 			cfg,
@@ -657,3 +686,43 @@ func execStarter(cobraCmd *cobra.Command, image string, args []string, name stri
 		sylog.Fatalf("%s", err)
 	}
 }
+
+// execWithInstanceAgent runs the container process with the exec agent of
+// the joined instance if it has one. It doesn't return if the process was
+// started by the exec agent, otherwise the instance is joined with starter.
+func execWithInstanceAgent(engineConfig *singularityConfig.EngineConfig) {
+	// processes started by the exec agent inherit the credentials and
+	// the security context of the instance process, so requests for
+	// other ones are handled by starter, like interactive processes
+	// which require a controlling terminal
+	if len(engineConfig.GetSecurity()) > 0 || engineConfig.GetAddCaps() != "" || engineConfig.GetDropCaps() != "" {
+		return
+	}
+	if engineConfig.GetKeepPrivs() || engineConfig.GetNoPrivs() || len(plugin.EngineConfigMutators()) > 0 {
+		return
+	}
+	if terminal.IsTerminal(int(os.Stdin.Fd())) {
+		return
+	}
+
+	name := instance.ExtractName(engineConfig.GetImage())
+	process := engineConfig.OciConfig.Process
+	req := &instance.ExecRequest{
+		Args: process.Args,
+		Env:  process.Env,
+		Cwd:  process.Cwd,
+	}
+
+	status, started, err := instance.ExecWithAgent(name, req)
+	if !started {
+		sylog.Debugf("Joining instance %s without exec agent: %s", name, err)
+		return
+	} else if err != nil {
+		sylog.Fatalf("%s", err)
+	}
+
+	if status.Signaled() {
+		os.Exit(128 + int(status.Signal()))
+	}
+	os.Exit(status.ExitStatus())
+}
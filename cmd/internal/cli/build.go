@@ -22,20 +22,22 @@ import (
 )
 
 var buildArgs struct {
-	sections   []string
-	arch       string
-	builderURL string
-	libraryURL string
-	detached   bool
-	encrypt    bool
-	fakeroot   bool
-	fixPerms   bool
-	isJSON     bool
-	noCleanUp  bool
-	noTest     bool
-	remote     bool
-	sandbox    bool
-	update     bool
+	sections       []string
+	arch           string
+	builderURL     string
+	libraryURL     string
+	mksquashfsArgs string
+	detached       bool
+	encrypt        bool
+	fakeroot       bool
+	fixPerms       bool
+	isJSON         bool
+	jobs           int
+	noCleanUp      bool
+	noTest         bool
+	remote         bool
+	sandbox        bool
+	update         bool
 }
 
 // -s|--sandbox
@@ -69,6 +71,17 @@ var buildJSONFlag = cmdline.Flag{
 	EnvKeys:      []string{"JSON"},
 }
 
+// -j|--jobs
+var buildJobsFlag = cmdline.Flag{
+	ID:           "buildJobsFlag",
+	Value:        &buildArgs.jobs,
+	DefaultValue: 1,
+	Name:         "jobs",
+	ShortHand:    "j",
+	Usage:        "maximum number of independent stages of a multi-stage build run concurrently, their output is interleaved",
+	EnvKeys:      []string{"BUILD_JOBS"},
+}
+
 // -u|--update
 var buildUpdateFlag = cmdline.Flag{
 	ID:           "buildUpdateFlag",
@@ -195,6 +208,16 @@ var buildFixPermsFlag = cmdline.Flag{
 	EnvKeys:      []string{"FIXPERMS"},
 }
 
+// --mksquashfs-args
+var buildMksquashfsArgsFlag = cmdline.Flag{
+	ID:           "buildMksquashfsArgsFlag",
+	Value:        &buildArgs.mksquashfsArgs,
+	DefaultValue: "",
+	Name:         "mksquashfs-args",
+	Usage:        "additional options for mksquashfs, the squashfs filesystem is then created with mksquashfs instead of in-process (e.g. \"-comp xz\")",
+	EnvKeys:      []string{"MKSQUASHFS_ARGS"},
+}
+
 func init() {
 	addCmdInit(func(cmdManager *cmdline.CommandManager) {
 		cmdManager.RegisterCmd(buildCmd)
@@ -206,8 +229,10 @@ func init() {
 		cmdManager.RegisterFlagForCmd(&buildEncryptFlag, buildCmd)
 		cmdManager.RegisterFlagForCmd(&buildFakerootFlag, buildCmd)
 		cmdManager.RegisterFlagForCmd(&buildFixPermsFlag, buildCmd)
+		cmdManager.RegisterFlagForCmd(&buildJobsFlag, buildCmd)
 		cmdManager.RegisterFlagForCmd(&buildJSONFlag, buildCmd)
 		cmdManager.RegisterFlagForCmd(&buildLibraryFlag, buildCmd)
+		cmdManager.RegisterFlagForCmd(&buildMksquashfsArgsFlag, buildCmd)
 		cmdManager.RegisterFlagForCmd(&buildNoCleanupFlag, buildCmd)
 		cmdManager.RegisterFlagForCmd(&buildNoTestFlag, buildCmd)
 		cmdManager.RegisterFlagForCmd(&buildRemoteFlag, buildCmd)
@@ -12,6 +12,7 @@ import (
 	"os"
 	osExec "os/exec"
 	"runtime"
+	"strings"
 	"syscall"
 
 	"github.com/spf13/cobra"
@@ -252,6 +253,7 @@ func runBuildLocal(ctx context.Context, cmd *cobra.Command, dst, spec string) {
 			Dest:      dst,
 			Format:    buildFormat,
 			NoCleanUp: buildArgs.noCleanUp,
+			Jobs:      buildArgs.jobs,
 			Opts: types.Options{
 				ImgCache:          imgCache,
 				TmpDir:            tmpDir,
@@ -267,6 +269,7 @@ func runBuildLocal(ctx context.Context, cmd *cobra.Command, dst, spec string) {
 				EncryptionKeyInfo: keyInfo,
 				FixPerms:          buildArgs.fixPerms,
 				SandboxTarget:     sandboxTarget,
+				MksquashfsArgs:    strings.Fields(buildArgs.mksquashfsArgs),
 			},
 		})
 	if err != nil {
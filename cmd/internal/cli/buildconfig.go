@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -45,6 +45,8 @@ var BuildConfigCmd = &cobra.Command{
 		printParam("MANDIR", buildcfg.MANDIR)
 		printParam("SINGULARITY_CONFDIR", buildcfg.SINGULARITY_CONFDIR)
 		printParam("SESSIONDIR", buildcfg.SESSIONDIR)
+		printParam("POOLDIR", buildcfg.POOLDIR)
+		printParam("NETNSPOOLDIR", buildcfg.NETNSPOOLDIR)
 	},
 	DisableFlagsInUseLine: true,
 
@@ -0,0 +1,55 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cli
+
+import (
+	"github.com/spf13/cobra"
+	"github.com/sylabs/singularity/docs"
+	"github.com/sylabs/singularity/internal/app/singularity"
+	"github.com/sylabs/singularity/internal/pkg/client/cache"
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/pkg/cmdline"
+)
+
+var cacheVerifyTypes []string
+
+// -T|--type
+var cacheVerifyTypesFlag = cmdline.Flag{
+	ID:           "cacheVerifyTypes",
+	Value:        &cacheVerifyTypes,
+	DefaultValue: []string{"all"},
+	Name:         "type",
+	ShortHand:    "T",
+	Usage:        "a list of cache types to verify, possible entries: library, oras, layer, all",
+}
+
+func init() {
+	addCmdInit(func(cmdManager *cmdline.CommandManager) {
+		cmdManager.RegisterFlagForCmd(&cacheVerifyTypesFlag, cacheVerifyCmd)
+	})
+}
+
+// cacheVerifyCmd is 'singularity cache verify' and will verify the content of
+// your local singularity cache
+var cacheVerifyCmd = &cobra.Command{
+	DisableFlagsInUseLine: true,
+	Run: func(cmd *cobra.Command, args []string) {
+		// A get a handle for the current image cache
+		imgCache := getCacheHandle(cache.Config{})
+		if imgCache == nil {
+			sylog.Fatalf("failed to create image cache handle")
+		}
+
+		if err := singularity.VerifySingularityCache(imgCache, cacheVerifyTypes); err != nil {
+			sylog.Fatalf("Cache verification failed: %v", err)
+		}
+	},
+
+	Use:     docs.CacheVerifyUse,
+	Short:   docs.CacheVerifyShort,
+	Long:    docs.CacheVerifyLong,
+	Example: docs.CacheVerifyExample,
+}
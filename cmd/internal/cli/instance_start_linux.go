@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -16,6 +16,7 @@ import (
 func init() {
 	addCmdInit(func(cmdManager *cmdline.CommandManager) {
 		cmdManager.RegisterFlagForCmd(&instanceStartPidFileFlag, instanceStartCmd)
+		cmdManager.RegisterFlagForCmd(&instanceStartExecAgentFlag, instanceStartCmd)
 	})
 }
 
@@ -30,6 +31,17 @@ var instanceStartPidFileFlag = cmdline.Flag{
 	EnvKeys:      []string{"PID_FILE"},
 }
 
+// --exec-agent
+var instanceStartExecAgent bool
+var instanceStartExecAgentFlag = cmdline.Flag{
+	ID:           "instanceStartExecAgentFlag",
+	Value:        &instanceStartExecAgent,
+	DefaultValue: false,
+	Name:         "exec-agent",
+	Usage:        "serve exec requests from within the instance to start processes faster than joining it",
+	EnvKeys:      []string{"EXEC_AGENT"},
+}
+
 // singularity instance start
 var instanceStartCmd = &cobra.Command{
 	Args:                  cobra.MinimumNArgs(2),
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -75,6 +75,28 @@ var ociLogFormatFlag = cmdline.Flag{
 	EnvKeys:      []string{"LOG_FORMAT"},
 }
 
+// --log-max-size
+var ociLogMaxSizeFlag = cmdline.Flag{
+	ID:           "ociLogMaxSizeFlag",
+	Value:        &ociArgs.LogMaxSize,
+	DefaultValue: 0,
+	Name:         "log-max-size",
+	Usage:        "rotate the log file once its size exceeds size in MiB, 0 disables rotation",
+	Tag:          "<size>",
+	EnvKeys:      []string{"LOG_MAX_SIZE"},
+}
+
+// --log-max-files
+var ociLogMaxFilesFlag = cmdline.Flag{
+	ID:           "ociLogMaxFilesFlag",
+	Value:        &ociArgs.LogMaxFiles,
+	DefaultValue: 5,
+	Name:         "log-max-files",
+	Usage:        "number of rotated log files kept with --log-max-size",
+	Tag:          "<number>",
+	EnvKeys:      []string{"LOG_MAX_FILES"},
+}
+
 // --pid-file
 var ociPidFileFlag = cmdline.Flag{
 	ID:           "ociPidFileFlag",
@@ -154,6 +176,8 @@ func init() {
 		cmdManager.RegisterFlagForCmd(&ociSyncSocketFlag, createRunCmd...)
 		cmdManager.RegisterFlagForCmd(&ociLogPathFlag, createRunCmd...)
 		cmdManager.RegisterFlagForCmd(&ociLogFormatFlag, createRunCmd...)
+		cmdManager.RegisterFlagForCmd(&ociLogMaxSizeFlag, createRunCmd...)
+		cmdManager.RegisterFlagForCmd(&ociLogMaxFilesFlag, createRunCmd...)
 		cmdManager.RegisterFlagForCmd(&ociPidFileFlag, createRunCmd...)
 		cmdManager.RegisterFlagForCmd(&ociCreateEmptyProcessFlag, OciCreateCmd)
 		cmdManager.RegisterFlagForCmd(&ociKillForceFlag, OciKillCmd)
@@ -16,8 +16,9 @@ import (
 )
 
 var (
-	privKey int // -k encryption key (index from 'keys list') specification
-	signAll bool
+	privKey   int // -k encryption key (index from 'keys list') specification
+	signAll   bool
+	blockHash bool
 )
 
 // -g|--group-id
@@ -80,6 +81,15 @@ var signAllFlag = cmdline.Flag{
 	Usage:        "sign all non-signature partitions",
 }
 
+// --block-hash
+var signBlockHashFlag = cmdline.Flag{
+	ID:           "signBlockHashFlag",
+	Value:        &blockHash,
+	DefaultValue: false,
+	Name:         "block-hash",
+	Usage:        "hash the signed data in parallel blocks, the signature can't be verified by previous versions",
+}
+
 func init() {
 	addCmdInit(func(cmdManager *cmdline.CommandManager) {
 		cmdManager.RegisterCmd(SignCmd)
@@ -90,6 +100,7 @@ func init() {
 		cmdManager.RegisterFlagForCmd(&signSifDescIDFlag, SignCmd)
 		cmdManager.RegisterFlagForCmd(&signKeyIdxFlag, SignCmd)
 		cmdManager.RegisterFlagForCmd(&signAllFlag, SignCmd)
+		cmdManager.RegisterFlagForCmd(&signBlockHashFlag, SignCmd)
 	})
 }
 
@@ -116,7 +127,7 @@ func doSignCmd(cmd *cobra.Command, cpath string) {
 	}
 
 	fmt.Printf("Signing image: %s\n", cpath)
-	if err := signing.Sign(cpath, id, isGroup, signAll, privKey); err != nil {
+	if err := signing.Sign(cpath, id, isGroup, signAll, privKey, blockHash); err != nil {
 		sylog.Fatalf("Failed to sign container: %s", err)
 	}
 	fmt.Printf("Signature created and applied to %s\n", cpath)
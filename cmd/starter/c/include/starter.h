@@ -1,5 +1,5 @@
 /*
-  Copyright (c) 2018-2019, Sylabs, Inc. All rights reserved.
+  Copyright (c) 2018-2020, Sylabs, Inc. All rights reserved.
 
   This software is licensed under a 3-clause BSD license.  Please
   consult LICENSE.md file distributed with the sources of this project regarding
@@ -19,7 +19,6 @@
 #define warningf(b...)   singularity_message(WARNING, b)
 #define errorf(b...)     singularity_message(ERROR, b)
 
-#define MAX_JSON_SIZE       128*1024
 #define MAX_MAP_SIZE        4096
 #define MAX_PATH_SIZE       PATH_MAX
 #define MAX_GID             32
@@ -34,6 +33,16 @@
 #define PR_GET_NO_NEW_PRIVS 39
 #endif
 
+/*
+ * engine configuration header: the magic, the format version and the
+ * little-endian 64 bits size of the configuration following the header,
+ * see pkg/runtime/engine/config/encoding.go
+ */
+#define ENGINE_CONFIG_MAGIC         "SYEC"
+#define ENGINE_CONFIG_HEADER_SIZE   13
+/* room left to stage 1 to grow the engine configuration */
+#define ENGINE_CONFIG_GROWTH        16*1024*1024
+
 #define NO_NAMESPACE        -1
 #define CREATE_NAMESPACE    0
 #define ENTER_NAMESPACE     1
@@ -69,6 +78,14 @@ enum goexec {
 #define CLONE_NEWCGROUP     0x02000000
 #endif
 
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP   0x200000000ULL
+#endif
+
+#ifndef __NR_clone3
+#define __NR_clone3         435
+#endif
+
 typedef enum {
     false,
     true
@@ -133,6 +150,10 @@ struct container {
     pid_t pid;
     /* is container will run as instance */
     bool isInstance;
+    /* cgroup directory file descriptor the container process is created into */
+    int cgroupFd;
+    /* is the cgroup created for this container process */
+    bool cgroupCreated;
 
     /* container privileges */
     struct privileges privileges;
@@ -144,6 +165,8 @@ struct container {
 struct starter {
     /* control starter working directory from a file descriptor */
     int workingDirectoryFd;
+    /* trace file descriptor validated by the starter constructor, -1 if none */
+    int traceFd;
 
     /* hold file descriptors that need to be remains open after stage 1 */
     int fds[MAX_STARTER_FDS];
@@ -159,8 +182,12 @@ struct starter {
 
 /* engine configuration */
 struct engine {
-    char config[MAX_JSON_SIZE];
+    /* shared memory holding the engine configuration */
+    char *config;
+    /* size of the engine configuration */
     size_t size;
+    /* size of the shared memory holding the engine configuration */
+    size_t mapSize;
 };
 
 /* starter configuration */
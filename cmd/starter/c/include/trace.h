@@ -0,0 +1,33 @@
+/*
+  Copyright (c) 2020, Sylabs, Inc. All rights reserved.
+
+  This software is licensed under a 3-clause BSD license.  Please
+  consult LICENSE.md file distributed with the sources of this project regarding
+  your rights to use or distribute this software.
+*/
+
+#ifndef _SINGULARITY_TRACE_H
+#define _SINGULARITY_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * environment variable holding the file descriptor of the trace file,
+ * see internal/pkg/util/trace
+ */
+#define TRACE_FD_ENV    "SINGULARITY_TRACE_FD"
+
+/*
+ * trace_init gets the trace file descriptor from the environment and
+ * removes the environment variable, it returns the file descriptor or
+ * -1 when tracing is disabled
+ */
+int trace_init(void);
+
+/* trace_now returns the monotonic clock time in microseconds */
+uint64_t trace_now(void);
+
+/* trace_event records a phase named name started at start */
+void trace_event(const char *name, uint64_t start);
+
+#endif /* _SINGULARITY_TRACE_H */
@@ -1,5 +1,5 @@
 /*
-  Copyright (c) 2018-2019, Sylabs, Inc. All rights reserved.
+  Copyright (c) 2018-2020, Sylabs, Inc. All rights reserved.
 
   This software is licensed under a 3-clause BSD license.  Please
   consult LICENSE.md file distributed with the sources of this project regarding
@@ -10,6 +10,7 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <errno.h>
@@ -47,6 +48,7 @@
 #include "include/capability.h"
 #include "include/message.h"
 #include "include/starter.h"
+#include "include/trace.h"
 
 #define SELF_PID_NS     "/proc/self/ns/pid"
 #define SELF_NET_NS     "/proc/self/ns/net"
@@ -99,6 +101,77 @@ __attribute__ ((returns_twice)) __attribute__((noinline)) static int fork_ns(uns
     return clone(clone_fn, stack.ptr, (SIGCHLD|flags), env);
 }
 
+/* clone3 arguments up to the cgroup field, see linux/sched.h */
+struct clone3_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+/*
+ * fork_ns_cgroup behaves like fork_ns but creates the child process directly
+ * into the cgroup referenced by cgroupfd with CLONE_INTO_CGROUP, so the resource
+ * limits apply from the start without moving the process. Kernels older than
+ * 5.7 don't support it, the child process moves itself into the cgroup instead.
+ */
+__attribute__ ((returns_twice)) __attribute__((noinline)) static int fork_ns_cgroup(unsigned int flags, int cgroupfd) {
+    struct clone3_args args;
+    int pid, fd;
+
+    memset(&args, 0, sizeof(args));
+    args.flags = flags | CLONE_INTO_CGROUP;
+    args.exit_signal = SIGCHLD;
+    args.cgroup = cgroupfd;
+
+    /* without CLONE_VM and a stack, the child process runs on a copy of the stack like fork */
+    pid = syscall(__NR_clone3, &args, sizeof(args));
+    if ( pid >= 0 || (errno != ENOSYS && errno != E2BIG && errno != EINVAL) ) {
+        return pid;
+    }
+
+    debugf("CLONE_INTO_CGROUP not supported, move process into cgroup\n");
+    pid = fork_ns(flags);
+    if ( pid == 0 ) {
+        fd = openat(cgroupfd, "cgroup.procs", O_WRONLY|O_CLOEXEC);
+        if ( fd < 0 || write(fd, "0", 1) != 1 ) {
+            fatalf("Failed to move process into cgroup: %s\n", strerror(errno));
+        }
+        close(fd);
+    }
+    return pid;
+}
+
+/*
+ * remove_cgroup removes the cgroup referenced by cgroupfd and created by
+ * stage 1 when the container process couldn't be created into it.
+ */
+static void remove_cgroup(int cgroupfd) {
+    char fdpath[64];
+    char path[PATH_MAX];
+    ssize_t n;
+
+    snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", cgroupfd);
+    n = readlink(fdpath, path, sizeof(path) - 1);
+    if ( n < 0 ) {
+        warningf("Failed to get cgroup path: %s\n", strerror(errno));
+        return;
+    }
+    path[n] = '\0';
+
+    debugf("Remove cgroup %s\n", path);
+    if ( rmdir(path) < 0 ) {
+        warningf("Failed to remove cgroup %s: %s\n", path, strerror(errno));
+    }
+}
+
 static void priv_escalate(bool keep_fsuid) {
     uid_t uid = getuid();
 
@@ -913,8 +986,8 @@ static void cleanenv(void) {
 
 /*
  * get_pipe_exec_fd returns the pipe file descriptor stored in
- * the PIPE_EXEC_FD environment variable. The returned pipe contains
- * JSON configuration for an engine to run a container.
+ * the PIPE_EXEC_FD environment variable. The returned pipe, a memfd
+ * or a socket, contains the configuration for an engine to run a container.
  */
 static int get_pipe_exec_fd(void) {
     int pipe_fd;
@@ -935,6 +1008,70 @@ static int get_pipe_exec_fd(void) {
     return pipe_fd;
 }
 
+/* read_full reads exactly size bytes from fd into buf */
+static void read_full(int fd, char *buf, size_t size) {
+    ssize_t n;
+
+    while ( size > 0 ) {
+        n = read(fd, buf, size);
+        if ( n < 0 && errno == EINTR ) {
+            continue;
+        } else if ( n < 0 ) {
+            fatalf("Read engine configuration failed: %s\n", strerror(errno));
+        } else if ( n == 0 ) {
+            fatalf("Read engine configuration failed: truncated configuration\n");
+        }
+        buf += n;
+        size -= n;
+    }
+}
+
+/*
+ * read_engine_config reads the engine configuration from fd into a shared
+ * memory area visible from all stages. The configuration size is read from
+ * its header so there is no limit on the size, the shared memory leaves
+ * ENGINE_CONFIG_GROWTH bytes for stage 1 updates, which are only backed by
+ * memory once written.
+ */
+static void read_engine_config(int fd, struct engine *engine) {
+    char header[ENGINE_CONFIG_HEADER_SIZE];
+    struct stat st;
+    uint64_t size = 0;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    int i;
+
+    if ( fstat(fd, &st) < 0 ) {
+        fatalf("Failed to get engine configuration file status: %s\n", strerror(errno));
+    }
+    /* memfd offset is at the end of the configuration written by the CLI */
+    if ( S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_SET) < 0 ) {
+        fatalf("Failed to seek engine configuration: %s\n", strerror(errno));
+    }
+
+    read_full(fd, header, ENGINE_CONFIG_HEADER_SIZE);
+    if ( memcmp(header, ENGINE_CONFIG_MAGIC, sizeof(ENGINE_CONFIG_MAGIC) - 1) != 0 ) {
+        fatalf("Bad engine configuration format\n");
+    }
+    for ( i = ENGINE_CONFIG_HEADER_SIZE - 1; i >= ENGINE_CONFIG_HEADER_SIZE - 8; i-- ) {
+        size = (size << 8) | (unsigned char)header[i];
+    }
+    if ( size > SIZE_MAX - ENGINE_CONFIG_HEADER_SIZE - ENGINE_CONFIG_GROWTH - pagesize ) {
+        fatalf("Engine configuration too big\n");
+    }
+
+    engine->size = ENGINE_CONFIG_HEADER_SIZE + size;
+    engine->mapSize = engine->size + ENGINE_CONFIG_GROWTH;
+    engine->mapSize = (engine->mapSize + pagesize - 1) & ~(pagesize - 1);
+
+    engine->config = (char *)mmap(NULL, engine->mapSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED | MAP_NORESERVE, -1, 0);
+    if ( engine->config == MAP_FAILED ) {
+        fatalf("Memory allocation failed: %s\n", strerror(errno));
+    }
+
+    memcpy(engine->config, header, ENGINE_CONFIG_HEADER_SIZE);
+    read_full(fd, engine->config + ENGINE_CONFIG_HEADER_SIZE, size);
+}
+
 /* "noop" mount operation to force kernel to load overlay module */
 void load_overlay_module(void) {
     if ( geteuid() == 0 && getenv("LOAD_OVERLAY_MODULE") != NULL ) {
@@ -968,6 +1105,12 @@ __attribute__((constructor)) static void init(void) {
     int clone_flags = 0;
     int userns = NO_NAMESPACE, pidns = NO_NAMESPACE;
     fdlist_t *master_fds;
+    int tracefd;
+    uint64_t trace_start;
+
+    /* before cleanenv, the trace file descriptor is read from environment */
+    tracefd = trace_init();
+    trace_start = trace_now();
 
     verbosef("Starter initialization\n");
 
@@ -994,6 +1137,7 @@ __attribute__((constructor)) static void init(void) {
     }
 
     sconfig->starter.isSuid = is_suid();
+    sconfig->starter.traceFd = tracefd;
 
     /* temporarily drop privileges while running as setuid */
     if ( sconfig->starter.isSuid ) {
@@ -1003,11 +1147,11 @@ __attribute__((constructor)) static void init(void) {
     debugf("Read engine configuration\n");
 
     /* read engine configuration from pipe */
-    if ( ( sconfig->engine.size = read(pipe_fd, sconfig->engine.config, MAX_JSON_SIZE - 1) ) <= 0 ) {
-        fatalf("Read engine configuration from pipe failed: %s\n", strerror(errno));
-    }
+    read_engine_config(pipe_fd, &sconfig->engine);
     close(pipe_fd);
 
+    trace_event("starter: initialization", trace_start);
+
     /* fix I/O streams to point to /dev/null if they are closed */
     fix_streams();
 
@@ -1016,6 +1160,8 @@ __attribute__((constructor)) static void init(void) {
 
     /* set an invalid value for check */
     sconfig->starter.workingDirectoryFd = -1;
+    sconfig->container.cgroupFd = -1;
+    sconfig->container.cgroupCreated = false;
 
     /*
      *  CLONE_FILES will share file descriptors opened during stage 1,
@@ -1025,6 +1171,7 @@ __attribute__((constructor)) static void init(void) {
      *  with a file descriptor in order to keep it open during cleanup
      *  step below.
      */
+    trace_start = trace_now();
     process = fork_ns(CLONE_FILES);
     if ( process == 0 ) {
         /*
@@ -1047,6 +1194,7 @@ __attribute__((constructor)) static void init(void) {
 
     debugf("Wait completion of stage1\n");
     wait_child("stage 1", process, false);
+    trace_event("starter: stage 1", trace_start);
 
     /* change current working directory if requested by stage 1 */
     if ( sconfig->starter.workingDirectoryFd >= 0 ) {
@@ -1169,7 +1317,12 @@ __attribute__((constructor)) static void init(void) {
         clone_flags |= CLONE_NEWPID;
     }
 
-    process = fork_ns(clone_flags);
+    trace_start = trace_now();
+    if ( sconfig->container.cgroupFd >= 0 ) {
+        process = fork_ns_cgroup(clone_flags, sconfig->container.cgroupFd);
+    } else {
+        process = fork_ns(clone_flags);
+    }
     if ( process == 0 ) {
         /* in the user namespace without any privileges */
         if ( userns == CREATE_NAMESPACE ) {
@@ -1210,6 +1363,9 @@ __attribute__((constructor)) static void init(void) {
             mount_namespace_init(&sconfig->container.namespace, false);
         }
 
+        trace_event("starter: stage 2 namespaces", trace_start);
+        trace_start = trace_now();
+
         if ( !sconfig->container.namespace.joinOnly ) {
             /* close master end of rpc communication socket */
             close(rpc_socket[0]);
@@ -1232,6 +1388,7 @@ __attribute__((constructor)) static void init(void) {
 
                 /* wait RPC server exits before running container process */
                 wait_child("rpc server", process, false);
+                trace_event("starter: stage 2 wait rpc server", trace_start);
 
                 if ( sconfig->starter.hybridWorkflow && sconfig->starter.isSuid ) {
                     /* make /proc/self readable by user to join instance without SUID workflow */
@@ -1247,7 +1404,9 @@ __attribute__((constructor)) static void init(void) {
             verbosef("Don't execute RPC server, joining instance\n");
         }
 
+        trace_start = trace_now();
         apply_container_privileges(&sconfig->container.privileges);
+        trace_event("starter: stage 2 privileges", trace_start);
         goexecute = STAGE2;
         /* continue execution with Go runtime in main_linux.go */
         return;
@@ -1394,10 +1553,15 @@ __attribute__((constructor)) static void init(void) {
                 priv_drop(false);
             }
 
+            trace_event("starter: master namespaces", trace_start);
             goexecute = MASTER;
             /* continue execution with Go runtime in main_linux.go */
             return;
         }
     }
+    /* a joined instance or container cgroup is left untouched */
+    if ( sconfig->container.cgroupFd >= 0 && sconfig->container.cgroupCreated ) {
+        remove_cgroup(sconfig->container.cgroupFd);
+    }
     fatalf("Failed to create container namespaces\n");
 }
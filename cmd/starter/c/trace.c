@@ -0,0 +1,84 @@
+/*
+  Copyright (c) 2020, Sylabs, Inc. All rights reserved.
+
+  This software is licensed under a 3-clause BSD license.  Please
+  consult LICENSE.md file distributed with the sources of this project regarding
+  your rights to use or distribute this software.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "include/message.h"
+#include "include/trace.h"
+
+/* trace file descriptor, -1 when tracing is disabled */
+static int trace_fd = -1;
+
+int trace_init(void) {
+    char *fd_env = getenv(TRACE_FD_ENV);
+    int fd = -1, flags;
+
+    if ( fd_env == NULL ) {
+        return -1;
+    }
+    /*
+     * the file descriptor is only valid now, before starter opens any
+     * file, the next stages get it from the starter configuration
+     */
+    if ( sscanf(fd_env, "%d", &fd) != 1 ) {
+        fd = -1;
+    }
+    unsetenv(TRACE_FD_ENV);
+    if ( fd < 0 ) {
+        return -1;
+    }
+
+    flags = fcntl(fd, F_GETFL);
+    if ( flags < 0 || (flags & O_ACCMODE) == O_RDONLY || (flags & O_APPEND) == 0 ) {
+        singularity_message(WARNING, "Bad " TRACE_FD_ENV " file descriptor %d, tracing disabled\n", fd);
+        return -1;
+    }
+    /* the trace file is shared by all stages but not by the container process */
+    if ( fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 ) {
+        return -1;
+    }
+    trace_fd = fd;
+    return fd;
+}
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+
+    if ( trace_fd < 0 || clock_gettime(CLOCK_MONOTONIC, &ts) < 0 ) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void trace_event(const char *name, uint64_t start) {
+    char event[512];
+    uint64_t now = trace_now();
+    int n;
+
+    if ( trace_fd < 0 || start == 0 ) {
+        return;
+    }
+
+    /* one complete event per write, the trace file is opened in append mode */
+    n = snprintf(event, sizeof(event),
+        "{\"name\":\"%s\",\"cat\":\"starter\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":%d,\"tid\":%ld},\n",
+        name, (unsigned long)start, (unsigned long)(now - start), getpid(), syscall(SYS_gettid));
+    if ( n < 0 || n >= (int)sizeof(event) ) {
+        return;
+    }
+    while ( write(trace_fd, event, n) < 0 && errno == EINTR ) {
+    }
+}
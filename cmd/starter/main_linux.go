@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -9,6 +9,7 @@ package main
 #include "c/message.c"
 #include "c/capability.c"
 #include "c/setns.c"
+#include "c/trace.c"
 #include "c/starter.c"
 */
 import "C"
@@ -23,39 +24,57 @@ import (
 	"github.com/sylabs/singularity/internal/pkg/sylog"
 	_ "github.com/sylabs/singularity/internal/pkg/util/goversion"
 	"github.com/sylabs/singularity/internal/pkg/util/mainthread"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 
 	// register engines
 	_ "github.com/sylabs/singularity/cmd/starter/engines"
 )
 
-func getEngine(jsonConfig []byte) *engine.Engine {
-	e, err := engine.Get(jsonConfig)
+func getEngine(engineConfig []byte) *engine.Engine {
+	e, err := engine.Get(engineConfig)
 	if err != nil {
 		sylog.Fatalf("Failed to initialize runtime engine: %s\n", err)
 	}
 	return e
 }
 
+func decodeConfig(e *engine.Engine) {
+	defer trace.Begin("starter: decode engine configuration").End()
+
+	if err := e.DecodeConfig(); err != nil {
+		sylog.Fatalf("Failed to initialize runtime engine: %s\n", err)
+	}
+}
+
 func startup() {
 	// global variable defined in cmd/starter/c/starter.c,
 	// C.sconfig points to a shared memory area
 	csconf := unsafe.Pointer(C.sconfig)
 	// initialize starter configuration
 	sconfig := starterConfig.NewConfig(starterConfig.SConfig(csconf))
-	// get JSON configuration originally passed from CLI
-	jsonConfig := sconfig.GetJSONConfig()
+	// the trace file descriptor is never taken from the environment
+	// by the starter processes, they may run privileged
+	trace.SetFd(sconfig.GetTraceFd())
+	// get configuration originally passed from CLI
+	// or updated by stage 1
+	engineConfig := sconfig.GetEngineConfig()
 
 	// get engine operations previously registered
-	// by the above import
-	e := getEngine(jsonConfig)
+	// by the above import, the engine configuration
+	// is only decoded by the stages using it
+	e := getEngine(engineConfig)
 	sylog.Debugf("%s runtime engine selected", e.EngineName)
 
 	switch C.goexecute {
 	case C.STAGE1:
+		trace.SetProcessName("starter stage 1")
 		sylog.Verbosef("Execute stage 1\n")
+		decodeConfig(e)
 		starter.StageOne(sconfig, e)
 	case C.STAGE2:
+		trace.SetProcessName("starter stage 2")
 		sylog.Verbosef("Execute stage 2\n")
+		decodeConfig(e)
 		if err := sconfig.Release(); err != nil {
 			sylog.Fatalf("%s", err)
 		}
@@ -64,7 +83,9 @@ func startup() {
 			starter.StageTwo(int(C.master_socket[1]), e)
 		})
 	case C.MASTER:
+		trace.SetProcessName("starter master")
 		sylog.Verbosef("Execute master process\n")
+		decodeConfig(e)
 
 		pid := sconfig.GetContainerPid()
 
@@ -74,6 +95,7 @@ func startup() {
 
 		starter.Master(int(C.rpc_socket[0]), int(C.master_socket[0]), pid, e)
 	case C.RPC_SERVER:
+		trace.SetProcessName("starter rpc server")
 		sylog.Verbosef("Serve RPC requests\n")
 
 		if err := sconfig.Release(); err != nil {
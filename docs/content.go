@@ -1,4 +1,4 @@
-// Copyright (c) 2017-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2017-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -163,8 +163,8 @@ Enterprise Performance Computing (EPC)`
 	CacheUse   string = `cache`
 	CacheShort string = `Manage the local cache`
 	CacheLong  string = `
-  Manage your local Singularity cache. You can list/clean using the specific 
-  types.`
+  Manage your local Singularity cache. You can list/clean/verify using the
+  specific types.`
 	CacheExample string = `
   All group commands have their own help output:
 
@@ -196,7 +196,9 @@ Enterprise Performance Computing (EPC)`
 	CacheListShort string = `List your local Singularity cache`
 	CacheListLong  string = `
   This will list your local cache (stored at $HOME/.singularity/cache if
-  SINGULARITY_CACHEDIR is not set).`
+  SINGULARITY_CACHEDIR is not set), along with the cache hit, miss and
+  eviction counters. When SINGULARITY_CACHE_MAXSIZE is set, e.g. to 20G, least
+  recently used container images are evicted once the cache exceeds this size.`
 	CacheListExample string = `
   All group commands have their own help output:
 
@@ -204,6 +206,24 @@ Enterprise Performance Computing (EPC)`
   $ singularity help cache list --type=library,oci
   $ singularity cache list --help`
 
+	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+	// Cache verify
+	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+	CacheVerifyUse   string = `verify [verify options...]`
+	CacheVerifyShort string = `Verify the integrity of your local Singularity cache`
+	CacheVerifyLong  string = `
+  This will hash the images of your local cache (stored at
+  $HOME/.singularity/cache if SINGULARITY_CACHEDIR is not set) and compare them
+  with their expected digest. Cached images are otherwise only hashed when
+  they are modified, verified digests are recorded along the images and
+  reused as long as the image size, inode and times are unchanged.`
+	CacheVerifyExample string = `
+  All group commands have their own help output:
+
+  $ singularity help cache verify
+  $ singularity cache verify --type=library
+  $ singularity cache verify --help`
+
 	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 	// key
 	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -540,6 +560,23 @@ Enterprise Performance Computing (EPC)`
   $ singularity instance stop /tmp/my-sql.sif mysql
   Stopping /tmp/my-sql.sif mysql`
 
+	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+	// instance stats
+	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+	InstanceStatsUse   string = `stats [stats options...] [<instance name glob>]`
+	InstanceStatsShort string = `Show resource usage of named Singularity instances`
+	InstanceStatsLong  string = `
+  The instance stats command allows you to view the CPU, memory, I/O and
+  processes usage reported by the cgroup of the Singularity container instances
+  started with the --apply-cgroups option.`
+	InstanceStatsExample string = `
+  $ sudo singularity instance start --apply-cgroups /tmp/limits.toml my-sql.sif mysql
+  $ sudo singularity instance stats mysql
+  INSTANCE NAME    PID      CPU TIME   MEMORY USAGE / LIMIT   IO READ / WRITE        PIDS
+  mysql            23845    1.52s      104.3MiB / 1.0GiB      12.0MiB / 3.2MiB       12 / max
+
+  $ sudo singularity instance stats --json mysql`
+
 	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 	// instance stop
 	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -337,6 +337,59 @@ func (c *ctx) applyCgroupsInstance(t *testing.T) {
 	c.stopInstance(t, instanceName)
 }
 
+// Test that a capability revoked after the start of an instance with an
+// exec agent is missing in the processes executed in the instance.
+func (c *ctx) testExecAgentRevokedCapability(t *testing.T) {
+	if !c.profile.In(e2e.UserProfile) {
+		t.Skipf("%s requires %s profile, current profile: %s", t.Name(), e2e.UserProfile, c.profile)
+	}
+
+	// pick up a random name
+	instanceName := uuid.NewV4().String()
+	username := c.profile.HostUser(t).Name
+
+	capability := func(t *testing.T, cmd string) {
+		c.env.RunSingularity(
+			t,
+			e2e.WithProfile(e2e.RootProfile),
+			e2e.WithCommand("capability "+cmd),
+			e2e.WithArgs("--user", username, "CAP_NET_RAW"),
+			e2e.ExpectExit(0),
+		)
+	}
+
+	capability(t, "add")
+	revoked := false
+	defer func() {
+		if !revoked {
+			capability(t, "drop")
+		}
+	}()
+
+	c.env.RunSingularity(
+		t,
+		e2e.WithProfile(c.profile),
+		e2e.WithCommand("instance start"),
+		e2e.WithArgs("--exec-agent", "--add-caps", "CAP_NET_RAW", c.env.ImagePath, instanceName),
+		e2e.ExpectExit(0),
+	)
+	defer c.stopInstance(t, instanceName)
+
+	capability(t, "drop")
+	revoked = true
+
+	c.env.RunSingularity(
+		t,
+		e2e.WithProfile(c.profile),
+		e2e.WithCommand("exec"),
+		e2e.WithArgs("instance://"+instanceName, "grep", "^CapEff:", "/proc/self/status"),
+		e2e.ExpectExit(
+			0,
+			e2e.ExpectOutput(e2e.RegexMatch, `CapEff:\s+0+\n`),
+		),
+	)
+}
+
 // E2ETests is the main func to trigger the test suite
 func E2ETests(env e2e.TestEnv) testhelper.Tests {
 	c := &ctx{
@@ -363,6 +416,7 @@ func E2ETests(env e2e.TestEnv) testhelper.Tests {
 				{"FinalNoInstances", c.testNoInstances},
 				{"GhostInstance", c.testGhostInstance},
 				{"ApplyCgroupsInstance", c.applyCgroupsInstance},
+				{"ExecAgentRevokedCapability", c.testExecAgentRevokedCapability},
 			}
 
 			profiles := []e2e.Profile{
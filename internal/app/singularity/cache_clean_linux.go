@@ -39,6 +39,10 @@ func cleanBlobCache(imgCache *cache.Handle, op func(string) error) error {
 	return cleanCacheDir("oci-blob", imgCache.OciBlob, op)
 }
 
+func cleanLayerCache(imgCache *cache.Handle, op func(string) error) error {
+	return cleanCacheDir("oci-layer", imgCache.OciLayer, op)
+}
+
 func cleanShubCache(imgCache *cache.Handle, op func(string) error) error {
 	return cleanCacheDir("shub", imgCache.Shub, op)
 }
@@ -67,6 +71,8 @@ func cleanCache(imgCache *cache.Handle, cacheType string, op func(string) error)
 		return cleanShubCache(imgCache, op)
 	case "blob", "blobs":
 		return cleanBlobCache(imgCache, op)
+	case "layer":
+		return cleanLayerCache(imgCache, op)
 	case "net":
 		return cleanNetCache(imgCache, op)
 	case "oras":
@@ -18,7 +18,7 @@ func normalizeCacheList(cacheList []string) ([]string, error) {
 
 	for _, e := range cacheList {
 		switch e {
-		case "library", "oci", "shub", "blob", "net", "oras":
+		case "library", "oci", "shub", "blob", "layer", "net", "oras":
 			list = append(list, e)
 
 		case "blobs":
@@ -37,7 +37,7 @@ func normalizeCacheList(cacheList []string) ([]string, error) {
 
 	if all {
 		// cleanAll overrides all the specified names
-		list = []string{"library", "oci", "shub", "blob", "net", "oras"}
+		list = []string{"library", "oci", "shub", "blob", "layer", "net", "oras"}
 	}
 
 	return list, nil
@@ -53,6 +53,8 @@ func cacheTypeToDir(imgCache *cache.Handle, cacheType string) (string, error) {
 		return imgCache.Shub, nil
 	case "blob":
 		return imgCache.OciBlob, nil
+	case "layer":
+		return imgCache.OciLayer, nil
 	case "net":
 		return imgCache.Net, nil
 	case "oras":
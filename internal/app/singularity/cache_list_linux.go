@@ -78,6 +78,9 @@ func listTypeCache(printList bool, name, cachePath string) (int, int64, error) {
 		}
 
 		for _, entry := range cacheEntries {
+			if cache.IsMetadataFile(entry.Name()) {
+				continue
+			}
 			fileInfo, err := os.Stat(filepath.Join(cachePath, dir.Name(), entry.Name()))
 			if err != nil {
 				return 0, 0, fmt.Errorf("unable to get stat for: %s: %v", cachePath, err)
@@ -91,9 +94,8 @@ func listTypeCache(printList bool, name, cachePath string) (int, int64, error) {
 					name)
 			}
 			totalSize += fileInfo.Size()
+			count++
 		}
-
-		count += len(cacheEntries)
 	}
 
 	return count, totalSize, nil
@@ -115,8 +117,8 @@ func ListSingularityCache(imgCache *cache.Handle, cacheListTypes []string, cache
 	}
 
 	var (
-		containerCount, blobCount             int
-		containerSpace, blobSpace, totalSpace int64
+		containerCount, blobCount, layerCount             int
+		containerSpace, blobSpace, layerSpace, totalSpace int64
 	)
 
 	if cacheListVerbose {
@@ -125,9 +127,11 @@ func ListSingularityCache(imgCache *cache.Handle, cacheListTypes []string, cache
 
 	containersShown := false
 	blobsShown := false
+	layersShown := false
 
 	for _, cacheType := range cacheTypes {
-		if cacheType == "blob" {
+		switch cacheType {
+		case "blob":
 			// the type blob is special: 1. there's a
 			// separate counter for it; 2. the cache entries
 			// are actually one level deeper
@@ -142,7 +146,19 @@ func ListSingularityCache(imgCache *cache.Handle, cacheListTypes []string, cache
 			blobSpace = blobsSize
 			totalSpace += blobsSize
 			blobsShown = true
-		} else {
+		case "layer":
+			// uncompressed layers are not containers either
+			cacheDir, _ := cacheTypeToDir(imgCache, cacheType)
+			count, size, err := listTypeCache(cacheListVerbose, cacheType, cacheDir)
+			if err != nil {
+				fmt.Print(err)
+				return err
+			}
+			layerCount = count
+			layerSpace = size
+			totalSpace += size
+			layersShown = true
+		default:
 			cacheDir, _ := cacheTypeToDir(imgCache, cacheType)
 			count, size, err := listTypeCache(cacheListVerbose, cacheType, cacheDir)
 			if err != nil {
@@ -160,21 +176,43 @@ func ListSingularityCache(imgCache *cache.Handle, cacheListTypes []string, cache
 		fmt.Print("\n")
 	}
 
-	out := new(strings.Builder)
-	out.WriteString("There are")
+	var counts []string
 	if containersShown {
-		fmt.Fprintf(out, " %d container file(s) using %s", containerCount, findSize(containerSpace))
+		counts = append(counts, fmt.Sprintf("%d container file(s) using %s", containerCount, findSize(containerSpace)))
 	}
-	if containersShown && blobsShown {
-		fmt.Fprintf(out, " and")
+	if layersShown {
+		counts = append(counts, fmt.Sprintf("%d oci layer file(s) using %s", layerCount, findSize(layerSpace)))
 	}
 	if blobsShown {
-		fmt.Fprintf(out, " %d oci blob file(s) using %s", blobCount, findSize(blobSpace))
+		counts = append(counts, fmt.Sprintf("%d oci blob file(s) using %s", blobCount, findSize(blobSpace)))
+	}
+
+	out := new(strings.Builder)
+	out.WriteString("There are")
+	for i, c := range counts {
+		switch {
+		case i == 0:
+			out.WriteString(" ")
+		case i == len(counts)-1:
+			out.WriteString(" and ")
+		default:
+			out.WriteString(", ")
+		}
+		out.WriteString(c)
 	}
 	out.WriteString(" of space\n")
 
 	fmt.Print(out.String())
 	fmt.Printf("Total space used: %s\n", findSize(totalSpace))
+	if imgCache.MaxSize() > 0 {
+		fmt.Printf("Cache size limit: %s\n", findSize(imgCache.MaxSize()))
+	}
+
+	if stats, err := imgCache.Stats(); err == nil {
+		fmt.Printf("Cache hits: %d, misses: %d, evictions: %d\n", stats.Hits, stats.Misses, stats.Evictions)
+	} else {
+		sylog.Debugf("Could not read cache counters: %s", err)
+	}
 
 	return nil
 }
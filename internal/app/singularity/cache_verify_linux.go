@@ -0,0 +1,106 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package singularity
+
+import (
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+
+	"github.com/sylabs/singularity/internal/pkg/client/cache"
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+)
+
+// verifyTypeCache hashes all images of the cache directory cachePath with
+// verify and returns the number of corrupted images.
+func verifyTypeCache(name, cachePath string, verify func(sum, name string) (bool, error)) (int, error) {
+	cacheDirs, err := ioutil.ReadDir(cachePath)
+	if os.IsNotExist(err) {
+		return 0, nil
+	} else if err != nil {
+		return 0, fmt.Errorf("unable to open cache %s at directory %s: %v", name, cachePath, err)
+	}
+
+	corrupted := 0
+
+	for _, dir := range cacheDirs {
+		if !dir.IsDir() {
+			sylog.Debugf("stray file in cache dir: %v", filepath.Join(cachePath, dir.Name()))
+			continue
+		}
+
+		cacheEntries, err := ioutil.ReadDir(filepath.Join(cachePath, dir.Name()))
+		if err != nil {
+			return 0, fmt.Errorf("unable to look in: %s: %v", cachePath, err)
+		}
+
+		for _, entry := range cacheEntries {
+			if !entry.Mode().IsRegular() || cache.IsMetadataFile(entry.Name()) {
+				continue
+			}
+
+			path := filepath.Join(cachePath, dir.Name(), entry.Name())
+			if _, err := verify(dir.Name(), entry.Name()); err == cache.ErrBadChecksum {
+				fmt.Printf("%-10s %s\n", "CORRUPTED", path)
+				corrupted++
+			} else if err != nil {
+				return 0, fmt.Errorf("unable to verify %s: %v", path, err)
+			} else {
+				fmt.Printf("%-10s %s\n", "OK", path)
+			}
+		}
+	}
+
+	return corrupted, nil
+}
+
+// VerifySingularityCache hashes the images of the cache types specified by
+// cacheVerifyTypes and records their verified digests, so that subsequent
+// lookups don't hash them again. If cacheVerifyTypes contains the value
+// "all", all the cache types are considered. Only library and oras images
+// and oci layers are identified by a digest of their content, other cache
+// types are skipped.
+func VerifySingularityCache(imgCache *cache.Handle, cacheVerifyTypes []string) error {
+	if imgCache == nil {
+		return errInvalidCacheHandle
+	}
+
+	cacheTypes, err := normalizeCacheList(cacheVerifyTypes)
+	if err != nil {
+		return err
+	}
+
+	corrupted := 0
+
+	for _, cacheType := range cacheTypes {
+		var verify func(sum, name string) (bool, error)
+
+		switch cacheType {
+		case "library":
+			verify = imgCache.VerifyLibraryImage
+		case "oras":
+			verify = imgCache.VerifyOrasImage
+		case "layer":
+			verify = imgCache.VerifyOciLayer
+		default:
+			sylog.Debugf("Skipping %s cache, entries are not identified by a digest", cacheType)
+			continue
+		}
+
+		cacheDir, _ := cacheTypeToDir(imgCache, cacheType)
+		count, err := verifyTypeCache(cacheType, cacheDir, verify)
+		if err != nil {
+			return err
+		}
+		corrupted += count
+	}
+
+	if corrupted > 0 {
+		return fmt.Errorf("found %d corrupted image(s), remove them with 'singularity cache clean --name'", corrupted)
+	}
+	return nil
+}
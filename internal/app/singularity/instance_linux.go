@@ -8,8 +8,11 @@ import (
 	"syscall"
 	"time"
 
+	"github.com/sylabs/singularity/internal/pkg/cgroups"
 	"github.com/sylabs/singularity/internal/pkg/instance"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/pkg/runtime/engine/config"
+	singularityConfig "github.com/sylabs/singularity/pkg/runtime/engine/singularity/config"
 	"github.com/sylabs/singularity/pkg/util/fs/proc"
 )
 
@@ -63,6 +66,101 @@ func PrintInstanceList(w io.Writer, name, user string, formatJSON bool) error {
 	return nil
 }
 
+type instanceStats struct {
+	Instance string         `json:"instance"`
+	Pid      int            `json:"pid"`
+	Stats    *cgroups.Stats `json:"stats"`
+}
+
+// PrintInstanceStats fetches instance list, applying name and user
+// filters, and prints the resource usage reported by the cgroup of the
+// instances started with cgroups resource limits in a regular or a JSON
+// format (if formatJSON is true) to the passed writer.
+func PrintInstanceStats(w io.Writer, name, user string, formatJSON bool) error {
+	ii, err := instance.List(user, name, instance.SingSubDir)
+	if err != nil {
+		return fmt.Errorf("could not retrieve instance list: %v", err)
+	}
+
+	instances := make([]instanceStats, 0, len(ii))
+	for _, i := range ii {
+		engineConfig := singularityConfig.NewConfig()
+		if err := json.Unmarshal(i.Config, &config.Common{EngineConfig: engineConfig}); err != nil {
+			return fmt.Errorf("could not read %s instance configuration: %v", i.Name, err)
+		}
+		if engineConfig.GetCgroupsPath() == "" {
+			sylog.Verbosef("Instance %s was started without cgroups resource limits", i.Name)
+			continue
+		}
+
+		// the cgroup created by stage 1 with cgroup v2, or the
+		// cgroup of the instance process
+		manager := &cgroups.Manager{Pid: i.Pid, Path: engineConfig.Cgroup}
+		stats, err := manager.GetStats()
+		if err != nil {
+			return fmt.Errorf("could not get %s instance stats: %v", i.Name, err)
+		}
+		instances = append(instances, instanceStats{Instance: i.Name, Pid: i.Pid, Stats: stats})
+	}
+	if len(instances) == 0 {
+		return fmt.Errorf("no instance started with cgroups resource limits found")
+	}
+
+	if formatJSON {
+		enc := json.NewEncoder(w)
+		enc.SetIndent("", "\t")
+		err = enc.Encode(
+			map[string][]instanceStats{
+				"instances": instances,
+			})
+		if err != nil {
+			return fmt.Errorf("could not encode instance stats: %v", err)
+		}
+		return nil
+	}
+
+	_, err = fmt.Fprintf(w, "%-16s %-8s %-10s %-22s %-22s %s\n", "INSTANCE NAME", "PID", "CPU TIME", "MEMORY USAGE / LIMIT", "IO READ / WRITE", "PIDS")
+	if err != nil {
+		return fmt.Errorf("could not write stats header: %v", err)
+	}
+	for _, i := range instances {
+		s := i.Stats
+		memory := formatSize(s.Memory.Usage) + " / " + formatLimit(s.Memory.Limit, formatSize)
+		ioUsage := formatSize(s.IO.ReadBytes) + " / " + formatSize(s.IO.WriteBytes)
+		pids := fmt.Sprintf("%d / %s", s.Pids.Current, formatLimit(s.Pids.Limit, func(v uint64) string {
+			return fmt.Sprintf("%d", v)
+		}))
+		cpu := time.Duration(s.CPU.Usage).Round(time.Millisecond).String()
+		_, err := fmt.Fprintf(w, "%-16s %-8d %-10s %-22s %-22s %s\n", i.Instance, i.Pid, cpu, memory, ioUsage, pids)
+		if err != nil {
+			return fmt.Errorf("could not write instance stats: %v", err)
+		}
+	}
+	return nil
+}
+
+// formatSize returns a human readable size in binary units.
+func formatSize(size uint64) string {
+	const unit = 1024
+	if size < unit {
+		return fmt.Sprintf("%dB", size)
+	}
+	div, exp := uint64(unit), 0
+	for n := size / unit; n >= unit; n /= unit {
+		div *= unit
+		exp++
+	}
+	return fmt.Sprintf("%.1f%ciB", float64(size)/float64(div), "KMGTPE"[exp])
+}
+
+// formatLimit returns max for an unlimited resource.
+func formatLimit(limit uint64, format func(uint64) string) string {
+	if limit == 0 {
+		return "max"
+	}
+	return format(limit)
+}
+
 // WriteInstancePidFile fetches instance's PID and writes it to the pidFile,
 // truncating it if it already exists. Note that the name should not be a glob,
 // i.e. name should identify a single instance only, otherwise an error is returned.
@@ -142,6 +240,12 @@ func killInstance(i *instance.File, sig syscall.Signal, stoppedPID chan<- int) {
 			stoppedPID <- i.Pid
 			break
 		}
+		// an instance monitored by the instance monitor of the user
+		// is stopped once its instance file has been removed
+		if _, err := os.Stat(i.Path); os.IsNotExist(err) {
+			stoppedPID <- i.Pid
+			break
+		}
 		if childs, err := proc.CountChilds(i.Pid); childs == 0 {
 			if err == nil {
 				syscall.Kill(i.Pid, syscall.SIGKILL)
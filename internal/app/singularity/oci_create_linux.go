@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -25,6 +25,10 @@ func OciCreate(containerID string, args *OciArgs) error {
 		return fmt.Errorf("%s already exists", containerID)
 	}
 
+	if args.LogMaxSize < 0 || args.LogMaxFiles < 0 {
+		return fmt.Errorf("log maximum size and maximum number of files must be positive")
+	}
+
 	os.Clearenv()
 
 	absBundle, err := filepath.Abs(args.BundlePath)
@@ -41,6 +45,8 @@ func OciCreate(containerID string, args *OciArgs) error {
 	engineConfig.SetBundlePath(absBundle)
 	engineConfig.SetLogPath(args.LogPath)
 	engineConfig.SetLogFormat(args.LogFormat)
+	engineConfig.SetLogMaxSize(int64(args.LogMaxSize) << 20)
+	engineConfig.SetLogMaxFiles(args.LogMaxFiles)
 	engineConfig.SetPidFile(args.PidFile)
 
 	// load config.json from bundle path
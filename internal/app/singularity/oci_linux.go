@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -23,6 +23,8 @@ type OciArgs struct {
 	BundlePath     string
 	LogPath        string
 	LogFormat      string
+	LogMaxSize     int
+	LogMaxFiles    int
 	SyncSocketPath string
 	PidFile        string
 	FromFile       string
@@ -52,6 +52,12 @@ func PullShub(imgCache *cache.Handle, filePath string, shubRef string, noHTTPS b
 			return err
 		}
 	} else {
+		unlock, err := imgCache.LockEntry(imagePath)
+		if err != nil {
+			return fmt.Errorf("unable to lock cache entry %s: %s", imagePath, err)
+		}
+		defer unlock()
+
 		exists, err := imgCache.ShubImageExists(manifest.Commit, imageName)
 		if err != nil {
 			return fmt.Errorf("unable to check if %v exists: %v", imagePath, err)
@@ -123,6 +129,12 @@ func OrasPull(ctx context.Context, imgCache *cache.Handle, name, ref string, for
 	imageName := uri.GetName("oras:" + ref)
 
 	cacheImagePath := imgCache.OrasImage(sum, imageName)
+	unlock, err := imgCache.LockEntry(cacheImagePath)
+	if err != nil {
+		return fmt.Errorf("unable to lock cache entry %s: %s", cacheImagePath, err)
+	}
+	defer unlock()
+
 	exists, err := imgCache.OrasImageExists(sum, imageName)
 	if err == cache.ErrBadChecksum {
 		sylog.Warningf("Removing cached image: %s: cache could be corrupted", cacheImagePath)
@@ -147,6 +159,7 @@ func OrasPull(ctx context.Context, imgCache *cache.Handle, name, ref string, for
 		} else if cacheFileHash != sum {
 			return fmt.Errorf("cached file hash(%s) and expected hash(%s) does not match", cacheFileHash, sum)
 		}
+		cache.SetImageDigest(cacheImagePath, sum)
 	} else {
 		sylog.Infof("Using cached image")
 	}
@@ -195,6 +208,12 @@ func OciPull(ctx context.Context, imgCache *cache.Handle, name, imageURI, tmpDir
 		imgName := uri.GetName(imageURI)
 		cachedImgPath := imgCache.OciTempImage(sum, imgName)
 
+		unlock, err := imgCache.LockEntry(cachedImgPath)
+		if err != nil {
+			return fmt.Errorf("unable to lock cache entry %s: %s", cachedImgPath, err)
+		}
+		defer unlock()
+
 		exists, err := imgCache.OciTempExists(sum, imgName)
 		if err != nil {
 			return fmt.Errorf("unable to check if %s exists: %s", imgName, err)
@@ -8,9 +8,7 @@ package singularity
 import (
 	"context"
 	"fmt"
-	"io/ioutil"
 	"os"
-	"path/filepath"
 
 	scs "github.com/sylabs/scs-library-client/client"
 	"github.com/sylabs/singularity/internal/pkg/client/cache"
@@ -60,59 +58,32 @@ func (l *Library) Pull(ctx context.Context, from, to, arch string) error {
 		return fmt.Errorf("could not get image info: %v", err)
 	}
 
-	dst, tmpName, err := func() (string, string, error) {
-		dst := to
-		if !l.cache.IsDisabled() {
-			imageName := uri.GetName("library://" + libraryPath)
-			dst = l.cache.LibraryImage(imageMeta.Hash, imageName)
-
-			// here we can check if the file is already in
-			// the cache
-			if _, err := os.Stat(dst); err == nil {
-				// we have the file in the cache, return
-				// the same name for the final
-				// destination and the temporary
-				// location to signal that no rename is
-				// necessary
-				return dst, dst, nil
-			}
-		}
+	dst := to
+	if !l.cache.IsDisabled() {
+		dst = l.cache.LibraryImage(imageMeta.Hash, uri.GetName("library://"+libraryPath))
 
-		tmpHandle, err := ioutil.TempFile(filepath.Dir(dst), filepath.Base(dst)+".")
+		// serialize concurrent pulls of the same image, the first one
+		// fills the cache entry the others then find there
+		unlock, err := l.cache.LockEntry(dst)
 		if err != nil {
-			return "", "", fmt.Errorf("unable to create temporary image: %w", err)
-		}
-		tmpHandle.Close()
-
-		tmpName := tmpHandle.Name()
-
-		// This is racy
-		if err := os.Remove(tmpName); err != nil {
-			return "", "", fmt.Errorf("unable to remove temporary file %s: %w", tmpName, err)
+			return fmt.Errorf("unable to lock cache entry: %s", err)
 		}
-
-		go interruptCleanup(tmpName)
-
-		return dst, tmpName, nil
-	}()
-
-	if err != nil {
-		return fmt.Errorf("unable to obtain intermediate location for %s: %w", to, err)
+		defer unlock()
 	}
 
-	// if the tmpName is the same as dst, that means we are
-	// looking at a file present in the cache, so we can skip
-	// downloading it
-	if tmpName != dst {
-		sylog.Debugf("Downloading to %s for intermediate destination %s and final destination %s", tmpName, dst, to)
-		// Download the image, either to the cache, or to the
-		// temporary location
-		if err := l.pullAndVerify(ctx, imageMeta, libraryPath, tmpName, arch); err != nil {
+	// the image is downloaded in a partial file stored along dst and
+	// renamed once complete, an interrupted download in the cache is
+	// resumed by the next pull
+	if _, err := os.Stat(dst); err != nil || dst == to {
+		sylog.Debugf("Downloading to %s for final destination %s", dst, to)
+		if err := l.pullAndVerify(ctx, imageMeta, libraryPath, dst, arch); err != nil {
 			return fmt.Errorf("unable to download image: %s", err)
 		}
 
-		sylog.Debugf("Renaming temporary file %s to %s", tmpName, dst)
-		os.Rename(tmpName, dst)
+		if dst != to {
+			// the image downloaded in the cache was verified
+			cache.SetImageDigest(dst, imageMeta.Hash)
+		}
 	}
 
 	// now we either have the image in the correct location (dst ==
@@ -142,18 +113,14 @@ func (l *Library) Pull(ctx context.Context, from, to, arch string) error {
 // will be saved to the location provided.
 func (l *Library) pullAndVerify(ctx context.Context, imgMeta *scs.Image, from, to, arch string) error {
 	sylog.Infof("Downloading library image")
-	go interruptCleanup(to)
 
-	err := library.DownloadImage(ctx, l.client, to, arch, from, printProgress)
+	// the image is hashed while downloaded
+	fileHash, err := library.DownloadImage(ctx, l.client, to, arch, from, printProgress)
 	if err != nil {
 		return fmt.Errorf("unable to download image: %v", err)
 	}
-
-	fileHash, err := scs.ImageHash(to)
-	if err != nil {
-		return fmt.Errorf("error getting image hash: %v", err)
-	}
 	if fileHash != imgMeta.Hash {
+		os.Remove(to)
 		return fmt.Errorf("file hash(%s) and expected hash(%s) does not match", fileHash, imgMeta.Hash)
 	}
 	return nil
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -14,12 +14,15 @@ import (
 	"os"
 	"os/signal"
 	"strings"
+	"sync"
 	"syscall"
 
+	"github.com/sylabs/singularity/internal/pkg/instance"
 	"github.com/sylabs/singularity/internal/pkg/runtime/engine"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
 	"github.com/sylabs/singularity/internal/pkg/util/mainthread"
 	signalutil "github.com/sylabs/singularity/internal/pkg/util/signal"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 	"github.com/sylabs/singularity/pkg/util/crypt"
 )
 
@@ -36,7 +39,9 @@ func createContainer(ctx context.Context, rpcSocket int, containerPid int, e *en
 		return
 	}
 
+	region := trace.Begin("master: create container")
 	err = e.CreateContainer(ctx, containerPid, rpcConn)
+	region.End()
 	if err != nil {
 		if strings.Contains(err.Error(), crypt.ErrInvalidPassphrase.Error()) {
 			sylog.Debugf("%s", err)
@@ -50,7 +55,9 @@ func createContainer(ctx context.Context, rpcSocket int, containerPid int, e *en
 	rpcConn.Close()
 }
 
-func startContainer(ctx context.Context, masterSocket int, containerPid int, e *engine.Engine, fatalChan chan error) {
+// startContainer waits until the container process is executed and
+// returns true once the container is started.
+func startContainer(ctx context.Context, masterSocket int, containerPid int, e *engine.Engine, h *monitorHandoff, fatalChan chan error) {
 	comm := os.NewFile(uintptr(masterSocket), "master-socket")
 	if comm == nil {
 		fatalChan <- fmt.Errorf("bad master socket file descriptor")
@@ -98,17 +105,129 @@ func startContainer(ctx context.Context, masterSocket int, containerPid int, e *
 	// was executed and master socket was closed by stage 2. If data
 	// byte sent is equal to 'f', it means an error occurred in
 	// StartProcess, just return by waiting error and process status
+	region := trace.Begin("master: wait container process execution")
 	_, err = conn.Read(data)
+	region.End()
 	if (err != nil && err != io.EOF) || data[0] == 'f' {
 		sylog.Debugf("stage 2 process reported an error, waiting status")
 		return
 	}
 
+	region = trace.Begin("master: post start process")
 	err = e.PostStartProcess(ctx, containerPid)
+	region.End()
 	if err != nil {
 		fatalChan <- fmt.Errorf("post start process failed: %s", err)
 		return
 	}
+
+	h.handoff(containerPid, e, conn)
+}
+
+// monitorHandoff hands off the container process to the instance monitor
+// of the user once started, when the engine allows it. The master process
+// exits once the container process is adopted, if the user has no instance
+// monitor running the master process becomes the instance monitor.
+type monitorHandoff struct {
+	mu      sync.Mutex
+	exiting bool
+	monitor *instance.Monitor
+}
+
+// handoffRequest sends a hand off request to the container process over
+// the master socket conn and waits for its reply.
+func handoffRequest(conn net.Conn, req byte) error {
+	if _, err := conn.Write([]byte{req}); err != nil {
+		return err
+	}
+	b := make([]byte, 1)
+	if _, err := conn.Read(b); err != nil {
+		return err
+	} else if b[0] != instance.HandoffDone {
+		return fmt.Errorf("unexpected reply %q", b[0])
+	}
+	return nil
+}
+
+// handoff is called once the container process is started. The container
+// process clears its parent death signal before being adopted by the
+// instance monitor and sets it again if the hand off fails, so that it
+// doesn't outlive the master process monitoring it.
+func (h *monitorHandoff) handoff(containerPid int, e *engine.Engine, conn net.Conn) {
+	obj, ok := e.Operations.(interface {
+		MonitoredContainer(int) *instance.MonitoredContainer
+	})
+	if !ok {
+		return
+	}
+	c := obj.MonitoredContainer(containerPid)
+	if c == nil {
+		return
+	}
+
+	// the container cleanup is done either by the master process
+	// or by the instance monitor
+	h.mu.Lock()
+	defer h.mu.Unlock()
+
+	if h.exiting {
+		return
+	}
+
+	if err := handoffRequest(conn, instance.HandoffStart); err != nil {
+		sylog.Debugf("Could not hand off container process: %s", err)
+		return
+	}
+
+	h.adopt(c)
+
+	// the master process keeps monitoring the container process
+	if err := handoffRequest(conn, instance.HandoffAbort); err != nil {
+		sylog.Warningf("Could not set container process parent death signal: %s", err)
+	}
+}
+
+// adopt hands off the container process c to the instance monitor of the
+// user and exits, or returns if the container process is still monitored
+// by the master process.
+func (h *monitorHandoff) adopt(c *instance.MonitoredContainer) {
+	// a second attempt is made if another master process became the
+	// instance monitor meanwhile
+	for i := 0; i < 2; i++ {
+		pid, err := instance.AdoptContainer(c)
+		if err == nil {
+			sylog.Debugf("Container process adopted by instance monitor (PID=%d)", pid)
+			os.Exit(0)
+		} else if err != instance.ErrNoMonitor {
+			sylog.Debugf("Could not hand off container process: %s", err)
+			return
+		}
+
+		m, err := instance.ListenMonitor()
+		if err == nil {
+			sylog.Debugf("Running as instance monitor")
+			h.monitor = m
+			go m.Serve()
+			return
+		} else if err != instance.ErrMonitorRunning {
+			sylog.Debugf("Could not start instance monitor: %s", err)
+			return
+		}
+	}
+}
+
+// wait is called once the container process exited, if the master process
+// is the instance monitor it waits until the adopted container processes
+// exited.
+func (h *monitorHandoff) wait() {
+	h.mu.Lock()
+	h.exiting = true
+	m := h.monitor
+	h.mu.Unlock()
+
+	if m != nil {
+		m.Wait()
+	}
 }
 
 // Master initializes a runtime engine and runs it.
@@ -130,7 +249,9 @@ func Master(rpcSocket, masterSocket int, containerPid int, e *engine.Engine) {
 
 	go createContainer(ctx, rpcSocket, containerPid, e, fatalChan)
 
-	go startContainer(ctx, masterSocket, containerPid, e, fatalChan)
+	h := new(monitorHandoff)
+
+	go startContainer(ctx, masterSocket, containerPid, e, h, fatalChan)
 
 	go func() {
 		var err error
@@ -144,6 +265,8 @@ func Master(rpcSocket, masterSocket int, containerPid int, e *engine.Engine) {
 		sylog.Errorf("container cleanup failed: %s", err)
 	}
 
+	h.wait()
+
 	if fatal != nil {
 		sylog.Fatalf("%s", fatal)
 	}
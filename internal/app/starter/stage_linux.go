@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -12,6 +12,7 @@ import (
 	"github.com/sylabs/singularity/internal/pkg/runtime/engine"
 	starterConfig "github.com/sylabs/singularity/internal/pkg/runtime/engine/config/starter"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 )
 
 // StageOne validates and prepares container configuration which is
@@ -24,13 +25,17 @@ import (
 func StageOne(sconfig *starterConfig.Config, e *engine.Engine) {
 	sylog.Debugf("Entering stage 1\n")
 
+	prepare := trace.Begin("stage 1: prepare configuration")
 	if err := e.PrepareConfig(sconfig); err != nil {
 		sylog.Fatalf("%s\n", err)
 	}
+	prepare.End()
 
+	write := trace.Begin("stage 1: write configuration")
 	if err := sconfig.Write(e.Common); err != nil {
 		sylog.Fatalf("%s", err)
 	}
+	write.End()
 
 	os.Exit(0)
 }
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -8,20 +8,25 @@ package assemblers
 import (
 	"encoding/binary"
 	"fmt"
+	"io"
 	"io/ioutil"
 	"os"
 	"regexp"
 	"runtime"
 	"strconv"
 	"syscall"
+	"time"
 
 	uuid "github.com/satori/go.uuid"
 	"github.com/sylabs/sif/pkg/sif"
+	"github.com/sylabs/singularity/internal/pkg/build/sources"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/internal/pkg/util/env"
 	"github.com/sylabs/singularity/internal/pkg/util/machine"
 	"github.com/sylabs/singularity/pkg/build/types"
 	"github.com/sylabs/singularity/pkg/image/packer"
 	"github.com/sylabs/singularity/pkg/util/crypt"
+	"github.com/sylabs/singularity/pkg/util/fs/squashfs"
 )
 
 // SIFAssembler doesn't store anything.
@@ -35,7 +40,7 @@ type encryptionOptions struct {
 	plaintext []byte
 }
 
-func createSIF(path string, definition, ociConf []byte, squashfile string, encOpts *encryptionOptions, arch string) (err error) {
+func createSIF(path string, definition, ociConf, staticEnv []byte, squashfile string, encOpts *encryptionOptions, arch string) (err error) {
 	// general info for the new SIF file creation
 	cinfo := sif.CreateInfo{
 		Pathname:   path,
@@ -71,6 +76,20 @@ func createSIF(path string, definition, ociConf []byte, squashfile string, encOp
 		cinfo.InputDescr = append(cinfo.InputDescr, ociInput)
 	}
 
+	if len(staticEnv) > 0 {
+		// environment resolved from the environment scripts
+		envInput := sif.DescriptorInput{
+			Datatype: sif.DataEnvVar,
+			Groupid:  sif.DescrDefaultGroup,
+			Link:     sif.DescrUnusedLink,
+			Data:     staticEnv,
+			Fname:    env.StaticEnvName,
+		}
+		envInput.Size = int64(binary.Size(envInput.Data))
+
+		cinfo.InputDescr = append(cinfo.InputDescr, envInput)
+	}
+
 	// data we need to create a system partition descriptor
 	parinput := sif.DescriptorInput{
 		Datatype: sif.DataPartition,
@@ -78,8 +97,14 @@ func createSIF(path string, definition, ociConf []byte, squashfile string, encOp
 		Link:     sif.DescrUnusedLink,
 		Fname:    squashfile,
 	}
+	// an empty partition is created when the squashfs filesystem
+	// is written in place once the SIF file is created
+	partfile := squashfile
+	if partfile == "" {
+		partfile = os.DevNull
+	}
 	// open up the data object file for this descriptor
-	fp, err := os.Open(parinput.Fname)
+	fp, err := os.Open(partfile)
 	if err != nil {
 		return fmt.Errorf("while opening partition file: %s", err)
 	}
@@ -152,10 +177,129 @@ func createSIF(path string, definition, ociConf []byte, squashfile string, encOp
 	return nil
 }
 
+// writeSquashfs creates the squashfs filesystem of rootfs directly at the
+// offset of the empty system partition of the SIF image, the partition
+// being the last data object the filesystem can grow without the need of
+// an intermediate squashfs file copied into the image afterward. If tree
+// is not nil, rootfs is merged on top of it and the filesystem is created
+// from the tree.
+func writeSquashfs(path, rootfs string, tree *squashfs.Tree) error {
+	fimg, err := sif.LoadContainer(path, true)
+	if err != nil {
+		return fmt.Errorf("while loading SIF: %s", err)
+	}
+	part, idx, err := fimg.GetPartPrimSys()
+	fimg.UnloadContainer()
+	if err != nil {
+		return fmt.Errorf("while searching system partition: %s", err)
+	}
+
+	// the SIF file handle doesn't implement io.WriterAt
+	f, err := os.OpenFile(path, os.O_RDWR, 0)
+	if err != nil {
+		return fmt.Errorf("while opening SIF: %s", err)
+	}
+	defer f.Close()
+
+	opts := squashfs.WriterOptions{
+		// build squashfs with all files owned by root when building as a user
+		AllRoot: syscall.Getuid() != 0,
+	}
+
+	start := time.Now()
+	var stats *squashfs.WriteStats
+	if tree != nil {
+		if err := tree.MergeDir(rootfs); err != nil {
+			return fmt.Errorf("while merging %s: %s", rootfs, err)
+		}
+		stats, err = squashfs.CreateFromTree(f, part.Fileoff, tree, opts)
+	} else {
+		stats, err = squashfs.Create(f, part.Fileoff, rootfs, opts)
+	}
+	if err != nil {
+		return fmt.Errorf("while creating squashfs: %s", err)
+	}
+	elapsed := time.Since(start)
+
+	d := &fimg.DescrArr[idx]
+	d.Filelen = stats.BytesOut
+	d.Storelen = stats.BytesOut
+	fimg.Header.Datalen = d.Fileoff + d.Filelen - fimg.Header.Dataoff
+
+	// update the header and the descriptors with the partition size
+	if _, err := f.Seek(0, io.SeekStart); err != nil {
+		return fmt.Errorf("while updating SIF header: %s", err)
+	}
+	if err := binary.Write(f, binary.LittleEndian, fimg.Header); err != nil {
+		return fmt.Errorf("while updating SIF header: %s", err)
+	}
+	if _, err := f.Seek(fimg.Header.Descroff, io.SeekStart); err != nil {
+		return fmt.Errorf("while updating SIF descriptors: %s", err)
+	}
+	if err := binary.Write(f, binary.LittleEndian, fimg.DescrArr); err != nil {
+		return fmt.Errorf("while updating SIF descriptors: %s", err)
+	}
+	if err := f.Close(); err != nil {
+		return fmt.Errorf("while closing SIF: %s", err)
+	}
+
+	sylog.Verbosef("Squashfs filesystem with %d inodes created in %s", stats.Inodes, elapsed.Round(time.Millisecond))
+	sylog.Infof("Packed %.1f MiB into %.1f MiB (%.1f MiB/s)",
+		float64(stats.BytesIn)/(1<<20),
+		float64(stats.BytesOut)/(1<<20),
+		float64(stats.BytesIn)/(1<<20)/elapsed.Seconds(),
+	)
+
+	return nil
+}
+
+// staticEnvironment returns the environment resolved from the environment
+// scripts of the bundle, or nil if it has to be resolved at runtime.
+func staticEnvironment(b *types.Bundle) []byte {
+	// environment scripts from a streamed root filesystem are
+	// not on disk to be parsed
+	if b.RootfsTree != nil && len(b.RootfsTree.ReadDir(".singularity.d")) > 0 {
+		return nil
+	}
+	staticEnv, err := sources.StaticEnvironment(b.RootfsPath)
+	if err != nil {
+		sylog.Warningf("Environment will be resolved at runtime: %s", err)
+		return nil
+	}
+	return staticEnv
+}
+
 // Assemble creates a SIF image from a Bundle.
 func (a *SIFAssembler) Assemble(b *types.Bundle, path string) error {
 	sylog.Infof("Creating SIF file...")
 
+	// a streamed root filesystem is only built from images of the native
+	// architecture, its binaries are not on disk to be inspected
+	arch := runtime.GOARCH
+	if b.RootfsTree == nil {
+		if arch = machine.ArchFromContainer(b.RootfsPath); arch == "" {
+			sylog.Infof("Architecture not recognized, use native")
+			arch = runtime.GOARCH
+		}
+	}
+	sylog.Verbosef("Set SIF container architecture to %s", arch)
+
+	staticEnv := staticEnvironment(b)
+
+	// without mksquashfs the squashfs filesystem is created in-process
+	// and written in place into the SIF file
+	if a.MksquashfsPath == "" {
+		err := createSIF(path, b.Recipe.Raw, b.JSONObjects[types.OCIConfigJSON], staticEnv, "", nil, arch)
+		if err != nil {
+			return fmt.Errorf("while creating SIF: %v", err)
+		}
+		if err := writeSquashfs(path, b.RootfsPath, b.RootfsTree); err != nil {
+			os.Remove(path)
+			return fmt.Errorf("while creating SIF: %v", err)
+		}
+		return nil
+	}
+
 	s := packer.NewSquashfs()
 	s.MksquashfsPath = a.MksquashfsPath
 
@@ -173,53 +317,50 @@ func (a *SIFAssembler) Assemble(b *types.Bundle, path string) error {
 	if syscall.Getuid() != 0 {
 		flags = append(flags, "-all-root")
 	}
-	// specify compression if needed
-	if a.GzipFlag {
+	// specify compression if needed and not set by the user options
+	if a.GzipFlag && !hasFlag(b.Opts.MksquashfsArgs, "-comp") {
 		flags = append(flags, "-comp", "gzip")
 	}
-
-	arch := machine.ArchFromContainer(b.RootfsPath)
-	if arch == "" {
-		sylog.Infof("Architecture not recognized, use native")
-		arch = runtime.GOARCH
-	}
-	sylog.Verbosef("Set SIF container architecture to %s", arch)
+	flags = append(flags, b.Opts.MksquashfsArgs...)
 
 	if err := s.Create([]string{b.RootfsPath}, fsPath, flags); err != nil {
 		return fmt.Errorf("while creating squashfs: %v", err)
 	}
 
-	var encOpts *encryptionOptions
-
-	if b.Opts.EncryptionKeyInfo != nil {
-		plaintext, err := crypt.NewPlaintextKey(*b.Opts.EncryptionKeyInfo)
+	if b.Opts.EncryptionKeyInfo == nil {
+		err = createSIF(path, b.Recipe.Raw, b.JSONObjects[types.OCIConfigJSON], staticEnv, fsPath, nil, arch)
 		if err != nil {
-			return fmt.Errorf("unable to obtain encryption key: %+v", err)
+			return fmt.Errorf("while creating SIF: %v", err)
 		}
+		return nil
+	}
 
-		// A dm-crypt device needs to be created with squashfs
-		cryptDev := &crypt.Device{}
+	plaintext, err := crypt.NewPlaintextKey(*b.Opts.EncryptionKeyInfo)
+	if err != nil {
+		return fmt.Errorf("unable to obtain encryption key: %+v", err)
+	}
 
-		// TODO (schebro): Fix #3876
-		// Detach the following code from the squashfs creation. SIF can be
-		// created first and encrypted after. This gives the flexibility to
-		// encrypt an existing SIF
-		loopPath, err := cryptDev.EncryptFilesystem(fsPath, plaintext)
-		if err != nil {
-			return fmt.Errorf("unable to encrypt filesystem at %s: %+v", fsPath, err)
-		}
-		defer os.Remove(loopPath)
+	// A dm-crypt device needs to be created with squashfs
+	cryptDev := &crypt.Device{}
 
-		fsPath = loopPath
+	// TODO (schebro): Fix #3876
+	// Detach the following code from the squashfs creation. SIF can be
+	// created first and encrypted after. This gives the flexibility to
+	// encrypt an existing SIF
+	loopPath, err := cryptDev.EncryptFilesystem(fsPath, plaintext)
+	if err != nil {
+		return fmt.Errorf("unable to encrypt filesystem at %s: %+v", fsPath, err)
+	}
+	defer os.Remove(loopPath)
 
-		encOpts = &encryptionOptions{
-			keyInfo:   *b.Opts.EncryptionKeyInfo,
-			plaintext: plaintext,
-		}
+	fsPath = loopPath
 
+	encOpts := &encryptionOptions{
+		keyInfo:   *b.Opts.EncryptionKeyInfo,
+		plaintext: plaintext,
 	}
 
-	err = createSIF(path, b.Recipe.Raw, b.JSONObjects[types.OCIConfigJSON], fsPath, encOpts, arch)
+	err = createSIF(path, b.Recipe.Raw, b.JSONObjects[types.OCIConfigJSON], staticEnv, fsPath, encOpts, arch)
 	if err != nil {
 		return fmt.Errorf("while creating SIF: %v", err)
 	}
@@ -227,6 +368,16 @@ func (a *SIFAssembler) Assemble(b *types.Bundle, path string) error {
 	return nil
 }
 
+// hasFlag returns whether flag is present in args.
+func hasFlag(args []string, flag string) bool {
+	for _, arg := range args {
+		if arg == flag {
+			return true
+		}
+	}
+	return false
+}
+
 // changeOwner check the command being called with sudo with the environment
 // variable SUDO_COMMAND. Pattern match that for the singularity bin.
 func changeOwner() (int, int, bool) {
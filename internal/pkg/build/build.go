@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -58,10 +58,18 @@ type Config struct {
 	// NoCleanUp allows a user to prevent a bundle from being cleaned
 	// up after a failed build, useful for debugging.
 	NoCleanUp bool
+	// Jobs is the maximum number of independent stages built
+	// concurrently, zero or one builds the stages one at a time.
+	Jobs int
 	// Opts for bundles.
 	Opts types.Options
 }
 
+// buildUmask is the umask of the process while the stages are built, it's
+// passed to the copy of the files between stages which runs concurrently
+// with other stages and can't read it.
+const buildUmask = 0002
+
 // NewBuild creates a new Build struct from a spec (URI, definition file, etc...).
 func NewBuild(spec string, conf Config) (*Build, error) {
 	def, err := makeDef(spec)
@@ -172,6 +180,11 @@ func newBuild(defs []types.Definition, conf Config) (*Build, error) {
 		}
 
 		s.b.Opts = conf.Opts
+		// the root filesystem of single stage SIF builds not modified
+		// by scripts or files can be written directly into the image
+		s.b.Opts.StreamRootfs = conf.Format == "sif" && len(defs) == 1 &&
+			!mksquashfsRequired(conf.Opts) && !conf.Opts.Update &&
+			!engineRequired(d) && len(d.CustomData) == 0
 		// dont need to get cp if we're skipping bootstrap
 		if !conf.Opts.Update || conf.Opts.Force {
 			if c, err := conveyorPacker(d); err == nil {
@@ -189,6 +202,11 @@ func newBuild(defs []types.Definition, conf Config) (*Build, error) {
 	case "sandbox":
 		b.stages[lastStageIndex].a = &assemblers.SandboxAssembler{Copy: sandboxCopy}
 	case "sif":
+		if !mksquashfsRequired(conf.Opts) {
+			b.stages[lastStageIndex].a = &assemblers.SIFAssembler{}
+			break
+		}
+
 		mksquashfsPath, err := squashfs.GetPath()
 		if err != nil {
 			return nil, fmt.Errorf("while searching for mksquashfs: %v", err)
@@ -209,6 +227,20 @@ func newBuild(defs []types.Definition, conf Config) (*Build, error) {
 	return b, nil
 }
 
+// mksquashfsRequired returns whether the squashfs filesystem of a SIF image
+// has to be created by mksquashfs instead of in-process. The in-process writer
+// only creates unencrypted gzip filesystems with the mksquashfs defaults, so
+// mksquashfs is still used for encrypted filesystems which need a standalone
+// file, when mksquashfs options (e.g. another compressor) are given and for
+// reproducible builds setting SOURCE_DATE_EPOCH honored by mksquashfs.
+func mksquashfsRequired(opts types.Options) bool {
+	if opts.EncryptionKeyInfo != nil || len(opts.MksquashfsArgs) > 0 {
+		return true
+	}
+	_, ok := os.LookupEnv("SOURCE_DATE_EPOCH")
+	return ok
+}
+
 // ensureGzipComp builds dummy squashfs images and checks the type of compression used
 // to deduce if we can successfully build with gzip compression. It returns an error
 // if we cannot and a boolean to indicate if the `-comp` flag is needed to specify
@@ -312,78 +344,87 @@ func (b *Build) Full(ctx context.Context) error {
 	// clean up build normally
 	defer b.cleanUp()
 
-	oldumask := syscall.Umask(0002)
+	oldumask := syscall.Umask(buildUmask)
 
-	// build each stage one after the other
-	for i, stage := range b.stages {
-		if err := stage.runPreScript(); err != nil {
-			return err
-		}
+	// build stages as soon as the stages they copy files from are built
+	if err := b.runStages(ctx, b.runStage); err != nil {
+		return err
+	}
 
-		// only update last stage if specified
-		update := stage.b.Opts.Update && !stage.b.Opts.Force && i == len(b.stages)-1
-		if update {
-			// updating, extract dest container to bundle
-			sylog.Infof("Building into existing container: %s", b.Conf.Dest)
-			p, err := sources.GetLocalPacker(b.Conf.Dest, stage.b)
-			if err != nil {
-				return err
-			}
+	syscall.Umask(oldumask)
 
-			_, err = p.Pack(ctx)
-			if err != nil {
-				return err
-			}
-		} else {
-			// regular build or force, start build from scratch
-			if b.Conf.Opts.ImgCache == nil {
-				return fmt.Errorf("undefined image cache")
-			}
-			if err := stage.c.Get(ctx, stage.b); err != nil {
-				return fmt.Errorf("conveyor failed to get: %v", err)
-			}
+	sylog.Debugf("Calling assembler")
+	if err := b.stages[len(b.stages)-1].Assemble(b.Conf.Dest); err != nil {
+		return err
+	}
 
-			_, err := stage.c.Pack(ctx)
-			if err != nil {
-				return fmt.Errorf("packer failed to pack: %v", err)
-			}
-		}
+	sylog.Verbosef("Build complete: %s", b.Conf.Dest)
+	return nil
+}
 
-		// create apps in bundle
-		a := apps.New()
-		for k, v := range stage.b.Recipe.CustomData {
-			a.HandleSection(k, v)
-		}
+// runStage builds the stage i into its bundle.
+func (b *Build) runStage(ctx context.Context, i int) error {
+	stage := &b.stages[i]
 
-		a.HandleBundle(stage.b)
-		stage.b.Recipe.BuildData.Post.Script += a.HandlePost()
+	if err := stage.runPreScript(); err != nil {
+		return err
+	}
 
-		if stage.b.RunSection("files") {
-			if err := stage.copyFiles(b); err != nil {
-				return fmt.Errorf("unable to copy files a stage to container fs: %v", err)
-			}
+	// only update last stage if specified
+	update := stage.b.Opts.Update && !stage.b.Opts.Force && i == len(b.stages)-1
+	if update {
+		// updating, extract dest container to bundle
+		sylog.Infof("Building into existing container: %s", b.Conf.Dest)
+		p, err := sources.GetLocalPacker(b.Conf.Dest, stage.b)
+		if err != nil {
+			return err
 		}
 
-		if engineRequired(stage.b.Recipe) {
-			if err := runBuildEngine(stage.b); err != nil {
-				return fmt.Errorf("while running engine: %v", err)
-			}
+		_, err = p.Pack(ctx)
+		if err != nil {
+			return err
+		}
+	} else {
+		// regular build or force, start build from scratch
+		if b.Conf.Opts.ImgCache == nil {
+			return fmt.Errorf("undefined image cache")
+		}
+		if err := stage.c.Get(ctx, stage.b); err != nil {
+			return fmt.Errorf("conveyor failed to get: %v", err)
 		}
 
-		sylog.Debugf("Inserting Metadata")
-		if err := stage.insertMetadata(); err != nil {
-			return fmt.Errorf("while inserting metadata to bundle: %v", err)
+		_, err := stage.c.Pack(ctx)
+		if err != nil {
+			return fmt.Errorf("packer failed to pack: %v", err)
 		}
 	}
 
-	syscall.Umask(oldumask)
+	// create apps in bundle
+	a := apps.New()
+	for k, v := range stage.b.Recipe.CustomData {
+		a.HandleSection(k, v)
+	}
 
-	sylog.Debugf("Calling assembler")
-	if err := b.stages[len(b.stages)-1].Assemble(b.Conf.Dest); err != nil {
-		return err
+	a.HandleBundle(stage.b)
+	stage.b.Recipe.BuildData.Post.Script += a.HandlePost()
+
+	if stage.b.RunSection("files") {
+		if err := stage.copyFiles(b); err != nil {
+			return fmt.Errorf("unable to copy files a stage to container fs: %v", err)
+		}
+	}
+
+	if engineRequired(stage.b.Recipe) {
+		if err := runBuildEngine(stage.b); err != nil {
+			return fmt.Errorf("while running engine: %v", err)
+		}
+	}
+
+	sylog.Debugf("Inserting Metadata")
+	if err := stage.insertMetadata(); err != nil {
+		return fmt.Errorf("while inserting metadata to bundle: %v", err)
 	}
 
-	sylog.Verbosef("Build complete: %s", b.Conf.Dest)
 	return nil
 }
 
@@ -530,7 +571,7 @@ func (s *stage) copyFiles(b *Build) error {
 			transfer.Src = files.AddPrefix(b.stages[stageIndex].b.RootfsPath, transfer.Src)
 			transfer.Dst = files.AddPrefix(s.b.RootfsPath, transfer.Dst)
 			sylog.Infof("Copying %v to %v", transfer.Src, transfer.Dst)
-			if err := files.Copy(transfer.Src, transfer.Dst, false); err != nil {
+			if err := files.Copy(transfer.Src, transfer.Dst, false, buildUmask); err != nil {
 				return err
 			}
 		}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -6,15 +6,35 @@
 package files
 
 import (
-	"bytes"
+	"bufio"
 	"fmt"
+	"io"
 	"os"
-	"os/exec"
 	"path/filepath"
+	"runtime"
+	"strconv"
 	"strings"
+	"sync"
+	"sync/atomic"
+	"syscall"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"golang.org/x/sys/unix"
 )
 
-// makeParentDir ensures existence of the expected destination directory for the cp command
+// copyWorkers is the number of regular files copied concurrently.
+var copyWorkers = runtime.NumCPU()
+
+// copyBufferPool provides the buffers used when the kernel can't copy the
+// file data itself.
+var copyBufferPool = sync.Pool{
+	New: func() interface{} {
+		b := make([]byte, 128*1024)
+		return &b
+	},
+}
+
+// makeParentDir ensures existence of the expected destination directory for the copy
 // based on the supplied path and the number of source paths to copy
 func makeParentDir(path string, numSrcPaths int) error {
 	_, err := os.Stat(path)
@@ -23,7 +43,7 @@ func makeParentDir(path string, numSrcPaths int) error {
 	}
 
 	// if path ends with a trailing '/' or if there are multiple source paths to copy
-	// always ensure the full path exists as a directory because 'cp' is expecting a
+	// always ensure the full path exists as a directory because the copy is expecting a
 	// dir in these cases
 	if strings.HasSuffix(path, "/") || numSrcPaths > 1 {
 		if err := os.MkdirAll(filepath.Clean(path), 0755); err != nil {
@@ -39,37 +59,444 @@ func makeParentDir(path string, numSrcPaths int) error {
 	return nil
 }
 
-// Copy calls cp with src and dst as its arguments
-// checks dst and creates parent directories if they do not exist
-// before calling cp
-func Copy(src, dst string, followLinks bool) error {
-	// resolve any bash globbing in filepath
+// Umask returns the umask of the process as reported by the kernel in
+// /proc/self/status. Kernels older than 4.7 don't report it, the umask is
+// then read by resetting it temporarily, so Umask must be called before
+// starting goroutines creating files.
+func Umask() (os.FileMode, error) {
+	f, err := os.Open("/proc/self/status")
+	if err != nil {
+		return 0, err
+	}
+	defer f.Close()
+
+	scanner := bufio.NewScanner(f)
+	for scanner.Scan() {
+		value := strings.TrimPrefix(scanner.Text(), "Umask:")
+		if value == scanner.Text() {
+			continue
+		}
+		umask, err := strconv.ParseUint(strings.TrimSpace(value), 8, 32)
+		if err != nil {
+			return 0, fmt.Errorf("while parsing umask %q: %s", value, err)
+		}
+		return os.FileMode(umask), nil
+	}
+	if err := scanner.Err(); err != nil {
+		return 0, err
+	}
+
+	umask := syscall.Umask(0)
+	syscall.Umask(umask)
+	return os.FileMode(umask), nil
+}
+
+// Copy copies src to dst with the semantics of "cp -fr", or "cp -fLr" if
+// followLinks is set, after expanding the wildcards in src. Parent
+// directories of dst are created if they do not exist. Directories are
+// walked in process while the regular files are copied concurrently,
+// cloned or copied by the kernel when the filesystems allow it. Hard links
+// between the copied files and permission bits are preserved. umask must
+// be the umask of the process, it's applied to the permissions of the
+// created directories (see Umask).
+func Copy(src, dst string, followLinks bool, umask os.FileMode) error {
 	paths, err := expandPath(src)
 	if err != nil {
-		return fmt.Errorf("while expanding source path with bash: %s: %s", src, err)
+		return fmt.Errorf("while expanding source path: %s: %s", src, err)
 	}
 
 	if err := makeParentDir(dst, len(paths)); err != nil {
 		return fmt.Errorf("while creating parent dir: %v", err)
 	}
 
-	// set flags for cp
-	args := []string{"-fr"}
-	if followLinks {
-		args = []string{"-fLr"}
+	c := newCopier(followLinks, umask)
+	for _, p := range paths {
+		// like cp, sources are copied into an existing directory
+		target := dst
+		if fi, err := os.Stat(dst); err == nil && fi.IsDir() {
+			if base := filepath.Base(p); base != "." && base != ".." {
+				target = filepath.Join(dst, base)
+			}
+		}
+		if err := c.copyRoot(p, target); err != nil {
+			c.setErr(err)
+			break
+		}
+	}
+	if err := c.wait(); err != nil {
+		return fmt.Errorf("while copying %s to %s: %s", paths, dst, err)
 	}
-	// append file(s) to be copied
-	args = append(args, paths...)
-	// append dst as last arg
-	args = append(args, dst)
 
-	var output, stderr bytes.Buffer
-	// copy each file into bundle rootfs
-	copy := exec.Command("/bin/cp", args...)
-	copy.Stdout = &output
-	copy.Stderr = &stderr
-	if err := copy.Run(); err != nil {
-		return fmt.Errorf("while copying %s to %s: %s: %s", paths, dst, err, stderr.String())
+	sylog.Verbosef("Copied %d files (%d bytes) from %s to %s", c.files, c.bytes, src, dst)
+	return nil
+}
+
+type inode struct {
+	dev uint64
+	ino uint64
+}
+
+type copyJob struct {
+	src  string
+	dst  string
+	mode os.FileMode
+}
+
+// copier walks the source trees, creating directories, symbolic links and
+// special files as it goes and queuing regular files to its workers.
+type copier struct {
+	followLinks bool
+	// process umask applied to the permissions of the created directories
+	umask os.FileMode
+
+	jobs    chan copyJob
+	workers sync.WaitGroup
+
+	mu  sync.Mutex
+	err error
+
+	// updated atomically by the workers
+	files int64
+	bytes int64
+	// set once reflinks or copy_file_range(2) are found to be unsupported
+	// between the source and destination filesystems
+	noClone     int32
+	noCopyRange int32
+
+	// first destination of the multiply linked source files, the
+	// following ones are linked to it once all files are copied
+	inodes map[inode]string
+	links  [][2]string
+	// directories currently walked, to detect symbolic link cycles
+	walking map[inode]bool
+	// created directories, their permissions are set last so they
+	// don't prevent the creation of their content
+	dirs []copyJob
+}
+
+func newCopier(followLinks bool, umask os.FileMode) *copier {
+	c := &copier{
+		followLinks: followLinks,
+		umask:       umask,
+		jobs:        make(chan copyJob, copyWorkers),
+		inodes:      make(map[inode]string),
+		walking:     make(map[inode]bool),
+	}
+	for i := 0; i < copyWorkers; i++ {
+		c.workers.Add(1)
+		go c.worker()
+	}
+	return c
+}
+
+func (c *copier) setErr(err error) {
+	c.mu.Lock()
+	if c.err == nil {
+		c.err = err
+	}
+	c.mu.Unlock()
+}
+
+func (c *copier) getErr() error {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	return c.err
+}
+
+func (c *copier) worker() {
+	defer c.workers.Done()
+
+	for job := range c.jobs {
+		// keep draining the queue after a failure
+		if c.getErr() != nil {
+			continue
+		}
+		n, err := c.copyFile(job.src, job.dst, job.mode)
+		if err != nil {
+			c.setErr(err)
+			continue
+		}
+		atomic.AddInt64(&c.files, 1)
+		atomic.AddInt64(&c.bytes, n)
+	}
+}
+
+// wait waits for the queued files to be copied, then creates the remaining
+// hard links and sets the permissions of the created directories.
+func (c *copier) wait() error {
+	close(c.jobs)
+	c.workers.Wait()
+	if err := c.getErr(); err != nil {
+		return err
+	}
+
+	for _, l := range c.links {
+		if err := removeNonDir(l[1]); err != nil {
+			return err
+		}
+		if err := os.Link(l[0], l[1]); err != nil {
+			return err
+		}
+		c.files++
+	}
+	for i := len(c.dirs) - 1; i >= 0; i-- {
+		if err := os.Chmod(c.dirs[i].dst, c.dirs[i].mode); err != nil {
+			return err
+		}
 	}
 	return nil
 }
+
+func (c *copier) stat(path string) (os.FileInfo, error) {
+	if c.followLinks {
+		return os.Stat(path)
+	}
+	return os.Lstat(path)
+}
+
+// copyRoot copies a source path given on the command line.
+func (c *copier) copyRoot(src, dst string) error {
+	fi, err := c.stat(src)
+	if err != nil {
+		return err
+	}
+	if fi.IsDir() {
+		// like cp, refuse to copy a directory into itself
+		s, err := filepath.Abs(src)
+		if err != nil {
+			return err
+		}
+		d, err := filepath.Abs(dst)
+		if err != nil {
+			return err
+		}
+		if strings.HasPrefix(d+"/", s+"/") && s != d {
+			return fmt.Errorf("cannot copy directory %s into itself", src)
+		}
+	}
+	return c.copy(src, dst, fi)
+}
+
+func (c *copier) copy(src, dst string, fi os.FileInfo) error {
+	if err := c.getErr(); err != nil {
+		return err
+	}
+
+	mode := fi.Mode()
+	switch {
+	case mode.IsDir():
+		return c.copyDir(src, dst, fi)
+	case mode&os.ModeSymlink != 0:
+		return copySymlink(src, dst)
+	case mode.IsRegular():
+		st := fi.Sys().(*syscall.Stat_t)
+		if st.Nlink > 1 {
+			key := inode{dev: uint64(st.Dev), ino: uint64(st.Ino)}
+			if first, ok := c.inodes[key]; ok {
+				c.links = append(c.links, [2]string{first, dst})
+				return nil
+			}
+			c.inodes[key] = dst
+		}
+		c.jobs <- copyJob{src: src, dst: dst, mode: mode.Perm()}
+		return nil
+	default:
+		return copySpecial(src, dst, fi)
+	}
+}
+
+func (c *copier) copyDir(src, dst string, fi os.FileInfo) error {
+	st := fi.Sys().(*syscall.Stat_t)
+	key := inode{dev: uint64(st.Dev), ino: uint64(st.Ino)}
+	if c.walking[key] {
+		return fmt.Errorf("%s: symbolic link cycle", src)
+	}
+	c.walking[key] = true
+	defer delete(c.walking, key)
+
+	if dfi, err := os.Stat(dst); err == nil {
+		// like cp, merge into an existing directory
+		if !dfi.IsDir() {
+			return fmt.Errorf("cannot overwrite non-directory %s with directory %s", dst, src)
+		}
+	} else if os.IsNotExist(err) {
+		if err := os.Mkdir(dst, 0700); err != nil {
+			return err
+		}
+		c.dirs = append(c.dirs, copyJob{src: src, dst: dst, mode: fi.Mode().Perm() &^ c.umask})
+	} else {
+		return err
+	}
+
+	f, err := os.Open(src)
+	if err != nil {
+		return err
+	}
+	names, err := f.Readdirnames(-1)
+	f.Close()
+	if err != nil {
+		return err
+	}
+
+	for _, name := range names {
+		s := filepath.Join(src, name)
+		fi, err := c.stat(s)
+		if err != nil {
+			return err
+		}
+		if err := c.copy(s, filepath.Join(dst, name), fi); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// removeNonDir removes path if it exists and isn't a directory, like
+// "cp -f" does for the files it can't overwrite.
+func removeNonDir(path string) error {
+	fi, err := os.Lstat(path)
+	if os.IsNotExist(err) {
+		return nil
+	} else if err != nil {
+		return err
+	}
+	if fi.IsDir() {
+		return fmt.Errorf("cannot overwrite directory %s with non-directory", path)
+	}
+	return os.Remove(path)
+}
+
+func copySymlink(src, dst string) error {
+	target, err := os.Readlink(src)
+	if err != nil {
+		return err
+	}
+	if err := removeNonDir(dst); err != nil {
+		return err
+	}
+	return os.Symlink(target, dst)
+}
+
+func copySpecial(src, dst string, fi os.FileInfo) error {
+	st := fi.Sys().(*syscall.Stat_t)
+	if err := removeNonDir(dst); err != nil {
+		return err
+	}
+	// like cp, the umask applies and the setuid and setgid bits are dropped
+	mode := st.Mode&unix.S_IFMT | uint32(fi.Mode().Perm())
+	if err := unix.Mknod(dst, mode, int(st.Rdev)); err != nil {
+		return &os.PathError{Op: "mknod", Path: dst, Err: err}
+	}
+	return nil
+}
+
+// copyFile copies the regular file src to dst and returns the number of
+// bytes copied. Like "cp -f", an existing dst is overwritten in place and
+// keeps its permissions, or is replaced if it can't be opened for writing.
+// A created dst gets the permissions perm minus the umask.
+func (c *copier) copyFile(src, dst string, perm os.FileMode) (int64, error) {
+	in, err := os.Open(src)
+	if err != nil {
+		return 0, err
+	}
+	defer in.Close()
+
+	out, err := os.OpenFile(dst, os.O_WRONLY, 0)
+	if os.IsNotExist(err) {
+		out, err = os.OpenFile(dst, os.O_WRONLY|os.O_CREATE, perm)
+	} else if err != nil {
+		if rerr := removeNonDir(dst); rerr != nil {
+			return 0, rerr
+		}
+		out, err = os.OpenFile(dst, os.O_WRONLY|os.O_CREATE|os.O_EXCL, perm)
+	}
+	if err != nil {
+		return 0, err
+	}
+	defer out.Close()
+
+	fi, err := in.Stat()
+	if err != nil {
+		return 0, err
+	}
+	dfi, err := out.Stat()
+	if err != nil {
+		return 0, err
+	}
+	// check before truncating
+	if os.SameFile(fi, dfi) {
+		return 0, fmt.Errorf("%s and %s are the same file", src, dst)
+	}
+	if dfi.Size() > 0 {
+		if err := out.Truncate(0); err != nil {
+			return 0, err
+		}
+	}
+
+	n, err := c.copyData(out, in, fi.Size())
+	if cerr := out.Close(); err == nil {
+		err = cerr
+	}
+	if err != nil {
+		return n, fmt.Errorf("while copying %s to %s: %s", src, dst, err)
+	}
+	return n, nil
+}
+
+// unsupported returns whether err reports an operation not supported
+// between two files.
+func unsupported(err error) bool {
+	switch err {
+	case unix.EOPNOTSUPP, unix.ENOTTY, unix.EXDEV, unix.EINVAL, unix.ENOSYS, unix.EPERM:
+		return true
+	}
+	return false
+}
+
+// copyData copies the content of in to out. The file extents are cloned if
+// both files are on a filesystem supporting reflinks, else the data are
+// copied with copy_file_range(2) to avoid the round trip through user space,
+// and with a read/write loop if the kernel can't copy between the files.
+func (c *copier) copyData(out, in *os.File, size int64) (int64, error) {
+	if size == 0 {
+		return 0, nil
+	}
+
+	rfd, wfd := int(in.Fd()), int(out.Fd())
+	if atomic.LoadInt32(&c.noClone) == 0 {
+		err := unix.IoctlSetInt(wfd, unix.FICLONE, rfd)
+		if err == nil {
+			return size, nil
+		} else if unsupported(err) {
+			atomic.StoreInt32(&c.noClone, 1)
+		}
+	}
+
+	var written int64
+	for atomic.LoadInt32(&c.noCopyRange) == 0 && written < size {
+		n, err := unix.CopyFileRange(rfd, nil, wfd, nil, int(size-written), 0)
+		if err == unix.EINTR {
+			continue
+		} else if err != nil && written == 0 && unsupported(err) {
+			// the offsets are unchanged
+			atomic.StoreInt32(&c.noCopyRange, 1)
+			break
+		} else if err != nil {
+			return written, err
+		}
+		if n == 0 {
+			// the file shrunk while copying
+			return written, nil
+		}
+		written += int64(n)
+	}
+	if written > 0 {
+		return written, nil
+	}
+
+	buf := copyBufferPool.Get().(*[]byte)
+	defer copyBufferPool.Put(buf)
+	// hide the files io.ReaderFrom and io.WriterTo implementations
+	// so that the buffer is used
+	return io.CopyBuffer(struct{ io.Writer }{out}, struct{ io.Reader }{in}, *buf)
+}
@@ -6,14 +6,26 @@
 package files
 
 import (
+	"fmt"
 	"io/ioutil"
 	"os"
+	"os/exec"
 	"path/filepath"
+	"syscall"
 	"testing"
 )
 
 var sourceFileContent = "Source File Content\n"
 
+// processUmask returns the umask of the test process.
+func processUmask(t testing.TB) os.FileMode {
+	umask, err := Umask()
+	if err != nil {
+		t.Fatalf("while reading umask: %s", err)
+	}
+	return umask
+}
+
 func TestMakeParentDir(t *testing.T) {
 	tests := []struct {
 		name   string
@@ -136,7 +148,7 @@ func TestCopyFile(t *testing.T) {
 
 			// manually concatenating because I don't want a Join function to clean the trailing slash
 			dst := dstDir + "/" + tt.dst
-			if err := Copy(tt.src, dst, false); err != nil {
+			if err := Copy(tt.src, dst, false, processUmask(t)); err != nil {
 				t.Errorf("unexpected failure running %s test: %s", t.Name(), err)
 			}
 
@@ -201,7 +213,7 @@ func TestCopyDir(t *testing.T) {
 
 			// manually concatenating because I don't want a Join function to clean the trailing slash
 			dst := dstDir + "/" + tt.dst
-			if err := Copy(tt.src, dst, false); err != nil {
+			if err := Copy(tt.src, dst, false, processUmask(t)); err != nil {
 				t.Errorf("unexpected failure running %s test: %s", t.Name(), err)
 			}
 
@@ -240,6 +252,7 @@ func TestCopyFail(t *testing.T) {
 		dst  string
 	}{
 		{"NoSrc", filepath.Join(dir, "not/a/file"), "file"},
+		{"DirOverFile", dir, "file"},
 	}
 
 	for _, tt := range tests {
@@ -255,9 +268,263 @@ func TestCopyFail(t *testing.T) {
 			defer os.RemoveAll(dstDir)
 
 			dst := filepath.Join(dstDir, tt.dst)
-			if err := Copy(tt.src, dst, false); err == nil {
+			if err := ioutil.WriteFile(filepath.Join(dstDir, "file"), nil, 0644); err != nil {
+				t.Fatal(err)
+			}
+			if err := Copy(tt.src, dst, false, processUmask(t)); err == nil {
 				t.Errorf("unexpected success running %s test: %s", t.Name(), err)
 			}
 		})
 	}
 }
+
+func TestCopyTree(t *testing.T) {
+	dir, err := ioutil.TempDir("", "copy-test-src-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	// src/
+	//   file       0640
+	//   link    -> file
+	//   hardlink   same inode as file
+	//   ro/        0555
+	//     file
+	//   .hidden
+	src := filepath.Join(dir, "src")
+	if err := os.MkdirAll(filepath.Join(src, "ro"), 0755); err != nil {
+		t.Fatal(err)
+	}
+	for _, f := range []string{"file", "ro/file", ".hidden"} {
+		if err := ioutil.WriteFile(filepath.Join(src, f), []byte(sourceFileContent), 0640); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if err := os.Chmod(filepath.Join(src, "file"), 0640); err != nil {
+		t.Fatal(err)
+	}
+	if err := os.Symlink("file", filepath.Join(src, "link")); err != nil {
+		t.Fatal(err)
+	}
+	if err := os.Link(filepath.Join(src, "file"), filepath.Join(src, "hardlink")); err != nil {
+		t.Fatal(err)
+	}
+	if err := os.Chmod(filepath.Join(src, "ro"), 0555); err != nil {
+		t.Fatal(err)
+	}
+	defer os.Chmod(filepath.Join(src, "ro"), 0755)
+
+	tests := []struct {
+		name        string
+		src         string
+		followLinks bool
+		hidden      bool
+	}{
+		{"Dir", src, false, true},
+		{"DirFollowLinks", src, true, true},
+		{"Wildcard", src + "/*", false, false},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			dstDir, err := ioutil.TempDir("", "copy-test-dst-")
+			if err != nil {
+				t.Fatal(err)
+			}
+			defer os.RemoveAll(dstDir)
+
+			dst := filepath.Join(dstDir, "dst")
+			if err := Copy(tt.src, dst+"/", tt.followLinks, processUmask(t)); err != nil {
+				t.Fatalf("unexpected failure: %s", err)
+			}
+			if tt.src == src {
+				dst = filepath.Join(dst, "src")
+			}
+			defer os.Chmod(filepath.Join(dst, "ro"), 0755)
+
+			for _, f := range []string{"file", "link", "hardlink", "ro/file"} {
+				content, err := ioutil.ReadFile(filepath.Join(dst, f))
+				if err != nil {
+					t.Fatalf("while reading %s: %s", f, err)
+				}
+				if string(content) != sourceFileContent {
+					t.Errorf("unexpected %s content: %q", f, content)
+				}
+			}
+			if _, err := os.Stat(filepath.Join(dst, ".hidden")); os.IsNotExist(err) == tt.hidden {
+				t.Errorf("hidden file copied: %v", !tt.hidden)
+			}
+
+			fi, err := os.Stat(filepath.Join(dst, "file"))
+			if err != nil {
+				t.Fatal(err)
+			}
+			if fi.Mode().Perm() != 0640 {
+				t.Errorf("unexpected file mode %o", fi.Mode().Perm())
+			}
+			hfi, err := os.Stat(filepath.Join(dst, "hardlink"))
+			if err != nil {
+				t.Fatal(err)
+			}
+			if !os.SameFile(fi, hfi) {
+				t.Errorf("hard link not preserved")
+			}
+			fi, err = os.Stat(filepath.Join(dst, "ro"))
+			if err != nil {
+				t.Fatal(err)
+			}
+			if fi.Mode().Perm() != 0555 {
+				t.Errorf("unexpected directory mode %o", fi.Mode().Perm())
+			}
+
+			fi, err = os.Lstat(filepath.Join(dst, "link"))
+			if err != nil {
+				t.Fatal(err)
+			}
+			if isLink := fi.Mode()&os.ModeSymlink != 0; isLink == tt.followLinks {
+				t.Errorf("unexpected symbolic link %v", isLink)
+			}
+		})
+	}
+}
+
+func TestCopyOverwrite(t *testing.T) {
+	dir, err := ioutil.TempDir("", "copy-test-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	src := filepath.Join(dir, "src")
+	if err := ioutil.WriteFile(src, []byte(sourceFileContent), 0644); err != nil {
+		t.Fatal(err)
+	}
+	// a read-only destination is replaced
+	dst := filepath.Join(dir, "dst")
+	if err := ioutil.WriteFile(dst, []byte("previous content, longer than the new one"), 0444); err != nil {
+		t.Fatal(err)
+	}
+
+	if err := Copy(src, dst, false, processUmask(t)); err != nil {
+		t.Fatalf("unexpected failure: %s", err)
+	}
+	content, err := ioutil.ReadFile(dst)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if string(content) != sourceFileContent {
+		t.Errorf("unexpected content: %q", content)
+	}
+
+	if err := Copy(src, src, false, processUmask(t)); err == nil {
+		t.Errorf("unexpected success copying a file onto itself")
+	}
+	if err := Copy(dir, filepath.Join(dir, "sub"), false, processUmask(t)); err == nil {
+		t.Errorf("unexpected success copying a directory into itself")
+	}
+}
+
+func TestCopyMode(t *testing.T) {
+	dir, err := ioutil.TempDir("", "copy-test-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	oldmask := syscall.Umask(0027)
+	defer syscall.Umask(oldmask)
+
+	if umask := processUmask(t); umask != 0027 {
+		t.Fatalf("unexpected umask %o instead of 0027", umask)
+	}
+
+	src := filepath.Join(dir, "src")
+	if err := ioutil.WriteFile(src, []byte(sourceFileContent), 0644); err != nil {
+		t.Fatal(err)
+	}
+	if err := os.Chmod(src, 0777|os.ModeSetuid|os.ModeSetgid); err != nil {
+		t.Fatal(err)
+	}
+	existing := filepath.Join(dir, "existing")
+	if err := ioutil.WriteFile(existing, nil, 0600); err != nil {
+		t.Fatal(err)
+	}
+
+	tests := []struct {
+		name string
+		dst  string
+		mode os.FileMode
+	}{
+		// like cp, the umask applies and setuid/setgid bits are dropped
+		{"Created", filepath.Join(dir, "created"), 0750},
+		// and the permissions of an existing destination are kept
+		{"Existing", existing, 0600},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			if err := Copy(src, tt.dst, false, processUmask(t)); err != nil {
+				t.Fatalf("unexpected failure: %s", err)
+			}
+			fi, err := os.Stat(tt.dst)
+			if err != nil {
+				t.Fatal(err)
+			}
+			if mode := fi.Mode() & (os.ModePerm | os.ModeSetuid | os.ModeSetgid | os.ModeSticky); mode != tt.mode {
+				t.Errorf("unexpected file mode %o instead of %o", mode, tt.mode)
+			}
+		})
+	}
+}
+
+// BenchmarkCopy compares the copy of a tree of small files with a spawned
+// cp command.
+func BenchmarkCopy(b *testing.B) {
+	dir, err := ioutil.TempDir("", "copy-bench-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	const (
+		dirs     = 16
+		files    = 32
+		fileSize = 16 * 1024
+	)
+	src := filepath.Join(dir, "src")
+	content := make([]byte, fileSize)
+	for i := 0; i < dirs; i++ {
+		d := filepath.Join(src, fmt.Sprintf("dir%d", i))
+		if err := os.MkdirAll(d, 0755); err != nil {
+			b.Fatal(err)
+		}
+		for j := 0; j < files; j++ {
+			if err := ioutil.WriteFile(filepath.Join(d, fmt.Sprintf("file%d", j)), content, 0644); err != nil {
+				b.Fatal(err)
+			}
+		}
+	}
+
+	umask := processUmask(b)
+	copies := map[string]func(src, dst string) error{
+		"Copy": func(src, dst string) error {
+			return Copy(src, dst, false, umask)
+		},
+		"cp": func(src, dst string) error {
+			return exec.Command("/bin/cp", "-fr", src, dst).Run()
+		},
+	}
+	for _, name := range []string{"Copy", "cp"} {
+		copy := copies[name]
+		b.Run(name, func(b *testing.B) {
+			b.SetBytes(dirs * files * fileSize)
+			for i := 0; i < b.N; i++ {
+				dst := filepath.Join(dir, fmt.Sprintf("dst-%s-%d", name, i))
+				if err := copy(src, dst); err != nil {
+					b.Fatal(err)
+				}
+			}
+		})
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -8,8 +8,10 @@ package files
 import (
 	"bytes"
 	"fmt"
+	"os"
 	"os/exec"
 	"path/filepath"
+	"sort"
 	"strings"
 )
 
@@ -18,7 +20,42 @@ const filenameExpansionScript = `for n in %[1]s ; do
 done
 `
 
-func expandPath(path string) ([]string, error) {
+// hasMeta reports whether path contains any of the wildcards recognized by
+// filepath.Match.
+func hasMeta(path string) bool {
+	return strings.ContainsAny(path, `*?[\`)
+}
+
+// matchPattern converts a sh pattern to a pattern for filepath.Match,
+// which negates a bracket expression with a leading '^' instead of '!'.
+func matchPattern(pattern string) string {
+	b := []byte(pattern)
+	inBracket := false
+	for i := 0; i < len(b); i++ {
+		switch {
+		case b[i] == '\\':
+			i++
+		case inBracket:
+			inBracket = b[i] != ']'
+		case b[i] == '[':
+			inBracket = true
+			if i+1 < len(b) && b[i+1] == '!' {
+				b[i+1] = '^'
+				i++
+			}
+		}
+	}
+	return string(b)
+}
+
+// needsShell reports whether path contains a variable, a command
+// substitution or a leading tilde, only expanded by a shell.
+func needsShell(path string) bool {
+	return strings.ContainsAny(path, "$`") || strings.HasPrefix(path, "~")
+}
+
+// shellExpandPath expands path with /bin/sh.
+func shellExpandPath(path string) ([]string, error) {
 	var output, stderr bytes.Buffer
 	cmd := exec.Command("/bin/sh", "-c", fmt.Sprintf(filenameExpansionScript, path))
 	cmd.Stdout = &output
@@ -39,8 +76,87 @@ func expandPath(path string) ([]string, error) {
 	return paths, nil
 }
 
+// expandPath expands the wildcards in path the way sh does: a wildcard
+// doesn't match a leading dot unless the pattern starts with one, matches
+// are sorted and a path matching nothing is returned unexpanded. Paths
+// with variables, command substitutions or a leading tilde are expanded
+// by /bin/sh.
+func expandPath(path string) ([]string, error) {
+	if needsShell(path) {
+		return shellExpandPath(path)
+	}
+	if !hasMeta(path) {
+		return []string{path}, nil
+	}
+
+	// paths are built by concatenation rather than with filepath.Join to
+	// keep them as written, "." and ".." components included
+	matches := []string{""}
+	parts := strings.Split(path, "/")
+	for i, part := range parts {
+		var next []string
+
+		for _, m := range matches {
+			if i > 0 {
+				m += "/"
+			}
+			if !hasMeta(part) {
+				next = append(next, m+part)
+				continue
+			}
+			pattern := matchPattern(part)
+
+			dir := m
+			if dir == "" {
+				dir = "."
+			}
+			f, err := os.Open(dir)
+			if err != nil {
+				// like sh, unreadable directories have no match
+				continue
+			}
+			names, err := f.Readdirnames(-1)
+			f.Close()
+			if err != nil {
+				continue
+			}
+			if part[0] == '.' {
+				names = append(names, ".", "..")
+			}
+			sort.Strings(names)
+
+			for _, name := range names {
+				if name[0] == '.' && part[0] != '.' {
+					continue
+				}
+				ok, err := filepath.Match(pattern, name)
+				if err != nil {
+					// sh takes a malformed pattern literally
+					return []string{path}, nil
+				}
+				if ok {
+					next = append(next, m+name)
+				}
+			}
+		}
+		matches = next
+	}
+
+	// literal components following a wildcard may not exist
+	paths := matches[:0]
+	for _, m := range matches {
+		if _, err := os.Lstat(m); err == nil {
+			paths = append(paths, m)
+		}
+	}
+	if len(paths) == 0 {
+		return []string{path}, nil
+	}
+	return paths, nil
+}
+
 // AddPrefix prepends the supplied prefix to the path, ensuring a trailing '/' in the path
-// since that is meaningful to the 'cp' command
+// since that is meaningful to Copy
 func AddPrefix(prefix, path string) string {
 	fullPath := filepath.Join(prefix, path)
 	// append a slash if path ended with a trailing '/', second check
@@ -198,6 +198,11 @@ func TestExpandPath(t *testing.T) {
 			path:    "?irL1/?",
 			correct: []string{"?irL1/?"},
 		},
+		{
+			name:    "negatedBracket",
+			path:    "dirL1/[!f]*",
+			correct: []string{"dirL1/dirL2"},
+		},
 		{
 			name:    "PathWhitespace",
 			path:    "*",
@@ -254,6 +259,59 @@ func TestExpandPath(t *testing.T) {
 	}
 }
 
+func TestExpandPathShell(t *testing.T) {
+	testDir := createTestDirLayout(t)
+	defer os.RemoveAll(testDir)
+
+	home := os.Getenv("HOME")
+	defer os.Setenv("HOME", home)
+	os.Setenv("HOME", testDir)
+
+	tests := []struct {
+		name    string
+		path    string
+		correct []string
+	}{
+		{
+			name:    "variable",
+			path:    "$HOME/dirL1",
+			correct: []string{"dirL1"},
+		},
+		{
+			name:    "bracedVariableWildcard",
+			path:    "${HOME}/dirL1/*",
+			correct: []string{"dirL1/dirL2", "dirL1/file"},
+		},
+		{
+			name:    "tilde",
+			path:    "~/dirL1/*/file",
+			correct: []string{"dirL1/dirL2/file"},
+		},
+		{
+			name:    "commandSubstitution",
+			path:    "`echo $HOME`/file",
+			correct: []string{"file"},
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			files, err := expandPath(tt.path)
+			if err != nil {
+				t.Fatalf("while expanding path: %s", err)
+			}
+
+			var correct []string
+			for _, c := range tt.correct {
+				correct = append(correct, testDir+"/"+c)
+			}
+			if fmt.Sprint(files) != fmt.Sprint(correct) {
+				t.Errorf("got %s instead of %s", formatSlice(files), formatSlice(correct))
+			}
+		})
+	}
+}
+
 func TestAddPrefix(t *testing.T) {
 	tests := []struct {
 		name    string
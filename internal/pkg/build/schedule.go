@@ -0,0 +1,205 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package build
+
+import (
+	"context"
+	"fmt"
+	"strings"
+	"sync"
+	"time"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+)
+
+// stageDeps returns, for each stage, the indexes of the stages it copies
+// files from with a "%files from <stage>" section.
+func (b *Build) stageDeps() ([][]int, error) {
+	deps := make([][]int, len(b.stages))
+
+	for i, s := range b.stages {
+		seen := make(map[int]bool)
+		for _, f := range s.b.Recipe.BuildData.Files {
+			args := strings.Fields(f.Args)
+			if len(args) != 2 {
+				continue
+			}
+			j, err := b.findStageIndex(args[1])
+			if err != nil {
+				return nil, err
+			}
+			if j == i {
+				return nil, fmt.Errorf("stage %s copies files from itself", args[1])
+			}
+			if !seen[j] {
+				seen[j] = true
+				deps[i] = append(deps[i], j)
+			}
+		}
+	}
+
+	// reject cycles, they would never be scheduled
+	const (
+		unvisited = iota
+		visiting
+		visited
+	)
+	state := make([]int, len(deps))
+	var visit func(i int) error
+	visit = func(i int) error {
+		switch state[i] {
+		case visiting:
+			return fmt.Errorf("circular %%files dependency involving stage %s", b.stages[i].name)
+		case visited:
+			return nil
+		}
+		state[i] = visiting
+		for _, j := range deps[i] {
+			if err := visit(j); err != nil {
+				return err
+			}
+		}
+		state[i] = visited
+		return nil
+	}
+	for i := range deps {
+		if err := visit(i); err != nil {
+			return nil, err
+		}
+	}
+
+	return deps, nil
+}
+
+// runStages runs each stage with run once all the stages it depends on are
+// complete. Without b.Conf.Jobs, or with one job, the stages run one after
+// the other in the definition order. Otherwise independent stages run
+// concurrently, at most b.Conf.Jobs at a time, the first error cancels the
+// stages not started yet and is returned once the running ones are complete.
+func (b *Build) runStages(ctx context.Context, run func(ctx context.Context, i int) error) error {
+	deps, err := b.stageDeps()
+	if err != nil {
+		return err
+	}
+
+	// timing is only reported for multi-stage builds
+	logf := sylog.Debugf
+	if len(b.stages) > 1 {
+		logf = sylog.Infof
+	}
+
+	jobs := b.Conf.Jobs
+	if jobs <= 1 {
+		return b.runStagesInOrder(ctx, deps, run, logf)
+	}
+
+	ctx, cancel := context.WithCancel(ctx)
+	defer cancel()
+
+	var (
+		wg       sync.WaitGroup
+		errOnce  sync.Once
+		firstErr error
+	)
+
+	slots := make(chan struct{}, jobs)
+	done := make([]chan struct{}, len(b.stages))
+	for i := range done {
+		done[i] = make(chan struct{})
+	}
+
+	for i := range b.stages {
+		wg.Add(1)
+		go func(i int) {
+			defer wg.Done()
+
+			// a failed stage never closes its channel, the
+			// stages depending on it are canceled
+			for _, j := range deps[i] {
+				select {
+				case <-done[j]:
+				case <-ctx.Done():
+					return
+				}
+			}
+			select {
+			case slots <- struct{}{}:
+			case <-ctx.Done():
+				return
+			}
+			defer func() { <-slots }()
+			if ctx.Err() != nil {
+				return
+			}
+
+			if err := b.runStage(ctx, i, run, logf); err != nil {
+				errOnce.Do(func() {
+					firstErr = err
+					cancel()
+				})
+				return
+			}
+			close(done[i])
+		}(i)
+	}
+
+	wg.Wait()
+	if firstErr == nil && ctx.Err() != nil {
+		return ctx.Err()
+	}
+	return firstErr
+}
+
+// runStagesInOrder runs the stages one at a time in the definition order,
+// a stage copying files from a stage defined after it is delayed until that
+// stage is built. It stops at the first error.
+func (b *Build) runStagesInOrder(ctx context.Context, deps [][]int, run func(ctx context.Context, i int) error, logf func(string, ...interface{})) error {
+	built := make([]bool, len(b.stages))
+
+	var visit func(i int) error
+	visit = func(i int) error {
+		if built[i] {
+			return nil
+		}
+		for _, j := range deps[i] {
+			if err := visit(j); err != nil {
+				return err
+			}
+		}
+		if err := ctx.Err(); err != nil {
+			return err
+		}
+		if err := b.runStage(ctx, i, run, logf); err != nil {
+			return err
+		}
+		built[i] = true
+		return nil
+	}
+
+	for i := range b.stages {
+		if err := visit(i); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// runStage runs the stage i with run and reports its build time with logf.
+func (b *Build) runStage(ctx context.Context, i int, run func(ctx context.Context, i int) error, logf func(string, ...interface{})) error {
+	name := b.stages[i].name
+	if name == "" {
+		name = fmt.Sprintf("%d", i+1)
+	}
+	logf("Starting stage %s", name)
+	start := time.Now()
+
+	if err := run(ctx, i); err != nil {
+		return err
+	}
+
+	logf("Stage %s completed in %s", name, time.Since(start).Round(time.Millisecond))
+	return nil
+}
@@ -0,0 +1,173 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package build
+
+import (
+	"context"
+	"fmt"
+	"sync"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	"github.com/sylabs/singularity/pkg/build/types"
+)
+
+// newTestBuild returns a build whose stages copy files from the stages
+// listed in from.
+func newTestBuild(jobs int, from map[string][]string, names ...string) *Build {
+	b := &Build{Conf: Config{Jobs: jobs}}
+	for _, name := range names {
+		d := types.Definition{}
+		for _, f := range from[name] {
+			d.BuildData.Files = append(d.BuildData.Files, types.Files{Args: "from " + f})
+		}
+		// %files sections without from are ignored
+		d.BuildData.Files = append(d.BuildData.Files, types.Files{})
+		b.stages = append(b.stages, stage{name: name, b: &types.Bundle{Recipe: d}})
+	}
+	return b
+}
+
+func TestStageDeps(t *testing.T) {
+	tests := []struct {
+		name  string
+		from  map[string][]string
+		deps  [][]int
+		error bool
+	}{
+		{
+			name: "independent",
+			deps: [][]int{nil, nil, nil},
+		},
+		{
+			name: "fan in",
+			from: map[string][]string{"final": {"one", "two", "one"}},
+			deps: [][]int{nil, nil, {0, 1}},
+		},
+		{
+			name: "chain",
+			from: map[string][]string{"two": {"one"}, "final": {"two"}},
+			deps: [][]int{nil, {0}, {1}},
+		},
+		{
+			name:  "unknown stage",
+			from:  map[string][]string{"final": {"three"}},
+			error: true,
+		},
+		{
+			name:  "self",
+			from:  map[string][]string{"one": {"one"}},
+			error: true,
+		},
+		{
+			name:  "cycle",
+			from:  map[string][]string{"one": {"final"}, "final": {"two"}, "two": {"one"}},
+			error: true,
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			b := newTestBuild(0, tt.from, "one", "two", "final")
+			deps, err := b.stageDeps()
+			if tt.error {
+				if err == nil {
+					t.Fatalf("unexpected success")
+				}
+				return
+			}
+			if err != nil {
+				t.Fatalf("unexpected error: %s", err)
+			}
+			if fmt.Sprint(deps) != fmt.Sprint(tt.deps) {
+				t.Errorf("got dependencies %v instead of %v", deps, tt.deps)
+			}
+		})
+	}
+}
+
+func TestRunStages(t *testing.T) {
+	from := map[string][]string{"final": {"one", "two", "three"}}
+
+	for _, jobs := range []int{1, 2, 3} {
+		t.Run(fmt.Sprintf("%d jobs", jobs), func(t *testing.T) {
+			b := newTestBuild(jobs, from, "one", "two", "three", "final")
+
+			var (
+				mu              sync.Mutex
+				order           []int
+				running, maxRun int32
+			)
+			err := b.runStages(context.Background(), func(ctx context.Context, i int) error {
+				n := atomic.AddInt32(&running, 1)
+				defer atomic.AddInt32(&running, -1)
+				for {
+					m := atomic.LoadInt32(&maxRun)
+					if n <= m || atomic.CompareAndSwapInt32(&maxRun, m, n) {
+						break
+					}
+				}
+				time.Sleep(20 * time.Millisecond)
+
+				mu.Lock()
+				order = append(order, i)
+				mu.Unlock()
+				return nil
+			})
+			if err != nil {
+				t.Fatalf("unexpected error: %s", err)
+			}
+
+			if len(order) != 4 || order[3] != 3 {
+				t.Errorf("final stage not built last: %v", order)
+			}
+			if int(maxRun) != jobs {
+				t.Errorf("%d stages built concurrently instead of %d", maxRun, jobs)
+			}
+		})
+	}
+
+	// without jobs the stages are built one at a time in the definition
+	// order, after the stages they copy files from
+	for _, tt := range []struct {
+		from  map[string][]string
+		order []int
+	}{
+		{from: from, order: []int{0, 1, 2, 3}},
+		{from: map[string][]string{"one": {"three"}, "final": {"one"}}, order: []int{2, 0, 1, 3}},
+	} {
+		b := newTestBuild(0, tt.from, "one", "two", "three", "final")
+		var order []int
+		err := b.runStages(context.Background(), func(ctx context.Context, i int) error {
+			order = append(order, i)
+			return nil
+		})
+		if err != nil {
+			t.Fatalf("unexpected error: %s", err)
+		}
+		if fmt.Sprint(order) != fmt.Sprint(tt.order) {
+			t.Errorf("stages built in order %v instead of %v", order, tt.order)
+		}
+	}
+
+	// a failed stage cancels the stages depending on it
+	b := newTestBuild(1, from, "one", "two", "three", "final")
+	built := make([]bool, 4)
+	err := b.runStages(context.Background(), func(ctx context.Context, i int) error {
+		built[i] = true
+		if i == 1 {
+			return fmt.Errorf("stage failed")
+		}
+		return nil
+	})
+	if err == nil || err.Error() != "stage failed" {
+		t.Errorf("unexpected error: %v", err)
+	}
+	if built[3] {
+		t.Errorf("dependent stage built after a failure")
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -6,10 +6,14 @@
 package sources
 
 import (
+	"encoding/json"
 	"fmt"
+	"io/ioutil"
 	"os"
 	"path/filepath"
 
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/internal/pkg/util/env"
 	"github.com/sylabs/singularity/internal/pkg/util/fs"
 )
 
@@ -431,3 +435,58 @@ func makeBaseEnv(rootPath string) (err error) {
 
 	return
 }
+
+// builtinEnvScripts maps the content of the stock environment scripts
+// implemented by the runtime to their builtin name.
+var builtinEnvScripts = map[string]string{
+	appsShFileContent:              env.BuiltinApps,
+	base99ShFileContent:            env.BuiltinLibs,
+	base99runtimevarsShFileContent: env.BuiltinRuntimeVars,
+}
+
+// StaticEnvironment resolves the environment set by the environment
+// scripts of the root filesystem rootPath for the exec action and returns
+// its JSON representation stored in the image. It returns nil if the exec
+// action isn't the stock one or if an environment script contains shell
+// code other than variable assignments, exports and unsets, the exec
+// action then sources the environment scripts at runtime.
+func StaticEnvironment(rootPath string) ([]byte, error) {
+	s := &env.StaticEnv{
+		Files: make(map[string]string),
+	}
+
+	action, err := ioutil.ReadFile(filepath.Join(rootPath, env.ExecAction))
+	if err != nil {
+		return nil, fmt.Errorf("while reading exec action: %s", err)
+	}
+	if string(action) != execFileContent {
+		sylog.Debugf("Not resolving static environment: exec action modified")
+		return nil, nil
+	}
+	s.Files[env.ExecAction] = env.FileDigest(action)
+
+	scripts, err := env.EnvScripts(rootPath)
+	if err != nil {
+		return nil, fmt.Errorf("while listing environment scripts: %s", err)
+	}
+	for _, path := range scripts {
+		content, err := ioutil.ReadFile(filepath.Join(rootPath, path))
+		if err != nil {
+			return nil, fmt.Errorf("while reading %s: %s", path, err)
+		}
+		s.Files[path] = env.FileDigest(content)
+
+		if name, ok := builtinEnvScripts[string(content)]; ok {
+			s.Ops = append(s.Ops, env.StaticOp{Op: env.OpBuiltin, Name: name})
+			continue
+		}
+		ops, err := env.ParseEnvScript(content)
+		if err != nil {
+			sylog.Debugf("Not resolving static environment: %s: %s", path, err)
+			return nil, nil
+		}
+		s.Ops = append(s.Ops, ops...)
+	}
+
+	return json.Marshal(s)
+}
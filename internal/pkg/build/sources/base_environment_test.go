@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -6,12 +6,15 @@
 package sources
 
 import (
+	"encoding/json"
 	"io/ioutil"
 	"os"
 	"path/filepath"
+	"reflect"
 	"testing"
 
 	"github.com/sylabs/singularity/internal/pkg/test"
+	"github.com/sylabs/singularity/internal/pkg/util/env"
 	"github.com/sylabs/singularity/internal/pkg/util/fs"
 )
 
@@ -81,3 +84,53 @@ func TestMakeBaseEnv(t *testing.T) {
 	testWithGoodDir(t, makeBaseEnv)
 	testWithBadDir(t, makeBaseEnv)
 }
+
+func TestStaticEnvironment(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	testWithGoodDir(t, func(d string) error {
+		if err := makeBaseEnv(d); err != nil {
+			return err
+		}
+		envScript := filepath.Join(d, env.EnvScriptsDir, "90-environment.sh")
+		if err := ioutil.WriteFile(envScript, []byte("#!/bin/sh\nexport FOO=bar\n"), 0755); err != nil {
+			return err
+		}
+
+		b, err := StaticEnvironment(d)
+		if err != nil {
+			return err
+		}
+		var s env.StaticEnv
+		if err := json.Unmarshal(b, &s); err != nil {
+			t.Fatalf("while decoding static environment: %s", err)
+		}
+		if err := s.Check(d); err != nil {
+			t.Errorf("unexpected error: %s", err)
+		}
+		expected := []env.StaticOp{
+			{Op: env.OpSet, Name: "FOO", Value: env.Word{{Literal: "bar"}}},
+			{Op: env.OpExport, Name: "FOO"},
+			{Op: env.OpBuiltin, Name: env.BuiltinApps},
+			{Op: env.OpBuiltin, Name: env.BuiltinLibs},
+			{Op: env.OpBuiltin, Name: env.BuiltinRuntimeVars},
+		}
+		if !reflect.DeepEqual(s.Ops, expected) {
+			t.Errorf("unexpected operations %+v", s.Ops)
+		}
+
+		// shell code other than assignments falls back to the exec action
+		if err := ioutil.WriteFile(envScript, []byte("#!/bin/sh\nexport FOO=$(id -u)\n"), 0755); err != nil {
+			return err
+		}
+		if b, err := StaticEnvironment(d); err != nil || b != nil {
+			t.Errorf("unexpected static environment %s (%v) with shell code", b, err)
+		}
+		return nil
+	})
+	testWithBadDir(t, func(d string) error {
+		_, err := StaticEnvironment(d)
+		return err
+	})
+}
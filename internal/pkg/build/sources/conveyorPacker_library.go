@@ -12,6 +12,7 @@ import (
 	"runtime"
 
 	"github.com/sylabs/scs-library-client/client"
+	"github.com/sylabs/singularity/internal/pkg/client/cache"
 	"github.com/sylabs/singularity/internal/pkg/library"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
 	"github.com/sylabs/singularity/internal/pkg/util/uri"
@@ -83,26 +84,30 @@ func (cp *LibraryConveyorPacker) Get(ctx context.Context, b *types.Bundle) (err
 
 		sylog.Infof("Downloading library image to tmp cache: %s", imagePath)
 
-		if err = library.DownloadImageNoProgress(ctx, libraryClient, imagePath, runtime.GOARCH, imageRef); err != nil {
+		if _, err = library.DownloadImageNoProgress(ctx, libraryClient, imagePath, runtime.GOARCH, imageRef); err != nil {
 			return fmt.Errorf("unable to download image: %v", err)
 		}
 	} else {
 		imagePath = b.Opts.ImgCache.LibraryImage(libraryImage.Hash, imageName)
 
+		unlock, err := b.Opts.ImgCache.LockEntry(imagePath)
+		if err != nil {
+			return fmt.Errorf("unable to lock cache entry %s: %s", imagePath, err)
+		}
+		defer unlock()
+
 		if exists, err := b.Opts.ImgCache.LibraryImageExists(libraryImage.Hash, imageName); err != nil {
 			return fmt.Errorf("unable to check if %v exists: %v", imagePath, err)
 		} else if !exists {
 			sylog.Infof("Downloading library image")
 
-			if err := library.DownloadImageNoProgress(ctx, libraryClient, imagePath, runtime.GOARCH, imageRef); err != nil {
+			// the image is hashed while downloaded
+			if cacheFileHash, err := library.DownloadImageNoProgress(ctx, libraryClient, imagePath, runtime.GOARCH, imageRef); err != nil {
 				return fmt.Errorf("unable to download image: %v", err)
-			}
-
-			if cacheFileHash, err := client.ImageHash(imagePath); err != nil {
-				return fmt.Errorf("error getting image hash: %v", err)
 			} else if cacheFileHash != libraryImage.Hash {
 				return fmt.Errorf("cached file hash(%s) and expected Hash(%s) does not match", cacheFileHash, libraryImage.Hash)
 			}
+			cache.SetImageDigest(imagePath, libraryImage.Hash)
 		}
 	}
 
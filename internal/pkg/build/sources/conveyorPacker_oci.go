@@ -287,12 +287,32 @@ func (cp *OCIConveyorPacker) extractArchive(src string, dst string) error {
 }
 
 func (cp *OCIConveyorPacker) unpackTmpfs(ctx context.Context) error {
+	if cp.b.Opts.StreamRootfs {
+		return streamRootfs(ctx, cp.b, cp.tmpfsRef, cp.sysCtx)
+	}
 	return unpackRootfs(ctx, cp.b, cp.tmpfsRef, cp.sysCtx)
 }
 
 func (cp *OCIConveyorPacker) insertBaseEnv() (err error) {
 	if err = makeBaseEnv(cp.b.RootfsPath); err != nil {
 		sylog.Errorf("%v", err)
+		return
+	}
+
+	// the compatibility symlinks are only created if missing from the
+	// image, which is not on disk when streamed
+	if cp.b.RootfsTree != nil {
+		entries, err := ioutil.ReadDir(cp.b.RootfsPath)
+		if err != nil {
+			return err
+		}
+		for _, fi := range entries {
+			if fi.Mode()&os.ModeSymlink != 0 && cp.b.RootfsTree.Get(fi.Name()) != nil {
+				if err := os.Remove(filepath.Join(cp.b.RootfsPath, fi.Name())); err != nil {
+					return err
+				}
+			}
+		}
 	}
 	return
 }
@@ -9,6 +9,7 @@ import (
 	"context"
 	"fmt"
 
+	"github.com/sylabs/singularity/internal/pkg/client/cache"
 	"github.com/sylabs/singularity/internal/pkg/oras"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
 	"github.com/sylabs/singularity/internal/pkg/util/uri"
@@ -37,6 +38,12 @@ func (cp *OrasConveyorPacker) Get(ctx context.Context, b *types.Bundle) (err err
 
 	imageName := uri.GetName(fullRef)
 	cacheImagePath := b.Opts.ImgCache.OrasImage(sum, imageName)
+	unlock, err := b.Opts.ImgCache.LockEntry(cacheImagePath)
+	if err != nil {
+		return fmt.Errorf("unable to lock cache entry %s: %s", cacheImagePath, err)
+	}
+	defer unlock()
+
 	if exists, err := b.Opts.ImgCache.OrasImageExists(sum, imageName); err != nil {
 		return fmt.Errorf("unable to check if %v exists: %v", cacheImagePath, err)
 	} else if !exists {
@@ -51,6 +58,7 @@ func (cp *OrasConveyorPacker) Get(ctx context.Context, b *types.Bundle) (err err
 		} else if cacheFileHash != sum {
 			return fmt.Errorf("cached file hash(%s) and expected hash(%s) does not match", cacheFileHash, sum)
 		}
+		cache.SetImageDigest(cacheImagePath, sum)
 	}
 
 	// insert base metadata before unpacking fs
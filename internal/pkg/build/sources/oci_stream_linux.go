@@ -0,0 +1,208 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package sources
+
+import (
+	"archive/tar"
+	"context"
+	"errors"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"os"
+	"path"
+	"runtime"
+	"strings"
+
+	"github.com/containers/image/types"
+	"github.com/openSUSE/umoci"
+	imgspecv1 "github.com/opencontainers/image-spec/specs-go/v1"
+	"github.com/sylabs/singularity/internal/pkg/client/cache"
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	sytypes "github.com/sylabs/singularity/pkg/build/types"
+	"github.com/sylabs/singularity/pkg/util/fs/squashfs"
+	"golang.org/x/sys/unix"
+)
+
+const (
+	whiteoutPrefix = ".wh."
+	whiteoutOpaque = whiteoutPrefix + whiteoutPrefix + ".opq"
+)
+
+// errNotStreamable is returned when the layers can't be merged in memory.
+var errNotStreamable = errors.New("layers can't be merged in memory")
+
+// streamRootfs merges the layers of the given image reference into the
+// in-memory root filesystem of the bundle, written directly into the SIF
+// image by the assembler. Regular files are not extracted, their content
+// is read from the uncompressed layers when the image is created. The
+// rootfs directory of the bundle is created empty to receive the files
+// added by the build. Images of another architecture, inspected on disk
+// by the assembler, and layers with sparse files are extracted as usual.
+func streamRootfs(ctx context.Context, b *sytypes.Bundle, tmpfsRef types.ImageReference, sysCtx *types.SystemContext) error {
+	engineExt, err := umoci.OpenLayout(b.TmpDir)
+	if err != nil {
+		return fmt.Errorf("error opening layout: %s", err)
+	}
+	manifest, err := imageManifest(ctx, tmpfsRef, sysCtx)
+	if err != nil {
+		return err
+	}
+	config, err := imageConfig(ctx, engineExt, manifest)
+	if err != nil {
+		return err
+	}
+	if config.Architecture != "" && config.Architecture != runtime.GOARCH {
+		sylog.Debugf("Extracting %s image root filesystem", config.Architecture)
+		return unpackRootfs(ctx, b, tmpfsRef, sysCtx)
+	}
+
+	var imgCache *cache.Handle
+	if !b.Opts.NoCache && b.Opts.ImgCache != nil && !b.Opts.ImgCache.IsDisabled() {
+		imgCache = b.Opts.ImgCache
+	}
+
+	// the uncompressed layers stay open until the image is created
+	tree := squashfs.NewTree()
+	err = decompressLayers(ctx, engineExt, manifest, config, imgCache, b.TmpDir, func(desc imgspecv1.Descriptor, f *os.File) error {
+		tree.AddCloser(f)
+		sylog.Debugf("Merging layer %s", desc.Digest)
+		if err := mergeLayer(tree, f); err != nil {
+			return fmt.Errorf("while merging layer %s: %w", desc.Digest, err)
+		}
+		return nil
+	})
+	if errors.Is(err, errNotStreamable) {
+		tree.Close()
+		sylog.Debugf("Extracting root filesystem: %s", err)
+		return unpackRootfs(ctx, b, tmpfsRef, sysCtx)
+	} else if err != nil {
+		tree.Close()
+		return fmt.Errorf("error merging rootfs: %s", err)
+	}
+
+	if b.Opts.FixPerms {
+		sylog.Warningf("The --fix-perms option modifies the filesystem permissions on the resulting container.")
+		sylog.Debugf("Modifying permissions for file/directory owners")
+		tree.Walk(func(name string, f *squashfs.File) error {
+			if f.Mode.IsDir() {
+				f.Mode |= 0700
+			} else if f.Mode.IsRegular() {
+				f.Mode |= 0600
+			}
+			return nil
+		})
+	}
+
+	os.RemoveAll(b.RootfsPath)
+	if err := os.Mkdir(b.RootfsPath, 0755); err != nil {
+		tree.Close()
+		return fmt.Errorf("error creating rootfs: %s", err)
+	}
+	b.RootfsTree = tree
+	return nil
+}
+
+// mergeLayer applies the uncompressed layer f to tree. Whiteouts only
+// remove the entries of the previous layers, the opaque whiteout of a
+// directory removes its entries not added by this layer.
+func mergeLayer(tree *squashfs.Tree, f *os.File) error {
+	added := make(map[*squashfs.File]bool)
+	// the parent directories of an added entry are kept by an opaque
+	// whiteout, only their other entries are removed
+	markAdded := func(name string) {
+		for ; name != "/"; name = path.Dir(name) {
+			added[tree.Get(name)] = true
+		}
+	}
+
+	tr := tar.NewReader(f)
+	for {
+		hdr, err := tr.Next()
+		if err == io.EOF {
+			return nil
+		} else if err != nil {
+			return err
+		}
+
+		name := path.Clean("/" + hdr.Name)
+		dir, base := path.Split(name)
+		if strings.HasPrefix(base, whiteoutPrefix) {
+			if base == whiteoutOpaque {
+				pruneOpaque(tree, dir, added)
+			} else if name = path.Join(dir, base[len(whiteoutPrefix):]); !added[tree.Get(name)] {
+				tree.Remove(name)
+			}
+			continue
+		}
+
+		file := &squashfs.File{
+			Mode:  hdr.FileInfo().Mode(),
+			UID:   uint32(hdr.Uid),
+			GID:   uint32(hdr.Gid),
+			Mtime: hdr.ModTime,
+		}
+		for k, v := range hdr.PAXRecords {
+			if strings.HasPrefix(k, "GNU.sparse.") {
+				return fmt.Errorf("%s is a sparse file: %w", name, errNotStreamable)
+			}
+			if strings.HasPrefix(k, "SCHILY.xattr.") {
+				if file.Xattrs == nil {
+					file.Xattrs = make(map[string][]byte)
+				}
+				file.Xattrs[strings.TrimPrefix(k, "SCHILY.xattr.")] = []byte(v)
+			}
+		}
+
+		switch hdr.Typeflag {
+		case tar.TypeLink:
+			if err := tree.Link(name, path.Clean("/"+hdr.Linkname)); err != nil {
+				return err
+			}
+			markAdded(name)
+			continue
+		case tar.TypeReg, tar.TypeRegA:
+			// the reader doesn't buffer, the file position is at the
+			// start of the entry content
+			offset, err := f.Seek(0, io.SeekCurrent)
+			if err != nil {
+				return err
+			}
+			size := hdr.Size
+			file.Size = size
+			file.Open = func() (io.ReadCloser, error) {
+				return ioutil.NopCloser(io.NewSectionReader(f, offset, size)), nil
+			}
+		case tar.TypeSymlink:
+			file.Target = hdr.Linkname
+		case tar.TypeChar, tar.TypeBlock:
+			file.Rdev = unix.Mkdev(uint32(hdr.Devmajor), uint32(hdr.Devminor))
+		case tar.TypeDir, tar.TypeFifo:
+		case tar.TypeGNUSparse:
+			return fmt.Errorf("%s is a sparse file: %w", name, errNotStreamable)
+		default:
+			sylog.Debugf("Ignoring %s of unsupported type %c", name, hdr.Typeflag)
+			continue
+		}
+
+		if err := tree.Put(name, file); err != nil {
+			return err
+		}
+		markAdded(name)
+	}
+}
+
+// pruneOpaque removes the entries of dir not added by the current layer.
+func pruneOpaque(tree *squashfs.Tree, dir string, added map[*squashfs.File]bool) {
+	for _, name := range tree.ReadDir(dir) {
+		p := path.Join(dir, name)
+		if f := tree.Get(p); !added[f] {
+			tree.Remove(p)
+		} else if f.Mode.IsDir() {
+			pruneOpaque(tree, p, added)
+		}
+	}
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package sources
+
+import (
+	"archive/tar"
+	"io"
+	"io/ioutil"
+	"os"
+	"testing"
+
+	"github.com/sylabs/singularity/pkg/util/fs/squashfs"
+)
+
+// createLayer returns an uncompressed layer with entries, the content of
+// regular files is their name.
+func createLayer(t *testing.T, entries []tar.Header) *os.File {
+	f, err := ioutil.TempFile("", "layer-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	os.Remove(f.Name())
+
+	tw := tar.NewWriter(f)
+	for _, hdr := range entries {
+		hdr := hdr
+		hdr.Mode = 0644
+		if hdr.Typeflag == tar.TypeReg {
+			hdr.Size = int64(len(hdr.Name))
+		}
+		if err := tw.WriteHeader(&hdr); err != nil {
+			t.Fatal(err)
+		}
+		if hdr.Typeflag == tar.TypeReg {
+			io.WriteString(tw, hdr.Name)
+		}
+	}
+	if err := tw.Close(); err != nil {
+		t.Fatal(err)
+	}
+	if _, err := f.Seek(0, io.SeekStart); err != nil {
+		t.Fatal(err)
+	}
+	return f
+}
+
+func TestMergeLayer(t *testing.T) {
+	layers := [][]tar.Header{
+		{
+			{Name: "./", Typeflag: tar.TypeDir},
+			{Name: "a/", Typeflag: tar.TypeDir},
+			{Name: "a/x", Typeflag: tar.TypeReg},
+			{Name: "a/y", Typeflag: tar.TypeReg},
+			{Name: "b/z", Typeflag: tar.TypeReg},
+			{Name: "b/link", Typeflag: tar.TypeLink, Linkname: "b/z"},
+			{Name: "c/d/e", Typeflag: tar.TypeReg},
+			{Name: "dev/null", Typeflag: tar.TypeChar, Devmajor: 1, Devminor: 3},
+		},
+		{
+			{Name: "a/.wh..wh..opq", Typeflag: tar.TypeReg},
+			{Name: "a/y", Typeflag: tar.TypeReg},
+			{Name: "b/.wh.z", Typeflag: tar.TypeReg},
+			// the opaque whiteout keeps the entries of this layer
+			{Name: "c/d/f", Typeflag: tar.TypeReg},
+			{Name: "c/.wh..wh..opq", Typeflag: tar.TypeReg},
+			// a whiteout doesn't remove the entries of its own layer
+			{Name: "s", Typeflag: tar.TypeSymlink, Linkname: "a"},
+			{Name: ".wh.s", Typeflag: tar.TypeReg},
+		},
+	}
+
+	tree := squashfs.NewTree()
+	for _, entries := range layers {
+		f := createLayer(t, entries)
+		defer f.Close()
+		if err := mergeLayer(tree, f); err != nil {
+			t.Fatalf("unexpected error: %s", err)
+		}
+	}
+
+	tests := []struct {
+		name    string
+		content string
+		exists  bool
+	}{
+		{name: "a/x"},
+		{name: "a/y", content: "a/y", exists: true},
+		{name: "b/z"},
+		{name: "b/link", content: "b/z", exists: true},
+		{name: "c/d/e"},
+		{name: "c/d/f", content: "c/d/f", exists: true},
+		{name: "dev/null", exists: true},
+		{name: "s", exists: true},
+	}
+	for _, tt := range tests {
+		f := tree.Get(tt.name)
+		if (f != nil) != tt.exists {
+			t.Errorf("%s: unexpected existence %v", tt.name, f != nil)
+			continue
+		}
+		if f == nil || f.Open == nil {
+			continue
+		}
+		r, err := f.Open()
+		if err != nil {
+			t.Fatalf("unexpected error: %s", err)
+		}
+		b, _ := ioutil.ReadAll(r)
+		r.Close()
+		if string(b) != tt.content {
+			t.Errorf("%s: content %q instead of %q", tt.name, b, tt.content)
+		}
+	}
+	if f := tree.Get("dev/null"); f.Mode&os.ModeCharDevice == 0 || f.Rdev == 0 {
+		t.Errorf("character device not merged")
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -23,3 +23,9 @@ func unpackRootfs(ctx context.Context, b *sytypes.Bundle, _ types.ImageReference
 	err = imagetools.UnpackLayout(b.TmpDir, b.RootfsPath, "amd64", refs)
 	return err
 }
+
+// streamRootfs extracts the root filesystem, layers are only merged in
+// memory on Linux.
+func streamRootfs(ctx context.Context, b *sytypes.Bundle, ref types.ImageReference, sysCtx *types.SystemContext) error {
+	return unpackRootfs(ctx, b, ref, sysCtx)
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -10,17 +10,26 @@
 package sources
 
 import (
+	"compress/gzip"
 	"context"
 	"encoding/json"
 	"errors"
 	"fmt"
+	"io"
+	"io/ioutil"
 	"os"
+	"path/filepath"
+	"runtime"
+	"time"
 
 	"github.com/containers/image/types"
 	"github.com/openSUSE/umoci"
+	"github.com/openSUSE/umoci/oci/casext"
 	umocilayer "github.com/openSUSE/umoci/oci/layer"
 	"github.com/openSUSE/umoci/pkg/idtools"
+	digest "github.com/opencontainers/go-digest"
 	imgspecv1 "github.com/opencontainers/image-spec/specs-go/v1"
+	"github.com/sylabs/singularity/internal/pkg/client/cache"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
 	"github.com/sylabs/singularity/internal/pkg/util/fs"
 	sytypes "github.com/sylabs/singularity/pkg/build/types"
@@ -52,26 +61,21 @@ func unpackRootfs(ctx context.Context, b *sytypes.Bundle, tmpfsRef types.ImageRe
 		return fmt.Errorf("error opening layout: %s", err)
 	}
 
-	// Obtain the manifest
-	imageSource, err := tmpfsRef.NewImageSource(ctx, sysCtx)
-	if err != nil {
-		return fmt.Errorf("error creating image source: %s", err)
-	}
-	manifestData, mediaType, err := imageSource.GetManifest(ctx, nil)
+	manifest, err := imageManifest(ctx, tmpfsRef, sysCtx)
 	if err != nil {
-		return fmt.Errorf("error obtaining manifest source: %s", err)
+		return err
 	}
-	if mediaType != imgspecv1.MediaTypeImageManifest {
-		return fmt.Errorf("error verifying manifest media type: %s", mediaType)
-	}
-	var manifest imgspecv1.Manifest
-	json.Unmarshal(manifestData, &manifest)
 
-	// UnpackRootfs from umoci v0.4.2 expects a path to a non-existing directory
+	// Start from an empty root filesystem
 	os.RemoveAll(b.RootfsPath)
 
+	var imgCache *cache.Handle
+	if !b.Opts.NoCache && b.Opts.ImgCache != nil && !b.Opts.ImgCache.IsDisabled() {
+		imgCache = b.Opts.ImgCache
+	}
+
 	// Unpack root filesystem
-	err = umocilayer.UnpackRootfs(ctx, engineExt, b.RootfsPath, manifest, &mapOptions)
+	err = unpackLayers(ctx, engineExt, b.RootfsPath, manifest, &mapOptions, imgCache, b.TmpDir)
 	if err != nil {
 		return fmt.Errorf("error unpacking rootfs: %s", err)
 	}
@@ -97,6 +101,280 @@ func unpackRootfs(ctx context.Context, b *sytypes.Bundle, tmpfsRef types.ImageRe
 
 }
 
+// imageManifest returns the manifest of the image copied in the OCI layout.
+func imageManifest(ctx context.Context, tmpfsRef types.ImageReference, sysCtx *types.SystemContext) (imgspecv1.Manifest, error) {
+	var manifest imgspecv1.Manifest
+
+	imageSource, err := tmpfsRef.NewImageSource(ctx, sysCtx)
+	if err != nil {
+		return manifest, fmt.Errorf("error creating image source: %s", err)
+	}
+	defer imageSource.Close()
+
+	manifestData, mediaType, err := imageSource.GetManifest(ctx, nil)
+	if err != nil {
+		return manifest, fmt.Errorf("error obtaining manifest source: %s", err)
+	}
+	if mediaType != imgspecv1.MediaTypeImageManifest {
+		return manifest, fmt.Errorf("error verifying manifest media type: %s", mediaType)
+	}
+	if err := json.Unmarshal(manifestData, &manifest); err != nil {
+		return manifest, fmt.Errorf("error decoding manifest: %s", err)
+	}
+	return manifest, nil
+}
+
+// uncompressedLayer is a layer decompressed in the background, file is set
+// once ready is closed if err is nil.
+type uncompressedLayer struct {
+	ready chan struct{}
+	file  *os.File
+	err   error
+}
+
+// unpackLayers extracts the layers of manifest into rootfs. The layers are
+// decompressed concurrently by decompressLayers while they are applied in
+// order, since later layers may replace or remove the content of earlier
+// ones.
+func unpackLayers(ctx context.Context, engineExt casext.Engine, rootfs string, manifest imgspecv1.Manifest, opt *umocilayer.MapOptions, imgCache *cache.Handle, tmpDir string) error {
+	config, err := imageConfig(ctx, engineExt, manifest)
+	if err != nil {
+		return err
+	}
+
+	if err := prepareRootfs(rootfs, opt); err != nil {
+		return err
+	}
+
+	return decompressLayers(ctx, engineExt, manifest, config, imgCache, tmpDir, func(desc imgspecv1.Descriptor, f *os.File) error {
+		sylog.Debugf("Applying layer %s", desc.Digest)
+		// release the temporary file as soon as possible
+		defer f.Close()
+		if err := umocilayer.UnpackLayer(rootfs, f, opt); err != nil {
+			return fmt.Errorf("while applying layer %s: %s", desc.Digest, err)
+		}
+		return nil
+	})
+}
+
+// imageConfig returns the config of the image of manifest, it provides the
+// digests of the uncompressed layers.
+func imageConfig(ctx context.Context, engineExt casext.Engine, manifest imgspecv1.Manifest) (imgspecv1.Image, error) {
+	configBlob, err := engineExt.FromDescriptor(ctx, manifest.Config)
+	if err != nil {
+		return imgspecv1.Image{}, fmt.Errorf("error obtaining image config: %s", err)
+	}
+	defer configBlob.Close()
+	config, ok := configBlob.Data.(imgspecv1.Image)
+	if !ok {
+		return imgspecv1.Image{}, fmt.Errorf("unexpected image config type %T", configBlob.Data)
+	}
+	if len(config.RootFS.DiffIDs) != len(manifest.Layers) {
+		return imgspecv1.Image{}, fmt.Errorf("image config has %d diffIDs for %d layers", len(config.RootFS.DiffIDs), len(manifest.Layers))
+	}
+	return config, nil
+}
+
+// decompressLayers calls apply in order with the uncompressed tar archive
+// of each layer of manifest, apply is responsible for closing it. The
+// layers are decompressed concurrently, one per CPU at most, and each one
+// is applied as soon as the previous ones are. The uncompressed layers are
+// kept in imgCache if not nil, so that the layers shared between images
+// are only decompressed once, else in unlinked temporary files in tmpDir.
+func decompressLayers(ctx context.Context, engineExt casext.Engine, manifest imgspecv1.Manifest, config imgspecv1.Image, imgCache *cache.Handle, tmpDir string, apply func(imgspecv1.Descriptor, *os.File) error) error {
+	ctx, cancel := context.WithCancel(ctx)
+	layers := make([]*uncompressedLayer, len(manifest.Layers))
+	for i := range layers {
+		layers[i] = &uncompressedLayer{ready: make(chan struct{})}
+	}
+	defer func() {
+		// close the layers decompressed after a failure
+		cancel()
+		for _, l := range layers {
+			<-l.ready
+			if l.file != nil {
+				l.file.Close()
+			}
+		}
+	}()
+
+	// layers are started in order so that the first ones to apply
+	// are the first ones ready
+	go func() {
+		slots := make(chan struct{}, runtime.NumCPU())
+		for i, l := range layers {
+			select {
+			case slots <- struct{}{}:
+			case <-ctx.Done():
+				for _, l := range layers[i:] {
+					l.err = ctx.Err()
+					close(l.ready)
+				}
+				return
+			}
+			go func(i int, l *uncompressedLayer) {
+				defer func() { <-slots }()
+				defer close(l.ready)
+				l.file, l.err = openLayer(ctx, engineExt, manifest.Layers[i], config.RootFS.DiffIDs[i], imgCache, tmpDir)
+			}(i, l)
+		}
+	}()
+
+	for i, l := range layers {
+		desc := manifest.Layers[i]
+		<-l.ready
+		if l.err != nil {
+			return fmt.Errorf("while decompressing layer %s: %s", desc.Digest, l.err)
+		}
+
+		f := l.file
+		l.file = nil
+		if err := apply(desc, f); err != nil {
+			return err
+		}
+	}
+
+	return nil
+}
+
+// prepareRootfs creates the rootfs directory owned by the container root
+// user, with a fixed modification time as images usually don't provide one
+// for the root directory.
+func prepareRootfs(rootfs string, opt *umocilayer.MapOptions) error {
+	if err := os.Mkdir(rootfs, 0755); err != nil && !os.IsExist(err) {
+		return fmt.Errorf("error creating rootfs: %s", err)
+	}
+
+	rootUID, err := idtools.ToHost(0, opt.UIDMappings)
+	if err != nil {
+		return fmt.Errorf("error mapping root uid: %s", err)
+	}
+	rootGID, err := idtools.ToHost(0, opt.GIDMappings)
+	if err != nil {
+		return fmt.Errorf("error mapping root gid: %s", err)
+	}
+	if err := os.Lchown(rootfs, rootUID, rootGID); err != nil {
+		return fmt.Errorf("error changing rootfs owner: %s", err)
+	}
+
+	epoch := time.Unix(0, 0)
+	if err := os.Chtimes(rootfs, epoch, epoch); err != nil {
+		return fmt.Errorf("error setting rootfs time: %s", err)
+	}
+	return nil
+}
+
+// openLayer returns the uncompressed tar archive of the layer desc, from
+// the layer cache if imgCache is not nil.
+func openLayer(ctx context.Context, engineExt casext.Engine, desc imgspecv1.Descriptor, diffID digest.Digest, imgCache *cache.Handle, tmpDir string) (*os.File, error) {
+	if imgCache == nil {
+		f, err := ioutil.TempFile(tmpDir, "layer-")
+		if err != nil {
+			return nil, err
+		}
+		// the file is released once closed
+		os.Remove(f.Name())
+
+		if err := decompressLayer(ctx, engineExt, desc, diffID, f); err != nil {
+			f.Close()
+			return nil, err
+		}
+		if _, err := f.Seek(0, io.SeekStart); err != nil {
+			f.Close()
+			return nil, err
+		}
+		return f, nil
+	}
+
+	sum := diffID.Hex()
+	path := imgCache.OciLayerTar(sum)
+	if path == "" {
+		return nil, fmt.Errorf("could not create cache directory for layer %s", diffID)
+	}
+
+	// concurrent builds wait for the first one to decompress the layer,
+	// the layer is opened before the lock is released so that it can't
+	// be evicted in between
+	unlock, err := imgCache.LockEntry(path)
+	if err != nil {
+		return nil, err
+	}
+	defer unlock()
+
+	exists, err := imgCache.OciLayerExists(sum)
+	if err == cache.ErrBadChecksum {
+		sylog.Warningf("Cached layer %s is corrupted, decompressing it again", diffID)
+	} else if err != nil {
+		return nil, fmt.Errorf("unable to check if layer %s exists: %s", diffID, err)
+	}
+	if exists {
+		sylog.Debugf("Using cached layer %s", diffID)
+		return os.Open(path)
+	}
+
+	// decompress in a hidden temporary file renamed once verified
+	f, err := ioutil.TempFile(filepath.Dir(path), "."+filepath.Base(path)+".")
+	if err != nil {
+		return nil, err
+	}
+	err = decompressLayer(ctx, engineExt, desc, diffID, f)
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Rename(f.Name(), path)
+	}
+	if err != nil {
+		os.Remove(f.Name())
+		return nil, err
+	}
+	cache.SetImageDigest(path, sum)
+
+	return os.Open(path)
+}
+
+// decompressLayer writes the uncompressed content of the layer desc to w and
+// checks that its digest is diffID.
+func decompressLayer(ctx context.Context, engineExt casext.Engine, desc imgspecv1.Descriptor, diffID digest.Digest, w io.Writer) error {
+	if err := diffID.Validate(); err != nil {
+		return fmt.Errorf("invalid layer diffID %s: %s", diffID, err)
+	}
+
+	blob, err := engineExt.FromDescriptor(ctx, desc)
+	if err != nil {
+		return err
+	}
+	defer blob.Close()
+
+	rc, ok := blob.Data.(io.ReadCloser)
+	if !ok {
+		return fmt.Errorf("unexpected layer data type %T", blob.Data)
+	}
+
+	var r io.Reader = rc
+	switch desc.MediaType {
+	case imgspecv1.MediaTypeImageLayerGzip, imgspecv1.MediaTypeImageLayerNonDistributableGzip:
+		zr, err := gzip.NewReader(rc)
+		if err != nil {
+			return err
+		}
+		defer zr.Close()
+		r = zr
+	case imgspecv1.MediaTypeImageLayer, imgspecv1.MediaTypeImageLayerNonDistributable:
+	default:
+		return fmt.Errorf("unsupported layer media type %s", desc.MediaType)
+	}
+
+	digester := diffID.Algorithm().Digester()
+	if _, err := io.Copy(io.MultiWriter(w, digester.Hash()), r); err != nil {
+		return err
+	}
+	if d := digester.Digest(); d != diffID {
+		return fmt.Errorf("layer diffID mismatch: %s instead of %s", d, diffID)
+	}
+	return nil
+}
+
 // fixPerms will work through the rootfs of this bundle, making sure that all
 // files and directories have permissions set such that the owner can read,
 // modify, delete. This brings us to the situation of <=3.4
@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -8,18 +8,23 @@ package cgroups
 import (
 	"encoding/json"
 	"fmt"
+	"os"
 	"path/filepath"
 	"strings"
+	"syscall"
 
 	"github.com/containerd/cgroups"
 	specs "github.com/opencontainers/runtime-spec/specs-go"
 )
 
-// Manager manage container cgroup resources restriction
+// Manager manage container cgroup resources restriction, with the
+// containerd library for cgroup v1 or natively when the host uses the
+// cgroup v2 unified hierarchy
 type Manager struct {
-	Path   string
-	Pid    int
-	cgroup cgroups.Cgroup
+	Path    string
+	Pid     int
+	cgroup  cgroups.Cgroup
+	unified *unified
 }
 
 func readSpecFromFile(path string) (spec specs.LinuxResources, err error) {
@@ -43,6 +48,9 @@ func readSpecFromFile(path string) (spec specs.LinuxResources, err error) {
 
 // GetCgroupRootPath returns cgroup root path
 func (m *Manager) GetCgroupRootPath() string {
+	if m.unified != nil {
+		return unifiedMountPoint
+	}
 	if m.cgroup == nil {
 		return ""
 	}
@@ -75,6 +83,23 @@ func (m *Manager) ApplyFromSpec(spec *specs.LinuxResources) (err error) {
 		s = &specs.LinuxResources{}
 	}
 
+	if IsUnified() {
+		m.unified = newUnified(m.Path)
+		if err := m.unified.create(s); err != nil {
+			return err
+		}
+		if err := m.unified.update(s); err != nil {
+			m.unified.remove()
+			return err
+		}
+		// a process created directly into the cgroup doesn't need
+		// to be moved
+		if m.Pid > 0 {
+			return m.unified.addProcess(m.Pid)
+		}
+		return nil
+	}
+
 	// creates cgroup
 	m.cgroup, err = cgroups.New(cgroups.V1, path, s)
 	if err != nil {
@@ -102,17 +127,40 @@ func (m *Manager) loadFromPid() (err error) {
 	if m.Pid == 0 {
 		return fmt.Errorf("no process ID specified")
 	}
+	if IsUnified() {
+		path, err := unifiedPidPath(m.Pid)
+		if err != nil {
+			return err
+		}
+		m.Path = path
+		m.unified = newUnified(path)
+		return nil
+	}
 	path := cgroups.PidPath(m.Pid)
 	m.cgroup, err = cgroups.Load(cgroups.V1, path)
 	return
 }
 
+// load loads the managed cgroup if not already done, from its path with
+// cgroup v2 or from the process ID.
+func (m *Manager) load() error {
+	if m.cgroup != nil || m.unified != nil {
+		return nil
+	}
+	if m.Path != "" && IsUnified() {
+		m.unified = newUnified(m.Path)
+		return nil
+	}
+	return m.loadFromPid()
+}
+
 // UpdateFromSpec updates cgroups resources restriction from OCI specification
 func (m *Manager) UpdateFromSpec(spec *specs.LinuxResources) (err error) {
-	if m.cgroup == nil {
-		if err = m.loadFromPid(); err != nil {
-			return
-		}
+	if err = m.load(); err != nil {
+		return
+	}
+	if m.unified != nil {
+		return m.unified.update(spec)
 	}
 	err = m.cgroup.Update(spec)
 	return
@@ -129,26 +177,67 @@ func (m *Manager) UpdateFromFile(path string) error {
 
 // Remove removes resources restriction for current managed process
 func (m *Manager) Remove() error {
+	if err := m.load(); err != nil {
+		return err
+	}
+	if m.unified != nil {
+		return m.unified.remove()
+	}
 	// deletes subgroup
 	return m.cgroup.Delete()
 }
 
 // Pause suspends all processes inside the container
 func (m *Manager) Pause() error {
-	if m.cgroup == nil {
-		if err := m.loadFromPid(); err != nil {
-			return err
-		}
+	if err := m.load(); err != nil {
+		return err
+	}
+	if m.unified != nil {
+		return m.unified.freeze(true)
 	}
 	return m.cgroup.Freeze()
 }
 
 // Resume resumes all processes that have been previously paused
 func (m *Manager) Resume() error {
-	if m.cgroup == nil {
-		if err := m.loadFromPid(); err != nil {
-			return err
-		}
+	if err := m.load(); err != nil {
+		return err
+	}
+	if m.unified != nil {
+		return m.unified.freeze(false)
 	}
 	return m.cgroup.Thaw()
 }
+
+// GetStats returns the resource usage of the processes inside the
+// container.
+func (m *Manager) GetStats() (*Stats, error) {
+	if err := m.load(); err != nil {
+		return nil, err
+	}
+	if m.unified != nil {
+		return m.unified.stats()
+	}
+	metrics, err := m.cgroup.Stat(cgroups.IgnoreNotExist)
+	if err != nil {
+		return nil, err
+	}
+	return statsFromMetrics(metrics), nil
+}
+
+// Open returns a file descriptor of the cgroup directory in the unified
+// hierarchy, starter creates the container process directly into the
+// cgroup with it instead of moving the process once started.
+func (m *Manager) Open() (int, error) {
+	if !IsUnified() {
+		return -1, fmt.Errorf("cgroup directory file descriptor requires cgroup v2")
+	}
+	if err := m.load(); err != nil {
+		return -1, err
+	}
+	fd, err := syscall.Open(m.unified.dir(), syscall.O_RDONLY|syscall.O_DIRECTORY|syscall.O_CLOEXEC, 0)
+	if err != nil {
+		return -1, &os.PathError{Op: "open", Path: m.unified.dir(), Err: err}
+	}
+	return fd, nil
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -16,6 +16,7 @@ import (
 	"strings"
 	"testing"
 
+	specs "github.com/opencontainers/runtime-spec/specs-go"
 	"github.com/sylabs/singularity/internal/pkg/test"
 )
 
@@ -62,14 +63,20 @@ func TestCgroups(t *testing.T) {
 		t.Fatalf("can't determine cgroups root path, is cgroups enabled ?")
 	}
 
+	// cpu shares are converted to a cpu weight with cgroup v2
 	cpuShares := filepath.Join(rootPath, "cpu", path, "cpu.shares")
+	defaultShares, updatedShares := int64(1024), int64(512)
+	if IsUnified() {
+		cpuShares = filepath.Join(rootPath, path, "cpu.weight")
+		defaultShares, updatedShares = 100, 20
+	}
 
 	i, err := readIntFromFile(cpuShares)
 	if err != nil {
 		t.Errorf("failed to read %s: %s", cpuShares, err)
 	}
-	if i != 1024 {
-		t.Errorf("cpu shares should be equal to 1024")
+	if i != defaultShares {
+		t.Errorf("cpu shares should be equal to %d", defaultShares)
 	}
 
 	content := []byte("[cpu]\nshares = 512")
@@ -97,8 +104,8 @@ func TestCgroups(t *testing.T) {
 	if err != nil {
 		t.Errorf("failed to read %s: %s", cpuShares, err)
 	}
-	if i != 512 {
-		t.Errorf("cpu shares should be equal to 512")
+	if i != updatedShares {
+		t.Errorf("cpu shares should be equal to %d", updatedShares)
 	}
 
 	pipe.Close()
@@ -137,6 +144,20 @@ func TestPauseResume(t *testing.T) {
 
 	manager.Pause()
 
+	// cgroup v2 freezer doesn't put processes in uninterruptible sleep
+	if IsUnified() {
+		b, err := ioutil.ReadFile(filepath.Join(unifiedMountPoint, manager.Path, "cgroup.events"))
+		if err != nil || !strings.Contains(string(b), "frozen 1") {
+			t.Errorf("failed to pause process %d", manager.Pid)
+		}
+		if err := manager.Resume(); err != nil {
+			t.Errorf("failed to resume process %d: %s", manager.Pid, err)
+		}
+		pipe.Close()
+		cmd.Wait()
+		return
+	}
+
 	file, err := os.Open(fmt.Sprintf("/proc/%d/status", manager.Pid))
 	if err != nil {
 		t.Error(err)
@@ -186,3 +207,79 @@ func TestPauseResume(t *testing.T) {
 
 	cmd.Wait()
 }
+
+func TestStats(t *testing.T) {
+	test.EnsurePrivilege(t)
+
+	cmd := exec.Command("/bin/cat")
+	pipe, err := cmd.StdinPipe()
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if err := cmd.Start(); err != nil {
+		t.Fatal(err)
+	}
+
+	pid := cmd.Process.Pid
+	manager := &Manager{Pid: pid, Path: filepath.Join("/singularity", strconv.Itoa(pid))}
+
+	limit := int64(64 * 1024 * 1024)
+	spec := &specs.LinuxResources{
+		Memory: &specs.LinuxMemory{Limit: &limit},
+		Pids:   &specs.LinuxPids{Limit: 16},
+	}
+	if err := manager.ApplyFromSpec(spec); err != nil {
+		t.Fatal(err)
+	}
+	defer manager.Remove()
+
+	// stats are read from the cgroup of the process
+	stats, err := (&Manager{Pid: pid}).GetStats()
+	if err != nil {
+		t.Fatalf("unexpected error while getting stats: %s", err)
+	}
+	if stats.Memory.Limit != uint64(limit) {
+		t.Errorf("unexpected memory limit %d", stats.Memory.Limit)
+	}
+	if stats.Pids.Current != 1 || stats.Pids.Limit != 16 {
+		t.Errorf("unexpected pids stats %d/%d", stats.Pids.Current, stats.Pids.Limit)
+	}
+
+	pipe.Close()
+
+	cmd.Wait()
+}
+
+func TestRestrictsDevices(t *testing.T) {
+	major := int64(1)
+	minor := int64(3)
+
+	allowAll := specs.LinuxDeviceCgroup{Allow: true, Type: "a", Access: "rwm"}
+	denyAll := specs.LinuxDeviceCgroup{Allow: false, Access: "rwm"}
+	allowNull := specs.LinuxDeviceCgroup{Allow: true, Type: "c", Major: &major, Minor: &minor, Access: "rw"}
+	denyNull := specs.LinuxDeviceCgroup{Allow: false, Type: "c", Major: &major, Minor: &minor, Access: "rwm"}
+
+	tests := []struct {
+		name       string
+		devices    []specs.LinuxDeviceCgroup
+		restricted bool
+	}{
+		{"NoRule", nil, false},
+		{"AllowAll", []specs.LinuxDeviceCgroup{allowAll}, false},
+		{"AllowDevice", []specs.LinuxDeviceCgroup{allowNull}, false},
+		{"DenyAll", []specs.LinuxDeviceCgroup{denyAll}, true},
+		{"DenyDevice", []specs.LinuxDeviceCgroup{denyNull}, true},
+		{"DenyAllAllowDevice", []specs.LinuxDeviceCgroup{denyAll, allowNull}, true},
+		{"DenyAllAllowAll", []specs.LinuxDeviceCgroup{denyAll, allowAll}, false},
+		{"AllowAllDenyDevice", []specs.LinuxDeviceCgroup{allowAll, denyNull}, true},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			if restricted := restrictsDevices(tt.devices); restricted != tt.restricted {
+				t.Errorf("unexpected device restriction %v", restricted)
+			}
+		})
+	}
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cgroups
+
+import (
+	"strings"
+
+	"github.com/containerd/cgroups"
+)
+
+// unlimited is the lowest value reported by cgroup v1 for an unlimited
+// resource, the page aligned maximum of an int64.
+const unlimited = 1 << 62
+
+// Stats holds the resource usage of a cgroup. Limits are 0 when the
+// resource is unlimited.
+type Stats struct {
+	CPU    CPUStats    `json:"cpu"`
+	Memory MemoryStats `json:"memory"`
+	IO     IOStats     `json:"io"`
+	Pids   PidsStats   `json:"pids"`
+}
+
+// CPUStats holds the CPU time consumed by the processes of a cgroup in
+// nanoseconds, and their throttling by a CPU quota.
+type CPUStats struct {
+	Usage            uint64 `json:"usage"`
+	User             uint64 `json:"user"`
+	System           uint64 `json:"system"`
+	ThrottledPeriods uint64 `json:"throttledPeriods"`
+	ThrottledTime    uint64 `json:"throttledTime"`
+}
+
+// MemoryStats holds the memory and swap used by the processes of a
+// cgroup in bytes.
+type MemoryStats struct {
+	Usage uint64 `json:"usage"`
+	Limit uint64 `json:"limit"`
+	Swap  uint64 `json:"swap"`
+}
+
+// IOStats holds the bytes and the I/O operations read and written by the
+// processes of a cgroup on all block devices.
+type IOStats struct {
+	ReadBytes  uint64 `json:"readBytes"`
+	WriteBytes uint64 `json:"writeBytes"`
+	ReadOps    uint64 `json:"readOps"`
+	WriteOps   uint64 `json:"writeOps"`
+}
+
+// PidsStats holds the number of processes of a cgroup.
+type PidsStats struct {
+	Current uint64 `json:"current"`
+	Limit   uint64 `json:"limit"`
+}
+
+// statsFromMetrics converts cgroup v1 metrics.
+func statsFromMetrics(m *cgroups.Metrics) *Stats {
+	s := new(Stats)
+
+	if m.CPU != nil {
+		if m.CPU.Usage != nil {
+			s.CPU.Usage = m.CPU.Usage.Total
+			s.CPU.User = m.CPU.Usage.User
+			s.CPU.System = m.CPU.Usage.Kernel
+		}
+		if m.CPU.Throttling != nil {
+			s.CPU.ThrottledPeriods = m.CPU.Throttling.ThrottledPeriods
+			s.CPU.ThrottledTime = m.CPU.Throttling.ThrottledTime
+		}
+	}
+
+	if m.Memory != nil && m.Memory.Usage != nil {
+		s.Memory.Usage = m.Memory.Usage.Usage
+		if m.Memory.Usage.Limit < unlimited {
+			s.Memory.Limit = m.Memory.Usage.Limit
+		}
+		// swap accounting reports memory and swap together
+		if m.Memory.Swap != nil && m.Memory.Swap.Usage > s.Memory.Usage {
+			s.Memory.Swap = m.Memory.Swap.Usage - s.Memory.Usage
+		}
+	}
+
+	if m.Blkio != nil {
+		for _, e := range m.Blkio.IoServiceBytesRecursive {
+			switch strings.ToLower(e.Op) {
+			case "read":
+				s.IO.ReadBytes += e.Value
+			case "write":
+				s.IO.WriteBytes += e.Value
+			}
+		}
+		for _, e := range m.Blkio.IoServicedRecursive {
+			switch strings.ToLower(e.Op) {
+			case "read":
+				s.IO.ReadOps += e.Value
+			case "write":
+				s.IO.WriteOps += e.Value
+			}
+		}
+	}
+
+	if m.Pids != nil {
+		s.Pids.Current = m.Pids.Current
+		s.Pids.Limit = m.Pids.Limit
+	}
+
+	return s
+}
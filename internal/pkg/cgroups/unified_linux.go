@@ -0,0 +1,532 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cgroups
+
+import (
+	"bufio"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"sync"
+	"syscall"
+	"time"
+
+	specs "github.com/opencontainers/runtime-spec/specs-go"
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+)
+
+const (
+	// unifiedMountPoint is the mount point of the cgroup v2 unified
+	// hierarchy.
+	unifiedMountPoint = "/sys/fs/cgroup"
+	// cgroup2SuperMagic is the filesystem type of the unified hierarchy.
+	cgroup2SuperMagic = 0x63677270
+)
+
+// statsControllers are the controllers enabled for the cgroups created
+// by singularity to report their resource usage, even if no limit is
+// set for them.
+var statsControllers = []string{"cpu", "io", "memory", "pids"}
+
+var unifiedOnce struct {
+	sync.Once
+	unified bool
+}
+
+// IsUnified returns true if the host uses the cgroup v2 unified hierarchy
+// only.
+func IsUnified() bool {
+	unifiedOnce.Do(func() {
+		var st syscall.Statfs_t
+		if err := syscall.Statfs(unifiedMountPoint, &st); err == nil {
+			unifiedOnce.unified = st.Type == cgroup2SuperMagic
+		}
+	})
+	return unifiedOnce.unified
+}
+
+// subtreeControl caches the controllers enabled in the cgroup.subtree_control
+// file of the cgroups, so the controllers of a parent cgroup are read once
+// per process and only the missing ones are enabled.
+var subtreeControl = struct {
+	sync.Mutex
+	enabled map[string]map[string]bool
+}{
+	enabled: make(map[string]map[string]bool),
+}
+
+// enableControllers enables the controllers in all the ancestors of the
+// cgroup path, starting from the root of the hierarchy. The controllers
+// not available in the root cgroup are ignored.
+func enableControllers(path string, controllers []string) error {
+	subtreeControl.Lock()
+	defer subtreeControl.Unlock()
+
+	available, err := readControllers(filepath.Join(unifiedMountPoint, "cgroup.controllers"))
+	if err != nil {
+		return err
+	}
+
+	dir := unifiedMountPoint
+	for _, elem := range strings.Split(filepath.Dir(path), "/") {
+		if elem != "" {
+			dir = filepath.Join(dir, elem)
+			if err := os.Mkdir(dir, 0755); err != nil && !os.IsExist(err) {
+				return fmt.Errorf("while creating cgroup %s: %s", dir, err)
+			}
+		}
+		enabled, ok := subtreeControl.enabled[dir]
+		if !ok {
+			enabled, err = readControllers(filepath.Join(dir, "cgroup.subtree_control"))
+			if err != nil {
+				return err
+			}
+			subtreeControl.enabled[dir] = enabled
+		}
+
+		var missing []string
+		for _, c := range controllers {
+			if available[c] && !enabled[c] {
+				missing = append(missing, "+"+c)
+			}
+		}
+		if len(missing) == 0 {
+			continue
+		}
+		file := filepath.Join(dir, "cgroup.subtree_control")
+		if err := ioutil.WriteFile(file, []byte(strings.Join(missing, " ")), 0644); err != nil {
+			return fmt.Errorf("while enabling controllers %s in %s: %s", strings.Join(missing, " "), dir, err)
+		}
+		for _, c := range missing {
+			enabled[c[1:]] = true
+		}
+	}
+
+	return nil
+}
+
+func readControllers(path string) (map[string]bool, error) {
+	b, err := ioutil.ReadFile(path)
+	if err != nil {
+		return nil, fmt.Errorf("while reading %s: %s", path, err)
+	}
+	controllers := make(map[string]bool)
+	for _, c := range strings.Fields(string(b)) {
+		controllers[c] = true
+	}
+	return controllers, nil
+}
+
+// unifiedPidPath returns the cgroup path of the process pid in the unified
+// hierarchy.
+func unifiedPidPath(pid int) (string, error) {
+	f, err := os.Open(fmt.Sprintf("/proc/%d/cgroup", pid))
+	if err != nil {
+		return "", err
+	}
+	defer f.Close()
+
+	scanner := bufio.NewScanner(f)
+	for scanner.Scan() {
+		if strings.HasPrefix(scanner.Text(), "0::") {
+			return strings.TrimPrefix(scanner.Text(), "0::"), nil
+		}
+	}
+	return "", fmt.Errorf("no unified cgroup found for process %d", pid)
+}
+
+// unified manages a cgroup of the cgroup v2 unified hierarchy.
+type unified struct {
+	path string
+	// files caches the values written to the interface files of the
+	// cgroup by this process, or read from them before an update.
+	files map[string]string
+}
+
+func newUnified(path string) *unified {
+	return &unified{
+		path:  path,
+		files: make(map[string]string),
+	}
+}
+
+func (u *unified) dir() string {
+	return filepath.Join(unifiedMountPoint, u.path)
+}
+
+// create creates the cgroup after enabling the controllers required by
+// the resources restriction in its parent cgroups.
+func (u *unified) create(r *specs.LinuxResources) error {
+	controllers := append([]string{}, statsControllers...)
+	if r.CPU != nil && (r.CPU.Cpus != "" || r.CPU.Mems != "") {
+		controllers = append(controllers, "cpuset")
+	}
+	if len(r.HugepageLimits) > 0 {
+		controllers = append(controllers, "hugetlb")
+	}
+	if err := enableControllers(u.path, controllers); err != nil {
+		return err
+	}
+	if err := os.Mkdir(u.dir(), 0755); err != nil {
+		return fmt.Errorf("while creating cgroup %s: %s", u.path, err)
+	}
+	return nil
+}
+
+// set writes value to an interface file of the cgroup, unless the file
+// already holds it: writing an interface file isn't free, a memory.max
+// write triggers a memory reclaim for example, and an update usually
+// changes a few limits only. The value is compared to the cached one,
+// or to the file content the first time.
+func (u *unified) set(file string, value string) error {
+	cached, ok := u.files[file]
+	if !ok {
+		if b, err := ioutil.ReadFile(filepath.Join(u.dir(), file)); err == nil {
+			cached, ok = strings.TrimSpace(string(b)), true
+		}
+	}
+	if ok && cached == value {
+		u.files[file] = value
+		return nil
+	}
+	if err := ioutil.WriteFile(filepath.Join(u.dir(), file), []byte(value), 0644); err != nil {
+		return fmt.Errorf("while setting %s to %q: %s", file, value, err)
+	}
+	u.files[file] = value
+	return nil
+}
+
+// setDevice writes the value for a device to an interface file holding
+// one entry per device like io.max, the written values are cached but not
+// compared to the file content as the kernel reports them differently.
+func (u *unified) setDevice(file string, major, minor int64, value string) error {
+	device := fmt.Sprintf("%d:%d", major, minor)
+	key := file + " " + device
+	if u.files[key] == value {
+		return nil
+	}
+	entry := device + " " + value
+	if err := ioutil.WriteFile(filepath.Join(u.dir(), file), []byte(entry), 0644); err != nil {
+		return fmt.Errorf("while setting %s to %q: %s", file, entry, err)
+	}
+	u.files[key] = value
+	return nil
+}
+
+// restrictsDevices returns whether the device access rules deny access
+// to a device. Like with cgroup v1, access to all devices is allowed
+// unless a rule denies it, so rules allowing access change nothing unless
+// they follow a deny rule.
+func restrictsDevices(devices []specs.LinuxDeviceCgroup) bool {
+	restricted := false
+	for _, d := range devices {
+		if !d.Allow {
+			restricted = true
+			continue
+		}
+		// the "a" type matches all devices whatever their numbers
+		if (d.Type == "" || d.Type == "a") && d.Access == "rwm" {
+			restricted = false
+		}
+	}
+	return restricted
+}
+
+// update applies the resources restriction from an OCI specification,
+// converting cgroup v1 values to their cgroup v2 equivalent.
+func (u *unified) update(r *specs.LinuxResources) error {
+	// device access rules require an eBPF program with cgroup v2, the
+	// restriction is refused rather than ignored
+	if restrictsDevices(r.Devices) {
+		return fmt.Errorf("device access rules denying access are not supported with cgroup v2")
+	}
+
+	if cpu := r.CPU; cpu != nil {
+		if cpu.Shares != nil && *cpu.Shares >= 2 {
+			// convert [2-262144] to [1-10000]
+			weight := 1 + ((*cpu.Shares-2)*9999)/262142
+			if err := u.set("cpu.weight", strconv.FormatUint(weight, 10)); err != nil {
+				return err
+			}
+		}
+		if cpu.Quota != nil || cpu.Period != nil {
+			quota := "max"
+			if cpu.Quota != nil && *cpu.Quota > 0 {
+				quota = strconv.FormatInt(*cpu.Quota, 10)
+			}
+			period := uint64(100000)
+			if cpu.Period != nil && *cpu.Period > 0 {
+				period = *cpu.Period
+			}
+			if err := u.set("cpu.max", fmt.Sprintf("%s %d", quota, period)); err != nil {
+				return err
+			}
+		}
+		if cpu.Cpus != "" {
+			if err := u.set("cpuset.cpus", cpu.Cpus); err != nil {
+				return err
+			}
+		}
+		if cpu.Mems != "" {
+			if err := u.set("cpuset.mems", cpu.Mems); err != nil {
+				return err
+			}
+		}
+		if cpu.RealtimeRuntime != nil || cpu.RealtimePeriod != nil {
+			sylog.Warningf("Realtime CPU limits are not supported with cgroup v2, ignoring")
+		}
+	}
+
+	if mem := r.Memory; mem != nil {
+		if mem.Limit != nil {
+			if err := u.set("memory.max", limitValue(*mem.Limit)); err != nil {
+				return err
+			}
+		}
+		if mem.Reservation != nil {
+			if err := u.set("memory.low", limitValue(*mem.Reservation)); err != nil {
+				return err
+			}
+		}
+		if mem.Swap != nil {
+			// cgroup v1 limits memory and swap together, cgroup v2
+			// limits swap alone
+			swap := *mem.Swap
+			if swap > 0 && mem.Limit != nil && *mem.Limit > 0 {
+				if swap < *mem.Limit {
+					return fmt.Errorf("memory and swap limit %d is lower than memory limit %d", swap, *mem.Limit)
+				}
+				swap -= *mem.Limit
+			}
+			if err := u.set("memory.swap.max", limitValue(swap)); err != nil {
+				return err
+			}
+		}
+		if mem.Kernel != nil || mem.KernelTCP != nil {
+			sylog.Warningf("Kernel memory limits are not supported with cgroup v2, ignoring")
+		}
+	}
+
+	if r.Pids != nil {
+		if err := u.set("pids.max", limitValue(r.Pids.Limit)); err != nil {
+			return err
+		}
+	}
+
+	if bio := r.BlockIO; bio != nil {
+		if bio.Weight != nil && *bio.Weight > 0 {
+			if err := u.set("io.weight", fmt.Sprintf("default %d", ioWeight(*bio.Weight))); err != nil {
+				return err
+			}
+		}
+		for _, d := range bio.WeightDevice {
+			if d.Weight == nil || *d.Weight == 0 {
+				continue
+			}
+			if err := u.setDevice("io.weight", d.Major, d.Minor, strconv.FormatUint(ioWeight(*d.Weight), 10)); err != nil {
+				return err
+			}
+		}
+		throttles := []struct {
+			key     string
+			devices []specs.LinuxThrottleDevice
+		}{
+			{"rbps", bio.ThrottleReadBpsDevice},
+			{"wbps", bio.ThrottleWriteBpsDevice},
+			{"riops", bio.ThrottleReadIOPSDevice},
+			{"wiops", bio.ThrottleWriteIOPSDevice},
+		}
+		for _, t := range throttles {
+			for _, d := range t.devices {
+				rate := "max"
+				if d.Rate > 0 {
+					rate = strconv.FormatUint(d.Rate, 10)
+				}
+				if err := u.setDevice("io.max", d.Major, d.Minor, t.key+"="+rate); err != nil {
+					return err
+				}
+			}
+		}
+	}
+
+	for _, h := range r.HugepageLimits {
+		if err := u.set("hugetlb."+h.Pagesize+".max", strconv.FormatUint(h.Limit, 10)); err != nil {
+			return err
+		}
+	}
+
+	if r.Network != nil {
+		sylog.Warningf("Network class and priority are not supported with cgroup v2, ignoring")
+	}
+
+	return nil
+}
+
+// limitValue returns the interface file value of a limit, negative and
+// null values meaning unlimited.
+func limitValue(limit int64) string {
+	if limit <= 0 {
+		return "max"
+	}
+	return strconv.FormatInt(limit, 10)
+}
+
+// ioWeight converts a blkio weight in [10-1000] to an io weight in
+// [1-10000].
+func ioWeight(weight uint16) uint64 {
+	if weight < 10 {
+		weight = 10
+	}
+	return 1 + (uint64(weight)-10)*9999/990
+}
+
+// addProcess moves the process pid into the cgroup.
+func (u *unified) addProcess(pid int) error {
+	procs := filepath.Join(u.dir(), "cgroup.procs")
+	if err := ioutil.WriteFile(procs, []byte(strconv.Itoa(pid)), 0644); err != nil {
+		return fmt.Errorf("while adding process %d to cgroup %s: %s", pid, u.path, err)
+	}
+	return nil
+}
+
+// freeze freezes or thaws the processes of the cgroup and waits until
+// the kernel reports the new state.
+func (u *unified) freeze(frozen bool) error {
+	state := "0"
+	if frozen {
+		state = "1"
+	}
+	if err := ioutil.WriteFile(filepath.Join(u.dir(), "cgroup.freeze"), []byte(state), 0644); err != nil {
+		return fmt.Errorf("while writing cgroup.freeze: %s", err)
+	}
+
+	for i := 0; i < 1000; i++ {
+		b, err := ioutil.ReadFile(filepath.Join(u.dir(), "cgroup.events"))
+		if err != nil {
+			return fmt.Errorf("while reading cgroup.events: %s", err)
+		}
+		for _, line := range strings.Split(string(b), "\n") {
+			if line == "frozen "+state {
+				return nil
+			}
+		}
+		time.Sleep(time.Millisecond)
+	}
+	return fmt.Errorf("cgroup %s state didn't change", u.path)
+}
+
+// remove removes the cgroup, the processes of the cgroup may not have
+// been released by the kernel yet when it's called right after they
+// exit.
+func (u *unified) remove() (err error) {
+	for i := 0; i < 100; i++ {
+		err = syscall.Rmdir(u.dir())
+		if err != syscall.EBUSY {
+			break
+		}
+		time.Sleep(10 * time.Millisecond)
+	}
+	if err != nil && err != syscall.ENOENT {
+		return fmt.Errorf("while removing cgroup %s: %s", u.path, err)
+	}
+	return nil
+}
+
+// stats returns the resource usage of the cgroup, the statistics of the
+// controllers not enabled for the cgroup are left empty.
+func (u *unified) stats() (*Stats, error) {
+	s := new(Stats)
+
+	values, err := u.readKeyValues("cpu.stat")
+	if err != nil {
+		return nil, err
+	}
+	s.CPU.Usage = values["usage_usec"] * 1000
+	s.CPU.User = values["user_usec"] * 1000
+	s.CPU.System = values["system_usec"] * 1000
+	s.CPU.ThrottledPeriods = values["nr_throttled"]
+	s.CPU.ThrottledTime = values["throttled_usec"] * 1000
+
+	for file, value := range map[string]*uint64{
+		"memory.current":      &s.Memory.Usage,
+		"memory.max":          &s.Memory.Limit,
+		"memory.swap.current": &s.Memory.Swap,
+		"pids.current":        &s.Pids.Current,
+		"pids.max":            &s.Pids.Limit,
+	} {
+		if *value, err = u.readValue(file); err != nil {
+			return nil, err
+		}
+	}
+
+	b, err := ioutil.ReadFile(filepath.Join(u.dir(), "io.stat"))
+	if err != nil && !os.IsNotExist(err) {
+		return nil, fmt.Errorf("while reading io.stat: %s", err)
+	}
+	for _, line := range strings.Split(string(b), "\n") {
+		for _, field := range strings.Fields(line) {
+			kv := strings.SplitN(field, "=", 2)
+			if len(kv) != 2 {
+				continue
+			}
+			v, _ := strconv.ParseUint(kv[1], 10, 64)
+			switch kv[0] {
+			case "rbytes":
+				s.IO.ReadBytes += v
+			case "wbytes":
+				s.IO.WriteBytes += v
+			case "rios":
+				s.IO.ReadOps += v
+			case "wios":
+				s.IO.WriteOps += v
+			}
+		}
+	}
+
+	return s, nil
+}
+
+// readValue reads a single value interface file, a missing file or the
+// max value are reported as 0.
+func (u *unified) readValue(file string) (uint64, error) {
+	b, err := ioutil.ReadFile(filepath.Join(u.dir(), file))
+	if os.IsNotExist(err) {
+		return 0, nil
+	} else if err != nil {
+		return 0, fmt.Errorf("while reading %s: %s", file, err)
+	}
+	value := strings.TrimSpace(string(b))
+	if value == "max" {
+		return 0, nil
+	}
+	v, err := strconv.ParseUint(value, 10, 64)
+	if err != nil {
+		return 0, fmt.Errorf("while parsing %s: %s", file, err)
+	}
+	return v, nil
+}
+
+// readKeyValues reads a flat keyed interface file like cpu.stat.
+func (u *unified) readKeyValues(file string) (map[string]uint64, error) {
+	b, err := ioutil.ReadFile(filepath.Join(u.dir(), file))
+	if err != nil {
+		return nil, fmt.Errorf("while reading %s: %s", file, err)
+	}
+	values := make(map[string]uint64)
+	for _, line := range strings.Split(string(b), "\n") {
+		fields := strings.Fields(line)
+		if len(fields) != 2 {
+			continue
+		}
+		if v, err := strconv.ParseUint(fields[1], 10, 64); err == nil {
+			values[fields[0]] = v
+		}
+	}
+	return values, nil
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cache
+
+import (
+	"encoding/json"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"golang.org/x/sys/unix"
+)
+
+// digestSuffix is the suffix of the hidden file recording the verified
+// digest of a cached image, stored along the image.
+const digestSuffix = ".digest"
+
+// imageDigest is the verified digest of a cached image along with the image
+// metadata at verification time, any modification of the image changes its
+// ctime and invalidates the record.
+type imageDigest struct {
+	Digest string `json:"digest"`
+	Dev    uint64 `json:"dev"`
+	Ino    uint64 `json:"ino"`
+	Size   int64  `json:"size"`
+	Mtime  int64  `json:"mtime"`
+	Ctime  int64  `json:"ctime"`
+}
+
+func digestPath(path string) string {
+	dir, name := filepath.Split(path)
+	return filepath.Join(dir, "."+name+digestSuffix)
+}
+
+func statDigest(path string) (*imageDigest, error) {
+	var st unix.Stat_t
+
+	if err := unix.Stat(path, &st); err != nil {
+		return nil, &os.PathError{Op: "stat", Path: path, Err: err}
+	}
+	return &imageDigest{
+		Dev:   uint64(st.Dev),
+		Ino:   uint64(st.Ino),
+		Size:  st.Size,
+		Mtime: st.Mtim.Nano(),
+		Ctime: st.Ctim.Nano(),
+	}, nil
+}
+
+func readDigest(path string) (*imageDigest, error) {
+	b, err := ioutil.ReadFile(digestPath(path))
+	if err != nil {
+		return nil, err
+	}
+	d := new(imageDigest)
+	if err := json.Unmarshal(b, d); err != nil {
+		return nil, err
+	}
+	return d, nil
+}
+
+func writeDigest(path string, d *imageDigest) error {
+	b, err := json.Marshal(d)
+	if err != nil {
+		return err
+	}
+
+	// write in a temporary file renamed once complete, concurrent
+	// readers only see a complete record
+	dst := digestPath(path)
+	f, err := ioutil.TempFile(filepath.Dir(dst), filepath.Base(dst)+".")
+	if err != nil {
+		return err
+	}
+	_, err = f.Write(b)
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Rename(f.Name(), dst)
+	}
+	if err != nil {
+		os.Remove(f.Name())
+	}
+	return err
+}
+
+// SetImageDigest records digest as the verified digest of the cached image
+// at path, the image content must have been verified by the caller. A
+// failure to record the digest is not fatal, the image is hashed again by
+// the next lookup.
+func SetImageDigest(path, digest string) {
+	d, err := statDigest(path)
+	if err == nil {
+		d.Digest = digest
+		err = writeDigest(path, d)
+	}
+	if err != nil {
+		sylog.Debugf("Could not record digest of cached image %s: %s", path, err)
+	}
+}
+
+// verifyImage returns whether the cached image at path exists and has the
+// digest sum. The image is hashed only if forced or if its metadata changed
+// since its digest was last verified, otherwise the lookup only costs a stat
+// of the image and the read of its digest record. ErrBadChecksum is returned
+// if the image content doesn't match sum.
+func verifyImage(path, sum string, hash func(string) (string, error), force bool) (bool, error) {
+	d, err := statDigest(path)
+	if os.IsNotExist(err) {
+		return false, nil
+	} else if err != nil {
+		return false, err
+	}
+
+	if !force {
+		if r, err := readDigest(path); err == nil && r.Digest == sum {
+			d.Digest = sum
+			if *r == *d {
+				return true, nil
+			}
+		}
+	}
+
+	// the metadata are collected before hashing, a modification while
+	// hashing invalidates the record
+	digest, err := hash(path)
+	if err != nil {
+		return false, err
+	}
+	if digest != sum {
+		os.Remove(digestPath(path))
+		return false, ErrBadChecksum
+	}
+
+	d.Digest = digest
+	if err := writeDigest(path, d); err != nil {
+		sylog.Debugf("Could not record digest of cached image %s: %s", path, err)
+	}
+	return true, nil
+}
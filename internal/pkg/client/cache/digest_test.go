@@ -0,0 +1,155 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cache
+
+import (
+	"crypto/sha256"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"testing"
+	"time"
+
+	"github.com/sylabs/singularity/internal/pkg/test"
+)
+
+func TestVerifyImage(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	dir, err := ioutil.TempDir("", "image-digest-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	image := filepath.Join(dir, "image.sif")
+	if err := ioutil.WriteFile(image, []byte("image content"), 0644); err != nil {
+		t.Fatal(err)
+	}
+
+	hashed := 0
+	hash := func(path string) (string, error) {
+		hashed++
+		b, err := ioutil.ReadFile(path)
+		if err != nil {
+			return "", err
+		}
+		return fmt.Sprintf("sha256.%x", sha256.Sum256(b)), nil
+	}
+	sum, _ := hash(image)
+
+	tests := []struct {
+		name   string
+		path   string
+		sum    string
+		force  bool
+		modify bool
+		exists bool
+		err    error
+		hashed int
+	}{
+		{
+			name:   "not existing",
+			path:   filepath.Join(dir, "missing.sif"),
+			sum:    sum,
+			hashed: 0,
+		},
+		{
+			name:   "first lookup",
+			path:   image,
+			sum:    sum,
+			exists: true,
+			hashed: 1,
+		},
+		{
+			name:   "verified lookup",
+			path:   image,
+			sum:    sum,
+			exists: true,
+			hashed: 0,
+		},
+		{
+			name:   "forced lookup",
+			path:   image,
+			sum:    sum,
+			force:  true,
+			exists: true,
+			hashed: 1,
+		},
+		{
+			name:   "other digest",
+			path:   image,
+			sum:    "sha256.0",
+			err:    ErrBadChecksum,
+			hashed: 1,
+		},
+		{
+			name:   "lookup after bad checksum",
+			path:   image,
+			sum:    sum,
+			exists: true,
+			hashed: 1,
+		},
+		{
+			name:   "modified image",
+			path:   image,
+			sum:    sum,
+			modify: true,
+			err:    ErrBadChecksum,
+			hashed: 1,
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			if tt.modify {
+				// same size and modification time, only ctime changes
+				fi, err := os.Stat(tt.path)
+				if err != nil {
+					t.Fatal(err)
+				}
+				time.Sleep(10 * time.Millisecond)
+				if err := ioutil.WriteFile(tt.path, []byte("IMAGE CONTENT"), 0644); err != nil {
+					t.Fatal(err)
+				}
+				if err := os.Chtimes(tt.path, fi.ModTime(), fi.ModTime()); err != nil {
+					t.Fatal(err)
+				}
+			}
+
+			hashed = 0
+			exists, err := verifyImage(tt.path, tt.sum, hash, tt.force)
+			if err != tt.err {
+				t.Fatalf("unexpected error %v instead of %v", err, tt.err)
+			}
+			if exists != tt.exists {
+				t.Errorf("unexpected exists %v", exists)
+			}
+			if hashed != tt.hashed {
+				t.Errorf("image hashed %d times instead of %d", hashed, tt.hashed)
+			}
+		})
+	}
+
+	// a digest recorded after a download is reused
+	if err := ioutil.WriteFile(image, []byte("image content"), 0644); err != nil {
+		t.Fatal(err)
+	}
+	SetImageDigest(image, sum)
+
+	hashed = 0
+	if exists, err := verifyImage(image, sum, hash, false); err != nil || !exists {
+		t.Fatalf("unexpected result: %v %v", exists, err)
+	}
+	if hashed != 0 {
+		t.Errorf("image with a recorded digest was hashed")
+	}
+	if !IsMetadataFile(filepath.Base(digestPath(image))) {
+		t.Errorf("digest file not recognized")
+	}
+}
@@ -30,6 +30,10 @@ const (
 	// DisableCacheEnv specifies whether the image should be used
 	DisableEnv = "SINGULARITY_DISABLE_CACHE"
 
+	// MaxSizeEnv specifies the size budget of the cache, e.g. 20G, least
+	// recently used images are evicted once the cache exceeds it
+	MaxSizeEnv = "SINGULARITY_CACHE_MAXSIZE"
+
 	// CacheDir specifies the name of the directory relative to the
 	// singularity data directory where images are cached in by
 	// default.
@@ -46,6 +50,10 @@ type Config struct {
 
 	// Disable specifies whether the user request the cache to be disabled by default.
 	Disable bool
+
+	// MaxSize specifies the size budget of the cache in bytes, zero
+	// means the value of the MaxSizeEnv environment variable is used.
+	MaxSize int64
 }
 
 // Handle is an structure representing a cache
@@ -78,6 +86,9 @@ type Handle struct {
 	// OciBlob provides the location of the OciBlob cache
 	OciBlob string
 
+	// OciLayer provides the location of the OciLayer cache
+	OciLayer string
+
 	// Net provides the location of the Net cache
 	Net string
 
@@ -89,6 +100,9 @@ type Handle struct {
 
 	// disabled specifies if the test is disabled
 	disabled bool
+
+	// maxSize is the size budget of the cache in bytes, zero if unlimited
+	maxSize int64
 }
 
 // NewHandle initializes a new cache within a given directory. It does not set
@@ -166,6 +180,15 @@ func NewHandle(cfg Config) (*Handle, error) {
 
 	newCache.baseDir = baseDir
 	newCache.rootDir = rootDir
+
+	newCache.maxSize = cfg.MaxSize
+	if newCache.maxSize == 0 && os.Getenv(MaxSizeEnv) != "" {
+		newCache.maxSize, err = parseSize(os.Getenv(MaxSizeEnv))
+		if err != nil {
+			return nil, fmt.Errorf("failed to parse environment variable %s: %s", MaxSizeEnv, err)
+		}
+	}
+
 	newCache.Library, err = getLibraryCachePath(newCache)
 	if err != nil {
 		return nil, fmt.Errorf("failed getting the path to the Library cache: %s", err)
@@ -178,6 +201,10 @@ func NewHandle(cfg Config) (*Handle, error) {
 	if err != nil {
 		return nil, fmt.Errorf("failed getting the path to the OCI blob cache")
 	}
+	newCache.OciLayer, err = getOciLayerCachePath(newCache)
+	if err != nil {
+		return nil, fmt.Errorf("failed getting the path to the OCI layer cache")
+	}
 	newCache.Net, err = getNetCachePath(newCache)
 	if err != nil {
 		return nil, fmt.Errorf("failed getting the path to the Net cache")
@@ -238,6 +265,11 @@ func (c *Handle) IsDisabled() bool {
 	return c.disabled
 }
 
+// MaxSize returns the size budget of the cache in bytes, zero if unlimited.
+func (c *Handle) MaxSize() int64 {
+	return c.maxSize
+}
+
 // updateCacheSubdir update/create a sub-cache (directory) within the cache,
 // for example, the 'shub' cache.
 func updateCacheSubdir(c *Handle, subdir string) (string, error) {
@@ -298,6 +330,7 @@ func (c *Handle) cleanAllCaches() {
 		"library": c.Library,
 		"oci":     c.OciTemp,
 		"blob":    c.OciBlob,
+		"layer":   c.OciLayer,
 		"shub":    c.Shub,
 		"oras":    c.Oras,
 		"net":     c.Net,
@@ -0,0 +1,155 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cache
+
+import (
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"syscall"
+	"time"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+)
+
+// IsMetadataFile returns whether the cache entry name is a file holding
+// metadata of a cached image, like its digest record or its lock file,
+// rather than an image.
+func IsMetadataFile(name string) bool {
+	return strings.HasPrefix(name, ".")
+}
+
+// parseSize parses a size in bytes with an optional K, M, G or T binary
+// unit suffix.
+func parseSize(s string) (int64, error) {
+	s = strings.TrimSuffix(strings.ToUpper(strings.TrimSpace(s)), "B")
+	shift := uint(0)
+	if n := len(s); n > 0 {
+		if i := strings.IndexByte("KMGT", s[n-1]); i >= 0 {
+			shift = 10 * uint(i+1)
+			s = s[:n-1]
+		}
+	}
+	size, err := strconv.ParseInt(s, 10, 64)
+	if err != nil || size < 0 || size > (1<<63-1)>>shift {
+		return 0, fmt.Errorf("invalid size %q", s)
+	}
+	return size << shift, nil
+}
+
+// cacheEntry is an image stored in the cache.
+type cacheEntry struct {
+	path    string
+	size    int64
+	lastUse time.Time
+}
+
+// entries returns the images stored in the cache. OCI blobs are not
+// included, their layout is managed by containers/image.
+func (c *Handle) entries() ([]cacheEntry, error) {
+	var entries []cacheEntry
+
+	for _, dir := range []string{c.Library, c.Oras, c.Shub, c.Net, c.OciTemp, c.OciLayer} {
+		sums, err := ioutil.ReadDir(dir)
+		if err != nil {
+			return nil, err
+		}
+		for _, sum := range sums {
+			if !sum.IsDir() {
+				continue
+			}
+			files, err := ioutil.ReadDir(filepath.Join(dir, sum.Name()))
+			if err != nil {
+				return nil, err
+			}
+			for _, fi := range files {
+				if !fi.Mode().IsRegular() || IsMetadataFile(fi.Name()) {
+					continue
+				}
+				e := cacheEntry{
+					path:    filepath.Join(dir, sum.Name(), fi.Name()),
+					size:    fi.Size(),
+					lastUse: fi.ModTime(),
+				}
+				// the lock file is touched on each use of the image,
+				// fall back to the image access time without it
+				if lfi, err := os.Stat(lockPath(e.path)); err == nil {
+					e.lastUse = lfi.ModTime()
+				} else if st, ok := fi.Sys().(*syscall.Stat_t); ok {
+					if atime := time.Unix(st.Atim.Unix()); atime.After(e.lastUse) {
+						e.lastUse = atime
+					}
+				}
+				entries = append(entries, e)
+			}
+		}
+	}
+
+	return entries, nil
+}
+
+// Evict removes least recently used images until the cache fits in its
+// size budget, the image at keep is never evicted. Images locked by another
+// process are skipped. It does nothing if the cache has no size budget.
+func (c *Handle) Evict(keep string) error {
+	if c.disabled || c.maxSize <= 0 {
+		return nil
+	}
+
+	entries, err := c.entries()
+	if err != nil {
+		return err
+	}
+
+	var total int64
+	for _, e := range entries {
+		total += e.size
+	}
+	if total <= c.maxSize {
+		return nil
+	}
+
+	sort.Slice(entries, func(i, j int) bool {
+		return entries[i].lastUse.Before(entries[j].lastUse)
+	})
+
+	evicted := uint64(0)
+	for _, e := range entries {
+		if total <= c.maxSize {
+			break
+		}
+		if e.path == keep {
+			continue
+		}
+		f, err := openLock(e.path, false)
+		if err != nil {
+			sylog.Debugf("Not evicting cached image %s: %s", e.path, err)
+			continue
+		}
+		// the lock file is kept, removing it would race with another
+		// process waiting on it
+		err = os.Remove(e.path)
+		if err == nil || os.IsNotExist(err) {
+			os.Remove(digestPath(e.path))
+			sylog.Debugf("Evicted cached image %s", e.path)
+			total -= e.size
+			evicted++
+		}
+		f.Close()
+	}
+
+	if total > c.maxSize {
+		sylog.Verbosef("Cache size %d bytes still exceeds its budget of %d bytes", total, c.maxSize)
+	}
+	if evicted > 0 {
+		c.updateStats(func(s *Stats) { s.Evictions += evicted })
+	}
+	return nil
+}
@@ -0,0 +1,186 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cache
+
+import (
+	"io/ioutil"
+	"os"
+	"testing"
+	"time"
+
+	"github.com/sylabs/singularity/internal/pkg/test"
+	"golang.org/x/sys/unix"
+)
+
+func TestParseSize(t *testing.T) {
+	tests := []struct {
+		value string
+		size  int64
+		ok    bool
+	}{
+		{"1024", 1024, true},
+		{"10K", 10 << 10, true},
+		{"20m", 20 << 20, true},
+		{"3GB", 3 << 30, true},
+		{"1T", 1 << 40, true},
+		{"", 0, false},
+		{"-1G", 0, false},
+		{"1.5G", 0, false},
+		{"1P", 0, false},
+		{"9999999999T", 0, false},
+	}
+
+	for _, tt := range tests {
+		size, err := parseSize(tt.value)
+		if (err == nil) != tt.ok {
+			t.Errorf("%q: unexpected error: %v", tt.value, err)
+		} else if size != tt.size {
+			t.Errorf("%q: got size %d instead of %d", tt.value, size, tt.size)
+		}
+	}
+}
+
+func TestEvict(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	dir, err := ioutil.TempDir("", "cache-evict-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	c, err := NewHandle(Config{BaseDir: dir})
+	if err != nil {
+		t.Fatal(err)
+	}
+	c.checkIfCacheDisabled(t)
+
+	images := []string{
+		c.LibraryImage("sha256.1", "oldest.sif"),
+		c.OrasImage("sha256.2", "locked.sif"),
+		c.ShubImage("sha256.3", "used.sif"),
+		c.NetImage("hash", "recent.sif"),
+		c.OciTempImage("sha256.4", "newest.sif"),
+	}
+	// oldest first, the used image was recently used through its lock
+	now := time.Now()
+	for i, image := range images {
+		if err := ioutil.WriteFile(image, make([]byte, 1000), 0644); err != nil {
+			t.Fatal(err)
+		}
+		used := now.Add(time.Duration(i-len(images)) * time.Hour)
+		if err := os.Chtimes(image, used, used); err != nil {
+			t.Fatal(err)
+		}
+	}
+	unlock, err := c.LockEntry(images[2])
+	if err != nil {
+		t.Fatal(err)
+	}
+	unlock()
+
+	// an image in use by another process is never evicted
+	f, err := openLock(images[1], false)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer f.Close()
+
+	c.maxSize = 3000
+	if err := c.Evict(images[4]); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+
+	for i, evicted := range []bool{true, false, false, true, false} {
+		_, err := os.Stat(images[i])
+		if evicted && !os.IsNotExist(err) {
+			t.Errorf("%s not evicted", images[i])
+		} else if !evicted && err != nil {
+			t.Errorf("%s evicted", images[i])
+		}
+	}
+
+	stats, err := c.Stats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.Evictions != 2 {
+		t.Errorf("%d evictions counted instead of 2", stats.Evictions)
+	}
+}
+
+func TestLockEntry(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	dir, err := ioutil.TempDir("", "cache-lock-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	c, err := NewHandle(Config{BaseDir: dir})
+	if err != nil {
+		t.Fatal(err)
+	}
+	c.checkIfCacheDisabled(t)
+
+	image := c.NetImage("hash", "image.sif")
+
+	unlock, err := c.LockEntry(image)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	// a concurrent fill waits for the first one and finds the image
+	done := make(chan bool)
+	go func() {
+		unlock, err := c.LockEntry(image)
+		if err != nil {
+			t.Error(err)
+			close(done)
+			return
+		}
+		defer unlock()
+		exists, _ := c.NetImageExists("hash", "image.sif")
+		done <- exists
+	}()
+
+	select {
+	case <-done:
+		t.Fatalf("cache entry not locked")
+	case <-time.After(100 * time.Millisecond):
+	}
+
+	if exists, _ := c.NetImageExists("hash", "image.sif"); exists {
+		t.Fatalf("unexpected image in cache")
+	}
+	if err := ioutil.WriteFile(image, []byte("image"), 0644); err != nil {
+		t.Fatal(err)
+	}
+	unlock()
+
+	if !<-done {
+		t.Errorf("image filled by another process not found")
+	}
+
+	// the image is kept from eviction while this process uses it
+	if f, err := openLock(image, false); err != unix.EWOULDBLOCK {
+		if err == nil {
+			f.Close()
+		}
+		t.Errorf("used image not locked: %v", err)
+	}
+
+	stats, err := c.Stats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.Hits != 1 || stats.Misses != 1 {
+		t.Errorf("unexpected counters: %+v", stats)
+	}
+}
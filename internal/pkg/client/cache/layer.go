@@ -0,0 +1,88 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cache
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"io"
+	"os"
+	"path/filepath"
+)
+
+const (
+	// OciLayerDir is the directory inside cache.Dir() where uncompressed
+	// oci layers are cached
+	OciLayerDir = "oci-layer"
+
+	// ociLayerSuffix is the suffix of an uncompressed layer tar archive
+	// named after its diffID
+	ociLayerSuffix = ".tar"
+)
+
+// getOciLayerCachePath returns the directory inside cache.Dir() where
+// uncompressed oci layers are cached
+func getOciLayerCachePath(c *Handle) (string, error) {
+	// This function may act on an cache object that is not fully initialized
+	// so it is not a method on a Handle but rather an independent
+	// function
+
+	return updateCacheSubdir(c, OciLayerDir)
+}
+
+// OciLayerTar creates a directory inside cache.Dir() with the name of the
+// hex encoded diffID of a layer and returns the path of its uncompressed tar
+// archive, named after the diffID as well.
+func (c *Handle) OciLayerTar(diffID string) string {
+	if c.disabled {
+		return ""
+	}
+
+	_, err := updateCacheSubdir(c, filepath.Join(OciLayerDir, diffID))
+	if err != nil {
+		return ""
+	}
+
+	return filepath.Join(c.OciLayer, diffID, diffID+ociLayerSuffix)
+}
+
+// OciLayerExists returns whether the uncompressed layer with the hex encoded
+// diffID exists in the OciLayer cache. The layer is only hashed if it was
+// modified since its digest was last verified.
+func (c *Handle) OciLayerExists(diffID string) (bool, error) {
+	if c.disabled {
+		return false, nil
+	}
+
+	return c.countLookup(verifyImage(c.OciLayerTar(diffID), diffID, layerHash, false))
+}
+
+// VerifyOciLayer hashes the uncompressed layer with the hex encoded diffID
+// in the OciLayer cache and records its digest, it returns ErrBadChecksum if
+// the layer is corrupted.
+func (c *Handle) VerifyOciLayer(diffID, name string) (bool, error) {
+	if c.disabled || name != diffID+ociLayerSuffix {
+		return false, nil
+	}
+
+	return verifyImage(c.OciLayerTar(diffID), diffID, layerHash, true)
+}
+
+// layerHash returns the hex encoded sha256 digest of the file at path, the
+// diffID of an uncompressed layer.
+func layerHash(path string) (string, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return "", err
+	}
+	defer f.Close()
+
+	h := sha256.New()
+	if _, err := io.Copy(h, f); err != nil {
+		return "", err
+	}
+	return hex.EncodeToString(h.Sum(nil)), nil
+}
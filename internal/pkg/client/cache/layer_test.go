@@ -0,0 +1,63 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cache
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/sylabs/singularity/internal/pkg/test"
+)
+
+func TestOciLayer(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	dir, err := ioutil.TempDir("", "cache-layer-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	c, err := NewHandle(Config{BaseDir: dir})
+	if err != nil {
+		t.Fatalf("failed to create new image cache handle: %s", err)
+	}
+	c.checkIfCacheDisabled(t)
+
+	content := []byte("layer content")
+	sum := sha256.Sum256(content)
+	diffID := hex.EncodeToString(sum[:])
+
+	path := c.OciLayerTar(diffID)
+	if expected := filepath.Join(dir, "cache", OciLayerDir, diffID, diffID+".tar"); path != expected {
+		t.Errorf("unexpected layer path %s instead of %s", path, expected)
+	}
+
+	if exists, err := c.OciLayerExists(diffID); err != nil || exists {
+		t.Fatalf("unexpected lookup result before fill: %v %v", exists, err)
+	}
+	if err := ioutil.WriteFile(path, content, 0644); err != nil {
+		t.Fatal(err)
+	}
+	if exists, err := c.OciLayerExists(diffID); err != nil || !exists {
+		t.Fatalf("unexpected lookup result after fill: %v %v", exists, err)
+	}
+	if _, err := c.VerifyOciLayer(diffID, diffID+".tar"); err != nil {
+		t.Errorf("unexpected verification failure: %s", err)
+	}
+
+	if err := ioutil.WriteFile(path, []byte("corrupted"), 0644); err != nil {
+		t.Fatal(err)
+	}
+	if _, err := c.OciLayerExists(diffID); err != ErrBadChecksum {
+		t.Errorf("unexpected lookup error %v for a corrupted layer", err)
+	}
+}
@@ -6,7 +6,6 @@
 package cache
 
 import (
-	"os"
 	"path/filepath"
 
 	"github.com/sylabs/scs-library-client/client"
@@ -42,26 +41,21 @@ func (c *Handle) LibraryImage(sum, name string) string {
 }
 
 // LibraryImageExists returns whether the image with the SHA sum exists in the LibraryImage cache.
+// The image is only hashed if it was modified since its digest was last verified.
 func (c *Handle) LibraryImageExists(sum, name string) (bool, error) {
 	if c.disabled {
 		return false, nil
 	}
 
-	imagePath := c.LibraryImage(sum, name)
-	_, err := os.Stat(imagePath)
-	if os.IsNotExist(err) {
-		return false, nil
-	} else if err != nil {
-		return false, err
-	}
+	return c.countLookup(verifyImage(c.LibraryImage(sum, name), sum, client.ImageHash, false))
+}
 
-	cacheSum, err := client.ImageHash(imagePath)
-	if err != nil {
-		return false, err
-	}
-	if cacheSum != sum {
-		return false, ErrBadChecksum
+// VerifyLibraryImage hashes the image with the SHA sum in the LibraryImage cache
+// and records its digest, it returns ErrBadChecksum if the image is corrupted.
+func (c *Handle) VerifyLibraryImage(sum, name string) (bool, error) {
+	if c.disabled {
+		return false, nil
 	}
 
-	return true, nil
+	return verifyImage(c.LibraryImage(sum, name), sum, client.ImageHash, true)
 }
@@ -0,0 +1,187 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cache
+
+import (
+	"os"
+	"path/filepath"
+	"sync"
+	"time"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"golang.org/x/sys/unix"
+)
+
+// lockSuffix is the suffix of the hidden file used to serialize the fill of
+// a cache entry, its modification time records the last use of the entry.
+const lockSuffix = ".lock"
+
+func lockPath(path string) string {
+	dir, name := filepath.Split(path)
+	return filepath.Join(dir, "."+name+lockSuffix)
+}
+
+// useGranularity is the precision of the last use recorded for a cache
+// entry, it saves a lock file update on each use of the entry.
+const useGranularity = time.Minute
+
+// held maps the lock files of the cache entries used by this process to
+// their open files holding a shared lock.
+var (
+	heldMu sync.Mutex
+	held   = make(map[string]*os.File)
+)
+
+// flock applies the lock operation how to the file f, if wait is true and
+// the lock is held by another process, it logs that the fetch of the cache
+// entry at path is awaited and blocks until it gets the lock.
+func flock(f *os.File, how int, wait bool, path string) error {
+	err := unix.Flock(int(f.Fd()), how|unix.LOCK_NB)
+	if err == unix.EWOULDBLOCK && wait {
+		sylog.Infof("Waiting for another process to fetch %s", filepath.Base(path))
+		for err = unix.EINTR; err == unix.EINTR; {
+			err = unix.Flock(int(f.Fd()), how)
+		}
+	}
+	return err
+}
+
+// openLock opens the lock file of the cache entry at path and takes an
+// exclusive lock on it, if wait is false and the lock is held by another
+// process, it returns unix.EWOULDBLOCK.
+func openLock(path string, wait bool) (*os.File, error) {
+	f, err := os.OpenFile(lockPath(path), os.O_RDWR|os.O_CREATE, 0600)
+	if err != nil {
+		return nil, err
+	}
+	if err := flock(f, unix.LOCK_EX, wait, path); err != nil {
+		f.Close()
+		return nil, err
+	}
+	return f, nil
+}
+
+// takeHeld returns the lock file held by this process for the cache entry
+// lock file lp, if any, and forgets it.
+func takeHeld(lp string) *os.File {
+	heldMu.Lock()
+	defer heldMu.Unlock()
+
+	f := held[lp]
+	delete(held, lp)
+	return f
+}
+
+// hold keeps the lock file f of a cache entry open until this process
+// exits, or until it executes starter if the lock is passed to it with
+// InheritLocks.
+func hold(f *os.File) {
+	heldMu.Lock()
+	defer heldMu.Unlock()
+
+	if old := held[f.Name()]; old != nil && old != f {
+		old.Close()
+	}
+	held[f.Name()] = f
+}
+
+// InheritLocks makes the lock files held on the cache entries used by this
+// process inherited across exec and returns their file descriptors. They
+// must be passed to the starter executed next, which holds the shared
+// locks for the lifetime of the container using the entries.
+func InheritLocks() []int {
+	heldMu.Lock()
+	defer heldMu.Unlock()
+
+	fds := make([]int, 0, len(held))
+	for _, f := range held {
+		if _, err := unix.FcntlInt(f.Fd(), unix.F_SETFD, 0); err != nil {
+			sylog.Debugf("Could not keep lock file %s across exec: %s", f.Name(), err)
+			continue
+		}
+		fds = append(fds, int(f.Fd()))
+	}
+	return fds
+}
+
+// LockEntry locks the cache entry at path, as returned by LibraryImage,
+// OrasImage, ShubImage, NetImage, OciTempImage or OciLayerTar, and marks
+// the entry as used. Concurrent pulls of the same image by several
+// processes are serialized: the first one takes an exclusive lock to fill
+// the entry while the others wait and find it in the cache once the lock
+// is released. An entry already filled is only locked shared, so that
+// processes using the same image don't wait for each other. The returned
+// function must be called once the entry is filled or used, it evicts
+// least recently used entries if the entry was missing and the cache
+// exceeds its size budget. A shared lock is then kept on the entry until
+// this process exits, or the container it starts with the lock passed by
+// InheritLocks, so that the entry can't be evicted while it is used.
+func (c *Handle) LockEntry(path string) (func(), error) {
+	if c.disabled || path == "" {
+		return func() {}, nil
+	}
+
+	f, err := os.OpenFile(lockPath(path), os.O_RDWR|os.O_CREATE, 0600)
+	if err != nil {
+		return nil, err
+	}
+
+	exclusive := true
+	if err := unix.Flock(int(f.Fd()), unix.LOCK_EX|unix.LOCK_NB); err == unix.EWOULDBLOCK {
+		// used or being filled, wait for the fill to complete
+		exclusive = false
+		err = flock(f, unix.LOCK_SH, true, path)
+		if err == nil {
+			// a lock held by this process for an earlier use of the entry
+			// would deadlock the upgrade below
+			if old := takeHeld(f.Name()); old != nil {
+				old.Close()
+			}
+			if _, serr := os.Stat(path); os.IsNotExist(serr) {
+				// the conversion drops the shared lock first, the entry
+				// may be filled in between, callers check it
+				exclusive = true
+				err = flock(f, unix.LOCK_EX, true, path)
+			}
+		}
+		if err != nil {
+			f.Close()
+			return nil, err
+		}
+	} else if err != nil {
+		f.Close()
+		return nil, err
+	}
+	_, err = os.Stat(path)
+	existed := err == nil
+
+	now := time.Now()
+	if fi, err := f.Stat(); err == nil && now.Sub(fi.ModTime()) >= useGranularity {
+		if err := os.Chtimes(f.Name(), now, now); err != nil {
+			sylog.Debugf("Could not record last use of cache entry %s: %s", path, err)
+		}
+	}
+
+	return func() {
+		if !existed {
+			if err := c.Evict(path); err != nil {
+				sylog.Warningf("Could not evict cache entries: %s", err)
+			}
+		}
+		if exclusive {
+			var err error
+			for err = unix.EINTR; err == unix.EINTR; {
+				err = unix.Flock(int(f.Fd()), unix.LOCK_SH)
+			}
+			if err != nil {
+				sylog.Debugf("Could not downgrade lock of cache entry %s: %s", path, err)
+				f.Close()
+				return
+			}
+		}
+		hold(f)
+	}, nil
+}
@@ -58,10 +58,10 @@ func (c *Handle) NetImageExists(sum, name string) (bool, error) {
 
 	_, err := os.Stat(c.NetImage(sum, name))
 	if os.IsNotExist(err) {
-		return false, nil
+		return c.countLookup(false, nil)
 	} else if err != nil {
 		return false, err
 	}
 
-	return true, nil
+	return c.countLookup(true, nil)
 }
@@ -6,7 +6,6 @@
 package cache
 
 import (
-	"os"
 	"path/filepath"
 
 	"github.com/sylabs/singularity/internal/pkg/oras"
@@ -41,27 +40,22 @@ func (c *Handle) OrasImage(sum, name string) string {
 	return filepath.Join(dir, name)
 }
 
-// OrasImageExists returns whether the image with the SHA sum exists in the OrasImage cache
+// OrasImageExists returns whether the image with the SHA sum exists in the OrasImage cache.
+// The image is only hashed if it was modified since its digest was last verified.
 func (c *Handle) OrasImageExists(sum, name string) (bool, error) {
 	if c.disabled {
 		return false, nil
 	}
 
-	imagePath := c.OrasImage(sum, name)
-	_, err := os.Stat(imagePath)
-	if os.IsNotExist(err) {
-		return false, nil
-	} else if err != nil {
-		return false, err
-	}
+	return c.countLookup(verifyImage(c.OrasImage(sum, name), sum, oras.ImageHash, false))
+}
 
-	cacheSum, err := oras.ImageHash(imagePath)
-	if err != nil {
-		return false, err
-	}
-	if cacheSum != sum {
-		return false, ErrBadChecksum
+// VerifyOrasImage hashes the image with the SHA sum in the OrasImage cache
+// and records its digest, it returns ErrBadChecksum if the image is corrupted.
+func (c *Handle) VerifyOrasImage(sum, name string) (bool, error) {
+	if c.disabled {
+		return false, nil
 	}
 
-	return true, nil
+	return verifyImage(c.OrasImage(sum, name), sum, oras.ImageHash, true)
 }
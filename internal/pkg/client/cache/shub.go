@@ -47,10 +47,10 @@ func (c *Handle) ShubImageExists(sum, name string) (bool, error) {
 
 	_, err := os.Stat(c.ShubImage(sum, name))
 	if os.IsNotExist(err) {
-		return false, nil
+		return c.countLookup(false, nil)
 	} else if err != nil {
 		return false, err
 	}
 
-	return true, nil
+	return c.countLookup(true, nil)
 }
@@ -0,0 +1,114 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package cache
+
+import (
+	"bytes"
+	"encoding/json"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"golang.org/x/sys/unix"
+)
+
+// statsFile is the name of the file in the cache root directory holding
+// the cache counters.
+const statsFile = ".stats"
+
+// Stats holds the counters of the cache, shared by all the processes using
+// the same cache directory.
+type Stats struct {
+	// Hits is the number of image lookups found in the cache
+	Hits uint64 `json:"hits"`
+	// Misses is the number of image lookups not found in the cache
+	Misses uint64 `json:"misses"`
+	// Evictions is the number of images evicted to fit the cache in its
+	// size budget
+	Evictions uint64 `json:"evictions"`
+}
+
+// Stats returns the counters of the cache.
+func (c *Handle) Stats() (Stats, error) {
+	var s Stats
+
+	if c.disabled {
+		return s, nil
+	}
+
+	b, err := ioutil.ReadFile(filepath.Join(c.rootDir, statsFile))
+	if os.IsNotExist(err) {
+		return s, nil
+	} else if err != nil {
+		return s, err
+	}
+	err = json.Unmarshal(b, &s)
+	return s, err
+}
+
+// updateStats applies update to the cache counters, they are only written
+// if changed. Counters are best effort, a failure is only logged.
+func (c *Handle) updateStats(update func(*Stats)) {
+	if c.disabled {
+		return
+	}
+
+	err := func() error {
+		f, err := os.OpenFile(filepath.Join(c.rootDir, statsFile), os.O_RDWR|os.O_CREATE, 0600)
+		if err != nil {
+			return err
+		}
+		defer f.Close()
+
+		if err := unix.Flock(int(f.Fd()), unix.LOCK_EX); err != nil {
+			return err
+		}
+
+		var s Stats
+		b, err := ioutil.ReadAll(f)
+		if err != nil {
+			return err
+		}
+		if len(b) > 0 {
+			if err := json.Unmarshal(b, &s); err != nil {
+				sylog.Debugf("Resetting invalid cache counters: %s", err)
+				s = Stats{}
+			}
+		}
+		update(&s)
+
+		nb, err := json.Marshal(&s)
+		if err != nil {
+			return err
+		} else if bytes.Equal(nb, b) {
+			return nil
+		}
+		if err := f.Truncate(0); err != nil {
+			return err
+		}
+		_, err = f.WriteAt(nb, 0)
+		return err
+	}()
+	if err != nil {
+		sylog.Debugf("Could not update cache counters: %s", err)
+	}
+}
+
+// countLookup records the result of an image lookup in the cache counters
+// and returns it unchanged.
+func (c *Handle) countLookup(exists bool, err error) (bool, error) {
+	if err == nil {
+		c.updateStats(func(s *Stats) {
+			if exists {
+				s.Hits++
+			} else {
+				s.Misses++
+			}
+		})
+	}
+	return exists, err
+}
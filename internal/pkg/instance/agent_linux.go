@@ -0,0 +1,450 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package instance
+
+import (
+	"encoding/json"
+	"fmt"
+	"net"
+	"os"
+	"os/signal"
+	"path/filepath"
+	"sync"
+	"syscall"
+)
+
+// execAgentSocket is the name of the exec agent socket stored in the
+// instance directory.
+const execAgentSocket = "exec.sock"
+
+// maxSocketPath is the maximum length of a unix socket path.
+const maxSocketPath = 107
+
+// ExecRequest describes a process started by the exec agent of an instance.
+type ExecRequest struct {
+	Args []string `json:"args"`
+	Env  []string `json:"env"`
+	Cwd  string   `json:"cwd"`
+}
+
+// execMessage is sent by the client once the process is started to
+// forward a signal to the process.
+type execMessage struct {
+	Signal int `json:"signal"`
+}
+
+// execResponse is sent by the exec agent once the process is started with
+// its PID or with the error preventing to start it, and once the process
+// exited with its wait status.
+type execResponse struct {
+	Pid    int    `json:"pid,omitempty"`
+	Status *int   `json:"status,omitempty"`
+	Error  string `json:"error,omitempty"`
+}
+
+// SpawnFunc starts the process described by req with stdio as standard
+// streams without waiting for it and returns its PID.
+type SpawnFunc func(req *ExecRequest, stdio []*os.File) (int, error)
+
+// ExecAgent serves the exec requests sent to an instance. It runs in the
+// instance process, so processes it starts are already in the namespaces
+// and in the cgroup of the instance and inherit its credentials and its
+// security context, exactly like a process joining the instance. Only
+// clients with the same UID and GID than the instance process are served,
+// the privilege checks done when joining an instance ensure the same
+// ownership.
+type ExecAgent struct {
+	listener *net.UnixListener
+	spawn    SpawnFunc
+	uid      int
+	gid      int
+
+	mu    sync.Mutex
+	procs map[int]chan syscall.WaitStatus
+}
+
+// NewExecAgent returns an exec agent serving the listening socket f and
+// starting processes with spawn. The exit status of the processes must be
+// reported with Reaped by the caller which is responsible for reaping them.
+func NewExecAgent(f *os.File, spawn SpawnFunc) (*ExecAgent, error) {
+	l, err := net.FileListener(f)
+	if err != nil {
+		return nil, fmt.Errorf("while getting exec agent listener: %s", err)
+	}
+	f.Close()
+
+	ul, ok := l.(*net.UnixListener)
+	if !ok {
+		l.Close()
+		return nil, fmt.Errorf("exec agent socket is not a unix socket")
+	}
+
+	return &ExecAgent{
+		listener: ul,
+		spawn:    spawn,
+		uid:      os.Getuid(),
+		gid:      os.Getgid(),
+		procs:    make(map[int]chan syscall.WaitStatus),
+	}, nil
+}
+
+// Serve accepts and serves the exec requests until the listener is closed.
+func (a *ExecAgent) Serve() error {
+	for {
+		c, err := a.listener.AcceptUnix()
+		if err != nil {
+			return err
+		}
+		go a.handle(c)
+	}
+}
+
+// Close closes the listener, processes already started are not affected.
+func (a *ExecAgent) Close() error {
+	return a.listener.Close()
+}
+
+// Reaped reports the wait status of a reaped process, it returns false
+// if the process wasn't started by the exec agent.
+func (a *ExecAgent) Reaped(pid int, status syscall.WaitStatus) bool {
+	a.mu.Lock()
+	defer a.mu.Unlock()
+
+	done, ok := a.procs[pid]
+	if ok {
+		delete(a.procs, pid)
+		done <- status
+	}
+	return ok
+}
+
+// kill sends sig to the process group of pid if the process wasn't reaped
+// yet, a reaped PID could have been reused already.
+func (a *ExecAgent) kill(pid int, sig syscall.Signal) {
+	a.mu.Lock()
+	defer a.mu.Unlock()
+
+	if _, ok := a.procs[pid]; ok {
+		syscall.Kill(-pid, sig)
+	}
+}
+
+func (a *ExecAgent) handle(c *net.UnixConn) {
+	defer c.Close()
+
+	enc := json.NewEncoder(c)
+	dec := json.NewDecoder(c)
+
+	pid, done, err := a.start(c, dec)
+	if err != nil {
+		enc.Encode(&execResponse{Error: err.Error()})
+		return
+	}
+	if err := enc.Encode(&execResponse{Pid: pid}); err != nil {
+		a.kill(pid, syscall.SIGKILL)
+		<-done
+		return
+	}
+
+	// forward the signals sent by the client to the process group, the
+	// process group is killed if the client disconnects before the
+	// process exits
+	go func() {
+		for {
+			var m execMessage
+			if err := dec.Decode(&m); err != nil {
+				a.kill(pid, syscall.SIGKILL)
+				return
+			}
+			if m.Signal > 0 {
+				a.kill(pid, syscall.Signal(m.Signal))
+			}
+		}
+	}()
+
+	status := int(<-done)
+	enc.Encode(&execResponse{Status: &status})
+}
+
+// start authorizes the client, receives its standard streams and the
+// request and starts the process.
+func (a *ExecAgent) start(c *net.UnixConn, dec *json.Decoder) (int, chan syscall.WaitStatus, error) {
+	if err := a.checkPeer(c); err != nil {
+		return 0, nil, err
+	}
+
+	stdio, err := recvStdio(c)
+	if err != nil {
+		return 0, nil, err
+	}
+	defer func() {
+		for _, f := range stdio {
+			f.Close()
+		}
+	}()
+
+	req := new(ExecRequest)
+	if err := dec.Decode(req); err != nil {
+		return 0, nil, fmt.Errorf("while decoding exec request: %s", err)
+	}
+	if len(req.Args) == 0 {
+		return 0, nil, fmt.Errorf("no process arguments")
+	}
+
+	// the process is registered before Reaped can be called for it
+	a.mu.Lock()
+	defer a.mu.Unlock()
+
+	pid, err := a.spawn(req, stdio)
+	if err != nil {
+		return 0, nil, err
+	}
+	done := make(chan syscall.WaitStatus, 1)
+	a.procs[pid] = done
+
+	return pid, done, nil
+}
+
+func (a *ExecAgent) checkPeer(c *net.UnixConn) error {
+	cred, err := peerCred(c)
+	if err != nil {
+		return err
+	}
+	if int(cred.Uid) != a.uid || int(cred.Gid) != a.gid {
+		return fmt.Errorf("client %d:%d is not the instance owner", cred.Uid, cred.Gid)
+	}
+	return nil
+}
+
+// peerCred returns the credentials of the process connected to c.
+func peerCred(c *net.UnixConn) (*syscall.Ucred, error) {
+	raw, err := c.SyscallConn()
+	if err != nil {
+		return nil, err
+	}
+
+	var cred *syscall.Ucred
+	var credErr error
+	err = raw.Control(func(fd uintptr) {
+		cred, credErr = syscall.GetsockoptUcred(int(fd), syscall.SOL_SOCKET, syscall.SO_PEERCRED)
+	})
+	if err == nil {
+		err = credErr
+	}
+	if err != nil {
+		return nil, fmt.Errorf("while getting client credentials: %s", err)
+	}
+	return cred, nil
+}
+
+// recvStdio receives the standard streams sent by sendStdio.
+func recvStdio(c *net.UnixConn) ([]*os.File, error) {
+	buf := make([]byte, 1)
+	oob := make([]byte, syscall.CmsgSpace(3*4))
+
+	_, oobn, _, _, err := c.ReadMsgUnix(buf, oob)
+	if err != nil {
+		return nil, fmt.Errorf("while receiving standard streams: %s", err)
+	}
+	msgs, err := syscall.ParseSocketControlMessage(oob[:oobn])
+	if err != nil {
+		return nil, fmt.Errorf("while receiving standard streams: %s", err)
+	}
+
+	var stdio []*os.File
+	for _, msg := range msgs {
+		fds, err := syscall.ParseUnixRights(&msg)
+		if err != nil {
+			continue
+		}
+		for _, fd := range fds {
+			syscall.CloseOnExec(fd)
+			stdio = append(stdio, os.NewFile(uintptr(fd), ""))
+		}
+	}
+	if len(stdio) != 3 {
+		for _, f := range stdio {
+			f.Close()
+		}
+		return nil, fmt.Errorf("received %d standard streams instead of 3", len(stdio))
+	}
+	return stdio, nil
+}
+
+// sendStdio sends the standard streams stdio to the exec agent.
+func sendStdio(c *net.UnixConn, stdio []*os.File) error {
+	fds := make([]int, len(stdio))
+	for i, f := range stdio {
+		fds[i] = int(f.Fd())
+	}
+	_, _, err := c.WriteMsgUnix([]byte{0}, syscall.UnixRights(fds...), nil)
+	return err
+}
+
+// socketPath calls fn with a path usable to bind or connect the unix socket
+// at path, long paths are reached through a directory file descriptor.
+func socketPath(path string, fn func(string) error) error {
+	if len(path) <= maxSocketPath {
+		return fn(path)
+	}
+
+	dir, err := os.Open(filepath.Dir(path))
+	if err != nil {
+		return err
+	}
+	defer dir.Close()
+
+	return fn(fmt.Sprintf("/proc/self/fd/%d/%s", dir.Fd(), filepath.Base(path)))
+}
+
+// ExecAgentSocket returns the path of the exec agent socket of the named
+// instance.
+func ExecAgentSocket(name string) (string, error) {
+	dir, err := GetDir(name, SingSubDir)
+	if err != nil {
+		return "", err
+	}
+	return filepath.Join(dir, execAgentSocket), nil
+}
+
+// ListenExecAgent creates the exec agent socket of the named instance and
+// returns the listening socket. The close-on-exec flag of the returned
+// file is cleared so that the socket is inherited by starter and passed
+// to the instance process.
+func ListenExecAgent(name string) (*os.File, error) {
+	path, err := ExecAgentSocket(name)
+	if err != nil {
+		return nil, err
+	}
+
+	oldumask := syscall.Umask(0)
+	err = os.MkdirAll(filepath.Dir(path), 0700)
+	syscall.Umask(oldumask)
+	if err != nil {
+		return nil, err
+	}
+
+	return listenExecAgent(path)
+}
+
+func listenExecAgent(path string) (*os.File, error) {
+	return listenSocket(path, "exec agent")
+}
+
+// listenSocket creates the unix socket path of the named service, only
+// accessible by its owner, and returns the listening socket.
+func listenSocket(path string, service string) (*os.File, error) {
+	// remove the socket left by a previous process
+	if err := os.Remove(path); err != nil && !os.IsNotExist(err) {
+		return nil, err
+	}
+
+	fd, err := syscall.Socket(syscall.AF_UNIX, syscall.SOCK_STREAM, 0)
+	if err != nil {
+		return nil, fmt.Errorf("while creating %s socket: %s", service, err)
+	}
+	err = socketPath(path, func(p string) error {
+		if err := syscall.Bind(fd, &syscall.SockaddrUnix{Name: p}); err != nil {
+			return err
+		}
+		return os.Chmod(p, 0600)
+	})
+	if err == nil {
+		err = syscall.Listen(fd, syscall.SOMAXCONN)
+	}
+	if err != nil {
+		syscall.Close(fd)
+		return nil, fmt.Errorf("while creating %s socket %s: %s", service, path, err)
+	}
+	return os.NewFile(uintptr(fd), path), nil
+}
+
+// execSignals are the signals forwarded to a process started by the exec
+// agent.
+var execSignals = []os.Signal{
+	syscall.SIGHUP,
+	syscall.SIGINT,
+	syscall.SIGQUIT,
+	syscall.SIGTERM,
+	syscall.SIGUSR1,
+	syscall.SIGUSR2,
+	syscall.SIGALRM,
+}
+
+// ExecWithAgent starts the process described by req with the exec agent of
+// the named instance, with the standard streams of the current process, and
+// waits for it. The signals received meanwhile are forwarded to the process.
+// The returned boolean is false if the process wasn't started, either
+// because the instance has no exec agent or because the request was
+// rejected, so that the caller can join the instance instead.
+func ExecWithAgent(name string, req *ExecRequest) (syscall.WaitStatus, bool, error) {
+	path, err := ExecAgentSocket(name)
+	if err != nil {
+		return 0, false, err
+	}
+
+	signals := make(chan os.Signal, len(execSignals))
+	signal.Notify(signals, execSignals...)
+	defer signal.Stop(signals)
+
+	stdio := []*os.File{os.Stdin, os.Stdout, os.Stderr}
+	return execWithAgent(path, req, stdio, signals)
+}
+
+func execWithAgent(path string, req *ExecRequest, stdio []*os.File, signals <-chan os.Signal) (syscall.WaitStatus, bool, error) {
+	var c *net.UnixConn
+	err := socketPath(path, func(p string) error {
+		var err error
+		c, err = net.DialUnix("unix", nil, &net.UnixAddr{Name: p, Net: "unix"})
+		return err
+	})
+	if err != nil {
+		return 0, false, err
+	}
+	defer c.Close()
+
+	if err := sendStdio(c, stdio); err != nil {
+		return 0, false, fmt.Errorf("while sending standard streams: %s", err)
+	}
+	enc := json.NewEncoder(c)
+	if err := enc.Encode(req); err != nil {
+		return 0, false, fmt.Errorf("while sending exec request: %s", err)
+	}
+
+	dec := json.NewDecoder(c)
+	var resp execResponse
+	if err := dec.Decode(&resp); err != nil {
+		return 0, false, fmt.Errorf("while reading exec agent response: %s", err)
+	}
+	if resp.Error != "" {
+		return 0, false, fmt.Errorf("exec agent error: %s", resp.Error)
+	}
+
+	pid := resp.Pid
+	responses := make(chan error, 1)
+	go func() {
+		resp = execResponse{}
+		err := dec.Decode(&resp)
+		if err == nil && resp.Status == nil {
+			err = fmt.Errorf("no exit status")
+		}
+		responses <- err
+	}()
+
+	for {
+		select {
+		case s := <-signals:
+			if err := enc.Encode(&execMessage{Signal: int(s.(syscall.Signal))}); err != nil {
+				return 0, true, fmt.Errorf("while forwarding signal: %s", err)
+			}
+		case err := <-responses:
+			if err != nil {
+				return 0, true, fmt.Errorf("while waiting process %d: %s", pid, err)
+			}
+			return syscall.WaitStatus(*resp.Status), true, nil
+		}
+	}
+}
@@ -0,0 +1,221 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package instance
+
+import (
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"strings"
+	"syscall"
+	"testing"
+)
+
+// startTestAgent starts an exec agent listening in dir, the test process
+// isn't an instance process reaping all its children, so each process is
+// waited individually.
+func startTestAgent(t testing.TB, dir string) (*ExecAgent, string) {
+	path := filepath.Join(dir, execAgentSocket)
+	f, err := listenExecAgent(path)
+	if err != nil {
+		t.Fatalf("unexpected error while creating exec agent socket: %s", err)
+	}
+
+	var a *ExecAgent
+	spawn := func(req *ExecRequest, stdio []*os.File) (int, error) {
+		pid, err := syscall.ForkExec(req.Args[0], req.Args, &syscall.ProcAttr{
+			Dir:   req.Cwd,
+			Env:   req.Env,
+			Files: []uintptr{stdio[0].Fd(), stdio[1].Fd(), stdio[2].Fd()},
+			Sys:   &syscall.SysProcAttr{Setsid: true},
+		})
+		if err != nil {
+			return 0, err
+		}
+		go func() {
+			var status syscall.WaitStatus
+			if _, err := syscall.Wait4(pid, &status, 0, nil); err == nil {
+				a.Reaped(pid, status)
+			}
+		}()
+		return pid, nil
+	}
+
+	a, err = NewExecAgent(f, spawn)
+	if err != nil {
+		t.Fatalf("unexpected error while creating exec agent: %s", err)
+	}
+	go a.Serve()
+
+	return a, path
+}
+
+func TestExecAgent(t *testing.T) {
+	dir, err := ioutil.TempDir("", "exec-agent-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	a, path := startTestAgent(t, dir)
+	defer a.Close()
+
+	fi, err := os.Stat(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if fi.Mode()&os.ModeSocket == 0 || fi.Mode().Perm() != 0600 {
+		t.Errorf("unexpected exec agent socket mode %s", fi.Mode())
+	}
+
+	out, err := ioutil.TempFile(dir, "out-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer out.Close()
+	stdio := []*os.File{os.Stdin, out, out}
+
+	tests := []struct {
+		name    string
+		req     *ExecRequest
+		signal  os.Signal
+		started bool
+		status  int
+		killed  syscall.Signal
+		output  string
+	}{
+		{
+			name:    "exit status",
+			req:     &ExecRequest{Args: []string{"/bin/sh", "-c", "exit 3"}, Cwd: "/"},
+			started: true,
+			status:  3,
+		},
+		{
+			name: "environment and working directory",
+			req: &ExecRequest{
+				Args: []string{"/bin/sh", "-c", `echo "$AGENT_TEST $(pwd)"`},
+				Env:  []string{"AGENT_TEST=value"},
+				Cwd:  dir,
+			},
+			started: true,
+			output:  "value " + dir + "\n",
+		},
+		{
+			name:    "signal",
+			req:     &ExecRequest{Args: []string{"/bin/sleep", "60"}, Cwd: "/"},
+			signal:  syscall.SIGTERM,
+			started: true,
+			killed:  syscall.SIGTERM,
+		},
+		{
+			name: "bad executable",
+			req:  &ExecRequest{Args: []string{"/non/existent"}, Cwd: "/"},
+		},
+		{
+			name: "no arguments",
+			req:  &ExecRequest{Cwd: "/"},
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			out.Truncate(0)
+			out.Seek(0, 0)
+
+			signals := make(chan os.Signal, 1)
+			if tt.signal != nil {
+				signals <- tt.signal
+			}
+
+			status, started, err := execWithAgent(path, tt.req, stdio, signals)
+			if started != tt.started {
+				t.Fatalf("unexpected started %v: %v", started, err)
+			}
+			if !tt.started {
+				if err == nil {
+					t.Errorf("unexpected success")
+				}
+				return
+			}
+			if err != nil {
+				t.Fatalf("unexpected error: %s", err)
+			}
+			if tt.killed != 0 {
+				if !status.Signaled() || status.Signal() != tt.killed {
+					t.Errorf("unexpected status %v instead of signal %s", status, tt.killed)
+				}
+			} else if status.ExitStatus() != tt.status {
+				t.Errorf("unexpected exit status %d instead of %d", status.ExitStatus(), tt.status)
+			}
+			if b, _ := ioutil.ReadFile(out.Name()); string(b) != tt.output {
+				t.Errorf("unexpected output %q instead of %q", b, tt.output)
+			}
+		})
+	}
+}
+
+func TestExecAgentLongPath(t *testing.T) {
+	dir, err := ioutil.TempDir("", "exec-agent-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	long := filepath.Join(dir, strings.Repeat("d", 64), strings.Repeat("d", 64))
+	if err := os.MkdirAll(long, 0700); err != nil {
+		t.Fatal(err)
+	}
+
+	a, path := startTestAgent(t, long)
+	defer a.Close()
+
+	if len(path) <= maxSocketPath {
+		t.Fatalf("socket path %s is too short", path)
+	}
+
+	req := &ExecRequest{Args: []string{"/bin/true"}, Cwd: "/"}
+	stdio := []*os.File{os.Stdin, os.Stdout, os.Stderr}
+	if _, started, err := execWithAgent(path, req, stdio, nil); !started || err != nil {
+		t.Errorf("unexpected error: %v", err)
+	}
+}
+
+// BenchmarkExecAgent measures the latency of a process started through an
+// exec agent, from the connection to the exec agent to the process exit,
+// compared to the latency of the process alone.
+func BenchmarkExecAgent(b *testing.B) {
+	dir, err := ioutil.TempDir("", "exec-agent-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	a, path := startTestAgent(b, dir)
+	defer a.Close()
+
+	args := []string{"/bin/true"}
+	stdio := []*os.File{os.Stdin, os.Stdout, os.Stderr}
+
+	b.Run("process", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			pid, err := syscall.ForkExec(args[0], args, &syscall.ProcAttr{
+				Files: []uintptr{stdio[0].Fd(), stdio[1].Fd(), stdio[2].Fd()},
+			})
+			if err != nil {
+				b.Fatal(err)
+			}
+			syscall.Wait4(pid, nil, 0, nil)
+		}
+	})
+	b.Run("exec-agent", func(b *testing.B) {
+		req := &ExecRequest{Args: args, Cwd: "/"}
+		for i := 0; i < b.N; i++ {
+			if _, _, err := execWithAgent(path, req, stdio, nil); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
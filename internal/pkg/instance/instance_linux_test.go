@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -9,6 +9,7 @@ import (
 	"os"
 	"os/exec"
 	"path/filepath"
+	"strings"
 	"testing"
 
 	"github.com/sylabs/singularity/internal/pkg/test"
@@ -252,6 +253,11 @@ func TestGet(t *testing.T) {
 }
 
 func TestMain(m *testing.M) {
+	if v := os.Getenv(monitorHelperEnv); v != "" {
+		s := strings.SplitN(v, ":", 2)
+		monitorHelper(s[0], s[1])
+	}
+
 	// spawn a fake instance process
 	cmd := exec.Command("cat")
 	// keep cat running until it gets killed
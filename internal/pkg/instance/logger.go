@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -11,8 +11,8 @@ import (
 	"fmt"
 	"io"
 	"os"
-	"strings"
 	"sync"
+	"sync/atomic"
 	"syscall"
 	"time"
 )
@@ -26,22 +26,63 @@ const (
 	JSONLogFormat = "json"
 )
 
-// LogFormatter implements a log formatter.
-type LogFormatter func(stream string, data string) string
+const (
+	// logFlushSize is the size of buffered log lines triggering
+	// a write to the log file.
+	logFlushSize = 64 * 1024
+	// logFlushInterval bounds the time a log line stays buffered
+	// before being written to the log file.
+	logFlushInterval = 100 * time.Millisecond
+)
 
-func kubernetesLogFormatter(stream, data string) string {
-	return fmt.Sprintf("%s %s F %s\n", time.Now().Format(time.RFC3339Nano), stream, data)
+// LogFormatter implements a log formatter, it appends the formatted
+// data of stream to buf and returns the extended buffer.
+type LogFormatter func(buf []byte, stream string, data []byte) []byte
+
+func kubernetesLogFormatter(buf []byte, stream string, data []byte) []byte {
+	buf = time.Now().AppendFormat(buf, time.RFC3339Nano)
+	buf = append(buf, ' ')
+	buf = append(buf, stream...)
+	buf = append(buf, " F "...)
+	buf = append(buf, data...)
+	return append(buf, '\n')
 }
 
-func jsonLogFormatter(stream, data string) string {
-	return fmt.Sprintf("{\"time\":\"%s\",\"stream\":\"%s\",\"log\":\"%s\"}\n", time.Now().Format(time.RFC3339Nano), stream, data)
+func jsonLogFormatter(buf []byte, stream string, data []byte) []byte {
+	buf = append(buf, "{\"time\":\""...)
+	buf = time.Now().AppendFormat(buf, time.RFC3339Nano)
+	buf = append(buf, "\",\"stream\":\""...)
+	buf = append(buf, stream...)
+	buf = append(buf, "\",\"log\":\""...)
+	buf = append(buf, data...)
+	return append(buf, "\"}\n"...)
 }
 
-func basicLogFormatter(stream, data string) string {
+func basicLogFormatter(buf []byte, stream string, data []byte) []byte {
+	buf = time.Now().AppendFormat(buf, time.RFC3339Nano)
+	buf = append(buf, ' ')
 	if stream != "" {
-		return fmt.Sprintf("%s %s %s\n", time.Now().Format(time.RFC3339Nano), stream, data)
+		buf = append(buf, stream...)
+		buf = append(buf, ' ')
+	}
+	buf = append(buf, data...)
+	return append(buf, '\n')
+}
+
+// appendEscapedCRNL appends data to buf with carriage returns and
+// newlines escaped.
+func appendEscapedCRNL(buf []byte, data []byte) []byte {
+	for _, c := range data {
+		switch c {
+		case '\r':
+			buf = append(buf, '\\', 'r')
+		case '\n':
+			buf = append(buf, '\\', 'n')
+		default:
+			buf = append(buf, c)
+		}
 	}
-	return fmt.Sprintf("%s %s\n", time.Now().Format(time.RFC3339Nano), data)
+	return buf
 }
 
 type closer func()
@@ -53,10 +94,32 @@ var LogFormats = map[string]LogFormatter{
 	JSONLogFormat:       jsonLogFormatter,
 }
 
-// Logger defines a file logger.
+// logBuffer holds formatted log lines waiting to be written.
+type logBuffer struct {
+	b []byte
+}
+
+var logBufferPool = sync.Pool{
+	New: func() interface{} {
+		return &logBuffer{b: make([]byte, 0, 2*logFlushSize)}
+	},
+}
+
+// Logger defines a file logger. Log lines of all streams are formatted
+// into a shared buffer written to the log file once logFlushSize bytes
+// are buffered or logFlushInterval after the first buffered line.
 type Logger struct {
-	fm        sync.Mutex // protect file
+	fm        sync.Mutex // protect buffer and timer
+	buf       *logBuffer
+	timer     *time.Timer
+	armed     bool
+	wm        sync.Mutex // protect file, its size and the rotation settings
 	file      *os.File
+	path      string
+	size      int64
+	maxSize   int64
+	maxFiles  int
+	failed    int32 // set once the log file can't be written anymore
 	formatter LogFormatter
 	cm        sync.Mutex // protect closers array
 	closers   []closer
@@ -65,6 +128,8 @@ type Logger struct {
 // NewLogger instantiates a new logger with formatter and return it.
 func NewLogger(logPath string, formatter LogFormatter) (*Logger, error) {
 	logger := &Logger{
+		buf:       logBufferPool.Get().(*logBuffer),
+		path:      logPath,
 		formatter: formatter,
 		closers:   make([]closer, 0),
 	}
@@ -73,21 +138,129 @@ func NewLogger(logPath string, formatter LogFormatter) (*Logger, error) {
 		logger.formatter = basicLogFormatter
 	}
 
-	if err := logger.openFile(logPath); err != nil {
+	if err := logger.openFile(); err != nil {
 		return nil, err
 	}
 
+	logger.timer = time.AfterFunc(logFlushInterval, logger.timedFlush)
+	logger.timer.Stop()
+
 	return logger, nil
 }
 
-func (l *Logger) openFile(path string) (err error) {
+// SetRotation enables the rotation of the log file once its size would
+// exceed maxSize bytes, the log file is renamed with a .1 suffix and up
+// to maxFiles rotated log files are kept, the oldest one having the
+// greatest suffix. With maxFiles set to 0 the log file is truncated.
+// Rotation happens between two batches of log lines, a log file may
+// then exceed maxSize by less than a batch. A maxSize of 0 disables
+// rotation.
+func (l *Logger) SetRotation(maxSize int64, maxFiles int) {
+	l.wm.Lock()
+	defer l.wm.Unlock()
+
+	l.maxSize = maxSize
+	l.maxFiles = maxFiles
+}
+
+func (l *Logger) openFile() (err error) {
 	oldmask := syscall.Umask(0)
 	defer syscall.Umask(oldmask)
 
-	l.file, err = os.OpenFile(path, os.O_CREATE|os.O_RDWR|os.O_APPEND, 0640)
+	l.file, err = os.OpenFile(l.path, os.O_CREATE|os.O_RDWR|os.O_APPEND, 0640)
+	if err != nil {
+		return err
+	}
+	fi, err := l.file.Stat()
+	if err != nil {
+		l.file.Close()
+		l.file = nil
+		return err
+	}
+	l.size = fi.Size()
+	return nil
+}
+
+// rotate renames the log files by incrementing their suffix and opens
+// a new log file, it's called with wm held.
+func (l *Logger) rotate() error {
+	l.file.Close()
+	l.file = nil
+
+	if l.maxFiles == 0 {
+		if err := os.Remove(l.path); err != nil && !os.IsNotExist(err) {
+			return fmt.Errorf("while removing log file: %s", err)
+		}
+		return l.openFile()
+	}
+	for i := l.maxFiles - 1; i >= 0; i-- {
+		oldpath := fmt.Sprintf("%s.%d", l.path, i)
+		if i == 0 {
+			oldpath = l.path
+		}
+		newpath := fmt.Sprintf("%s.%d", l.path, i+1)
+		if err := os.Rename(oldpath, newpath); err != nil && !os.IsNotExist(err) {
+			return fmt.Errorf("while rotating log file: %s", err)
+		}
+	}
+	return l.openFile()
+}
+
+// write writes the buffered log lines to the log file and rotates it
+// if required, it's called with wm held.
+func (l *Logger) write(b *logBuffer) error {
+	if len(b.b) == 0 || l.file == nil {
+		return nil
+	}
+	if l.maxSize > 0 && l.size > 0 && l.size+int64(len(b.b)) > l.maxSize {
+		if err := l.rotate(); err != nil {
+			return err
+		}
+	}
+	n, err := l.file.Write(b.b)
+	l.size += int64(n)
 	return err
 }
 
+// handoff swaps the buffered log lines with an empty buffer and returns
+// them once wm is held. It's called with fm held and releases it, so
+// streams keep buffering log lines while the previous ones are written
+// in order.
+func (l *Logger) handoff() *logBuffer {
+	b := l.buf
+	l.buf = logBufferPool.Get().(*logBuffer)
+	l.wm.Lock()
+	l.fm.Unlock()
+	return b
+}
+
+// release releases wm and returns the log lines returned by handoff
+// to the buffer pool.
+func (l *Logger) release(b *logBuffer) {
+	l.wm.Unlock()
+
+	b.b = b.b[:0]
+	logBufferPool.Put(b)
+}
+
+// flush writes the log lines returned by handoff and releases wm.
+func (l *Logger) flush(b *logBuffer) error {
+	err := l.write(b)
+	if err != nil && l.file == nil {
+		// log file can't be reopened after rotation, scan
+		// goroutines stop reading their stream
+		atomic.StoreInt32(&l.failed, 1)
+	}
+	l.release(b)
+	return err
+}
+
+func (l *Logger) timedFlush() {
+	l.fm.Lock()
+	l.armed = false
+	l.flush(l.handoff())
+}
+
 func (l *Logger) scanOutput(data []byte, atEOF bool) (advance int, token []byte, err error) {
 	if atEOF && len(data) == 0 {
 		return 0, nil, nil
@@ -120,7 +293,6 @@ func (l *Logger) NewWriter(stream string, dropCRNL bool) (*io.PipeWriter, error)
 }
 
 func (l *Logger) scan(stream string, pr *io.PipeReader, pw *io.PipeWriter, dropCRNL bool) closer {
-	r := strings.NewReplacer("\r", "\\r", "\n", "\\n")
 	scanner := bufio.NewScanner(pr)
 	if !dropCRNL {
 		scanner.Split(l.scanOutput)
@@ -131,19 +303,29 @@ func (l *Logger) scan(stream string, pr *io.PipeReader, pw *io.PipeWriter, dropC
 	wg.Add(1)
 
 	go func() {
+		var escaped []byte
+
 		for scanner.Scan() {
-			// this section is locked to ensure that log file is
-			// not being written while ReOpenFile is called
-			l.fm.Lock()
-			// means ReOpenFile has failed proceed with cleanup
-			if l.file == nil {
-				l.fm.Unlock()
+			// means log file can't be written anymore, proceed
+			// with cleanup
+			if atomic.LoadInt32(&l.failed) != 0 {
 				break
 			}
+			line := scanner.Bytes()
 			if !dropCRNL {
-				fmt.Fprint(l.file, l.formatter(stream, r.Replace(scanner.Text())))
-			} else {
-				fmt.Fprint(l.file, l.formatter(stream, scanner.Text()))
+				escaped = appendEscapedCRNL(escaped[:0], line)
+				line = escaped
+			}
+
+			l.fm.Lock()
+			l.buf.b = l.formatter(l.buf.b, stream, line)
+			if len(l.buf.b) >= logFlushSize {
+				l.flush(l.handoff())
+				continue
+			}
+			if !l.armed {
+				l.armed = true
+				l.timer.Reset(logFlushInterval)
 			}
 			l.fm.Unlock()
 		}
@@ -170,24 +352,38 @@ func (l *Logger) endScans() {
 	l.closers = nil
 }
 
-// Close closes all pipe pairs created with NewWriter and also closes
-// log file descriptor.
+// Close closes all pipe pairs created with NewWriter, writes the
+// buffered log lines and also closes log file descriptor.
 func (l *Logger) Close() {
 	l.endScans()
+
 	l.fm.Lock()
-	l.file.Sync()
-	l.file.Close()
-	l.fm.Unlock()
+	l.timer.Stop()
+	l.armed = false
+	b := l.handoff()
+	l.write(b)
+	if l.file != nil {
+		l.file.Sync()
+		l.file.Close()
+	}
+	l.release(b)
 }
 
-// ReOpenFile closes and re-open log file (eg: log rotation).
+// ReOpenFile writes the buffered log lines, closes and re-open log file
+// (eg: log rotation by an external tool).
 func (l *Logger) ReOpenFile() error {
 	l.fm.Lock()
-	filename := l.file.Name()
-	l.file.Sync()
-	l.file.Close()
-	err := l.openFile(filename)
-	l.fm.Unlock()
+	b := l.handoff()
+	l.write(b)
+	if l.file != nil {
+		l.file.Sync()
+		l.file.Close()
+	}
+	err := l.openFile()
+	if err != nil {
+		atomic.StoreInt32(&l.failed, 1)
+	}
+	l.release(b)
 
 	if err != nil {
 		// logger is not usable anymore, proceed with cleanup
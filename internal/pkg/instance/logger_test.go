@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -7,9 +7,15 @@ package instance
 
 import (
 	"bytes"
+	"fmt"
+	"io"
 	"io/ioutil"
 	"os"
+	"path/filepath"
+	"strings"
+	"sync"
 	"testing"
+	"time"
 
 	"github.com/sylabs/singularity/internal/pkg/test"
 )
@@ -119,3 +125,170 @@ func TestLogger(t *testing.T) {
 		}
 	}
 }
+
+func TestLoggerFlush(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	dir, err := ioutil.TempDir("", "log-")
+	if err != nil {
+		t.Fatalf("failed to create temporary directory: %s", err)
+	}
+	defer os.RemoveAll(dir)
+
+	filename := filepath.Join(dir, "test.log")
+
+	logger, err := NewLogger(filename, LogFormats[BasicLogFormat])
+	if err != nil {
+		t.Fatalf("failed to create new logger: %s", err)
+	}
+	defer logger.Close()
+
+	writer, err := logger.NewWriter("stdout", true)
+	if err != nil {
+		t.Fatalf("failed to add new writer: %s", err)
+	}
+	writer.Write([]byte("test\n"))
+
+	// the line is buffered and written once the flush interval elapsed
+	deadline := time.Now().Add(10 * logFlushInterval)
+	for {
+		d, err := ioutil.ReadFile(filename)
+		if err != nil {
+			t.Fatalf("failed to read log data: %s", err)
+		}
+		if bytes.Contains(d, []byte(" stdout test\n")) {
+			break
+		}
+		if time.Now().After(deadline) {
+			t.Fatalf("log line not written after %s", 10*logFlushInterval)
+		}
+		time.Sleep(logFlushInterval / 4)
+	}
+}
+
+func TestLoggerRotation(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	const (
+		lines   = 1000
+		maxSize = 4 * logFlushSize
+	)
+
+	for _, maxFiles := range []int{0, 1, 3} {
+		dir, err := ioutil.TempDir("", "log-")
+		if err != nil {
+			t.Fatalf("failed to create temporary directory: %s", err)
+		}
+		defer os.RemoveAll(dir)
+
+		filename := filepath.Join(dir, "test.log")
+
+		logger, err := NewLogger(filename, LogFormats[BasicLogFormat])
+		if err != nil {
+			t.Fatalf("failed to create new logger: %s", err)
+		}
+		logger.SetRotation(maxSize, maxFiles)
+
+		writers := make([]*io.PipeWriter, 2)
+		for i := range writers {
+			writers[i], err = logger.NewWriter(fmt.Sprintf("stream%d", i), true)
+			if err != nil {
+				t.Fatalf("failed to add new writer: %s", err)
+			}
+		}
+
+		var wg sync.WaitGroup
+		line := strings.Repeat("x", 1024) + "\n"
+		for _, w := range writers {
+			wg.Add(1)
+			go func(w io.Writer) {
+				defer wg.Done()
+				for i := 0; i < lines; i++ {
+					w.Write([]byte(line))
+				}
+			}(w)
+		}
+		wg.Wait()
+		logger.Close()
+
+		files, err := ioutil.ReadDir(dir)
+		if err != nil {
+			t.Fatalf("failed to read log directory: %s", err)
+		}
+		if len(files) != maxFiles+1 {
+			t.Errorf("found %d log files instead of %d with %d rotated files", len(files), maxFiles+1, maxFiles)
+		}
+
+		for _, fi := range files {
+			// a log file may exceed its maximum size by less than a batch
+			if fi.Size() > maxSize+2*logFlushSize {
+				t.Errorf("log file %s size %d exceeds %d", fi.Name(), fi.Size(), maxSize)
+			}
+			d, err := ioutil.ReadFile(filepath.Join(dir, fi.Name()))
+			if err != nil {
+				t.Fatalf("failed to read log data: %s", err)
+			}
+			// log lines are never split across log files
+			for _, l := range strings.SplitAfter(string(d), "\n") {
+				if l != "" && !strings.HasSuffix(l, " "+line) {
+					t.Errorf("unexpected log line in %s: %q", fi.Name(), l)
+					break
+				}
+			}
+		}
+	}
+}
+
+// BenchmarkLogger measures the number of log lines per second written by
+// an instance with its stdout and stderr streams logged concurrently.
+func BenchmarkLogger(b *testing.B) {
+	dir, err := ioutil.TempDir("", "log-")
+	if err != nil {
+		b.Fatalf("failed to create temporary directory: %s", err)
+	}
+	defer os.RemoveAll(dir)
+
+	const linesPerOp = 1000
+
+	for _, format := range []string{BasicLogFormat, KubernetesLogFormat, JSONLogFormat} {
+		for _, size := range []int{16, 256} {
+			b.Run(fmt.Sprintf("%s/%dB", format, size), func(b *testing.B) {
+				filename := filepath.Join(dir, "bench.log")
+				defer os.Remove(filename)
+
+				logger, err := NewLogger(filename, LogFormats[format])
+				if err != nil {
+					b.Fatalf("failed to create new logger: %s", err)
+				}
+
+				var wg sync.WaitGroup
+				line := []byte(strings.Repeat("x", size-1) + "\n")
+
+				b.ReportAllocs()
+				b.ResetTimer()
+				start := time.Now()
+				for _, stream := range []string{"stdout", "stderr"} {
+					w, err := logger.NewWriter(stream, false)
+					if err != nil {
+						b.Fatalf("failed to add new writer: %s", err)
+					}
+					wg.Add(1)
+					go func() {
+						defer wg.Done()
+						for i := 0; i < b.N*linesPerOp/2; i++ {
+							w.Write(line)
+						}
+					}()
+				}
+				wg.Wait()
+				logger.Close()
+				elapsed := time.Since(start)
+				b.StopTimer()
+
+				b.ReportMetric(float64(b.N*linesPerOp)/elapsed.Seconds(), "lines/s")
+			})
+		}
+	}
+}
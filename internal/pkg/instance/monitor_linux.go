@@ -0,0 +1,511 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package instance
+
+import (
+	"bytes"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"net"
+	"os"
+	"os/signal"
+	"path/filepath"
+	"sync"
+	"syscall"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/pkg/util/fs/proc"
+	"golang.org/x/sys/unix"
+)
+
+const (
+	// monitorSocket is the name of the instance monitor socket stored
+	// in the instance directory of the user.
+	monitorSocket = "monitor.sock"
+	// monitorLock is locked by the instance monitor of the user for
+	// its lifetime.
+	monitorLock = "monitor.lock"
+	// maxMonitorFds is the maximum number of file descriptors passed
+	// with an adoption request.
+	maxMonitorFds = 64
+)
+
+// pidfd system call numbers of the generic system call table, the mips
+// numbers are set by monitor_linux_mipsx.go and monitor_linux_mips64x.go.
+var (
+	sysPidfdSendSignal uintptr = 424
+	sysPidfdOpen       uintptr = 434
+)
+
+var (
+	// ErrNoMonitor is returned by AdoptContainer when the user has no
+	// instance monitor running.
+	ErrNoMonitor = errors.New("no instance monitor running")
+	// ErrMonitorRunning is returned by ListenMonitor when the user has
+	// an instance monitor running already.
+	ErrMonitorRunning = errors.New("instance monitor already running")
+)
+
+// Messages exchanged on the master socket between the master process and
+// an instance process which may be handed off to the instance monitor.
+// The instance process clears its parent death signal only for the time
+// of the adoption, so that it's still killed with its master process if
+// the hand off fails.
+const (
+	// HandoffReady is sent by the instance process once started, in
+	// place of closing the master socket.
+	HandoffReady byte = 's'
+	// HandoffStart asks the instance process to clear its parent death
+	// signal before its adoption by the instance monitor.
+	HandoffStart byte = 'h'
+	// HandoffAbort asks the instance process to set its parent death
+	// signal again, it wasn't adopted.
+	HandoffAbort byte = 'a'
+	// HandoffDone is the reply of the instance process to a request.
+	HandoffDone byte = 'd'
+)
+
+// MonitoredContainer describes an instance process handed off by its
+// master process to the instance monitor of the user.
+type MonitoredContainer struct {
+	Pid  int    `json:"pid"`
+	Name string `json:"name"`
+	// DeleteImage is a temporary image deleted once the instance
+	// process exited.
+	DeleteImage string `json:"deleteImage,omitempty"`
+	// SignalPropagation forwards the signals received by the monitor
+	// to the instance process.
+	SignalPropagation bool `json:"signalPropagation"`
+	// Fds are file descriptors passed to the monitor and held open
+	// until the instance process exited, like the lock files of the
+	// cache entries used by the instance.
+	Fds []int `json:"-"`
+}
+
+type monitorResponse struct {
+	Pid   int    `json:"pid,omitempty"`
+	Error string `json:"error,omitempty"`
+}
+
+// monitored is an instance process adopted by the monitor, referenced
+// by a pidfd so a reused PID is never signaled.
+type monitored struct {
+	MonitoredContainer
+	pidfd *os.File
+}
+
+// Monitor watches the instance processes adopted from the master processes
+// of the instances of a user, so that their master processes can exit
+// instead of staying resident for the lifetime of each instance. It runs
+// in the master process of an instance of the user, the instance processes
+// are watched through pidfds and their cleanup is limited to what doesn't
+// require privileges: instance files and temporary images are deleted
+// once they exited. Only instances started without privileges are handed
+// off to the monitor.
+type Monitor struct {
+	listener *net.UnixListener
+	lock     *os.File
+	path     string
+	uid      int
+	gid      int
+	signals  chan os.Signal
+
+	mu         sync.Mutex
+	cond       *sync.Cond
+	containers map[*monitored]bool
+	closed     bool
+}
+
+// monitorSignals are the signals received by the monitor forwarded to the
+// instance processes with signal propagation.
+var monitorSignals = []os.Signal{
+	syscall.SIGHUP,
+	syscall.SIGINT,
+	syscall.SIGQUIT,
+	syscall.SIGTERM,
+	syscall.SIGUSR1,
+	syscall.SIGUSR2,
+}
+
+// monitorDir returns the directory holding the instance directories of
+// the user, where the instance monitor socket is created.
+func monitorDir() (string, error) {
+	dir, err := getPath("", SingSubDir)
+	if err != nil {
+		return "", err
+	}
+
+	oldumask := syscall.Umask(0)
+	err = os.MkdirAll(dir, 0700)
+	syscall.Umask(oldumask)
+
+	return dir, err
+}
+
+// ListenMonitor creates the instance monitor of the user, it returns
+// ErrMonitorRunning if the user has an instance monitor running already.
+func ListenMonitor() (*Monitor, error) {
+	dir, err := monitorDir()
+	if err != nil {
+		return nil, err
+	}
+	return listenMonitor(dir)
+}
+
+func listenMonitor(dir string) (*Monitor, error) {
+	lock, err := os.OpenFile(filepath.Join(dir, monitorLock), os.O_RDONLY|os.O_CREATE, 0600)
+	if err != nil {
+		return nil, fmt.Errorf("while opening instance monitor lock: %s", err)
+	}
+	if err := syscall.Flock(int(lock.Fd()), syscall.LOCK_EX|syscall.LOCK_NB); err == syscall.EWOULDBLOCK {
+		lock.Close()
+		return nil, ErrMonitorRunning
+	} else if err != nil {
+		lock.Close()
+		return nil, fmt.Errorf("while locking instance monitor lock: %s", err)
+	}
+
+	path := filepath.Join(dir, monitorSocket)
+	f, err := listenSocket(path, "instance monitor")
+	if err != nil {
+		lock.Close()
+		return nil, err
+	}
+	syscall.CloseOnExec(int(f.Fd()))
+
+	l, err := net.FileListener(f)
+	f.Close()
+	if err != nil {
+		lock.Close()
+		return nil, fmt.Errorf("while getting instance monitor listener: %s", err)
+	}
+
+	m := &Monitor{
+		listener:   l.(*net.UnixListener),
+		lock:       lock,
+		path:       path,
+		uid:        os.Getuid(),
+		gid:        os.Getgid(),
+		signals:    make(chan os.Signal, len(monitorSignals)),
+		containers: make(map[*monitored]bool),
+	}
+	m.cond = sync.NewCond(&m.mu)
+
+	return m, nil
+}
+
+// Serve accepts and serves the adoption requests and forwards the signals
+// received to the adopted instance processes until Wait returns.
+func (m *Monitor) Serve() {
+	signal.Notify(m.signals, monitorSignals...)
+	go func() {
+		for s := range m.signals {
+			m.kill(s.(syscall.Signal))
+		}
+	}()
+
+	for {
+		c, err := m.listener.AcceptUnix()
+		if err != nil {
+			return
+		}
+		go m.handle(c)
+	}
+}
+
+// Wait waits until all the adopted instance processes exited, the monitor
+// then stops accepting adoption requests and releases its socket.
+func (m *Monitor) Wait() {
+	m.mu.Lock()
+	for len(m.containers) > 0 {
+		m.cond.Wait()
+	}
+	m.closed = true
+	m.mu.Unlock()
+
+	signal.Stop(m.signals)
+	close(m.signals)
+
+	os.Remove(m.path)
+	m.listener.Close()
+	m.lock.Close()
+}
+
+// kill sends sig to the adopted instance processes with signal propagation.
+func (m *Monitor) kill(sig syscall.Signal) {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+
+	for c := range m.containers {
+		if c.SignalPropagation {
+			pidfdSendSignal(c.pidfd, sig)
+		}
+	}
+}
+
+func (m *Monitor) handle(c *net.UnixConn) {
+	defer c.Close()
+
+	enc := json.NewEncoder(c)
+
+	mc, err := m.adopt(c)
+	if err != nil {
+		enc.Encode(&monitorResponse{Error: err.Error()})
+		return
+	}
+	sylog.Debugf("Instance monitor adopted instance %s (PID=%d)", mc.Name, mc.Pid)
+
+	go m.watch(mc)
+
+	enc.Encode(&monitorResponse{Pid: os.Getpid()})
+}
+
+// adopt authorizes the client and takes a reference on the instance
+// process it hands off, which must be a child of the client.
+func (m *Monitor) adopt(c *net.UnixConn) (*monitored, error) {
+	cred, err := peerCred(c)
+	if err != nil {
+		return nil, err
+	}
+	if int(cred.Uid) != m.uid || int(cred.Gid) != m.gid {
+		return nil, fmt.Errorf("client %d:%d is not the monitor owner", cred.Uid, cred.Gid)
+	}
+
+	// the file descriptors passed along the request are received with
+	// its first bytes
+	b := make([]byte, 4096)
+	oob := make([]byte, syscall.CmsgSpace(maxMonitorFds*4))
+	n, oobn, flags, _, err := c.ReadMsgUnix(b, oob)
+	if err != nil {
+		return nil, fmt.Errorf("while receiving adoption request: %s", err)
+	}
+	fds, err := parseRights(oob[:oobn])
+	if err != nil {
+		return nil, err
+	}
+	mc := &monitored{MonitoredContainer: MonitoredContainer{Fds: fds}}
+	if flags&syscall.MSG_CTRUNC != 0 {
+		mc.closeFds()
+		return nil, fmt.Errorf("too many file descriptors passed to the instance monitor")
+	}
+
+	dec := json.NewDecoder(io.MultiReader(bytes.NewReader(b[:n]), c))
+	if err := dec.Decode(&mc.MonitoredContainer); err != nil {
+		mc.closeFds()
+		return nil, fmt.Errorf("while decoding adoption request: %s", err)
+	}
+	if mc.Pid <= 1 {
+		mc.closeFds()
+		return nil, fmt.Errorf("bad instance process ID")
+	}
+
+	// the pidfd is opened before checking the parent process, if the
+	// PID was reused meanwhile the check fails
+	mc.pidfd, err = pidfdOpen(mc.Pid)
+	if err != nil {
+		mc.closeFds()
+		return nil, err
+	}
+	if ppid, err := proc.Getppid(mc.Pid); err != nil || ppid != int(cred.Pid) {
+		mc.pidfd.Close()
+		mc.closeFds()
+		return nil, fmt.Errorf("process %d is not a child of the client", mc.Pid)
+	}
+
+	m.mu.Lock()
+	if m.closed {
+		m.mu.Unlock()
+		mc.pidfd.Close()
+		mc.closeFds()
+		return nil, fmt.Errorf("instance monitor is exiting")
+	}
+	m.containers[mc] = true
+	m.mu.Unlock()
+
+	// the instance is now bound to the monitor lifetime
+	if mc.Name != "" {
+		if err := setInstanceParent(mc.Name, mc.Pid, os.Getpid()); err != nil {
+			m.release(mc)
+			return nil, err
+		}
+	}
+
+	return mc, nil
+}
+
+// release forgets an adopted instance process and closes the file
+// descriptors held for it.
+func (m *Monitor) release(mc *monitored) {
+	m.mu.Lock()
+	delete(m.containers, mc)
+	mc.pidfd.Close()
+	mc.closeFds()
+	m.cond.Broadcast()
+	m.mu.Unlock()
+}
+
+// closeFds closes the file descriptors passed with the adoption request.
+func (mc *monitored) closeFds() {
+	for _, fd := range mc.Fds {
+		syscall.Close(fd)
+	}
+	mc.Fds = nil
+}
+
+// parseRights returns the file descriptors passed in the socket control
+// messages oob, they are set close-on-exec.
+func parseRights(oob []byte) ([]int, error) {
+	msgs, err := syscall.ParseSocketControlMessage(oob)
+	if err != nil {
+		return nil, fmt.Errorf("while parsing adoption request control message: %s", err)
+	}
+	var fds []int
+	for i := range msgs {
+		rights, err := syscall.ParseUnixRights(&msgs[i])
+		if err != nil {
+			continue
+		}
+		for _, fd := range rights {
+			syscall.CloseOnExec(fd)
+		}
+		fds = append(fds, rights...)
+	}
+	return fds, nil
+}
+
+// watch waits for the adopted instance process to exit and cleans up
+// after it.
+func (m *Monitor) watch(mc *monitored) {
+	if err := pidfdWait(mc.pidfd); err != nil {
+		sylog.Warningf("Could not wait instance %s (PID=%d): %s", mc.Name, mc.Pid, err)
+	}
+	sylog.Debugf("Instance %s (PID=%d) exited", mc.Name, mc.Pid)
+
+	if mc.DeleteImage != "" {
+		if err := os.RemoveAll(mc.DeleteImage); err != nil {
+			sylog.Errorf("failed to delete container image %s: %s", mc.DeleteImage, err)
+		}
+	}
+	if mc.Name != "" {
+		if file, err := Get(mc.Name, SingSubDir); err == nil && file.Pid == mc.Pid {
+			file.Delete()
+		}
+	}
+
+	m.release(mc)
+}
+
+// setInstanceParent replaces the parent process recorded in the instance
+// file of the named instance process pid with ppid.
+func setInstanceParent(name string, pid, ppid int) error {
+	file, err := Get(name, SingSubDir)
+	if err != nil {
+		return err
+	}
+	if file.Pid != pid {
+		return fmt.Errorf("instance %s has PID %d instead of %d", name, file.Pid, pid)
+	}
+	file.PPid = ppid
+	return file.Update()
+}
+
+// AdoptContainer hands off the instance process described by c, a child of
+// the current process, to the instance monitor of the user. The current
+// process may exit once it returns without error, the returned PID is the
+// PID of the instance monitor. ErrNoMonitor is returned if the user has no
+// instance monitor running.
+func AdoptContainer(c *MonitoredContainer) (int, error) {
+	dir, err := monitorDir()
+	if err != nil {
+		return 0, err
+	}
+	return adoptContainer(filepath.Join(dir, monitorSocket), c)
+}
+
+func adoptContainer(path string, mc *MonitoredContainer) (int, error) {
+	var c *net.UnixConn
+	err := socketPath(path, func(p string) error {
+		var err error
+		c, err = net.DialUnix("unix", nil, &net.UnixAddr{Name: p, Net: "unix"})
+		return err
+	})
+	if errors.Is(err, syscall.ENOENT) || errors.Is(err, syscall.ECONNREFUSED) {
+		return 0, ErrNoMonitor
+	} else if err != nil {
+		return 0, err
+	}
+	defer c.Close()
+
+	if len(mc.Fds) > maxMonitorFds {
+		return 0, fmt.Errorf("too many file descriptors passed to the instance monitor")
+	}
+	b, err := json.Marshal(mc)
+	if err != nil {
+		return 0, fmt.Errorf("while encoding adoption request: %s", err)
+	}
+	var oob []byte
+	if len(mc.Fds) > 0 {
+		oob = syscall.UnixRights(mc.Fds...)
+	}
+	if _, _, err := c.WriteMsgUnix(append(b, '\n'), oob, nil); err != nil {
+		return 0, fmt.Errorf("while sending adoption request: %s", err)
+	}
+	var resp monitorResponse
+	if err := json.NewDecoder(c).Decode(&resp); err != nil {
+		return 0, fmt.Errorf("while receiving adoption response: %s", err)
+	}
+	if resp.Error != "" {
+		return 0, errors.New(resp.Error)
+	}
+	return resp.Pid, nil
+}
+
+// pidfdOpen returns a pidfd referring to the process pid, it's set non
+// blocking so that waiting for the process is done by the runtime poller
+// instead of blocking a thread.
+func pidfdOpen(pid int) (*os.File, error) {
+	fd, _, errno := syscall.Syscall(sysPidfdOpen, uintptr(pid), 0, 0)
+	if errno != 0 {
+		return nil, fmt.Errorf("while opening pidfd for process %d: %s", pid, errno)
+	}
+	if err := syscall.SetNonblock(int(fd), true); err != nil {
+		syscall.Close(int(fd))
+		return nil, fmt.Errorf("while setting pidfd non blocking: %s", err)
+	}
+	return os.NewFile(fd, fmt.Sprintf("pidfd:%d", pid)), nil
+}
+
+// pidfdWait waits until the process referred to by pidfd exited, pidfd
+// becomes readable once the process exited.
+func pidfdWait(pidfd *os.File) error {
+	raw, err := pidfd.SyscallConn()
+	if err != nil {
+		return err
+	}
+	return raw.Read(func(fd uintptr) bool {
+		fds := []unix.PollFd{{Fd: int32(fd), Events: unix.POLLIN}}
+		n, err := unix.Poll(fds, 0)
+		return n > 0 || (err != nil && err != unix.EINTR)
+	})
+}
+
+// pidfdSendSignal sends sig to the process referred to by pidfd.
+func pidfdSendSignal(pidfd *os.File, sig syscall.Signal) error {
+	raw, err := pidfd.SyscallConn()
+	if err != nil {
+		return err
+	}
+	var errno syscall.Errno
+	err = raw.Control(func(fd uintptr) {
+		_, _, errno = syscall.Syscall6(sysPidfdSendSignal, fd, uintptr(sig), 0, 0, 0, 0)
+	})
+	if err == nil && errno != 0 {
+		err = errno
+	}
+	return err
+}
@@ -0,0 +1,14 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// +build linux,mips64 linux,mips64le
+
+package instance
+
+func init() {
+	// n64 system call numbers start at 5000
+	sysPidfdSendSignal = 5424
+	sysPidfdOpen = 5434
+}
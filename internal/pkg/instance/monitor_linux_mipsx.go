@@ -0,0 +1,14 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// +build linux,mips linux,mipsle
+
+package instance
+
+func init() {
+	// o32 system call numbers start at 4000
+	sysPidfdSendSignal = 4424
+	sysPidfdOpen = 4434
+}
@@ -0,0 +1,321 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package instance
+
+import (
+	"bufio"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"os"
+	"os/exec"
+	"os/signal"
+	"path/filepath"
+	"strings"
+	"syscall"
+	"testing"
+	"time"
+)
+
+// monitorHelperEnv selects the process run by the test binary when it's
+// executed by BenchmarkMonitorMemory, see monitorHelper.
+const monitorHelperEnv = "SINGULARITY_TEST_MONITOR_HELPER"
+
+func TestMonitor(t *testing.T) {
+	dir, err := ioutil.TempDir("", "monitor-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	path := filepath.Join(dir, monitorSocket)
+
+	if _, err := adoptContainer(path, &MonitoredContainer{Pid: os.Getpid()}); err != ErrNoMonitor {
+		t.Fatalf("unexpected error without monitor: %v", err)
+	}
+
+	m, err := listenMonitor(dir)
+	if err != nil {
+		t.Fatalf("unexpected error while creating monitor: %s", err)
+	}
+	if _, err := listenMonitor(dir); err != ErrMonitorRunning {
+		t.Fatalf("unexpected error while creating second monitor: %v", err)
+	}
+	go m.Serve()
+
+	if _, err := adoptContainer(path, &MonitoredContainer{Pid: os.Getpid()}); err == nil {
+		t.Errorf("unexpected success while adopting a process which is not a child")
+	}
+
+	cmd := exec.Command("sleep", "60")
+	if err := cmd.Start(); err != nil {
+		t.Fatal(err)
+	}
+	defer cmd.Process.Kill()
+
+	pid, err := adoptContainer(path, &MonitoredContainer{Pid: cmd.Process.Pid, SignalPropagation: true})
+	if err != nil {
+		t.Fatalf("unexpected error while adopting process: %s", err)
+	}
+	if pid != os.Getpid() {
+		t.Errorf("unexpected monitor PID %d", pid)
+	}
+
+	waited := make(chan struct{})
+	go func() {
+		m.Wait()
+		close(waited)
+	}()
+
+	select {
+	case <-waited:
+		t.Fatalf("monitor returned while adopted process is running")
+	case <-time.After(100 * time.Millisecond):
+	}
+
+	// the adopted process is terminated by the signal forwarded by
+	// the monitor
+	syscall.Kill(os.Getpid(), syscall.SIGUSR1)
+	cmd.Wait()
+
+	select {
+	case <-waited:
+	case <-time.After(5 * time.Second):
+		t.Fatalf("monitor didn't return once adopted process exited")
+	}
+
+	if _, err := adoptContainer(path, &MonitoredContainer{Pid: os.Getpid()}); err != ErrNoMonitor {
+		t.Errorf("unexpected error once monitor returned: %v", err)
+	}
+	if m, err := listenMonitor(dir); err != nil {
+		t.Errorf("unexpected error while creating new monitor: %s", err)
+	} else {
+		m.Wait()
+	}
+}
+
+// TestMonitorFds checks that the lock of a cache entry passed with an
+// adoption request is held by the monitor until the adopted process exits,
+// so that the cache entry can't be evicted once the master process exited.
+func TestMonitorFds(t *testing.T) {
+	dir, err := ioutil.TempDir("", "monitor-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	lockPath := filepath.Join(dir, "entry.lock")
+	// evictable reports if the cache entry could be locked for eviction
+	evictable := func() bool {
+		fd, err := syscall.Open(lockPath, syscall.O_RDONLY|syscall.O_CLOEXEC, 0)
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer syscall.Close(fd)
+		return syscall.Flock(fd, syscall.LOCK_EX|syscall.LOCK_NB) == nil
+	}
+
+	fd, err := syscall.Open(lockPath, syscall.O_RDONLY|syscall.O_CREAT|syscall.O_CLOEXEC, 0600)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if err := syscall.Flock(fd, syscall.LOCK_SH); err != nil {
+		t.Fatal(err)
+	}
+
+	m, err := listenMonitor(dir)
+	if err != nil {
+		t.Fatalf("unexpected error while creating monitor: %s", err)
+	}
+	go m.Serve()
+
+	cmd := exec.Command("sleep", "60")
+	if err := cmd.Start(); err != nil {
+		t.Fatal(err)
+	}
+	defer cmd.Process.Kill()
+
+	path := filepath.Join(dir, monitorSocket)
+	if _, err := adoptContainer(path, &MonitoredContainer{Pid: cmd.Process.Pid, Fds: []int{fd}}); err != nil {
+		t.Fatalf("unexpected error while adopting process: %s", err)
+	}
+	// the master process exits after the hand off
+	syscall.Close(fd)
+
+	if evictable() {
+		t.Errorf("cache entry evictable while adopted process is running")
+	}
+
+	cmd.Process.Kill()
+	cmd.Wait()
+	m.Wait()
+
+	if !evictable() {
+		t.Errorf("cache entry still locked once adopted process exited")
+	}
+}
+
+// monitorHelper runs the processes started by BenchmarkMonitorMemory: a
+// monitor, or a master process spawning an instance process, waiting for
+// it or handing it off to the monitor before exiting. It prints the PID of
+// the instance process once ready and runs until its standard input is
+// closed.
+func monitorHelper(mode string, dir string) {
+	if mode == "monitor" {
+		m, err := listenMonitor(dir)
+		if err != nil {
+			fmt.Fprintln(os.Stderr, err)
+			os.Exit(1)
+		}
+		go m.Serve()
+		fmt.Println(0)
+		ioutil.ReadAll(os.Stdin)
+		os.Exit(0)
+	}
+
+	signals := make(chan os.Signal, 1)
+	signal.Notify(signals)
+
+	cmd := exec.Command("sleep", "3600")
+	if err := cmd.Start(); err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(1)
+	}
+
+	if mode == "adopt" {
+		c := &MonitoredContainer{Pid: cmd.Process.Pid}
+		if _, err := adoptContainer(filepath.Join(dir, monitorSocket), c); err != nil {
+			fmt.Fprintln(os.Stderr, err)
+			cmd.Process.Kill()
+			os.Exit(1)
+		}
+		fmt.Println(cmd.Process.Pid)
+		os.Exit(0)
+	}
+
+	go func() {
+		var status syscall.WaitStatus
+		for range signals {
+			syscall.Wait4(cmd.Process.Pid, &status, syscall.WNOHANG, nil)
+		}
+	}()
+	fmt.Println(cmd.Process.Pid)
+	ioutil.ReadAll(os.Stdin)
+	cmd.Process.Kill()
+	os.Exit(0)
+}
+
+type helperProcess struct {
+	cmd      *exec.Cmd
+	stdin    io.WriteCloser
+	childPid int
+}
+
+// startHelper starts the test binary as monitorHelper and waits until
+// it's ready.
+func startHelper(b *testing.B, mode string, dir string) *helperProcess {
+	r, w, err := os.Pipe()
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer r.Close()
+
+	cmd := exec.Command(os.Args[0])
+	cmd.Env = append(os.Environ(), monitorHelperEnv+"="+mode+":"+dir)
+	cmd.Stdout = w
+	cmd.Stderr = os.Stderr
+	stdin, err := cmd.StdinPipe()
+	if err != nil {
+		b.Fatal(err)
+	}
+	if err := cmd.Start(); err != nil {
+		b.Fatal(err)
+	}
+	w.Close()
+
+	h := &helperProcess{cmd: cmd, stdin: stdin}
+	line, err := bufio.NewReader(r).ReadString('\n')
+	if _, serr := fmt.Sscanf(line, "%d", &h.childPid); err != nil || serr != nil {
+		b.Fatalf("helper %s failed to start", mode)
+	}
+	return h
+}
+
+func (h *helperProcess) stop() {
+	h.stdin.Close()
+	if h.childPid > 0 {
+		syscall.Kill(h.childPid, syscall.SIGKILL)
+	}
+	h.cmd.Wait()
+}
+
+// processMemory returns the resident and the proportional set size of
+// the process pid in KiB.
+func processMemory(b *testing.B, pid int) (rss int64, pss int64) {
+	data, err := ioutil.ReadFile(fmt.Sprintf("/proc/%d/smaps_rollup", pid))
+	if err != nil {
+		b.Skipf("smaps_rollup not supported: %s", err)
+	}
+	for _, line := range strings.Split(string(data), "\n") {
+		fmt.Sscanf(line, "Rss: %d kB", &rss)
+		fmt.Sscanf(line, "Pss: %d kB", &pss)
+	}
+	return rss, pss
+}
+
+// BenchmarkMonitorMemory measures the memory used to monitor instances
+// with one master process per instance, and with a single monitor adopting
+// the instance processes of exited master processes. Master processes are
+// emulated by the test binary which has the same Go runtime footprint.
+func BenchmarkMonitorMemory(b *testing.B) {
+	const instances = 32
+
+	dir, err := ioutil.TempDir("", "monitor-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	b.Run("master", func(b *testing.B) {
+		var rss, pss int64
+		for i := 0; i < b.N; i++ {
+			helpers := make([]*helperProcess, instances)
+			for j := range helpers {
+				helpers[j] = startHelper(b, "master", dir)
+			}
+			for _, h := range helpers {
+				r, p := processMemory(b, h.cmd.Process.Pid)
+				rss += r
+				pss += p
+			}
+			for _, h := range helpers {
+				h.stop()
+			}
+		}
+		b.ReportMetric(float64(rss)/float64(b.N*instances), "rss-KiB/instance")
+		b.ReportMetric(float64(pss)/float64(b.N*instances), "pss-KiB/instance")
+	})
+
+	b.Run("monitor", func(b *testing.B) {
+		var rss, pss int64
+		for i := 0; i < b.N; i++ {
+			monitor := startHelper(b, "monitor", dir)
+			helpers := make([]*helperProcess, instances)
+			for j := range helpers {
+				helpers[j] = startHelper(b, "adopt", dir)
+			}
+			r, p := processMemory(b, monitor.cmd.Process.Pid)
+			rss += r
+			pss += p
+			for _, h := range helpers {
+				h.stop()
+			}
+			monitor.stop()
+		}
+		b.ReportMetric(float64(rss)/float64(b.N*instances), "rss-KiB/instance")
+		b.ReportMetric(float64(pss)/float64(b.N*instances), "pss-KiB/instance")
+	})
+}
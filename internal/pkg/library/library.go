@@ -9,10 +9,15 @@ import (
 	"context"
 	"fmt"
 	"io"
-	"os"
+	"io/ioutil"
+	"net/http"
+	"net/url"
+	"path"
+	"runtime"
 	"strings"
 
 	"github.com/sylabs/scs-library-client/client"
+	net "github.com/sylabs/singularity/pkg/client/net"
 )
 
 const defaultTag = "latest"
@@ -29,44 +34,73 @@ func NormalizeLibraryRef(libraryRef string) string {
 	return ir
 }
 
-// DownloadImage is a helper function to wrap library image download operation
-func DownloadImage(ctx context.Context, c *client.Client, imagePath, arch, libraryRef string, callback progressCallback) error {
+// DownloadImage is a helper function to wrap library image download operation,
+// it returns the image hash in the format of client.ImageHash computed while
+// the image is downloaded. The image is downloaded over concurrent
+// connections when the library supports range requests, an interrupted
+// download is resumed by the next download to imagePath.
+func DownloadImage(ctx context.Context, c *client.Client, imagePath, arch, libraryRef string, callback progressCallback) (string, error) {
 	// reassemble "stripped" library ref for scs-library-client
 	validLibraryRef := "library:///" + libraryRef
 
 	// parse library ref
 	r, err := client.Parse(validLibraryRef)
 	if err != nil {
-		return fmt.Errorf("error parsing library ref: %v", err)
+		return "", fmt.Errorf("error parsing library ref: %v", err)
 	}
 
-	// open destination file for writing
-	f, err := os.OpenFile(imagePath, os.O_CREATE|os.O_TRUNC|os.O_RDWR, 0777)
-	if err != nil {
-		return fmt.Errorf("error opening file %s for writing: %v", imagePath, err)
+	if arch == "" {
+		arch = runtime.GOARCH
 	}
-	defer f.Close()
-
-	var tag string
+	apiPath := "v1/imagefile/" + strings.TrimPrefix(r.Path, "/")
 	if len(r.Tags) > 0 {
-		tag = r.Tags[0]
+		apiPath += ":" + r.Tags[0]
 	}
+	u := *c.BaseURL
+	u.Path = path.Join(u.Path, apiPath)
+	u.RawQuery = url.Values{"arch": []string{arch}}.Encode()
 
-	// call library client to download image
-	err = c.DownloadImage(ctx, f, arch, r.Path, tag, callback)
-	if err != nil {
-		// delete incomplete image file in the event of failure
-		os.Remove(imagePath)
+	opts := &net.DownloadOptions{
+		Header: http.Header{},
+	}
+	if c.AuthToken != "" {
+		opts.Header.Set("Authorization", "Bearer "+c.AuthToken)
+	}
 
-		return fmt.Errorf("error downloading image: %v", err)
+	// the progress callback consumes the image content in order
+	var (
+		pw   *io.PipeWriter
+		done chan error
+	)
+	if callback != nil {
+		opts.Progress = func(size int64) io.Writer {
+			var pr *io.PipeReader
+			pr, pw = io.Pipe()
+			done = make(chan error, 1)
+			go func() {
+				err := callback(size, pr, ioutil.Discard)
+				pr.CloseWithError(err)
+				done <- err
+			}()
+			return pw
+		}
 	}
 
-	return nil
+	digest, err := net.Download(ctx, c.HTTPClient, u.String(), imagePath, opts)
+	if pw != nil {
+		pw.CloseWithError(err)
+		<-done
+	}
+	if err != nil {
+		return "", fmt.Errorf("error downloading image: %v", err)
+	}
+
+	return "sha256." + digest, nil
 }
 
 // DownloadImageNoProgress downloads an image from the library without
 // displaying a progress bar while doing so
-func DownloadImageNoProgress(ctx context.Context, c *client.Client, imagePath, arch, libraryRef string) error {
+func DownloadImageNoProgress(ctx context.Context, c *client.Client, imagePath, arch, libraryRef string) (string, error) {
 	return DownloadImage(ctx, c, imagePath, arch, libraryRef, nil)
 }
 
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -15,7 +15,7 @@ package starter
 // #cgo CFLAGS: -I../../../../../../cmd/starter/c/include
 import "C"
 import (
-	"encoding/json"
+	"encoding"
 	"fmt"
 	"os"
 	"os/exec"
@@ -144,6 +144,26 @@ func (c *Config) SetWorkingDirectoryFd(fd int) {
 	c.config.starter.workingDirectoryFd = C.int(fd)
 }
 
+// GetTraceFd returns the trace file descriptor validated by starter
+// before any file is opened, or -1 if tracing is disabled.
+func (c *Config) GetTraceFd() int {
+	return int(c.config.starter.traceFd)
+}
+
+// SetCgroupFd changes starter config so that the container process is
+// created into the cgroup directory pointed by the file descriptor fd.
+// The file descriptor must also be kept with KeepFileDescriptor. If
+// created is set, the cgroup was created for the container process and
+// starter removes it when the process can't be created.
+func (c *Config) SetCgroupFd(fd int, created bool) {
+	c.config.container.cgroupFd = C.int(fd)
+	if created {
+		c.config.container.cgroupCreated = C.true
+	} else {
+		c.config.container.cgroupCreated = C.false
+	}
+}
+
 // KeepFileDescriptor adds a file descriptor to an array of file
 // descriptor that starter will kept open. All files opened during
 // stage 1 will be shared with starter process, once stage 1 returns
@@ -179,31 +199,30 @@ func (c *Config) SetAllowSetgroups(allow bool) {
 	}
 }
 
-// GetJSONConfig returns pointer to the engine's JSON configuration.
-// A copy of the original bytes allocated on C heap is returned.
-func (c *Config) GetJSONConfig() []byte {
-	return C.GoBytes(unsafe.Pointer(&c.config.engine.config[0]), C.int(c.config.engine.size))
+// GetEngineConfig returns the engine's binary configuration. A copy
+// of the original bytes stored in shared memory is returned.
+func (c *Config) GetEngineConfig() []byte {
+	return C.GoBytes(unsafe.Pointer(c.config.engine.config), C.int(c.config.engine.size))
 }
 
-// WriteConfig modifies starter config by fully updating engine json
-// configuration stored there. If json config is too big the error
-// will be returned.
-func (c *Config) Write(payload interface{}) error {
-	jsonConf, err := json.Marshal(payload)
+// Write modifies starter config by fully updating the engine
+// configuration stored there with the binary encoding of payload.
+// An error is returned if the configuration doesn't fit in the
+// shared memory reserved by starter.
+func (c *Config) Write(payload encoding.BinaryMarshaler) error {
+	data, err := payload.MarshalBinary()
 	if err != nil {
 		return fmt.Errorf("failed to marshal payload: %s", err)
 	}
 
-	size := len(jsonConf)
-	maxSize := C.MAX_JSON_SIZE - 1
-	if size >= maxSize {
-		return fmt.Errorf("json configuration too big %d > %d", size, maxSize)
+	size := len(data)
+	maxSize := int(c.config.engine.mapSize)
+	if size > maxSize {
+		return fmt.Errorf("engine configuration too big %d > %d", size, maxSize)
 	}
 
+	C.memcpy(unsafe.Pointer(c.config.engine.config), unsafe.Pointer(&data[0]), C.size_t(size))
 	c.config.engine.size = C.size_t(size)
-	engineConfig := C.CBytes(jsonConf)
-	C.memcpy(unsafe.Pointer(&c.config.engine.config[0]), engineConfig, c.config.engine.size)
-	C.free(engineConfig)
 
 	return nil
 }
@@ -449,6 +468,9 @@ func (c *Config) SetTargetGID(gids []int) {
 // the underlying starter configuration. Attempt to modify the underlying config after
 // call to Release will result in a segmentation fault.
 func (c *Config) Release() error {
+	if C.munmap(unsafe.Pointer(c.config.engine.config), c.config.engine.mapSize) != 0 {
+		return fmt.Errorf("failed to release engine configuration memory")
+	}
 	if C.munmap(unsafe.Pointer(c.config), C.sizeof_struct_starterConfig) != 0 {
 		return fmt.Errorf("failed to release starter memory")
 	}
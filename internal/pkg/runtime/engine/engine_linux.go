@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -7,7 +7,6 @@ package engine
 
 import (
 	"context"
-	"encoding/json"
 	"fmt"
 	"net"
 	"net/rpc"
@@ -23,6 +22,10 @@ import (
 type Engine struct {
 	Operations
 	*config.Common
+
+	// engineConfig is the engine specific configuration
+	// until decoded by DecodeConfig
+	engineConfig []byte
 }
 
 // Operations is an interface describing necessary operations to launch
@@ -90,41 +93,42 @@ type Operations interface {
 	CleanupContainer(context.Context, error, syscall.WaitStatus) error
 }
 
-// getName returns the engine name set in JSON []byte configuration.
-func getName(b []byte) string {
-	engineName := struct {
-		EngineName string `json:"engineName"`
-	}{}
-	if err := json.Unmarshal(b, &engineName); err != nil {
-		return ""
-	}
-	return engineName.EngineName
-}
-
-// Get returns the engine described by the JSON []byte configuration.
+// Get returns the engine described by the binary configuration b. Only
+// the engine name and the container ID are decoded, DecodeConfig must be
+// called before any use of the engine configuration.
 func Get(b []byte) (*Engine, error) {
-	engineName := getName(b)
+	common := new(config.Common)
+
+	engineConfig, err := common.UnmarshalBinaryHeader(b)
+	if err != nil {
+		return nil, fmt.Errorf("could not parse configuration: %s", err)
+	}
 
 	// ensure engine with given name is registered
-	eOp, ok := registeredOperations[engineName]
+	eOp, ok := registeredOperations[common.EngineName]
 	if !ok {
-		return nil, fmt.Errorf("engine %q is not found", engineName)
+		return nil, fmt.Errorf("engine %q is not found", common.EngineName)
 	}
 
-	// create empty Engine object with properly initialized EngineConfig && Operations
-	e := &Engine{
-		Operations: eOp,
-		Common: &config.Common{
-			EngineConfig: eOp.Config(),
-		},
-	}
+	// create Engine object with properly initialized EngineConfig && Operations
+	common.EngineConfig = eOp.Config()
+
+	return &Engine{
+		Operations:   eOp,
+		Common:       common,
+		engineConfig: engineConfig,
+	}, nil
+}
 
-	// parse received JSON configuration to specific EngineConfig
-	if err := json.Unmarshal(b, e.Common); err != nil {
-		return nil, fmt.Errorf("could not parse JSON configuration: %s", err)
+// DecodeConfig decodes the engine specific configuration and stores it
+// into the engine operations.
+func (e *Engine) DecodeConfig() error {
+	if err := e.UnmarshalEngineConfig(e.engineConfig); err != nil {
+		return fmt.Errorf("could not parse engine configuration: %s", err)
 	}
+	e.engineConfig = nil
 	e.InitConfig(e.Common)
-	return e, nil
+	return nil
 }
 
 var (
@@ -236,6 +236,11 @@ func (e *EngineOperations) copyFiles() error {
 			filesSection = f
 		}
 	}
+	umask, err := files.Umask()
+	if err != nil {
+		return fmt.Errorf("while reading umask: %s", err)
+	}
+
 	// iterate through filetransfers
 	for _, transfer := range filesSection.Files {
 		// sanity
@@ -251,7 +256,7 @@ func (e *EngineOperations) copyFiles() error {
 		// copying from host to container should follow symlinks
 		transfer.Dst = files.AddPrefix(e.EngineConfig.RootfsPath, transfer.Dst)
 		sylog.Infof("Copying %v to %v", transfer.Src, transfer.Dst)
-		if err := files.Copy(transfer.Src, transfer.Dst, true); err != nil {
+		if err := files.Copy(transfer.Src, transfer.Dst, true, umask); err != nil {
 			return err
 		}
 	}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -21,6 +21,8 @@ type EngineConfig struct {
 	BundlePath    string           `json:"bundlePath"`
 	LogPath       string           `json:"logPath"`
 	LogFormat     string           `json:"logFormat"`
+	LogMaxSize    int64            `json:"logMaxSize"`
+	LogMaxFiles   int              `json:"logMaxFiles"`
 	PidFile       string           `json:"pidFile"`
 	OciConfig     *oci.Config      `json:"ociConfig"`
 	MasterPts     int              `json:"masterPts"`
@@ -86,6 +88,28 @@ func (e *EngineConfig) GetLogFormat() string {
 	return e.LogFormat
 }
 
+// SetLogMaxSize sets the size in bytes triggering the container log
+// rotation, 0 disables rotation.
+func (e *EngineConfig) SetLogMaxSize(size int64) {
+	e.LogMaxSize = size
+}
+
+// GetLogMaxSize returns the size in bytes triggering the container log
+// rotation.
+func (e *EngineConfig) GetLogMaxSize() int64 {
+	return e.LogMaxSize
+}
+
+// SetLogMaxFiles sets the number of rotated container log files kept.
+func (e *EngineConfig) SetLogMaxFiles(files int) {
+	e.LogMaxFiles = files
+}
+
+// GetLogMaxFiles returns the number of rotated container log files kept.
+func (e *EngineConfig) GetLogMaxFiles() int {
+	return e.LogMaxFiles
+}
+
 // SetPidFile sets the pid file path.
 func (e *EngineConfig) SetPidFile(path string) {
 	e.PidFile = path
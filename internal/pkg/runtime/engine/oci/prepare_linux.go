@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -12,6 +12,7 @@ import (
 	"github.com/containerd/cgroups"
 	"github.com/kr/pty"
 	specs "github.com/opencontainers/runtime-spec/specs-go"
+	cgroupsutil "github.com/sylabs/singularity/internal/pkg/cgroups"
 	"github.com/sylabs/singularity/internal/pkg/runtime/engine/config/starter"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
 	"github.com/sylabs/singularity/pkg/ociruntime"
@@ -209,6 +210,20 @@ func (e *EngineOperations) PrepareConfig(starterConfig *starter.Config) error {
 			return nil
 		}
 
+		// create executed process into container cgroup with cgroup v2
+		if cgroupsutil.IsUnified() {
+			manager := &cgroupsutil.Manager{Path: cPath}
+			fd, err := manager.Open()
+			if err != nil {
+				return fmt.Errorf("failed to open cgroup %s: %s", cPath, err)
+			}
+			if err := starterConfig.KeepFileDescriptor(fd); err != nil {
+				return err
+			}
+			starterConfig.SetCgroupFd(fd, false)
+			return nil
+		}
+
 		// add executed process to container cgroups
 		ppid := os.Getppid()
 		staticPath := cgroups.StaticPath(cPath)
@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -32,6 +32,10 @@ import (
 	"github.com/sylabs/singularity/pkg/util/unix"
 )
 
+// attachBufferSize is the size of the buffer holding container output
+// not yet sent to an attached client.
+const attachBufferSize = 1 << 20
+
 // StartProcess is called during stage2 after RPC server finished
 // environment preparation. This is the container process itself.
 //
@@ -200,6 +204,7 @@ func (e *EngineOperations) PreStartProcess(ctx context.Context, pid int, masterC
 	if err != nil {
 		return err
 	}
+	logger.SetRotation(e.EngineConfig.GetLogMaxSize(), e.EngineConfig.GetLogMaxFiles())
 
 	pidFile := e.EngineConfig.GetPidFile()
 	if pidFile != "" {
@@ -329,6 +334,14 @@ func (e *EngineOperations) handleStream(l net.Listener, logger *instance.Logger,
 
 	hasTerminal := e.EngineConfig.OciConfig.Process.Terminal
 
+	// a slow attached client must not block the container output,
+	// terminal output not sent in time to a client is dropped while
+	// a client attached to output streams is disconnected instead
+	attachPolicy := copy.DisconnectOnOverflow
+	if hasTerminal {
+		attachPolicy = copy.DropOnOverflow
+	}
+
 	inputWriters = &copy.MultiWriter{}
 	outputWriters = &copy.MultiWriter{}
 	outWriter, _ := logger.NewWriter("stdout", true)
@@ -366,9 +379,9 @@ func (e *EngineOperations) handleStream(l net.Listener, logger *instance.Logger,
 			}
 
 			go func() {
-				outputWriters.Add(c)
+				outputWriters.AddBuffered(c, attachBufferSize, attachPolicy)
 				if stderr != nil {
-					errorWriters.Add(c)
+					errorWriters.AddBuffered(c, attachBufferSize, attachPolicy)
 				}
 
 				if tbuf != nil {
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -57,11 +57,28 @@ func (e *EngineOperations) CleanupContainer(ctx context.Context, fatal error, st
 		}
 	}
 
+	// the container exit status is returned once cleanup is done, the
+	// pool fill started at container startup is left to the next
+	// container using the pool after the entry being added
+	pool := e.EngineConfig.NetnsPool
+	if pool != nil {
+		pool.Stop()
+		if err := pool.Wait(); err != nil {
+			sylog.Verbosef("Could not fill network namespace pool: %v", err)
+		}
+	}
+
 	if e.EngineConfig.Network != nil {
 		if e.EngineConfig.GetFakeroot() {
 			priv.Escalate()
 		}
-		if err := e.EngineConfig.Network.DelNetworks(ctx); err != nil {
+		var err error
+		if entry := e.EngineConfig.NetnsPoolEntry; entry != "" && pool != nil {
+			err = pool.Release(ctx, e.EngineConfig.Network, entry)
+		} else {
+			err = e.EngineConfig.Network.DelNetworks(ctx)
+		}
+		if err != nil {
 			sylog.Errorf("could not delete networks: %v", err)
 		}
 		if e.EngineConfig.GetFakeroot() {
@@ -75,6 +92,12 @@ func (e *EngineOperations) CleanupContainer(ctx context.Context, fatal error, st
 		}
 	}
 
+	for _, ref := range e.EngineConfig.SharedMounts {
+		if err := ref.Release(); err != nil {
+			sylog.Errorf("could not release shared mount: %v", err)
+		}
+	}
+
 	if e.EngineConfig.CryptDev != "" {
 		if err := cleanupCrypt(e.EngineConfig.CryptDev); err != nil {
 			sylog.Errorf("could not cleanup crypt: %v", err)
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -18,6 +18,7 @@ import (
 	specs "github.com/opencontainers/runtime-spec/specs-go"
 	"github.com/sylabs/singularity/internal/pkg/buildcfg"
 	"github.com/sylabs/singularity/internal/pkg/cgroups"
+	args "github.com/sylabs/singularity/internal/pkg/runtime/engine/singularity/rpc"
 	"github.com/sylabs/singularity/internal/pkg/runtime/engine/singularity/rpc/client"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
 	"github.com/sylabs/singularity/internal/pkg/util/fs"
@@ -27,8 +28,10 @@ import (
 	"github.com/sylabs/singularity/internal/pkg/util/fs/layout/layer/underlay"
 	"github.com/sylabs/singularity/internal/pkg/util/fs/mount"
 	fsoverlay "github.com/sylabs/singularity/internal/pkg/util/fs/overlay"
+	"github.com/sylabs/singularity/internal/pkg/util/fs/pool"
 	"github.com/sylabs/singularity/internal/pkg/util/mainthread"
 	"github.com/sylabs/singularity/internal/pkg/util/priv"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 	"github.com/sylabs/singularity/internal/pkg/util/user"
 	"github.com/sylabs/singularity/pkg/image"
 	"github.com/sylabs/singularity/pkg/network"
@@ -52,6 +55,17 @@ type lastMount struct {
 	flags uintptr
 }
 
+// pendingMount is a mount queued until the end of its tag, with what is
+// needed to handle its error.
+type pendingMount struct {
+	args        args.MountArgs
+	point       mount.Point
+	tag         mount.AuthorizedTag
+	bindMount   bool
+	remount     bool
+	propagation bool
+}
+
 type container struct {
 	engine        *EngineOperations
 	rpcOps        *client.RPC
@@ -66,6 +80,7 @@ type container struct {
 	mountInfoPath string
 	lastMount     lastMount
 	skippedMount  []string
+	pendingMounts []pendingMount
 	suidFlag      uintptr
 	devSourcePath string
 }
@@ -119,8 +134,9 @@ func create(ctx context.Context, engine *EngineOperations, rpcOps *client.RPC, p
 	}
 
 	p := &mount.Points{}
-	system := &mount.System{Points: p, Mount: c.mount}
+	system := &mount.System{Points: p, Mount: c.mount, Flush: c.flushMounts}
 
+	region := trace.Begin("create: prepare mount points")
 	if err := c.setupSessionLayout(system); err != nil {
 		return err
 	}
@@ -192,15 +208,19 @@ func create(ctx context.Context, engine *EngineOperations, rpcOps *client.RPC, p
 	if err != nil {
 		return err
 	}
+	region.End()
 
 	sylog.Debugf("Mount all")
+	region = trace.Begin("create: mount all")
 	if err := system.MountAll(); err != nil {
 		return err
 	}
+	region.End()
 
 	// chroot from RPC server current working directory since
 	// it's already in final directory after chdirFinal call
 	sylog.Debugf("Chroot into %s\n", c.session.FinalPath())
+	region = trace.Begin("create: chroot")
 	_, err = c.rpcOps.Chroot(".", "pivot")
 	if err != nil {
 		sylog.Debugf("Fallback to move/chroot")
@@ -209,16 +229,24 @@ func create(ctx context.Context, engine *EngineOperations, rpcOps *client.RPC, p
 			return fmt.Errorf("chroot failed: %s", err)
 		}
 	}
+	region.End()
 
 	if networkSetup != nil {
+		region = trace.Begin("create: network setup")
 		if err := networkSetup(ctx); err != nil {
 			return err
 		}
+		region.End()
 	}
 
 	if os.Geteuid() == 0 && !c.userNS {
 		path := engine.EngineConfig.GetCgroupsPath()
-		if path != "" {
+		if engine.EngineConfig.Cgroup != "" {
+			// the container process was created into the cgroup
+			// created by stage 1 with the resource limits applied
+			engine.EngineConfig.Cgroups = &cgroups.Manager{Pid: pid, Path: engine.EngineConfig.Cgroup}
+		} else if path != "" {
+			defer trace.Begin("create: cgroups").End()
 			cgroupPath := filepath.Join("/singularity", strconv.Itoa(pid))
 			manager := &cgroups.Manager{Pid: pid, Path: cgroupPath}
 			if err := manager.ApplyFromFile(path); err != nil {
@@ -302,12 +330,27 @@ func (c *container) isLayerEnabled() bool {
 }
 
 func (c *container) mount(point *mount.Point, system *mount.System) error {
-	if _, err := mount.GetOffset(point.InternalOptions); err == nil {
+	tag := system.CurrentTag()
+
+	_, err := mount.GetOffset(point.InternalOptions)
+	image := err == nil
+	// the mounts of a tag are queued by mountGeneric and performed at
+	// once by flushMounts, except the mounts depending on the result of
+	// the previous ones or which may be retried, they are performed once
+	// the queued mounts are. A point whose source or destination lies
+	// under a queued mount also waits for it, its destination must be
+	// resolved against the mounted directory and not against the image
+	if image || !batchMount(point, tag) || c.underPendingMount(point) {
+		if err := c.flushMounts(system); err != nil {
+			return err
+		}
+	}
+
+	if image {
 		if err := c.mountImage(point); err != nil {
 			return fmt.Errorf("while mounting image %s: %s", point.Source, err)
 		}
 	} else {
-		tag := system.CurrentTag()
 		if err := c.mountGeneric(point, tag); err != nil {
 			return fmt.Errorf("while mounting %s: %s", point.Source, err)
 		}
@@ -315,6 +358,44 @@ func (c *container) mount(point *mount.Point, system *mount.System) error {
 	return nil
 }
 
+// batchMount returns whether the generic mount point can be queued.
+func batchMount(point *mount.Point, tag mount.AuthorizedTag) bool {
+	return tag != mount.RootfsTag && tag != mount.CwdTag && point.Type != "overlay"
+}
+
+// underPendingMount returns whether the source or the destination of
+// the mount point lies under the target of a queued mount.
+func (c *container) underPendingMount(point *mount.Point) bool {
+	if len(c.pendingMounts) == 0 {
+		return false
+	}
+
+	paths := []string{point.Source, c.mountDest(point)}
+	if !strings.HasPrefix(point.Destination, c.session.Path()) {
+		paths = append(paths, filepath.Join(c.session.FinalPath(), point.Destination))
+	}
+
+	for _, p := range c.pendingMounts {
+		target := filepath.Clean(p.args.Target) + "/"
+		for _, path := range paths {
+			if strings.HasPrefix(filepath.Clean(path), target) {
+				return true
+			}
+		}
+	}
+	return false
+}
+
+// mountDest returns the mount point destination path resolved in the
+// container root filesystem.
+func (c *container) mountDest(mnt *mount.Point) string {
+	if strings.HasPrefix(mnt.Destination, c.session.Path()) {
+		return mnt.Destination
+	}
+	dest := fs.EvalRelative(mnt.Destination, c.session.FinalPath())
+	return filepath.Join(c.session.FinalPath(), dest)
+}
+
 // setPropagationMount will apply propagation flag set by
 // configuration directive, when applied master process
 // won't see mount done by RPC server anymore. Typically
@@ -411,12 +492,10 @@ func (c *container) isMounted(dest string) bool {
 func (c *container) mountGeneric(mnt *mount.Point, tag mount.AuthorizedTag) (err error) {
 	flags, opts := mount.ConvertOptions(mnt.Options)
 	optsString := strings.Join(opts, ",")
-	sessionPath := c.session.Path()
 	bindMount := flags&syscall.MS_BIND != 0
 	remount := mount.HasRemountFlag(flags)
 	propagation := mount.HasPropagationFlag(flags)
 	source := mnt.Source
-	dest := ""
 
 	if bindMount {
 		if !remount {
@@ -444,18 +523,11 @@ func (c *container) mountGeneric(mnt *mount.Point, tag mount.AuthorizedTag) (err
 		}
 	}
 
-	if !strings.HasPrefix(mnt.Destination, sessionPath) {
-		dest = fs.EvalRelative(mnt.Destination, c.session.FinalPath())
-		dest = filepath.Join(c.session.FinalPath(), dest)
-	} else {
-		dest = mnt.Destination
-	}
+	dest := c.mountDest(mnt)
 
 	if remount || propagation {
-		for _, skipped := range c.skippedMount {
-			if skipped == mnt.Destination {
-				return nil
-			}
+		if c.isSkipped(mnt.Destination) {
+			return nil
 		}
 		sylog.Debugf("Remounting %s\n", dest)
 	} else {
@@ -486,8 +558,88 @@ func (c *container) mountGeneric(mnt *mount.Point, tag mount.AuthorizedTag) (err
 		}
 	}
 
+	if batchMount(mnt, tag) {
+		c.pendingMounts = append(c.pendingMounts, pendingMount{
+			args: args.MountArgs{
+				Source:     source,
+				Target:     dest,
+				Filesystem: mnt.Type,
+				Mountflags: flags,
+				Data:       optsString,
+			},
+			point:       *mnt,
+			tag:         tag,
+			bindMount:   bindMount,
+			remount:     remount,
+			propagation: propagation,
+		})
+		return nil
+	}
+
 mount:
 	err = c.rpcOps.Mount(source, dest, mnt.Type, flags, optsString)
+	if err != nil && !bindMount && mnt.Type == "overlay" && err == syscall.ESTALE {
+		// overlay mount can return this error when a previous mount was
+		// done with an upper layer and overlay inodes index is enabled
+		// by default, see https://github.com/sylabs/singularity/issues/4539
+		sylog.Verbosef("Overlay mount failed with %s, mounting with index=off", err)
+		optsString = fmt.Sprintf("%s,index=off", optsString)
+		goto mount
+	}
+	return c.mountError(mnt, tag, bindMount, remount, flags, err)
+}
+
+// flushMounts performs the queued mounts in order with a single RPC until
+// one fails. Its error is handled as if it was mounted alone, the queued
+// remounts of a skipped mount are dropped and the remaining mounts are
+// sent again.
+func (c *container) flushMounts(system *mount.System) error {
+	for len(c.pendingMounts) > 0 {
+		mounts := make([]args.MountArgs, len(c.pendingMounts))
+		for i, p := range c.pendingMounts {
+			mounts[i] = p.args
+		}
+
+		done, err := c.rpcOps.MountBatch(mounts)
+		if err == nil {
+			c.pendingMounts = nil
+			return nil
+		}
+		if done >= len(c.pendingMounts) {
+			done = len(c.pendingMounts) - 1
+		}
+
+		p := c.pendingMounts[done]
+		if err := c.mountError(&p.point, p.tag, p.bindMount, p.remount, p.args.Mountflags, err); err != nil {
+			c.pendingMounts = nil
+			return fmt.Errorf("while mounting %s: %s", p.point.Source, err)
+		}
+
+		var remaining []pendingMount
+		for _, p := range c.pendingMounts[done+1:] {
+			if (p.remount || p.propagation) && c.isSkipped(p.point.Destination) {
+				continue
+			}
+			remaining = append(remaining, p)
+		}
+		c.pendingMounts = remaining
+	}
+	return nil
+}
+
+// isSkipped returns whether the mount to dest was skipped.
+func (c *container) isSkipped(dest string) bool {
+	for _, skipped := range c.skippedMount {
+		if skipped == dest {
+			return true
+		}
+	}
+	return false
+}
+
+// mountError handles the error of the mount mnt, it returns nil if the
+// error is not fatal.
+func (c *container) mountError(mnt *mount.Point, tag mount.AuthorizedTag, bindMount, remount bool, flags uintptr, err error) error {
 	if os.IsNotExist(err) {
 		switch tag {
 		case mount.KernelTag,
@@ -497,7 +649,7 @@ mount:
 			mount.FilesTag,
 			mount.TmpTag:
 			c.skippedMount = append(c.skippedMount, mnt.Destination)
-			sylog.Warningf("Skipping mount %s [%s]: %s doesn't exist in container", source, tag, mnt.Destination)
+			sylog.Warningf("Skipping mount %s [%s]: %s doesn't exist in container", mnt.Source, tag, mnt.Destination)
 			return nil
 		default:
 			if c.engine.EngineConfig.GetWritableImage() {
@@ -516,13 +668,6 @@ mount:
 			if mnt.Type == "devpts" {
 				sylog.Verbosef("Couldn't mount devpts filesystem, continuing with PTY allocation functionality disabled")
 				return nil
-			} else if mnt.Type == "overlay" && err == syscall.ESTALE {
-				// overlay mount can return this error when a previous mount was
-				// done with an upper layer and overlay inodes index is enabled
-				// by default, see https://github.com/sylabs/singularity/issues/4539
-				sylog.Verbosef("Overlay mount failed with %s, mounting with index=off", err)
-				optsString = fmt.Sprintf("%s,index=off", optsString)
-				goto mount
 			}
 			// mount error for other filesystems is considered fatal
 			return fmt.Errorf("can't mount %s filesystem to %s: %s", mnt.Type, mnt.Destination, err)
@@ -578,6 +723,21 @@ func (c *container) mountImage(mnt *mount.Point) error {
 		Flags:     loopFlags,
 	}
 
+	mountType := mnt.Type
+
+	// read-only squashfs image partitions can be shared between containers,
+	// the host mount namespace may also be kept for the network namespace
+	// pool
+	nsFd := c.engine.EngineConfig.HostMountNsFd
+	if nsFd > 0 && c.engine.sharedImageMounts() && mountType == "squashfs" && attachFlag == os.O_RDONLY {
+		pooled, err := c.mountPooledImage(mnt, nsFd, *info, flags)
+		if err != nil {
+			sylog.Warningf("Shared mount failed, mounting image privately: %s", err)
+		} else if pooled {
+			return nil
+		}
+	}
+
 	shared := c.engine.EngineConfig.File.SharedLoopDevices
 	number, err := c.rpcOps.LoopDevice(mnt.Source, attachFlag, *info, maxDevices, shared)
 	if err != nil {
@@ -588,8 +748,6 @@ func (c *container) mountImage(mnt *mount.Point) error {
 
 	sylog.Debugf("Mounting loop device %s to %s of type %s\n", path, mnt.Destination, mnt.Type)
 
-	mountType := mnt.Type
-
 	if mountType == "encryptfs" {
 		key, err := mount.GetKey(mnt.InternalOptions)
 		if err != nil {
@@ -640,6 +798,54 @@ func (c *container) mountImage(mnt *mount.Point) error {
 	return nil
 }
 
+// mountPooledImage binds the shared mount of a read-only image partition
+// from the shared mount pool, the shared mount is created by the first
+// container using the image partition. It returns false if the shared
+// mount isn't visible from the container mount namespace, which happens
+// for containers created before the pool directory became a shared mount
+// point, the image partition must then be mounted privately.
+func (c *container) mountPooledImage(mnt *mount.Point, nsFd int, info loop.Info64, flags uintptr) (bool, error) {
+	key, err := pool.Key(mnt.Source, info.Offset, info.SizeLimit)
+	if err != nil {
+		return false, err
+	}
+	p := &pool.Pool{Dir: buildcfg.POOLDIR, NsFd: nsFd}
+
+	ref, err := p.Acquire(key, func(target string) error {
+		maxDevices := int(c.engine.EngineConfig.File.MaxLoopDevices)
+		shared := c.engine.EngineConfig.File.SharedLoopDevices
+		number, err := c.rpcOps.LoopDevice(mnt.Source, os.O_RDONLY, info, maxDevices, shared)
+		if err != nil {
+			return fmt.Errorf("failed to find loop device: %s", err)
+		}
+		path := fmt.Sprintf("/dev/loop%d", number)
+
+		sylog.Debugf("Mounting loop device %s to shared mount %s", path, target)
+		return c.rpcOps.PoolMount(nsFd, key, path, mnt.Type, syscall.MS_RDONLY|syscall.MS_NOSUID|syscall.MS_NODEV, "")
+	})
+	if err != nil {
+		return false, err
+	}
+	// the reference is released by the container cleanup
+	c.engine.EngineConfig.SharedMounts = append(c.engine.EngineConfig.SharedMounts, ref)
+
+	if !p.Visible(key) {
+		sylog.Debugf("Shared mount %s not visible from container, mounting image privately", key)
+		return false, nil
+	}
+
+	source := p.Path(key)
+	sylog.Debugf("Binding shared mount %s to %s", source, mnt.Destination)
+
+	if err := c.rpcOps.Mount(source, mnt.Destination, "", syscall.MS_BIND, ""); err != nil {
+		return false, fmt.Errorf("while binding shared mount %s: %s", source, err)
+	}
+	if err := c.rpcOps.Mount("", mnt.Destination, "", syscall.MS_BIND|syscall.MS_REMOUNT|flags, ""); err != nil {
+		return false, fmt.Errorf("while remounting shared mount %s: %s", mnt.Destination, err)
+	}
+	return true, nil
+}
+
 func (c *container) loadImage(path string, rootfs bool) (*image.Image, error) {
 	list := c.engine.EngineConfig.GetImageList()
 
@@ -2000,16 +2206,7 @@ func (c *container) prepareNetworkSetup(system *mount.System, pid int) (func(con
 		networks = []string{fakerootNet}
 	}
 
-	cniPath := &network.CNIPath{}
-
-	cniPath.Conf = c.engine.EngineConfig.File.CniConfPath
-	if cniPath.Conf == "" {
-		cniPath.Conf = defaultCNIConfPath
-	}
-	cniPath.Plugin = c.engine.EngineConfig.File.CniPluginPath
-	if cniPath.Plugin == "" {
-		cniPath.Plugin = defaultCNIPluginPath
-	}
+	cniPath := c.engine.cniPath()
 
 	setup, err := network.NewSetup(networks, strconv.Itoa(pid), nspath, cniPath)
 	if err != nil {
@@ -2020,6 +2217,20 @@ func (c *container) prepareNetworkSetup(system *mount.System, pid int) (func(con
 		return nil, fmt.Errorf("error while setting network arguments: %s", err)
 	}
 
+	var pool *network.NsPool
+	var key string
+
+	// the pool is filled in the host mount namespace kept by stage 1
+	if !fakeroot && c.engine.EngineConfig.HostMountNsFd > 0 {
+		pool, key = c.engine.netnsPool(networks)
+	}
+	entry := c.engine.EngineConfig.NetnsPoolEntry
+	if entry != "" && pool == nil {
+		// the configuration changed since the entry was claimed,
+		// the entry is released without filling the pool
+		pool = &network.NsPool{Dir: buildcfg.NETNSPOOLDIR, NsFd: c.engine.EngineConfig.HostMountNsFd}
+	}
+
 	return func(ctx context.Context) error {
 		if fakeroot {
 			// prevent port hijacking between user processes
@@ -2032,16 +2243,77 @@ func (c *container) prepareNetworkSetup(system *mount.System, pid int) (func(con
 			}
 		}
 
-		setup.SetEnvPath("/bin:/sbin:/usr/bin:/usr/sbin")
+		envPath := "/bin:/sbin:/usr/bin:/usr/sbin"
 
-		if err := setup.AddNetworks(ctx); err != nil {
-			return fmt.Errorf("%s", err)
+		if entry != "" {
+			// the container joined a network namespace configured
+			// in advance
+			pooled, err := pool.Restore(entry, networks, nspath, cniPath)
+			if err != nil {
+				return fmt.Errorf("while restoring pooled network setup: %s", err)
+			}
+			setup = pooled
+			setup.SetEnvPath(envPath)
+		} else {
+			setup.SetEnvPath(envPath)
+			if err := setup.AddNetworks(ctx); err != nil {
+				return fmt.Errorf("%s", err)
+			}
 		}
 		c.engine.EngineConfig.Network = setup
+
+		if key != "" {
+			// replace the network namespace used by the container
+			// while it runs, cleanup stops the fill once the entry
+			// being added is configured
+			pool.Fill(key, networks, cniPath, envPath)
+		}
+		c.engine.EngineConfig.NetnsPool = pool
 		return nil
 	}, nil
 }
 
+// cniPath returns the CNI configuration and plugin directories.
+func (e *EngineOperations) cniPath() *network.CNIPath {
+	cniPath := &network.CNIPath{
+		Conf:   e.EngineConfig.File.CniConfPath,
+		Plugin: e.EngineConfig.File.CniPluginPath,
+	}
+	if cniPath.Conf == "" {
+		cniPath.Conf = defaultCNIConfPath
+	}
+	if cniPath.Plugin == "" {
+		cniPath.Plugin = defaultCNIPluginPath
+	}
+	return cniPath
+}
+
+// netnsPool returns the network namespace pool and the pool key of the
+// networks if the network setup of the container can be pooled. Network
+// arguments modify the network setup, containers requesting them don't
+// use the pool.
+func (e *EngineOperations) netnsPool(networks []string) (*network.NsPool, string) {
+	size := e.EngineConfig.File.NetnsPoolSize
+	if size == 0 || len(e.EngineConfig.GetNetworkArgs()) > 0 {
+		return nil, ""
+	}
+
+	key, err := network.PoolKey(networks, e.cniPath())
+	if err != nil {
+		sylog.Debugf("Not using network namespace pool: %s", err)
+		return nil, ""
+	} else if key == "" {
+		return nil, ""
+	}
+
+	p := &network.NsPool{
+		Dir:  buildcfg.NETNSPOOLDIR,
+		Size: int(size),
+		NsFd: e.EngineConfig.HostMountNsFd,
+	}
+	return p, key
+}
+
 // addFuseMount transforms the plugin configuration into a series of
 // mount requests for FUSE filesystems
 func (c *container) addFuseMount(system *mount.System) error {
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -11,9 +11,10 @@ import (
 	"net"
 	"net/rpc"
 
-	"github.com/sylabs/singularity/internal/pkg/buildcfg"
 	"github.com/sylabs/singularity/internal/pkg/runtime/engine/singularity/rpc/client"
-	"github.com/sylabs/singularity/pkg/runtime/engine/config"
+	"github.com/sylabs/singularity/internal/pkg/syecl"
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/internal/pkg/util/priv"
 	singularityConfig "github.com/sylabs/singularity/pkg/runtime/engine/singularity/config"
 )
 
@@ -30,8 +31,6 @@ import (
 // of the setup (e.g. mount operations) where privileges may be required is performed
 // by calling RPC server methods (see internal/app/starter/rpc_linux.go for details).
 func (e *EngineOperations) CreateContainer(ctx context.Context, pid int, rpcConn net.Conn) error {
-	var err error
-
 	if e.CommonConfig.EngineName != singularityConfig.Name {
 		return fmt.Errorf("engineName configuration doesn't match runtime name")
 	}
@@ -40,9 +39,19 @@ func (e *EngineOperations) CreateContainer(ctx context.Context, pid int, rpcConn
 		return nil
 	}
 
-	e.EngineConfig.File, err = config.ParseFile(buildcfg.SINGULARITY_CONF_FILE)
-	if err != nil {
-		return fmt.Errorf("unable to parse singularity.conf file: %s", err)
+	// reuse the configuration parsed by stage 1
+	if err := e.EngineConfig.RestoreFile(); err != nil {
+		return fmt.Errorf("unable to restore singularity.conf configuration: %s", err)
+	}
+
+	// record the images verified by stage 1 in the ECL verification cache
+	for _, key := range e.EngineConfig.EclCacheKeys {
+		priv.Escalate()
+		err := syecl.RecordCache(key)
+		priv.Drop()
+		if err != nil {
+			sylog.Debugf("Could not record ECL verification: %s", err)
+		}
 	}
 
 	rpcOps := &client.RPC{
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -8,7 +8,11 @@ package singularity
 import (
 	"fmt"
 	"os"
+	"reflect"
 	"syscall"
+
+	"github.com/sylabs/singularity/internal/pkg/instance"
+	"github.com/sylabs/singularity/internal/pkg/sylog"
 )
 
 // MonitorContainer is called from master once the container has
@@ -43,3 +47,127 @@ func (e *EngineOperations) MonitorContainer(pid int, signals chan os.Signal) (sy
 		}
 	}
 }
+
+// handoffSafe lists the engine configuration fields which may be set for
+// an instance handed off to the instance monitor of the user. The JSON
+// fields, listed with a "JSON." prefix, are options whose resources held
+// by the master process are in the other fields (Network, Cgroups,
+// CryptDev...), except the cache entry locks which are moved to the
+// instance monitor along with the image to delete. Setting any field not
+// listed, including fields added later, keeps the instance monitored by
+// its master process.
+var handoffSafe = map[string]bool{
+	"JSON":            true,
+	"OciConfig":       true,
+	"File":            true,
+	"FileSnapshot":    true,
+	"EclCacheKeys":    true,
+	"StaticEnv":       true,
+	"InstanceMonitor": true,
+
+	"JSON.ScratchDir":        true,
+	"JSON.OverlayImage":      true,
+	"JSON.BindPath":          true,
+	"JSON.NetworkArgs":       true,
+	"JSON.Security":          true,
+	"JSON.FilesPath":         true,
+	"JSON.LibrariesPath":     true,
+	"JSON.ImageList":         true,
+	"JSON.OpenFd":            true,
+	"JSON.CacheLockFds":      true,
+	"JSON.TargetGID":         true,
+	"JSON.Image":             true,
+	"JSON.Workdir":           true,
+	"JSON.CgroupsPath":       true,
+	"JSON.HomeSource":        true,
+	"JSON.HomeDest":          true,
+	"JSON.Command":           true,
+	"JSON.Shell":             true,
+	"JSON.TmpDir":            true,
+	"JSON.AddCaps":           true,
+	"JSON.DropCaps":          true,
+	"JSON.Hostname":          true,
+	"JSON.Network":           true,
+	"JSON.DNS":               true,
+	"JSON.Cwd":               true,
+	"JSON.SessionLayer":      true,
+	"JSON.EncryptionKey":     true,
+	"JSON.TargetUID":         true,
+	"JSON.ExecAgentFd":       true,
+	"JSON.WritableImage":     true,
+	"JSON.WritableTmpfs":     true,
+	"JSON.Contain":           true,
+	"JSON.Nv":                true,
+	"JSON.Rocm":              true,
+	"JSON.CustomHome":        true,
+	"JSON.Instance":          true,
+	"JSON.InstanceJoin":      true,
+	"JSON.BootInstance":      true,
+	"JSON.RunPrivileged":     true,
+	"JSON.AllowSUID":         true,
+	"JSON.KeepPrivs":         true,
+	"JSON.NoPrivs":           true,
+	"JSON.NoHome":            true,
+	"JSON.NoInit":            true,
+	"JSON.DeleteImage":       true,
+	"JSON.Fakeroot":          true,
+	"JSON.SignalPropagation": true,
+}
+
+// handoffBlocker returns the name of the first field set in the engine
+// configuration v which is not listed in handoffSafe, or an empty string.
+func handoffBlocker(v reflect.Value, prefix string) string {
+	t := v.Type()
+	for i := 0; i < t.NumField(); i++ {
+		f := v.Field(i)
+		switch f.Kind() {
+		case reflect.Map, reflect.Slice:
+			if f.Len() == 0 {
+				continue
+			}
+		default:
+			if f.IsZero() {
+				continue
+			}
+		}
+
+		name := prefix + t.Field(i).Name
+		if !handoffSafe[name] {
+			return name
+		}
+		if name == "JSON" {
+			if b := handoffBlocker(f.Elem(), "JSON."); b != "" {
+				return b
+			}
+		}
+	}
+	return ""
+}
+
+// MonitoredContainer is called from master once the container has been
+// started. It returns the description of the instance process pid handed
+// off to the instance monitor of the user, or nil if the master process
+// must monitor the container because it holds resources or does a cleanup
+// the instance monitor can't take over, see handoffSafe.
+func (e *EngineOperations) MonitoredContainer(pid int) *instance.MonitoredContainer {
+	if !e.EngineConfig.InstanceMonitor {
+		return nil
+	}
+	if b := handoffBlocker(reflect.ValueOf(e.EngineConfig).Elem(), ""); b != "" {
+		sylog.Debugf("Instance process not handed off, %s is monitored by the master process", b)
+		return nil
+	}
+
+	c := &instance.MonitoredContainer{
+		Pid:               pid,
+		Name:              e.CommonConfig.ContainerID,
+		SignalPropagation: e.EngineConfig.GetSignalPropagation(),
+		// the instance monitor holds the cache entry locks until
+		// the instance process exited
+		Fds: e.EngineConfig.GetCacheLockFds(),
+	}
+	if e.EngineConfig.GetDeleteImage() {
+		c.DeleteImage = e.EngineConfig.GetImage()
+	}
+	return c
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package singularity
+
+import (
+	"reflect"
+	"testing"
+
+	"github.com/sylabs/singularity/internal/pkg/cgroups"
+	"github.com/sylabs/singularity/pkg/runtime/engine/config"
+	singularityConfig "github.com/sylabs/singularity/pkg/runtime/engine/singularity/config"
+)
+
+func TestMonitoredContainer(t *testing.T) {
+	newEngine := func() *EngineOperations {
+		e := &EngineOperations{
+			CommonConfig: &config.Common{ContainerID: "test"},
+			EngineConfig: singularityConfig.NewConfig(),
+		}
+		e.EngineConfig.InstanceMonitor = true
+		e.EngineConfig.SetImage("/tmp/image.sif")
+		e.EngineConfig.SetDeleteImage(true)
+		e.EngineConfig.SetCacheLockFds([]int{3, 4})
+		return e
+	}
+
+	c := newEngine().MonitoredContainer(42)
+	if c == nil {
+		t.Fatalf("unexpected instance process monitored by the master process")
+	}
+	if c.Pid != 42 || c.Name != "test" || c.DeleteImage != "/tmp/image.sif" {
+		t.Errorf("unexpected monitored container %+v", c)
+	}
+	// the cache entry locks are moved to the instance monitor
+	if !reflect.DeepEqual(c.Fds, []int{3, 4}) {
+		t.Errorf("unexpected file descriptors %v passed to the instance monitor", c.Fds)
+	}
+
+	tests := []struct {
+		name string
+		set  func(e *singularityConfig.EngineConfig)
+	}{
+		{"no monitor", func(e *singularityConfig.EngineConfig) { e.InstanceMonitor = false }},
+		{"cgroups", func(e *singularityConfig.EngineConfig) { e.Cgroups = &cgroups.Manager{} }},
+		{"cgroup", func(e *singularityConfig.EngineConfig) { e.Cgroup = "/sys/fs/cgroup/test" }},
+		{"encrypted", func(e *singularityConfig.EngineConfig) { e.CryptDev = "/dev/mapper/test" }},
+		{"host mount namespace", func(e *singularityConfig.EngineConfig) { e.HostMountNsFd = 5 }},
+		{"network namespace pool", func(e *singularityConfig.EngineConfig) { e.NetnsPoolFd = 6 }},
+		{"plugin", func(e *singularityConfig.EngineConfig) { e.Plugin["test"] = []byte("{}") }},
+	}
+	for _, tt := range tests {
+		e := newEngine()
+		tt.set(e.EngineConfig)
+		if c := e.MonitoredContainer(42); c != nil {
+			t.Errorf("unexpected instance process handed off with %s", tt.name)
+		}
+	}
+}
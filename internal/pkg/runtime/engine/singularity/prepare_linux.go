@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -9,16 +9,20 @@ import (
 	"bufio"
 	"encoding/json"
 	"fmt"
+	"io"
 	"io/ioutil"
 	"os"
 	"path/filepath"
 	"strconv"
 	"strings"
 	"syscall"
+	"time"
 
 	"github.com/containerd/cgroups"
 	specs "github.com/opencontainers/runtime-spec/specs-go"
+	"github.com/sylabs/sif/pkg/sif"
 	"github.com/sylabs/singularity/internal/pkg/buildcfg"
+	cgroupsutil "github.com/sylabs/singularity/internal/pkg/cgroups"
 	fakerootutil "github.com/sylabs/singularity/internal/pkg/fakeroot"
 	"github.com/sylabs/singularity/internal/pkg/instance"
 	"github.com/sylabs/singularity/internal/pkg/runtime/engine/config/starter"
@@ -26,9 +30,11 @@ import (
 	"github.com/sylabs/singularity/internal/pkg/security/seccomp"
 	"github.com/sylabs/singularity/internal/pkg/syecl"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/internal/pkg/util/env"
 	"github.com/sylabs/singularity/internal/pkg/util/fs"
 	"github.com/sylabs/singularity/internal/pkg/util/fs/overlay"
 	"github.com/sylabs/singularity/internal/pkg/util/mainthread"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 	"github.com/sylabs/singularity/internal/pkg/util/user"
 	"github.com/sylabs/singularity/pkg/image"
 	"github.com/sylabs/singularity/pkg/runtime/engine/config"
@@ -38,6 +44,10 @@ import (
 	"golang.org/x/sys/unix"
 )
 
+// maxStaticEnvSize is the maximum size of the environment resolved at
+// build time read from a SIF image.
+const maxStaticEnvSize = 1 << 20
+
 var nsProcName = map[specs.LinuxNamespaceType]string{
 	specs.PIDNamespace:     "pid",
 	specs.UTSNamespace:     "uts",
@@ -67,10 +77,26 @@ func (e *EngineOperations) PrepareConfig(starterConfig *starter.Config) error {
 	}
 
 	configurationFile := buildcfg.SINGULARITY_CONF_FILE
+	region := trace.Begin("stage 1: parse singularity.conf")
 	e.EngineConfig.File, err = config.ParseFile(configurationFile)
 	if err != nil {
 		return fmt.Errorf("unable to parse singularity.conf file: %s", err)
 	}
+	region.End()
+	// always replace the snapshot provided by the user
+	if err := e.EngineConfig.SnapshotFile(); err != nil {
+		return fmt.Errorf("unable to snapshot singularity.conf configuration: %s", err)
+	}
+	// never trust a host mount namespace, an ECL verification, a
+	// static environment, an instance monitor setting, a network
+	// namespace pool entry or a cgroup provided by the user
+	e.EngineConfig.HostMountNsFd = 0
+	e.EngineConfig.EclCacheKeys = nil
+	e.EngineConfig.StaticEnv = nil
+	e.EngineConfig.InstanceMonitor = false
+	e.EngineConfig.NetnsPoolEntry = ""
+	e.EngineConfig.NetnsPoolFd = 0
+	e.EngineConfig.Cgroup = ""
 
 	if !e.EngineConfig.File.AllowSetuid && starterConfig.GetIsSUID() {
 		return fmt.Errorf("suid workflow disabled by administrator")
@@ -128,9 +154,18 @@ func (e *EngineOperations) PrepareConfig(starterConfig *starter.Config) error {
 		if err := e.prepareContainerConfig(starterConfig); err != nil {
 			return err
 		}
+		region = trace.Begin("stage 1: load images")
 		if err := e.loadImages(starterConfig); err != nil {
 			return err
 		}
+		region.End()
+	}
+
+	if err := e.checkExecAgent(starterConfig); err != nil {
+		return err
+	}
+	if err := e.keepCacheLocks(starterConfig); err != nil {
+		return err
 	}
 
 	starterConfig.SetMasterPropagateMount(true)
@@ -161,6 +196,92 @@ func (e *EngineOperations) PrepareConfig(starterConfig *starter.Config) error {
 		return err
 	}
 
+	// the container cgroup is created last, once nothing can fail anymore
+	// in stage 1, starter removes it if the container process creation fails
+	if !e.EngineConfig.GetInstanceJoin() {
+		return e.prepareCgroups(starterConfig)
+	}
+
+	return nil
+}
+
+// checkExecAgent ensures that the exec agent file descriptor passed
+// for an instance is a listening unix socket. The exec agent is disabled
+// for instances it can't serve, see execAgentDenied, their processes are
+// started by joining the instance.
+func (e *EngineOperations) checkExecAgent(starterConfig *starter.Config) error {
+	fd := e.EngineConfig.GetExecAgentFd()
+	if fd <= 0 || !e.EngineConfig.GetInstance() || e.EngineConfig.GetBootInstance() {
+		return nil
+	}
+
+	if reason := e.execAgentDenied(starterConfig.GetIsSUID(), os.Getuid()); reason != "" {
+		sylog.Warningf("Exec agent disabled for instance %s: %s", e.CommonConfig.ContainerID, reason)
+		// without a listening socket, clients join the instance
+		if path, err := instance.ExecAgentSocket(e.CommonConfig.ContainerID); err == nil {
+			os.Remove(path)
+		}
+		syscall.Close(fd)
+		e.EngineConfig.SetExecAgentFd(0)
+		return nil
+	}
+
+	domain, err := syscall.GetsockoptInt(fd, syscall.SOL_SOCKET, syscall.SO_DOMAIN)
+	if err == nil && domain != syscall.AF_UNIX {
+		err = fmt.Errorf("not a unix socket")
+	}
+	if err == nil {
+		var listening int
+		listening, err = syscall.GetsockoptInt(fd, syscall.SOL_SOCKET, syscall.SO_ACCEPTCONN)
+		if err == nil && listening != 1 {
+			err = fmt.Errorf("not a listening socket")
+		}
+	}
+	if err != nil {
+		return fmt.Errorf("bad exec agent file descriptor %d: %s", fd, err)
+	}
+	return nil
+}
+
+// execAgentDenied returns why the exec agent can't serve the instance, or
+// an empty string. The processes started by the exec agent inherit the
+// credentials of the instance process, bypassing the configuration checks
+// done when joining the instance, and the configuration may have revoked
+// capabilities or the setuid workflow since the instance start. So the exec
+// agent only serves the instances of a user started without setuid
+// workflow, fakeroot or capabilities, which have no privilege to revoke.
+func (e *EngineOperations) execAgentDenied(suid bool, uid int) string {
+	caps := e.EngineConfig.OciConfig.Process.Capabilities
+	switch {
+	case suid:
+		return "started with the setuid workflow"
+	case uid == 0:
+		return "started by root"
+	case e.EngineConfig.GetFakeroot():
+		return "started with fakeroot"
+	case caps != nil && (len(caps.Permitted) > 0 || len(caps.Effective) > 0 ||
+		len(caps.Inheritable) > 0 || len(caps.Ambient) > 0):
+		return "started with capabilities"
+	}
+	return ""
+}
+
+// keepCacheLocks keeps open the lock files held on the cache entries used
+// by the container, so that the master process holds the locks for the
+// lifetime of the container. The container process closes them.
+func (e *EngineOperations) keepCacheLocks(starterConfig *starter.Config) error {
+	for _, fd := range e.EngineConfig.GetCacheLockFds() {
+		var st syscall.Stat_t
+		if err := syscall.Fstat(fd, &st); err != nil {
+			return fmt.Errorf("bad cache lock file descriptor %d: %s", fd, err)
+		}
+		if st.Mode&syscall.S_IFMT != syscall.S_IFREG {
+			return fmt.Errorf("bad cache lock file descriptor %d: not a regular file", fd)
+		}
+		if err := starterConfig.KeepFileDescriptor(fd); err != nil {
+			return err
+		}
+	}
 	return nil
 }
 
@@ -561,6 +682,10 @@ func (e *EngineOperations) prepareContainerConfig(starterConfig *starter.Config)
 
 	starterConfig.SetInstance(e.EngineConfig.GetInstance())
 
+	if err := e.prepareNetnsPool(starterConfig); err != nil {
+		return err
+	}
+
 	starterConfig.SetNsFlagsFromSpec(e.EngineConfig.OciConfig.Linux.Namespaces)
 
 	// user namespace ID mappings
@@ -592,10 +717,178 @@ func (e *EngineOperations) prepareContainerConfig(starterConfig *starter.Config)
 		}
 	}
 
+	if err := e.prepareSharedImageMounts(starterConfig); err != nil {
+		return err
+	}
+
+	e.prepareInstanceMonitor(starterConfig)
+
 	// open file descriptors (autofs bug path)
 	return e.prepareAutofs(starterConfig)
 }
 
+// prepareCgroups creates the container cgroup with the resource limits
+// applied when the host uses the cgroup v2 unified hierarchy, starter
+// creates the container process directly into it. The cgroup is named
+// after stage 1 as the container PID isn't known yet and cgroup v2
+// doesn't allow to rename it later. With cgroup v1, the master process
+// applies the limits once the container process is created.
+func (e *EngineOperations) prepareCgroups(starterConfig *starter.Config) error {
+	path := e.EngineConfig.GetCgroupsPath()
+	if path == "" || os.Getuid() != 0 || !cgroupsutil.IsUnified() {
+		return nil
+	}
+	if e.EngineConfig.GetFakeroot() || e.EngineConfig.OciConfig.Linux == nil {
+		return nil
+	}
+	for _, ns := range e.EngineConfig.OciConfig.Linux.Namespaces {
+		if ns.Type == specs.UserNamespace {
+			return nil
+		}
+	}
+
+	cgroup := fmt.Sprintf("/singularity/%d-%x", os.Getpid(), time.Now().UnixNano())
+	manager := &cgroupsutil.Manager{Path: cgroup}
+	if err := manager.ApplyFromFile(path); err != nil {
+		return fmt.Errorf("failed to apply cgroups resources restriction: %s", err)
+	}
+	fd, err := manager.Open()
+	if err == nil {
+		err = starterConfig.KeepFileDescriptor(fd)
+	}
+	if err != nil {
+		manager.Remove()
+		return fmt.Errorf("while opening cgroup %s: %s", cgroup, err)
+	}
+	starterConfig.SetCgroupFd(fd, true)
+	e.EngineConfig.Cgroup = cgroup
+
+	return nil
+}
+
+// sharedImageMounts returns whether images may be mounted in the shared
+// mount pool. The pool is used by containers without user namespace only,
+// with a slave mount propagation to receive the shared mounts.
+func (e *EngineOperations) sharedImageMounts() bool {
+	if !e.EngineConfig.File.SharedImageMounts || !e.EngineConfig.File.MountSlave {
+		return false
+	}
+	if e.EngineConfig.GetFakeroot() || e.EngineConfig.OciConfig.Linux == nil {
+		return false
+	}
+	for _, ns := range e.EngineConfig.OciConfig.Linux.Namespaces {
+		if ns.Type == specs.UserNamespace {
+			return false
+		}
+	}
+	return true
+}
+
+// prepareSharedImageMounts keeps a reference on the host mount namespace
+// when images may be mounted in the shared mount pool by a privileged
+// container.
+func (e *EngineOperations) prepareSharedImageMounts(starterConfig *starter.Config) error {
+	if !e.sharedImageMounts() {
+		return nil
+	}
+	if !starterConfig.GetIsSUID() && os.Getuid() != 0 {
+		return nil
+	}
+
+	return e.keepHostMountNs(starterConfig)
+}
+
+// keepHostMountNs keeps a reference on the host mount namespace for the
+// master process.
+func (e *EngineOperations) keepHostMountNs(starterConfig *starter.Config) error {
+	if e.EngineConfig.HostMountNsFd > 0 {
+		return nil
+	}
+
+	fd, err := syscall.Open("/proc/self/ns/mnt", syscall.O_RDONLY|syscall.O_CLOEXEC, 0)
+	if err != nil {
+		return fmt.Errorf("while opening host mount namespace: %s", err)
+	}
+	if err := starterConfig.KeepFileDescriptor(fd); err != nil {
+		return err
+	}
+	e.EngineConfig.HostMountNsFd = fd
+
+	return nil
+}
+
+// prepareNetnsPool joins a network namespace configured in advance from
+// the network namespace pool instead of creating one. The pool is used by
+// containers of the root user without user namespace only, as network
+// setup requires root privileges otherwise, the master process fills it
+// in the host mount namespace.
+func (e *EngineOperations) prepareNetnsPool(starterConfig *starter.Config) error {
+	if os.Getuid() != 0 || e.EngineConfig.OciConfig.Linux == nil {
+		return nil
+	}
+	net := e.EngineConfig.GetNetwork()
+	if net == "" || net == "none" {
+		return nil
+	}
+
+	netNS := false
+	for _, ns := range e.EngineConfig.OciConfig.Linux.Namespaces {
+		switch ns.Type {
+		case specs.UserNamespace:
+			return nil
+		case specs.NetworkNamespace:
+			netNS = ns.Path == ""
+		}
+	}
+	if !netNS {
+		return nil
+	}
+
+	p, key := e.netnsPool(strings.Split(net, ","))
+	if p == nil {
+		return nil
+	}
+	if err := e.keepHostMountNs(starterConfig); err != nil {
+		return err
+	}
+
+	nsPath, fd, err := p.Claim(key)
+	if err != nil {
+		sylog.Debugf("Could not claim pooled network namespace: %s", err)
+		return nil
+	} else if nsPath == "" {
+		sylog.Debugf("No pooled network namespace available")
+		return nil
+	}
+	if err := starterConfig.KeepFileDescriptor(fd); err != nil {
+		return err
+	}
+	if err := starterConfig.SetNsPath(specs.NetworkNamespace, nsPath); err != nil {
+		return err
+	}
+	e.EngineConfig.OciConfig.AddOrReplaceLinuxNamespace(specs.NetworkNamespace, nsPath)
+	e.EngineConfig.NetnsPoolEntry = filepath.Dir(nsPath)
+	e.EngineConfig.NetnsPoolFd = fd
+
+	sylog.Debugf("Joining pooled network namespace %s", nsPath)
+
+	return nil
+}
+
+// prepareInstanceMonitor allows the master process of an instance to hand
+// off the instance process to the instance monitor of the user. Only
+// instances started without privileges are handed off, their cleanup
+// doesn't require privileges.
+func (e *EngineOperations) prepareInstanceMonitor(starterConfig *starter.Config) {
+	if !e.EngineConfig.File.SharedInstanceMonitor || !e.EngineConfig.GetInstance() {
+		return
+	}
+	if starterConfig.GetIsSUID() || os.Getuid() == 0 || e.EngineConfig.GetFakeroot() {
+		return
+	}
+	e.EngineConfig.InstanceMonitor = true
+}
+
 // prepareInstanceJoinConfig is responsible for getting and
 // applying configuration to join a running instance.
 func (e *EngineOperations) prepareInstanceJoinConfig(starterConfig *starter.Config) error {
@@ -853,7 +1146,23 @@ func (e *EngineOperations) prepareInstanceJoinConfig(starterConfig *starter.Conf
 		e.EngineConfig.OciConfig.Linux.Seccomp = instanceEngineConfig.OciConfig.Linux.Seccomp
 	}
 
-	if uid == 0 && !file.UserNs {
+	if uid == 0 && !file.UserNs && cgroupsutil.IsUnified() {
+		// create the joining process into the instance cgroup
+		// instead of adding the master process to it
+		path := filepath.Clean(instanceEngineConfig.Cgroup)
+		if strings.HasPrefix(path, "/singularity/") {
+			manager := &cgroupsutil.Manager{Path: path}
+			fd, err := manager.Open()
+			if err != nil {
+				sylog.Debugf("Could not open instance cgroup %s: %s", path, err)
+			} else {
+				if err := starterConfig.KeepFileDescriptor(fd); err != nil {
+					return err
+				}
+				starterConfig.SetCgroupFd(fd, false)
+			}
+		}
+	} else if uid == 0 && !file.UserNs {
 		pid := os.Getppid()
 		path := fmt.Sprintf("/singularity/%d", file.Pid)
 		control, err := cgroups.Load(cgroups.V1, cgroups.StaticPath(path))
@@ -1088,16 +1397,47 @@ func (e *EngineOperations) loadImages(starterConfig *starter.Config) error {
 		}
 	} else if img.Type == image.SIF {
 		// query the ECL module, proceed if an ecl config file is found
+		region := trace.Begin("stage 1: ECL verification")
 		ecl, err := syecl.LoadConfig(buildcfg.ECL_FILE)
 		if err == nil {
 			if err = ecl.ValidateConfig(); err != nil {
 				return err
 			}
-			_, err := ecl.ShouldRunFp(img.File)
+			// skip the signatures check of an unchanged image already
+			// allowed to run with the same configuration
+			key, err := ecl.CacheKey(img.File)
 			if err != nil {
-				return err
+				sylog.Debugf("ECL verification cache not used: %s", err)
+				key = ""
+			}
+			if !ecl.Activated || key == "" || !syecl.Cached(key) {
+				if _, err := ecl.ShouldRunFp(img.File); err != nil {
+					return err
+				}
+				if ecl.Activated && key != "" {
+					e.EngineConfig.EclCacheKeys = append(e.EngineConfig.EclCacheKeys, key)
+				}
 			}
 		}
+		region.End()
+		// environment resolved at build time, checked against the
+		// environment scripts by the exec action before use
+		for _, section := range img.Sections {
+			if section.Type != uint32(sif.DataEnvVar) || section.Name != env.StaticEnvName {
+				continue
+			}
+			if section.Size > maxStaticEnvSize {
+				break
+			}
+			staticEnv := new(env.StaticEnv)
+			r := io.NewSectionReader(img.File, int64(section.Offset), int64(section.Size))
+			if err := json.NewDecoder(r).Decode(staticEnv); err != nil {
+				sylog.Debugf("Ignoring static environment: %s", err)
+				break
+			}
+			e.EngineConfig.StaticEnv = staticEnv
+			break
+		}
 		// load overlay partition if we use overlay layer
 		if sessionLayer == singularityConfig.OverlayLayer {
 			// look for potential overlay partition in SIF image
@@ -1185,6 +1525,8 @@ func (e *EngineOperations) loadImages(starterConfig *starter.Config) error {
 }
 
 func (e *EngineOperations) loadImage(path string, writable bool) (*image.Image, error) {
+	defer trace.Begin("image: init " + filepath.Base(path)).End()
+
 	imgObject, err := image.Init(path, writable)
 	if err != nil {
 		return nil, err
@@ -0,0 +1,59 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package singularity
+
+import (
+	"testing"
+
+	specs "github.com/opencontainers/runtime-spec/specs-go"
+	singularityConfig "github.com/sylabs/singularity/pkg/runtime/engine/singularity/config"
+)
+
+func TestExecAgentDenied(t *testing.T) {
+	tests := []struct {
+		name   string
+		suid   bool
+		uid    int
+		set    func(e *singularityConfig.EngineConfig)
+		denied bool
+	}{
+		{name: "user", uid: 1000},
+		{name: "setuid", suid: true, uid: 1000, denied: true},
+		{name: "root", uid: 0, denied: true},
+		{
+			name:   "fakeroot",
+			uid:    1000,
+			set:    func(e *singularityConfig.EngineConfig) { e.SetFakeroot(true) },
+			denied: true,
+		},
+		{
+			// a capability granted at instance start may be revoked
+			// afterwards, joining the instance drops it
+			name: "capabilities",
+			uid:  1000,
+			set: func(e *singularityConfig.EngineConfig) {
+				e.OciConfig.Process.Capabilities.Permitted = []string{"CAP_NET_RAW"}
+			},
+			denied: true,
+		},
+	}
+
+	for _, tt := range tests {
+		e := &EngineOperations{EngineConfig: singularityConfig.NewConfig()}
+		e.EngineConfig.OciConfig.Process = &specs.Process{
+			Capabilities: &specs.LinuxCapabilities{},
+		}
+		if tt.set != nil {
+			tt.set(e.EngineConfig)
+		}
+		reason := e.execAgentDenied(tt.suid, tt.uid)
+		if tt.denied && reason == "" {
+			t.Errorf("unexpected exec agent allowed for %s instance", tt.name)
+		} else if !tt.denied && reason != "" {
+			t.Errorf("unexpected exec agent denied for %s instance: %s", tt.name, reason)
+		}
+	}
+}
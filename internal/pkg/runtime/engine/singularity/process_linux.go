@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -26,7 +26,9 @@ import (
 	"github.com/sylabs/singularity/internal/pkg/instance"
 	"github.com/sylabs/singularity/internal/pkg/security"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
+	envutil "github.com/sylabs/singularity/internal/pkg/util/env"
 	"github.com/sylabs/singularity/internal/pkg/util/machine"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 	"github.com/sylabs/singularity/internal/pkg/util/user"
 	singularity "github.com/sylabs/singularity/pkg/runtime/engine/singularity/config"
 	"github.com/sylabs/singularity/pkg/util/rlimit"
@@ -47,6 +49,8 @@ func (e *EngineOperations) StartProcess(masterConn net.Conn) error {
 	signals := make(chan os.Signal, 1)
 	signal.Notify(signals)
 
+	region := trace.Begin("stage 2: start process")
+
 	if err := preStartProcess(e); err != nil {
 		return err
 	}
@@ -131,6 +135,25 @@ func (e *EngineOperations) StartProcess(masterConn net.Conn) error {
 		}
 	}
 
+	// the exec agent socket is only served by the instance process,
+	// don't leak it in container processes
+	agentFd := e.EngineConfig.GetExecAgentFd()
+	if agentFd > 0 {
+		syscall.CloseOnExec(agentFd)
+	}
+
+	// the host mount namespace, the network namespace pool entry lock
+	// and the cache entry locks are only held by the master process
+	for _, fd := range e.EngineConfig.GetCacheLockFds() {
+		syscall.Close(fd)
+	}
+	if fd := e.EngineConfig.HostMountNsFd; fd > 0 {
+		syscall.Close(fd)
+	}
+	if fd := e.EngineConfig.NetnsPoolFd; fd > 0 {
+		syscall.Close(fd)
+	}
+
 	// restore the stack size limit for setuid workflow
 	for _, limit := range e.EngineConfig.OciConfig.Process.Rlimits {
 		if limit.Type == "RLIMIT_STACK" {
@@ -145,7 +168,18 @@ func (e *EngineOperations) StartProcess(masterConn net.Conn) error {
 		return fmt.Errorf("failed to apply security configuration: %s", err)
 	}
 
+	var path string
+	var staticArgs, staticEnv []string
+	if cwd, err := os.Getwd(); err == nil {
+		path, staticArgs, staticEnv = e.staticExec(args, env, cwd)
+	}
+
 	if (!isInstance && !shimProcess) || bootInstance || e.EngineConfig.GetInstanceJoin() {
+		region.End()
+		if staticArgs != nil {
+			err := syscall.Exec(path, staticArgs, staticEnv)
+			sylog.Debugf("Exec %s failed: %s, sourcing environment scripts", path, err)
+		}
 		err := syscall.Exec(args[0], args, env)
 		if err != nil {
 			// We know the shell exists at this point, so let's inspect its architecture
@@ -177,6 +211,11 @@ func (e *EngineOperations) StartProcess(masterConn net.Conn) error {
 	cmd.Stderr = os.Stderr
 	cmd.Stdin = os.Stdin
 	cmd.Env = env
+	if staticArgs != nil {
+		cmd.Path = path
+		cmd.Args = staticArgs
+		cmd.Env = staticEnv
+	}
 	cmd.SysProcAttr = &syscall.SysProcAttr{
 		Setpgid: isInstance,
 	}
@@ -184,6 +223,17 @@ func (e *EngineOperations) StartProcess(masterConn net.Conn) error {
 	errChan := make(chan error, 1)
 	statusChan := make(chan syscall.WaitStatus, 1)
 
+	var agent *instance.ExecAgent
+	if isInstance && agentFd > 0 {
+		f := os.NewFile(uintptr(agentFd), "exec-agent")
+		a, err := instance.NewExecAgent(f, e.spawnAgentProcess)
+		if err != nil {
+			return fmt.Errorf("while starting exec agent: %s", err)
+		}
+		agent = a
+	}
+
+	region.End()
 	if err := cmd.Start(); err != nil {
 		return fmt.Errorf("exec %s failed: %s", args[0], err)
 	}
@@ -211,10 +261,45 @@ func (e *EngineOperations) StartProcess(masterConn net.Conn) error {
 		return syscall.Errno(err)
 	}
 
-	masterConn.Close()
+	// the instance process may be handed off to the instance monitor
+	// of the user, the master process then asks to clear the parent
+	// death signal for the time of the adoption
+	var handoff chan byte
+	if isInstance && e.EngineConfig.InstanceMonitor {
+		if _, err := masterConn.Write([]byte{instance.HandoffReady}); err != nil {
+			return fmt.Errorf("while notifying master process: %s", err)
+		}
+		handoff = make(chan byte)
+		go func(requests chan<- byte) {
+			b := make([]byte, 1)
+			for {
+				if _, err := masterConn.Read(b); err != nil {
+					close(requests)
+					return
+				}
+				requests <- b[0]
+			}
+		}(handoff)
+	} else {
+		masterConn.Close()
+	}
+
+	if agent != nil {
+		go agent.Serve()
+	}
 
 	for {
 		select {
+		case req, ok := <-handoff:
+			if !ok {
+				masterConn.Close()
+				handoff = nil
+				break
+			}
+			if err := handoffRequest(masterConn, req); err != nil {
+				sylog.Debugf("Could not hand off instance process: %s", err)
+				masterConn.Close()
+			}
 		case s := <-signals:
 			sylog.Debugf("Received signal %s", s.String())
 			switch s {
@@ -230,6 +315,8 @@ func (e *EngineOperations) StartProcess(masterConn net.Conn) error {
 
 					if wpid == cmd.Process.Pid {
 						statusChan <- status
+					} else if agent != nil {
+						agent.Reaped(wpid, status)
 					}
 				}
 			default:
@@ -281,6 +368,138 @@ func (e *EngineOperations) StartProcess(masterConn net.Conn) error {
 	}
 }
 
+// spawnAgentProcess starts a process requested through the exec agent of
+// the instance. Like a process joining the instance, it gets the HOME
+// environment variable set at instance start and falls back to the home
+// directory if its working directory doesn't exist in container. It runs
+// in its own session, signals forwarded by the exec agent are sent to its
+// process group. The instance process must not hold any capability, see
+// execAgentDenied.
+func (e *EngineOperations) spawnAgentProcess(req *instance.ExecRequest, stdio []*os.File) (int, error) {
+	if err := checkNoCapabilities(); err != nil {
+		return 0, err
+	}
+
+	home := e.EngineConfig.GetHomeDest()
+
+	env := make([]string, 0, len(req.Env)+1)
+	for _, keyval := range req.Env {
+		if !strings.HasPrefix(keyval, "HOME=") {
+			env = append(env, keyval)
+		}
+	}
+	env = append(env, "HOME="+home)
+
+	args, err := e.resolveExec(req.Args, env)
+	if err != nil {
+		return 0, err
+	}
+
+	dir := "/"
+	for _, d := range []string{req.Cwd, home} {
+		if fi, err := os.Stat(d); err == nil && fi.IsDir() {
+			dir = d
+			break
+		}
+	}
+
+	files := make([]uintptr, len(stdio))
+	for i, f := range stdio {
+		files[i] = f.Fd()
+	}
+
+	attr := &syscall.ProcAttr{
+		Dir:   dir,
+		Env:   env,
+		Files: files,
+		Sys:   &syscall.SysProcAttr{Setsid: true},
+	}
+
+	if path, staticArgs, staticEnv := e.staticExec(args, env, dir); staticArgs != nil {
+		staticAttr := *attr
+		staticAttr.Env = staticEnv
+		if pid, err := syscall.ForkExec(path, staticArgs, &staticAttr); err == nil {
+			return pid, nil
+		}
+	}
+
+	return syscall.ForkExec(args[0], args, attr)
+}
+
+// checkNoCapabilities returns an error if the current thread has any
+// permitted, effective or inheritable capability.
+func checkNoCapabilities() error {
+	hdr := struct {
+		version uint32
+		pid     int32
+	}{
+		version: 0x20080522, // _LINUX_CAPABILITY_VERSION_3
+	}
+	var data [2]struct {
+		effective   uint32
+		permitted   uint32
+		inheritable uint32
+	}
+
+	_, _, errno := syscall.RawSyscall(syscall.SYS_CAPGET, uintptr(unsafe.Pointer(&hdr)), uintptr(unsafe.Pointer(&data[0])), 0)
+	if errno != 0 {
+		return fmt.Errorf("while getting instance process capabilities: %s", errno)
+	}
+	for _, d := range data {
+		if d.effective|d.permitted|d.inheritable != 0 {
+			return fmt.Errorf("instance process holds capabilities, join the instance instead")
+		}
+	}
+	return nil
+}
+
+// staticExec returns the path, the arguments and the environment of the
+// command executed by the exec action args with the environment env in
+// the working directory cwd when the static environment of the image
+// applies, the exec action and the environment scripts are then bypassed.
+// It returns nil arguments if the exec action must be executed.
+func (e *EngineOperations) staticExec(args []string, env []string, cwd string) (string, []string, []string) {
+	s := e.EngineConfig.StaticEnv
+	if s == nil || len(args) < 2 || args[0] != envutil.ExecAction {
+		return "", nil, nil
+	}
+	if err := s.Check("/"); err != nil {
+		sylog.Debugf("Sourcing environment scripts: %s", err)
+		return "", nil, nil
+	}
+	environ, path, ok := s.Environ(env, cwd)
+	if !ok {
+		return "", nil, nil
+	}
+	// relative paths are left to the shell, they are resolved
+	// from the working directory of the executed process
+	file, ok := envutil.LookPath(args[1], path)
+	if !ok || !filepath.IsAbs(file) {
+		return "", nil, nil
+	}
+	sylog.Debugf("Executing %s with static environment", file)
+	return file, args[1:], environ
+}
+
+// handoffRequest applies a hand off request of the master process, it must
+// be called from the main thread as the parent death signal is a thread
+// attribute.
+func handoffRequest(masterConn net.Conn, req byte) error {
+	signo := 0
+	switch req {
+	case instance.HandoffStart:
+	case instance.HandoffAbort:
+		signo = int(syscall.SIGKILL)
+	default:
+		return fmt.Errorf("unexpected request %q", req)
+	}
+	if _, _, errno := syscall.RawSyscall(syscall.SYS_PRCTL, syscall.PR_SET_PDEATHSIG, uintptr(signo), 0); errno != 0 {
+		return fmt.Errorf("while setting parent death signal: %s", errno)
+	}
+	_, err := masterConn.Write([]byte{instance.HandoffDone})
+	return err
+}
+
 // PostStartProcess is called from master after successful
 // execution of the container process. It will write instance
 // state/config files (if any).
@@ -297,6 +516,11 @@ func (e *EngineOperations) PostStartProcess(ctx context.Context, pid int) error
 	if e.EngineConfig.GetInstance() {
 		name := e.CommonConfig.ContainerID
 
+		// the exec agent socket is served by the instance process
+		if fd := e.EngineConfig.GetExecAgentFd(); fd > 0 {
+			syscall.Close(fd)
+		}
+
 		if err := os.Chdir("/"); err != nil {
 			return fmt.Errorf("failed to change directory to /: %s", err)
 		}
@@ -371,8 +595,8 @@ func (e *EngineOperations) PostStartProcess(ctx context.Context, pid int) error
 	return nil
 }
 
-func (e *EngineOperations) setPathEnv() {
-	env := e.EngineConfig.OciConfig.Process.Env
+// setPathEnv sets PATH of the current process to the PATH value of env.
+func setPathEnv(env []string) {
 	for _, keyval := range env {
 		if strings.HasPrefix(keyval, "PATH=") {
 			os.Setenv("PATH", keyval[5:])
@@ -382,6 +606,15 @@ func (e *EngineOperations) setPathEnv() {
 }
 
 func (e *EngineOperations) checkExec() error {
+	args, err := e.resolveExec(e.EngineConfig.OciConfig.Process.Args, e.EngineConfig.OciConfig.Process.Env)
+	e.EngineConfig.OciConfig.Process.Args = args
+	return err
+}
+
+// resolveExec returns the arguments of the process to execute for args
+// with the environment env, the actions scripts are replaced by their
+// fallback if missing in container.
+func (e *EngineOperations) resolveExec(args []string, env []string) ([]string, error) {
 	shell := e.EngineConfig.GetShell()
 
 	if shell == "" {
@@ -390,26 +623,19 @@ func (e *EngineOperations) checkExec() error {
 
 	// Make sure the shell exists
 	if _, err := os.Stat(shell); os.IsNotExist(err) {
-		return fmt.Errorf("shell %s doesn't exist in container", shell)
+		return args, fmt.Errorf("shell %s doesn't exist in container", shell)
 	}
 
-	args := e.EngineConfig.OciConfig.Process.Args
-	env := e.EngineConfig.OciConfig.Process.Env
-
 	// match old behavior of searching path
 	oldPath := os.Getenv("PATH")
-	defer func() {
-		os.Setenv("PATH", oldPath)
-		e.EngineConfig.OciConfig.Process.Args = args
-		e.EngineConfig.OciConfig.Process.Env = env
-	}()
+	defer os.Setenv("PATH", oldPath)
 
-	e.setPathEnv()
+	setPathEnv(env)
 
 	// If args[0] is an absolute path, exec.LookPath() looks for
 	// this file directly instead of within PATH
 	if _, err := exec.LookPath(args[0]); err == nil {
-		return nil
+		return args, nil
 	}
 
 	// If args[0] isn't executable (either via PATH or absolute path),
@@ -418,51 +644,51 @@ func (e *EngineOperations) checkExec() error {
 	case "/.singularity.d/actions/exec":
 		if p, err := exec.LookPath("/.exec"); err == nil {
 			args[0] = p
-			return nil
+			return args, nil
 		}
 		if p, err := exec.LookPath(args[1]); err == nil {
 			sylog.Warningf("container does not have %s, calling %s directly", args[0], args[1])
 			args[1] = p
 			args = args[1:]
-			return nil
+			return args, nil
 		}
-		return fmt.Errorf("no executable %s found", args[1])
+		return args, fmt.Errorf("no executable %s found", args[1])
 	case "/.singularity.d/actions/shell":
 		if p, err := exec.LookPath("/.shell"); err == nil {
 			args[0] = p
-			return nil
+			return args, nil
 		}
 		if p, err := exec.LookPath(shell); err == nil {
 			sylog.Warningf("container does not have %s, calling %s directly", args[0], shell)
 			args[0] = p
-			return nil
+			return args, nil
 		}
-		return fmt.Errorf("no %s found inside container", shell)
+		return args, fmt.Errorf("no %s found inside container", shell)
 	case "/.singularity.d/actions/run":
 		if p, err := exec.LookPath("/.run"); err == nil {
 			args[0] = p
-			return nil
+			return args, nil
 		}
 		if p, err := exec.LookPath("/singularity"); err == nil {
 			args[0] = p
-			return nil
+			return args, nil
 		}
-		return fmt.Errorf("no run driver found inside container")
+		return args, fmt.Errorf("no run driver found inside container")
 	case "/.singularity.d/actions/start":
 		if _, err := exec.LookPath(shell); err != nil {
-			return fmt.Errorf("no %s found inside container, can't run instance", shell)
+			return args, fmt.Errorf("no %s found inside container, can't run instance", shell)
 		}
 		args = []string{shell, "-c", `echo "instance start script not found"`}
-		return nil
+		return args, nil
 	case "/.singularity.d/actions/test":
 		if p, err := exec.LookPath("/.test"); err == nil {
 			args[0] = p
-			return nil
+			return args, nil
 		}
-		return fmt.Errorf("no test driver found inside container")
+		return args, fmt.Errorf("no test driver found inside container")
 	}
 
-	return fmt.Errorf("no %s found inside container", args[0])
+	return args, fmt.Errorf("no %s found inside container", args[0])
 }
 
 func (e *EngineOperations) runFuseDriver(name string, program []string, fd int) error {
@@ -496,7 +722,7 @@ func (e *EngineOperations) runFuseDriver(name string, program []string, fd int)
 	defer func() {
 		os.Setenv("PATH", oldpath)
 	}()
-	e.setPathEnv()
+	setPathEnv(e.EngineConfig.OciConfig.Process.Env)
 
 	cmd := exec.Command(args[0], args[1:]...)
 
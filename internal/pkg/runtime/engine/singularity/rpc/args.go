@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -6,6 +6,8 @@
 package rpc
 
 import (
+	"encoding/binary"
+	"fmt"
 	"os"
 	"syscall"
 
@@ -36,6 +38,99 @@ type MountArgs struct {
 	Data       string
 }
 
+// MountBatchArgs defines the arguments to perform a list of mounts in order.
+type MountBatchArgs struct {
+	Mounts []MountArgs
+}
+
+// MountBatchReply defines the reply for a list of mounts, Done is the number
+// of mounts performed and Err the error of the following mount if any.
+type MountBatchReply struct {
+	Done int
+	Err  error
+}
+
+// MarshalBinary encodes the mount list with length prefixed strings, which
+// is more compact than the gob encoding of each mount.
+func (a *MountBatchArgs) MarshalBinary() ([]byte, error) {
+	size := binary.MaxVarintLen64
+	for _, m := range a.Mounts {
+		size += 5*binary.MaxVarintLen64 + len(m.Source) + len(m.Target) + len(m.Filesystem) + len(m.Data)
+	}
+
+	b := make([]byte, size)
+	n := binary.PutUvarint(b, uint64(len(a.Mounts)))
+	putString := func(s string) {
+		n += binary.PutUvarint(b[n:], uint64(len(s)))
+		n += copy(b[n:], s)
+	}
+	for _, m := range a.Mounts {
+		putString(m.Source)
+		putString(m.Target)
+		putString(m.Filesystem)
+		n += binary.PutUvarint(b[n:], uint64(m.Mountflags))
+		putString(m.Data)
+	}
+	return b[:n], nil
+}
+
+// UnmarshalBinary decodes a mount list encoded by MarshalBinary.
+func (a *MountBatchArgs) UnmarshalBinary(b []byte) error {
+	var err error
+
+	uvarint := func() uint64 {
+		v, n := binary.Uvarint(b)
+		if n <= 0 {
+			err = fmt.Errorf("truncated mount list")
+			return 0
+		}
+		b = b[n:]
+		return v
+	}
+	getString := func() string {
+		l := uvarint()
+		if err != nil {
+			return ""
+		} else if l > uint64(len(b)) {
+			err = fmt.Errorf("truncated mount list")
+			return ""
+		}
+		s := string(b[:l])
+		b = b[l:]
+		return s
+	}
+
+	count := uvarint()
+	// each mount is encoded with 5 bytes at least
+	if count > uint64(len(b))/5 {
+		return fmt.Errorf("invalid mount list length %d", count)
+	}
+	a.Mounts = make([]MountArgs, count)
+	for i := range a.Mounts {
+		m := &a.Mounts[i]
+		m.Source = getString()
+		m.Target = getString()
+		m.Filesystem = getString()
+		m.Mountflags = uintptr(uvarint())
+		m.Data = getString()
+	}
+	if err == nil && len(b) > 0 {
+		err = fmt.Errorf("trailing data after mount list")
+	}
+	return err
+}
+
+// PoolMountArgs defines the arguments to mount a filesystem in the
+// shared mount pool.
+type PoolMountArgs struct {
+	NsFd       int
+	Key        string
+	Source     string
+	Filesystem string
+	Mountflags uintptr
+	Data       string
+}
+
 // CryptArgs defines the arguments to mount.
 type CryptArgs struct {
 	Offset    uint64
@@ -0,0 +1,60 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package rpc
+
+import (
+	"reflect"
+	"syscall"
+	"testing"
+)
+
+func TestMountBatchArgs(t *testing.T) {
+	in := &MountBatchArgs{
+		Mounts: []MountArgs{
+			{
+				Source:     "/etc/hosts",
+				Target:     "/session/final/etc/hosts",
+				Mountflags: syscall.MS_BIND | syscall.MS_REC,
+			},
+			{
+				Target:     "/session/final/etc/hosts",
+				Mountflags: syscall.MS_BIND | syscall.MS_REMOUNT | syscall.MS_RDONLY,
+			},
+			{
+				Source:     "tmpfs",
+				Target:     "/session/final/tmp",
+				Filesystem: "tmpfs",
+				Mountflags: syscall.MS_NOSUID | syscall.MS_NODEV,
+				Data:       "mode=1777,size=16m",
+			},
+		},
+	}
+
+	b, err := in.MarshalBinary()
+	if err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	out := new(MountBatchArgs)
+	if err := out.UnmarshalBinary(b); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	if !reflect.DeepEqual(in, out) {
+		t.Errorf("decoded mounts differ: %+v", out.Mounts)
+	}
+
+	empty := new(MountBatchArgs)
+	b, _ = empty.MarshalBinary()
+	if err := out.UnmarshalBinary(b); err != nil || len(out.Mounts) != 0 {
+		t.Errorf("unexpected result for an empty list: %v %v", out.Mounts, err)
+	}
+
+	b, _ = in.MarshalBinary()
+	for _, bad := range [][]byte{nil, b[:len(b)-1], append(b, 0), {0xff, 0xff, 0xff, 0x0f}} {
+		if err := out.UnmarshalBinary(bad); err == nil {
+			t.Errorf("unexpected success with invalid data %x", bad)
+		}
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -42,6 +42,25 @@ func (t *RPC) Mount(source string, target string, filesystem string, flags uintp
 	return err
 }
 
+// MountBatch calls the batched mount RPC, the mounts are performed in order
+// with a single round-trip until one fails. It returns the number of mounts
+// performed and the error of the failed mount, or the RPC error.
+func (t *RPC) MountBatch(mounts []args.MountArgs) (int, error) {
+	arguments := &args.MountBatchArgs{
+		Mounts: mounts,
+	}
+
+	var reply args.MountBatchReply
+
+	err := t.Client.Call(t.Name+".MountBatch", arguments, &reply)
+	// RPC communication will take precedence over mount error
+	if err == nil {
+		err = reply.Err
+	}
+
+	return reply.Done, err
+}
+
 // Decrypt calls the DeCrypt RPC using the supplied arguments.
 func (t *RPC) Decrypt(offset uint64, path string, key []byte, masterPid int) (string, error) {
 	arguments := &args.CryptArgs{
@@ -93,6 +112,22 @@ func (t *RPC) LoopDevice(image string, mode int, info loop.Info64, maxDevices in
 	return reply, err
 }
 
+// PoolMount calls the mount RPC creating the shared mount key in the
+// shared mount pool of the host mount namespace referenced by nsFd.
+func (t *RPC) PoolMount(nsFd int, key, source, filesystem string, flags uintptr, data string) error {
+	arguments := &args.PoolMountArgs{
+		NsFd:       nsFd,
+		Key:        key,
+		Source:     source,
+		Filesystem: filesystem,
+		Mountflags: flags,
+		Data:       data,
+	}
+
+	var reply int
+	return t.Client.Call(t.Name+".PoolMount", arguments, &reply)
+}
+
 // SetHostname calls the sethostname RPC using the supplied arguments.
 func (t *RPC) SetHostname(hostname string) (int, error) {
 	arguments := &args.HostnameArgs{
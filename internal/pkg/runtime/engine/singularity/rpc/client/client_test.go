@@ -0,0 +1,161 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package client
+
+import (
+	"fmt"
+	"net"
+	"net/rpc"
+	"os"
+	"sync/atomic"
+	"syscall"
+	"testing"
+
+	args "github.com/sylabs/singularity/internal/pkg/runtime/engine/singularity/rpc"
+)
+
+// testMethods records the mount calls, mounts to /missing fail.
+type testMethods struct {
+	calls  int32
+	mounts []string
+}
+
+func (t *testMethods) mount(m *args.MountArgs) error {
+	if m.Target == "/missing" {
+		return syscall.ENOENT
+	}
+	t.mounts = append(t.mounts, m.Target)
+	return nil
+}
+
+func (t *testMethods) Mount(arguments *args.MountArgs, mountErr *error) error {
+	atomic.AddInt32(&t.calls, 1)
+	*mountErr = t.mount(arguments)
+	return nil
+}
+
+func (t *testMethods) MountBatch(arguments *args.MountBatchArgs, reply *args.MountBatchReply) error {
+	atomic.AddInt32(&t.calls, 1)
+	for i := range arguments.Mounts {
+		if err := t.mount(&arguments.Mounts[i]); err != nil {
+			reply.Done = i
+			reply.Err = err
+			return nil
+		}
+	}
+	reply.Done = len(arguments.Mounts)
+	return nil
+}
+
+// newTestRPC returns a client connected through a socket pair to a server
+// serving methods, like the RPC server of the container setup.
+func newTestRPC(t testing.TB, methods *testMethods) *RPC {
+	fds, err := syscall.Socketpair(syscall.AF_UNIX, syscall.SOCK_STREAM, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	var conns [2]net.Conn
+	for i, fd := range fds {
+		f := os.NewFile(uintptr(fd), "rpc")
+		conns[i], err = net.FileConn(f)
+		f.Close()
+		if err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	server := rpc.NewServer()
+	if err := server.RegisterName("test", methods); err != nil {
+		t.Fatal(err)
+	}
+	go server.ServeConn(conns[1])
+
+	return &RPC{Client: rpc.NewClient(conns[0]), Name: "test"}
+}
+
+func TestMountBatch(t *testing.T) {
+	methods := new(testMethods)
+	c := newTestRPC(t, methods)
+	defer c.Client.Close()
+
+	mounts := []args.MountArgs{
+		{Target: "/a"},
+		{Target: "/b"},
+		{Target: "/missing"},
+		{Target: "/c"},
+	}
+
+	done, err := c.MountBatch(mounts)
+	if done != 2 || !os.IsNotExist(err) {
+		t.Errorf("unexpected result: %d mounts done, error %v", done, err)
+	}
+	done, err = c.MountBatch(mounts[3:])
+	if done != 1 || err != nil {
+		t.Errorf("unexpected result: %d mounts done, error %v", done, err)
+	}
+	if fmt.Sprint(methods.mounts) != "[/a /b /c]" {
+		t.Errorf("unexpected mounts %v", methods.mounts)
+	}
+	if methods.calls != 2 {
+		t.Errorf("%d round-trips instead of 2", methods.calls)
+	}
+}
+
+// BenchmarkMountStartup compares the number of round-trips and the time
+// spent in RPCs to mount the bind paths of a container one by one or in
+// batch, as the number of bind paths grows. Each bind path requires a bind
+// mount and a remount to apply its flags.
+func BenchmarkMountStartup(b *testing.B) {
+	for _, binds := range []int{4, 16, 64, 256} {
+		mounts := make([]args.MountArgs, 0, 2*binds)
+		for i := 0; i < binds; i++ {
+			target := fmt.Sprintf("/var/singularity/mnt/session/final/bind%d", i)
+			mounts = append(mounts,
+				args.MountArgs{
+					Source:     fmt.Sprintf("/host/bind%d", i),
+					Target:     target,
+					Mountflags: syscall.MS_BIND | syscall.MS_REC,
+				},
+				args.MountArgs{
+					Target:     target,
+					Mountflags: syscall.MS_BIND | syscall.MS_REMOUNT | syscall.MS_NOSUID | syscall.MS_NODEV,
+				},
+			)
+		}
+
+		b.Run(fmt.Sprintf("single/%d", binds), func(b *testing.B) {
+			methods := new(testMethods)
+			c := newTestRPC(b, methods)
+			defer c.Client.Close()
+
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				methods.mounts = methods.mounts[:0]
+				for _, m := range mounts {
+					if err := c.Mount(m.Source, m.Target, m.Filesystem, m.Mountflags, m.Data); err != nil {
+						b.Fatal(err)
+					}
+				}
+			}
+			b.ReportMetric(float64(atomic.LoadInt32(&methods.calls))/float64(b.N), "round-trips/op")
+		})
+
+		b.Run(fmt.Sprintf("batch/%d", binds), func(b *testing.B) {
+			methods := new(testMethods)
+			c := newTestRPC(b, methods)
+			defer c.Client.Close()
+
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				methods.mounts = methods.mounts[:0]
+				if _, err := c.MountBatch(mounts); err != nil {
+					b.Fatal(err)
+				}
+			}
+			b.ReportMetric(float64(atomic.LoadInt32(&methods.calls))/float64(b.N), "round-trips/op")
+		})
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -13,9 +13,12 @@ import (
 	"strings"
 	"syscall"
 
+	"github.com/sylabs/singularity/internal/pkg/buildcfg"
 	args "github.com/sylabs/singularity/internal/pkg/runtime/engine/singularity/rpc"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/internal/pkg/util/fs/pool"
 	"github.com/sylabs/singularity/internal/pkg/util/mainthread"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 	"github.com/sylabs/singularity/internal/pkg/util/user"
 	"github.com/sylabs/singularity/pkg/util/crypt"
 	"github.com/sylabs/singularity/pkg/util/loop"
@@ -35,8 +38,37 @@ func (t *Methods) Mount(arguments *args.MountArgs, mountErr *error) (err error)
 	return nil
 }
 
+// MountBatch performs the mounts in order and stops at the first failure.
+func (t *Methods) MountBatch(arguments *args.MountBatchArgs, reply *args.MountBatchReply) error {
+	defer trace.Begin("rpc server: mount batch").End()
+
+	mainthread.Execute(func() {
+		for i, m := range arguments.Mounts {
+			if err := syscall.Mount(m.Source, m.Target, m.Filesystem, m.Mountflags, m.Data); err != nil {
+				reply.Done = i
+				reply.Err = err
+				return
+			}
+		}
+		reply.Done = len(arguments.Mounts)
+	})
+	return nil
+}
+
+// PoolMount mounts a filesystem in the shared mount pool of the host
+// mount namespace. Pool errors aren't syscall.Errno values and can't be
+// encoded in the reply, they are returned as the RPC error instead.
+func (t *Methods) PoolMount(arguments *args.PoolMountArgs, reply *int) error {
+	defer trace.Begin("rpc server: pool mount").End()
+
+	p := &pool.Pool{Dir: buildcfg.POOLDIR, NsFd: arguments.NsFd}
+	return p.Mount(arguments.Key, arguments.Source, arguments.Filesystem, arguments.Mountflags, arguments.Data)
+}
+
 // Decrypt decrypts the loop device.
 func (t *Methods) Decrypt(arguments *args.CryptArgs, reply *string) (err error) {
+	defer trace.Begin("rpc server: decrypt").End()
+
 	cryptDev := &crypt.Device{}
 
 	// cryptsetup requires to run in the host IPC namespace
@@ -78,6 +110,8 @@ func (t *Methods) Mkdir(arguments *args.MkdirArgs, reply *int) (err error) {
 
 // Chroot performs a chroot with the specified arguments.
 func (t *Methods) Chroot(arguments *args.ChrootArgs, reply *int) error {
+	defer trace.Begin("rpc server: chroot").End()
+
 	root := arguments.Root
 
 	if root != "." {
@@ -150,6 +184,8 @@ func (t *Methods) Chroot(arguments *args.ChrootArgs, reply *int) error {
 
 // LoopDevice attaches a loop device with the specified arguments.
 func (t *Methods) LoopDevice(arguments *args.LoopArgs, reply *int) error {
+	defer trace.Begin("rpc server: loop device").End()
+
 	var image *os.File
 
 	loopdev := &loop.Device{}
@@ -0,0 +1,64 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package server
+
+import (
+	"net"
+	"net/rpc"
+	"os"
+	"syscall"
+	"testing"
+
+	"github.com/sylabs/singularity/internal/pkg/runtime/engine/singularity/rpc/client"
+)
+
+// newTestRPC returns a client connected through a socket pair to a server
+// serving the RPC methods, like the RPC server of the container setup.
+func newTestRPC(t *testing.T) *client.RPC {
+	fds, err := syscall.Socketpair(syscall.AF_UNIX, syscall.SOCK_STREAM, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	var conns [2]net.Conn
+	for i, fd := range fds {
+		f := os.NewFile(uintptr(fd), "rpc")
+		conns[i], err = net.FileConn(f)
+		f.Close()
+		if err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	server := rpc.NewServer()
+	if err := server.RegisterName("privileged", new(Methods)); err != nil {
+		t.Fatal(err)
+	}
+	go server.ServeConn(conns[1])
+
+	return &client.RPC{Client: rpc.NewClient(conns[0]), Name: "privileged"}
+}
+
+// TestPoolMountFailure checks that a failed shared mount is reported to
+// the container without closing the RPC connection, so the image can
+// still be mounted privately with the following RPC calls.
+func TestPoolMountFailure(t *testing.T) {
+	c := newTestRPC(t)
+	defer c.Client.Close()
+
+	// an invalid host mount namespace makes the pool mount fail
+	err := c.PoolMount(-1, "key", "/dev/loop0", "squashfs", syscall.MS_RDONLY, "")
+	if err == nil {
+		t.Fatalf("unexpected success with an invalid host mount namespace")
+	}
+	if err == rpc.ErrShutdown {
+		t.Fatalf("RPC connection closed by the pool mount failure")
+	}
+
+	// fallback to the private mount with the same connection
+	if _, err := c.Stat(os.TempDir()); err != nil {
+		t.Fatalf("unexpected error after pool mount failure: %s", err)
+	}
+}
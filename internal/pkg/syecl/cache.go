@@ -0,0 +1,102 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package syecl
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"fmt"
+	"os"
+	"path/filepath"
+	"syscall"
+)
+
+// CacheDir is the root-owned directory recording the images allowed to run
+// by the execution control list, it's cleared at reboot.
+var CacheDir = "/var/run/singularity/ecl"
+
+// fstatfs is the function pointing to syscall.Fstatfs and
+// also used by unit tests for mocking.
+var fstatfs = syscall.Fstatfs
+
+// trustedFs are the local filesystems whose file metadata is maintained by
+// the kernel. On network and FUSE filesystems the metadata comes from a
+// server which could replace the image content under identical metadata,
+// the verification cache is only used for images stored on trusted ones.
+var trustedFs = map[uint32]string{
+	0xEF53:     "ext2/3/4",
+	0x58465342: "XFS",
+	0x9123683E: "BTRFS",
+	0xF2F52010: "F2FS",
+	0x2FC12FC1: "ZFS",
+	0x01021994: "TMPFS",
+	0x858458F6: "RAMFS",
+}
+
+// CacheKey returns the verification cache key of the image opened as fp.
+// The key identifies the image path, inode, size, modification and change
+// times and the execution control list configuration, any modification of
+// the image or of the configuration results in another key. An error is
+// returned for images not stored on a trusted local filesystem.
+func (ecl *EclConfig) CacheKey(fp *os.File) (string, error) {
+	var stfs syscall.Statfs_t
+	var st syscall.Stat_t
+
+	if err := fstatfs(int(fp.Fd()), &stfs); err != nil {
+		return "", fmt.Errorf("while getting %s filesystem information: %s", fp.Name(), err)
+	}
+	if _, ok := trustedFs[uint32(stfs.Type)]; !ok {
+		return "", fmt.Errorf("%s filesystem type 0x%x not trusted for the verification cache", fp.Name(), uint32(stfs.Type))
+	}
+	if err := syscall.Fstat(int(fp.Fd()), &st); err != nil {
+		return "", fmt.Errorf("while getting %s information: %s", fp.Name(), err)
+	}
+	config, err := json.Marshal(ecl)
+	if err != nil {
+		return "", fmt.Errorf("while encoding ECL configuration: %s", err)
+	}
+
+	h := sha256.New()
+	fmt.Fprintf(h, "%s\x00%d:%d:%d:%d.%d:%d.%d\x00", fp.Name(), st.Dev, st.Ino, st.Size, st.Mtim.Sec, st.Mtim.Nsec, st.Ctim.Sec, st.Ctim.Nsec)
+	h.Write(config)
+
+	return hex.EncodeToString(h.Sum(nil)), nil
+}
+
+// Cached returns whether the cache key was recorded by RecordCache. The
+// record is trusted only if the cache directory and the record are owned
+// by root and only writable by root.
+func Cached(key string) bool {
+	var st syscall.Stat_t
+
+	if err := syscall.Lstat(CacheDir, &st); err != nil {
+		return false
+	}
+	if st.Mode&syscall.S_IFMT != syscall.S_IFDIR || st.Uid != 0 || st.Mode&0022 != 0 {
+		return false
+	}
+	if err := syscall.Lstat(filepath.Join(CacheDir, key), &st); err != nil {
+		return false
+	}
+	return st.Mode&syscall.S_IFMT == syscall.S_IFREG && st.Uid == 0
+}
+
+// RecordCache records the cache key of an image allowed to run, it must be
+// called with root privileges.
+func RecordCache(key string) error {
+	if b, err := hex.DecodeString(key); err != nil || len(b) != sha256.Size {
+		return fmt.Errorf("bad cache key %q", key)
+	}
+	if err := os.MkdirAll(CacheDir, 0755); err != nil {
+		return fmt.Errorf("while creating ECL cache directory: %s", err)
+	}
+	f, err := os.OpenFile(filepath.Join(CacheDir, key), os.O_WRONLY|os.O_CREATE|syscall.O_NOFOLLOW, 0644)
+	if err != nil {
+		return fmt.Errorf("while recording ECL verification: %s", err)
+	}
+	return f.Close()
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -103,19 +103,30 @@ func (ecl *EclConfig) ValidateConfig() error {
 	return nil
 }
 
+// signEntities returns the set of signing entities fingerprints on the
+// primary partition.
+func signEntities(fp *os.File) (map[string]struct{}, error) {
+	keyfps, err := signing.GetSignEntitiesFp(fp)
+	if err != nil {
+		return nil, err
+	}
+	set := make(map[string]struct{}, len(keyfps))
+	for _, u := range keyfps {
+		set[u] = struct{}{}
+	}
+	return set, nil
+}
+
 // checkWhiteList evaluates authorization by requiring at least 1 entity
 func checkWhiteList(fp *os.File, egroup *execgroup) (ok bool, err error) {
-	// get all signing entities fingerprints on the primary partition
-	keyfps, err := signing.GetSignEntitiesFp(fp)
+	keyfps, err := signEntities(fp)
 	if err != nil {
 		return
 	}
 	// was the primary partition signed by an authorized entity?
 	for _, v := range egroup.KeyFPs {
-		for _, u := range keyfps {
-			if v == u {
-				ok = true
-			}
+		if _, ok = keyfps[v]; ok {
+			break
 		}
 	}
 	if !ok {
@@ -127,24 +138,14 @@ func checkWhiteList(fp *os.File, egroup *execgroup) (ok bool, err error) {
 
 // checkWhiteStrict evaluates authorization by requiring all entities
 func checkWhiteStrict(fp *os.File, egroup *execgroup) (ok bool, err error) {
-	// get all signing entities fingerprints on the primary partition
-	keyfps, err := signing.GetSignEntitiesFp(fp)
+	keyfps, err := signEntities(fp)
 	if err != nil {
 		return
 	}
 
 	// was the primary partition signed by all authorized entity?
-	m := map[string]bool{}
 	for _, v := range egroup.KeyFPs {
-		m[v] = false
-		for _, u := range keyfps {
-			if v == u {
-				m[v] = true
-			}
-		}
-	}
-	for _, v := range m {
-		if !v {
+		if _, ok := keyfps[v]; !ok {
 			return false, fmt.Errorf("%s is not signed by required entities", fp.Name())
 		}
 	}
@@ -154,17 +155,14 @@ func checkWhiteStrict(fp *os.File, egroup *execgroup) (ok bool, err error) {
 
 // checkBlackList evaluates authorization by requiring all entities to be absent
 func checkBlackList(fp *os.File, egroup *execgroup) (ok bool, err error) {
-	// get all signing entities fingerprints on the primary partition
-	keyfps, err := signing.GetSignEntitiesFp(fp)
+	keyfps, err := signEntities(fp)
 	if err != nil {
 		return
 	}
-	// was the primary partition signed by an authorized entity?
+	// was the primary partition signed by a forbidden entity?
 	for _, v := range egroup.KeyFPs {
-		for _, u := range keyfps {
-			if v == u {
-				return false, fmt.Errorf("%s is signed by a forbidden entity", fp.Name())
-			}
+		if _, ok := keyfps[v]; ok {
+			return false, fmt.Errorf("%s is signed by a forbidden entity", fp.Name())
 		}
 	}
 
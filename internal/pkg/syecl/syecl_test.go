@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -10,7 +10,9 @@ import (
 	"io/ioutil"
 	"os"
 	"path/filepath"
+	"syscall"
 	"testing"
+	"time"
 )
 
 const (
@@ -156,6 +158,161 @@ func TestShouldRun(t *testing.T) {
 	}
 }
 
+func TestCache(t *testing.T) {
+	dir, err := ioutil.TempDir("", "ecl-cache-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	defaultCacheDir := CacheDir
+	defer func() { CacheDir = defaultCacheDir }()
+	CacheDir = filepath.Join(dir, "cache")
+
+	ecl, err := LoadConfig(testEclFileName)
+	if err != nil {
+		t.Fatalf("unexpected error while loading config: %s", err)
+	}
+
+	image := filepath.Join(dir, "image.sif")
+	if err := copyFile(image, srcContainer1); err != nil {
+		t.Fatal(err)
+	}
+	fp, err := os.Open(image)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer fp.Close()
+
+	// images on untrusted filesystems are never cached
+	defer func() { fstatfs = syscall.Fstatfs }()
+	fstatfs = func(fd int, st *syscall.Statfs_t) error {
+		st.Type = 0x65735546 // FUSE
+		return nil
+	}
+	if _, err := ecl.CacheKey(fp); err == nil {
+		t.Errorf("unexpected success with an image on FUSE")
+	}
+	fstatfs = func(fd int, st *syscall.Statfs_t) error {
+		st.Type = 0xEF53 // ext4
+		return nil
+	}
+
+	key, err := ecl.CacheKey(fp)
+	if err != nil {
+		t.Fatalf("unexpected error while computing cache key: %s", err)
+	}
+	if k, _ := ecl.CacheKey(fp); k != key {
+		t.Errorf("unexpected cache key %s for the same image instead of %s", k, key)
+	}
+
+	// any change of the configuration or of the image changes the key
+	other := ecl
+	other.ExecGroups = append([]execgroup(nil), ecl.ExecGroups...)
+	other.ExecGroups[0].ListMode = "blacklist"
+	if k, _ := other.CacheKey(fp); k == key {
+		t.Errorf("unexpected identical cache key with another configuration")
+	}
+	future := time.Now().Add(time.Hour)
+	if err := os.Chtimes(image, future, future); err != nil {
+		t.Fatal(err)
+	}
+	if k, _ := ecl.CacheKey(fp); k == key {
+		t.Errorf("unexpected identical cache key for a modified image")
+	}
+	key, _ = ecl.CacheKey(fp)
+
+	if Cached(key) {
+		t.Errorf("unexpected cached key before record")
+	}
+	if err := RecordCache("../../etc/passwd"); err == nil {
+		t.Errorf("unexpected success with a bad cache key")
+	}
+	if err := RecordCache(key); err != nil {
+		t.Fatalf("unexpected error while recording cache key: %s", err)
+	}
+	// records are only trusted when owned by root
+	if Cached(key) != (os.Getuid() == 0) {
+		t.Errorf("unexpected cache record status for uid %d", os.Getuid())
+	}
+	if os.Getuid() == 0 {
+		if err := os.Chmod(CacheDir, 0777); err != nil {
+			t.Fatal(err)
+		}
+		if Cached(key) {
+			t.Errorf("unexpected cached key in a world writable directory")
+		}
+	}
+}
+
+// BenchmarkShouldRun measures 1000 sequential launches of an image with ECL
+// activated, with the signatures checked at each launch or with the
+// verification cache used by the runtime engine.
+func BenchmarkShouldRun(b *testing.B) {
+	const launches = 1000
+
+	dir, err := ioutil.TempDir("", "ecl-cache-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	defaultCacheDir := CacheDir
+	defer func() { CacheDir = defaultCacheDir }()
+	CacheDir = filepath.Join(dir, "cache")
+
+	// each launch loads the configuration and opens the image
+	launch := func(cache bool) error {
+		ecl, err := LoadConfig(testEclFileName)
+		if err != nil {
+			return err
+		}
+		if err := ecl.ValidateConfig(); err != nil {
+			return err
+		}
+		fp, err := os.Open(testContainer1)
+		if err != nil {
+			return err
+		}
+		defer fp.Close()
+
+		var key string
+		if cache {
+			if key, err = ecl.CacheKey(fp); err != nil {
+				return err
+			} else if Cached(key) {
+				return nil
+			}
+		}
+		if _, err := ecl.ShouldRunFp(fp); err != nil {
+			return err
+		}
+		if cache {
+			return RecordCache(key)
+		}
+		return nil
+	}
+
+	for _, cache := range []bool{false, true} {
+		name := "signatures"
+		if cache {
+			name = "cache"
+		}
+		b.Run(name, func(b *testing.B) {
+			if cache && os.Getuid() != 0 {
+				b.Skip("cache records are only trusted when created by root")
+			}
+			for i := 0; i < b.N; i++ {
+				for j := 0; j < launches; j++ {
+					if err := launch(cache); err != nil {
+						b.Fatal(err)
+					}
+				}
+			}
+		})
+	}
+}
+
 func copyFile(dst, src string) error {
 	s, err := os.Open(src)
 	if err != nil {
@@ -0,0 +1,607 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package env
+
+import (
+	"bytes"
+	"crypto/sha256"
+	"encoding/hex"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+)
+
+const (
+	// StaticEnvName is the name of the SIF data object holding the
+	// container environment resolved at build time.
+	StaticEnvName = "static-env.json"
+
+	// EnvScriptsDir is the directory containing the environment scripts
+	// sourced by the action scripts.
+	EnvScriptsDir = "/.singularity.d/env"
+	// ExecAction is the action script executing a command in container.
+	ExecAction = "/.singularity.d/actions/exec"
+)
+
+// Builtin environment scripts, the stock environment scripts created
+// at build time implemented by StaticEnv.Environ.
+const (
+	// BuiltinApps sets the environment of the SCIF application
+	// SINGULARITY_APPNAME, it's not implemented and Environ fails
+	// if SINGULARITY_APPNAME is set.
+	BuiltinApps = "apps"
+	// BuiltinLibs appends the container libraries directory to
+	// LD_LIBRARY_PATH and sets the prompt.
+	BuiltinLibs = "libs"
+	// BuiltinRuntimeVars sets PATH from the SINGULARITYENV_*PATH
+	// variables set by the user.
+	BuiltinRuntimeVars = "runtimevars"
+)
+
+// StaticOp types.
+const (
+	// OpSet sets the shell variable Name to Value.
+	OpSet = "set"
+	// OpExport exports the shell variable Name.
+	OpExport = "export"
+	// OpUnset unsets the shell variable Name.
+	OpUnset = "unset"
+	// OpBuiltin runs the builtin environment script Name.
+	OpBuiltin = "builtin"
+)
+
+// WordPart is a literal string or a variable expansion of a shell word.
+type WordPart struct {
+	Literal string `json:"lit,omitempty"`
+	Var     string `json:"var,omitempty"`
+	// Op is "-" or ":-" if Default is expanded instead of Var when Var
+	// is unset, or when Var is unset or empty.
+	Op      string `json:"op,omitempty"`
+	Default Word   `json:"default,omitempty"`
+}
+
+// Word is a shell word composed of literal strings and variable
+// expansions.
+type Word []WordPart
+
+// StaticOp is an operation on the shell variables done by an environment
+// script.
+type StaticOp struct {
+	Op    string `json:"op"`
+	Name  string `json:"name"`
+	Value Word   `json:"value,omitempty"`
+}
+
+// StaticEnv is the container environment defined by the environment
+// scripts sourced by the exec action, resolved at build time into the
+// sequence of operations on the shell variables done by the scripts.
+type StaticEnv struct {
+	// Files maps the environment scripts and the exec action script
+	// to the SHA-256 digest of their content.
+	Files map[string]string `json:"files"`
+	Ops   []StaticOp        `json:"ops"`
+}
+
+// FileDigest returns the digest of the content of a script recorded in
+// StaticEnv.Files.
+func FileDigest(content []byte) string {
+	sum := sha256.Sum256(content)
+	return hex.EncodeToString(sum[:])
+}
+
+// EnvScripts returns the environment scripts sourced by the action
+// scripts in the root filesystem root, in the order they are sourced.
+func EnvScripts(root string) ([]string, error) {
+	fis, err := ioutil.ReadDir(filepath.Join(root, EnvScriptsDir))
+	if err != nil {
+		return nil, err
+	}
+	scripts := make([]string, 0, len(fis))
+	for _, fi := range fis {
+		name := fi.Name()
+		// the shell pattern *.sh doesn't match hidden files
+		if strings.HasPrefix(name, ".") || !strings.HasSuffix(name, ".sh") {
+			continue
+		}
+		path := filepath.Join(EnvScriptsDir, name)
+		// scripts are sourced if they are regular files
+		if fi, err := os.Stat(filepath.Join(root, path)); err != nil || !fi.Mode().IsRegular() {
+			continue
+		}
+		scripts = append(scripts, path)
+	}
+	sort.Strings(scripts)
+	return scripts, nil
+}
+
+// Check returns an error if the environment scripts or the exec action
+// script in the root filesystem root differ from the scripts the static
+// environment was resolved from, eg: with an overlay or a bind mount.
+func (s *StaticEnv) Check(root string) error {
+	scripts, err := EnvScripts(root)
+	if err != nil {
+		return fmt.Errorf("while listing environment scripts: %s", err)
+	}
+	if len(scripts)+1 != len(s.Files) {
+		return fmt.Errorf("environment scripts differ")
+	}
+	for _, path := range append(scripts, ExecAction) {
+		digest, ok := s.Files[path]
+		if !ok {
+			return fmt.Errorf("%s not found in static environment", path)
+		}
+		b, err := ioutil.ReadFile(filepath.Join(root, path))
+		if err != nil {
+			return fmt.Errorf("while reading %s: %s", path, err)
+		}
+		if FileDigest(b) != digest {
+			return fmt.Errorf("%s content differs", path)
+		}
+	}
+	return nil
+}
+
+// shellVars holds the shell variables and their export attribute.
+type shellVars struct {
+	names    []string
+	values   map[string]string
+	exported map[string]bool
+}
+
+func (v *shellVars) set(name, value string) {
+	if _, ok := v.values[name]; !ok {
+		v.names = append(v.names, name)
+	}
+	v.values[name] = value
+}
+
+func (v *shellVars) unset(name string) {
+	delete(v.values, name)
+	delete(v.exported, name)
+}
+
+func (v *shellVars) expand(w Word) string {
+	var b strings.Builder
+	for _, p := range w {
+		if p.Var == "" {
+			b.WriteString(p.Literal)
+			continue
+		}
+		value, ok := v.values[p.Var]
+		if (p.Op == "-" && !ok) || (p.Op == ":-" && value == "") {
+			value = v.expand(p.Default)
+		}
+		b.WriteString(value)
+	}
+	return b.String()
+}
+
+// Environ returns the environment of a command executed by the exec
+// action with the environment environ in the working directory cwd,
+// and the PATH variable used by the shell to search the command. It
+// returns false if the environment can't be computed without sourcing
+// the environment scripts.
+func (s *StaticEnv) Environ(environ []string, cwd string) ([]string, string, bool) {
+	v := &shellVars{
+		values:   make(map[string]string),
+		exported: make(map[string]bool),
+	}
+	for _, keyval := range environ {
+		kv := strings.SplitN(keyval, "=", 2)
+		if len(kv) != 2 {
+			continue
+		}
+		v.set(kv[0], kv[1])
+		v.exported[kv[0]] = true
+	}
+	// the shell sets and exports the working directory
+	v.set("PWD", cwd)
+	v.exported["PWD"] = true
+
+	for _, op := range s.Ops {
+		switch op.Op {
+		case OpSet:
+			v.set(op.Name, v.expand(op.Value))
+		case OpExport:
+			v.exported[op.Name] = true
+		case OpUnset:
+			v.unset(op.Name)
+		case OpBuiltin:
+			switch op.Name {
+			case BuiltinApps:
+				if v.values["SINGULARITY_APPNAME"] != "" {
+					return nil, "", false
+				}
+			case BuiltinLibs:
+				if ld := v.values["LD_LIBRARY_PATH"]; ld == "" {
+					v.set("LD_LIBRARY_PATH", "/.singularity.d/libs")
+				} else {
+					v.set("LD_LIBRARY_PATH", ld+":/.singularity.d/libs")
+				}
+				v.set("PS1", "Singularity> ")
+				v.exported["LD_LIBRARY_PATH"] = true
+				v.exported["PS1"] = true
+			case BuiltinRuntimeVars:
+				if p := v.values["SING_USER_DEFINED_PREPEND_PATH"]; p != "" {
+					v.set("PATH", p+":"+v.values["PATH"])
+				}
+				if p := v.values["SING_USER_DEFINED_APPEND_PATH"]; p != "" {
+					v.set("PATH", v.values["PATH"]+":"+p)
+				}
+				if p := v.values["SING_USER_DEFINED_PATH"]; p != "" {
+					v.set("PATH", p)
+				}
+				v.unset("SING_USER_DEFINED_PREPEND_PATH")
+				v.unset("SING_USER_DEFINED_APPEND_PATH")
+				v.unset("SING_USER_DEFINED_PATH")
+				v.exported["PATH"] = true
+			default:
+				return nil, "", false
+			}
+		default:
+			return nil, "", false
+		}
+	}
+
+	path, ok := v.values["PATH"]
+	if !ok {
+		return nil, "", false
+	}
+
+	env := make([]string, 0, len(v.names))
+	seen := make(map[string]bool, len(v.names))
+	for _, name := range v.names {
+		// a variable unset and set again is listed twice
+		if seen[name] {
+			continue
+		}
+		seen[name] = true
+		if value, ok := v.values[name]; ok && v.exported[name] {
+			env = append(env, name+"="+value)
+		}
+	}
+	return env, path, true
+}
+
+// LookPath searches the executable file like the shell does with the
+// PATH variable path, it returns false if the file isn't found.
+func LookPath(file, path string) (string, bool) {
+	isExec := func(name string) bool {
+		fi, err := os.Stat(name)
+		return err == nil && fi.Mode().IsRegular() && fi.Mode()&0111 != 0
+	}
+	if strings.Contains(file, "/") {
+		return file, isExec(file)
+	}
+	for _, dir := range filepath.SplitList(path) {
+		if dir == "" {
+			dir = "."
+		}
+		name := dir + "/" + file
+		if isExec(name) {
+			return name, true
+		}
+	}
+	return "", false
+}
+
+// scriptParser parses the shell variable assignments, exports and
+// unsets of an environment script, any other shell syntax is rejected.
+type scriptParser struct {
+	s   []byte
+	pos int
+}
+
+func isNameStart(c byte) bool {
+	return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+}
+
+func isNameChar(c byte) bool {
+	return isNameStart(c) || (c >= '0' && c <= '9')
+}
+
+func isName(s string) bool {
+	if s == "" || !isNameStart(s[0]) {
+		return false
+	}
+	for i := 1; i < len(s); i++ {
+		if !isNameChar(s[i]) {
+			return false
+		}
+	}
+	return true
+}
+
+func (p *scriptParser) eof() bool {
+	return p.pos >= len(p.s)
+}
+
+// name reads a variable name at the current position.
+func (p *scriptParser) name() string {
+	start := p.pos
+	if p.eof() || !isNameStart(p.s[p.pos]) {
+		return ""
+	}
+	for p.pos < len(p.s) && isNameChar(p.s[p.pos]) {
+		p.pos++
+	}
+	return string(p.s[start:p.pos])
+}
+
+// expansion reads a variable expansion following a $ character.
+func (p *scriptParser) expansion(inDouble bool) (WordPart, error) {
+	if p.eof() {
+		return WordPart{Literal: "$"}, nil
+	}
+	c := p.s[p.pos]
+	switch {
+	case c == '{':
+		p.pos++
+		part := WordPart{Var: p.name()}
+		if part.Var == "" {
+			return part, fmt.Errorf("unsupported parameter expansion")
+		}
+		if p.eof() {
+			return part, fmt.Errorf("unterminated parameter expansion")
+		}
+		switch {
+		case p.s[p.pos] == '}':
+			p.pos++
+			return part, nil
+		case p.s[p.pos] == '-':
+			part.Op = "-"
+			p.pos++
+		case p.s[p.pos] == ':' && p.pos+1 < len(p.s) && p.s[p.pos+1] == '-':
+			part.Op = ":-"
+			p.pos += 2
+		default:
+			return part, fmt.Errorf("unsupported parameter expansion")
+		}
+		w, err := p.word(true, inDouble)
+		if err != nil {
+			return part, err
+		}
+		if p.eof() || p.s[p.pos] != '}' {
+			return part, fmt.Errorf("unterminated parameter expansion")
+		}
+		p.pos++
+		part.Default = w
+		return part, nil
+	case isNameStart(c):
+		return WordPart{Var: p.name()}, nil
+	case strings.IndexByte("@*#?-$!0123456789('\"", c) >= 0:
+		return WordPart{}, fmt.Errorf("unsupported expansion $%c", c)
+	}
+	return WordPart{Literal: "$"}, nil
+}
+
+// word reads a shell word up to an unquoted blank or newline, or up to
+// the closing brace of a parameter expansion with inBrace.
+func (p *scriptParser) word(inBrace, inDouble bool) (Word, error) {
+	var w Word
+	var lit strings.Builder
+
+	flush := func() {
+		if lit.Len() > 0 {
+			w = append(w, WordPart{Literal: lit.String()})
+			lit.Reset()
+		}
+	}
+	expand := func(inDouble bool) error {
+		part, err := p.expansion(inDouble)
+		if err != nil {
+			return err
+		}
+		if part.Var == "" {
+			lit.WriteString(part.Literal)
+			return nil
+		}
+		flush()
+		w = append(w, part)
+		return nil
+	}
+
+	for !p.eof() {
+		c := p.s[p.pos]
+		switch {
+		case inBrace && c == '}':
+			flush()
+			return w, nil
+		case !inBrace && (c == ' ' || c == '\t' || c == '\n'):
+			flush()
+			return w, nil
+		case c == '\\':
+			if p.pos+1 >= len(p.s) {
+				return nil, fmt.Errorf("unterminated escape")
+			}
+			if p.s[p.pos+1] != '\n' {
+				lit.WriteByte(p.s[p.pos+1])
+			}
+			p.pos += 2
+		case c == '\'':
+			if inDouble {
+				return nil, fmt.Errorf("unsupported quote in parameter expansion")
+			}
+			end := bytes.IndexByte(p.s[p.pos+1:], '\'')
+			if end < 0 {
+				return nil, fmt.Errorf("unterminated single quote")
+			}
+			lit.Write(p.s[p.pos+1 : p.pos+1+end])
+			p.pos += end + 2
+		case c == '"':
+			p.pos++
+			for {
+				if p.eof() {
+					return nil, fmt.Errorf("unterminated double quote")
+				}
+				c := p.s[p.pos]
+				if c == '"' {
+					p.pos++
+					break
+				}
+				switch c {
+				case '\\':
+					if p.pos+1 < len(p.s) && strings.IndexByte("$`\"\\\n", p.s[p.pos+1]) >= 0 {
+						if p.s[p.pos+1] != '\n' {
+							lit.WriteByte(p.s[p.pos+1])
+						}
+						p.pos += 2
+						continue
+					}
+					lit.WriteByte(c)
+					p.pos++
+				case '$':
+					p.pos++
+					if err := expand(true); err != nil {
+						return nil, err
+					}
+				case '`':
+					return nil, fmt.Errorf("unsupported command substitution")
+				default:
+					lit.WriteByte(c)
+					p.pos++
+				}
+			}
+		case c == '$':
+			p.pos++
+			if err := expand(inDouble); err != nil {
+				return nil, err
+			}
+		case inBrace && (c == ' ' || c == '\t' || c == '\n'):
+			lit.WriteByte(c)
+			p.pos++
+		case strings.IndexByte("`;&|<>(){}*?[~", c) >= 0:
+			return nil, fmt.Errorf("unsupported shell syntax %q", c)
+		default:
+			lit.WriteByte(c)
+			p.pos++
+		}
+	}
+	if inBrace {
+		return nil, fmt.Errorf("unterminated parameter expansion")
+	}
+	flush()
+	return w, nil
+}
+
+// commandWord is a word of a simple command, assignments are separated
+// in the variable name and its value.
+type commandWord struct {
+	assign string
+	value  Word
+}
+
+// literal returns the word as a string if it has no expansion.
+func (cw commandWord) literal() (string, bool) {
+	if cw.assign != "" {
+		return "", false
+	}
+	var s strings.Builder
+	for _, p := range cw.value {
+		if p.Var != "" {
+			return "", false
+		}
+		s.WriteString(p.Literal)
+	}
+	return s.String(), true
+}
+
+// command reads the words of a simple command terminated by a newline.
+func (p *scriptParser) command() ([]commandWord, error) {
+	var words []commandWord
+
+	for !p.eof() {
+		c := p.s[p.pos]
+		switch {
+		case c == ' ' || c == '\t':
+			p.pos++
+		case c == '\\' && p.pos+1 < len(p.s) && p.s[p.pos+1] == '\n':
+			p.pos += 2
+		case c == '\n':
+			p.pos++
+			return words, nil
+		case c == '#':
+			for !p.eof() && p.s[p.pos] != '\n' {
+				p.pos++
+			}
+		default:
+			var cw commandWord
+			start := p.pos
+			if name := p.name(); name != "" && !p.eof() && p.s[p.pos] == '=' {
+				cw.assign = name
+				p.pos++
+			} else {
+				p.pos = start
+			}
+			w, err := p.word(false, false)
+			if err != nil {
+				return nil, err
+			}
+			cw.value = w
+			words = append(words, cw)
+		}
+	}
+	return words, nil
+}
+
+// ParseEnvScript returns the operations on the shell variables done by
+// the environment script content. The script must only contain variable
+// assignments, export and unset commands, with variable values quoted
+// or containing variable expansions, any other shell code returns an
+// error.
+func ParseEnvScript(content []byte) ([]StaticOp, error) {
+	var ops []StaticOp
+
+	p := &scriptParser{s: content}
+	for !p.eof() {
+		line := 1 + bytes.Count(content[:p.pos], []byte("\n"))
+		words, err := p.command()
+		if err != nil {
+			return nil, fmt.Errorf("line %d: %s", line, err)
+		}
+		if len(words) == 0 {
+			continue
+		}
+
+		cmd, ok := words[0].literal()
+		switch {
+		case words[0].assign != "":
+			for _, w := range words {
+				if w.assign == "" {
+					return nil, fmt.Errorf("line %d: unsupported command with variable assignments", line)
+				}
+				ops = append(ops, StaticOp{Op: OpSet, Name: w.assign, Value: w.value})
+			}
+		case ok && cmd == "export":
+			for _, w := range words[1:] {
+				if w.assign != "" {
+					ops = append(ops, StaticOp{Op: OpSet, Name: w.assign, Value: w.value})
+					ops = append(ops, StaticOp{Op: OpExport, Name: w.assign})
+					continue
+				}
+				if name, ok := w.literal(); ok && isName(name) {
+					ops = append(ops, StaticOp{Op: OpExport, Name: name})
+					continue
+				}
+				return nil, fmt.Errorf("line %d: unsupported export argument", line)
+			}
+		case ok && cmd == "unset":
+			for _, w := range words[1:] {
+				name, ok := w.literal()
+				if !ok || !isName(name) {
+					return nil, fmt.Errorf("line %d: unsupported unset argument", line)
+				}
+				ops = append(ops, StaticOp{Op: OpUnset, Name: name})
+			}
+		default:
+			return nil, fmt.Errorf("line %d: unsupported command", line)
+		}
+	}
+	return ops, nil
+}
@@ -0,0 +1,226 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package env
+
+import (
+	"io/ioutil"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"reflect"
+	"sort"
+	"strings"
+	"testing"
+
+	"github.com/sylabs/singularity/internal/pkg/test"
+)
+
+// shellEnviron returns the environment of a command executed by the
+// shell after sourcing script with the environment environ.
+func shellEnviron(t *testing.T, dir, script string, environ []string) []string {
+	path := filepath.Join(dir, "script.sh")
+	if err := ioutil.WriteFile(path, []byte(script), 0644); err != nil {
+		t.Fatal(err)
+	}
+	cmd := exec.Command("/bin/sh", "-c", `. "$0" && exec /usr/bin/env`, path)
+	cmd.Dir = dir
+	cmd.Env = environ
+	out, err := cmd.Output()
+	if err != nil {
+		t.Fatalf("while sourcing script: %s", err)
+	}
+	return strings.Split(strings.TrimSuffix(string(out), "\n"), "\n")
+}
+
+func TestStaticEnv(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	dir, err := ioutil.TempDir("", "env-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	environ := []string{
+		"PATH=/bin:/usr/bin",
+		"HOME=/home/tester",
+		"EMPTY=",
+		"REMOVED=1",
+	}
+
+	tests := []struct {
+		name   string
+		script string
+	}{
+		{"empty", "#!/bin/sh\n# comment\n\n"},
+		{"export", "export FOO=bar\nexport BAR='a b' BAZ=\"$FOO c\"\n"},
+		{"shell variable", "FOO=bar\nBAR=$FOO\nexport BAR\n"},
+		{"inherited variable", "HOME=/root\n"},
+		{"path", "export PATH=\"/opt/bin:$PATH\"\nexport PATH=${PATH}:/usr/local/bin\n"},
+		{"defaults", "export A=${EMPTY:-x} B=${EMPTY-y} C=${UNSET-\"z z\"} D=\"${UNSET:-$HOME}\"\n"},
+		{"escapes", "export A=\\$HOME B=\"\\\"\\\\ \\$HOME \\a\" C='$HOME' D=a\\\nb\n"},
+		{"docker", "#!/bin/sh\nexport PATH=\"/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin\"\nexport LANG=${LANG:-\"C.UTF-8\"}\n"},
+		{"unset", "unset REMOVED\nexport REMOVED=2\nunset EMPTY\n"},
+		{"literal dollar", "export A=a$ B=\"$ b\" C=$/\n"},
+		{"comments", "export A=a#b # comment\n"},
+	}
+
+	for _, tt := range tests {
+		ops, err := ParseEnvScript([]byte(tt.script))
+		if err != nil {
+			t.Errorf("unexpected error with %s script: %s", tt.name, err)
+			continue
+		}
+		s := &StaticEnv{Ops: ops}
+		got, path, ok := s.Environ(environ, dir)
+		if !ok {
+			t.Errorf("unexpected failure with %s script", tt.name)
+			continue
+		}
+		expected := shellEnviron(t, dir, tt.script, environ)
+		sort.Strings(got)
+		sort.Strings(expected)
+		if !reflect.DeepEqual(got, expected) {
+			t.Errorf("unexpected environment with %s script:\ngot      %q\nexpected %q", tt.name, got, expected)
+		}
+		for _, kv := range got {
+			if strings.HasPrefix(kv, "PATH=") && kv != "PATH="+path {
+				t.Errorf("unexpected PATH %s with %s script", path, tt.name)
+			}
+		}
+	}
+
+	unsupported := []string{
+		"echo test\n",
+		"export A=$(id -u)\n",
+		"export A=`id -u`\n",
+		"export A=$1\n",
+		"export A=${#HOME}\n",
+		"export A=${HOME:=x}\n",
+		"if true; then export A=1; fi\n",
+		"export A=1; export B=2\n",
+		"A=1 command\n",
+		"export A=*\n",
+		"export A=~/bin\n",
+		"export A=\"unterminated\n",
+		"export -p\n",
+		". /etc/profile\n",
+	}
+	for _, script := range unsupported {
+		if _, err := ParseEnvScript([]byte(script)); err == nil {
+			t.Errorf("unexpected success with script %q", script)
+		}
+	}
+}
+
+func TestStaticEnvBuiltins(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	s := &StaticEnv{
+		Ops: []StaticOp{
+			{Op: OpBuiltin, Name: BuiltinApps},
+			{Op: OpBuiltin, Name: BuiltinLibs},
+			{Op: OpBuiltin, Name: BuiltinRuntimeVars},
+		},
+	}
+
+	env, path, ok := s.Environ([]string{
+		"PATH=/bin",
+		"SING_USER_DEFINED_PREPEND_PATH=/first",
+		"SING_USER_DEFINED_APPEND_PATH=/last",
+	}, "/")
+	if !ok {
+		t.Fatalf("unexpected failure")
+	}
+	if path != "/first:/bin:/last" {
+		t.Errorf("unexpected PATH %s", path)
+	}
+	sort.Strings(env)
+	expected := []string{
+		"LD_LIBRARY_PATH=/.singularity.d/libs",
+		"PATH=/first:/bin:/last",
+		"PS1=Singularity> ",
+		"PWD=/",
+	}
+	if !reflect.DeepEqual(env, expected) {
+		t.Errorf("unexpected environment %q", env)
+	}
+
+	if _, _, ok := s.Environ([]string{"PATH=/bin", "SINGULARITY_APPNAME=app"}, "/"); ok {
+		t.Errorf("unexpected success with SCIF application")
+	}
+}
+
+func TestStaticEnvCheck(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	dir, err := ioutil.TempDir("", "env-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	files := map[string]string{
+		ExecAction:                    "exec",
+		EnvScriptsDir + "/01-base.sh": "base",
+		EnvScriptsDir + "/90-env.sh":  "env",
+	}
+	s := &StaticEnv{Files: make(map[string]string)}
+	for path, content := range files {
+		if err := os.MkdirAll(filepath.Join(dir, filepath.Dir(path)), 0755); err != nil {
+			t.Fatal(err)
+		}
+		if err := ioutil.WriteFile(filepath.Join(dir, path), []byte(content), 0644); err != nil {
+			t.Fatal(err)
+		}
+		s.Files[path] = FileDigest([]byte(content))
+	}
+	// not sourced
+	if err := os.Mkdir(filepath.Join(dir, EnvScriptsDir, "dir.sh"), 0755); err != nil {
+		t.Fatal(err)
+	}
+	if err := ioutil.WriteFile(filepath.Join(dir, EnvScriptsDir, ".hidden.sh"), nil, 0644); err != nil {
+		t.Fatal(err)
+	}
+
+	if err := s.Check(dir); err != nil {
+		t.Errorf("unexpected error: %s", err)
+	}
+
+	added := filepath.Join(dir, EnvScriptsDir, "99-added.sh")
+	if err := ioutil.WriteFile(added, nil, 0644); err != nil {
+		t.Fatal(err)
+	}
+	if err := s.Check(dir); err == nil {
+		t.Errorf("unexpected success with an added script")
+	}
+	os.Remove(added)
+
+	if err := ioutil.WriteFile(filepath.Join(dir, ExecAction), []byte("modified"), 0644); err != nil {
+		t.Fatal(err)
+	}
+	if err := s.Check(dir); err == nil {
+		t.Errorf("unexpected success with a modified exec action")
+	}
+}
+
+func TestLookPath(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	if p, ok := LookPath("sh", "/nonexistent::/bin"); !ok || p != "/bin/sh" {
+		t.Errorf("unexpected result %s, %v", p, ok)
+	}
+	if _, ok := LookPath("nonexistent", "/bin"); ok {
+		t.Errorf("unexpected success with a missing command")
+	}
+	if p, ok := LookPath("/bin/sh", ""); !ok || p != "/bin/sh" {
+		t.Errorf("unexpected result %s, %v", p, ok)
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -20,8 +20,12 @@ type mountFn func(*Point, *System) error
 // System defines a mount system allowing to register before/after
 // hook functions for specific tag during mount phase
 type System struct {
-	Points         *Points
-	Mount          mountFn
+	Points *Points
+	Mount  mountFn
+	// Flush is called once the points of a tag have been passed to Mount,
+	// before the after hooks of the tag, it lets Mount queue the mount
+	// operations of a tag and perform them at once.
+	Flush          hookFn
 	currentTag     AuthorizedTag
 	beforeTagHooks map[AuthorizedTag][]hookFn
 	afterTagHooks  map[AuthorizedTag][]hookFn
@@ -81,6 +85,11 @@ func (b *System) MountAll() error {
 				}
 			}
 		}
+		if b.Flush != nil {
+			if err := b.Flush(b); err != nil {
+				return fmt.Errorf("mount error for tag %s: %s", tag, err)
+			}
+		}
 		for _, fn := range b.afterTagHooks[tag] {
 			if err := fn(b); err != nil {
 				return fmt.Errorf("hook function for tag %s returns error: %s", tag, err)
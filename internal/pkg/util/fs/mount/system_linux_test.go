@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -28,6 +28,7 @@ func TestSystem(t *testing.T) {
 	before := false
 	after := false
 	mnt := false
+	flushed := false
 
 	mountFn := func(point *Point, system *System) error {
 		mnt = true
@@ -41,6 +42,12 @@ func TestSystem(t *testing.T) {
 		}
 		return nil
 	}
+	flushFn := func(system *System) error {
+		if mnt && !after {
+			flushed = true
+		}
+		return nil
+	}
 	afterHook := func(system *System) error {
 		after = true
 		if system.Mount == nil {
@@ -74,10 +81,15 @@ func TestSystem(t *testing.T) {
 	if after == false {
 		t.Errorf("afterHook wasn't executed")
 	}
+	after = false
+	system.Flush = flushFn
 	if err := system.MountAll(); err != nil {
 		t.Error(err)
 	}
 	if mnt == false {
 		t.Errorf("mountFn wasn't executed")
 	}
+	if flushed == false {
+		t.Errorf("flushFn wasn't executed between mountFn and afterHook")
+	}
 }
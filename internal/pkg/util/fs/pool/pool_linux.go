@@ -0,0 +1,274 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// Package pool shares the read-only mounts of identical image partitions
+// between the containers running on a node.
+//
+// The first container using an image partition mounts it in the pool
+// directory of the host mount namespace. The pool directory is a shared
+// mount point, so the mount propagates to the mount namespaces of the
+// running containers created with a slave mount propagation, which bind
+// it in their session directory instead of mounting the image again.
+//
+// Each container holds a shared lock on the reference file of the mounts
+// it uses for its lifetime, the last container releasing a mount tears
+// it down. The pool lock file serializes the creation and the removal of
+// shared mounts.
+package pool
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"fmt"
+	"os"
+	"path/filepath"
+	"runtime"
+	"strings"
+	"syscall"
+
+	"github.com/sylabs/singularity/internal/pkg/util/priv"
+	"github.com/sylabs/singularity/pkg/util/fs/proc"
+	"golang.org/x/sys/unix"
+)
+
+const (
+	lockFile  = ".lock"
+	refSuffix = ".ref"
+)
+
+// Pool is a directory of shared mounts.
+type Pool struct {
+	// Dir is the root-owned pool directory.
+	Dir string
+	// NsFd is a file descriptor referencing the host mount namespace
+	// where shared mounts are created.
+	NsFd int
+}
+
+// Key identifies an image partition by the identity of the image file and
+// the location of the partition, any modification of the image changes
+// its change time and thus its key.
+func Key(image string, offset, size uint64) (string, error) {
+	var st syscall.Stat_t
+
+	if err := syscall.Stat(image, &st); err != nil {
+		return "", fmt.Errorf("while getting %s information: %s", image, err)
+	}
+	h := sha256.New()
+	fmt.Fprintf(h, "%d:%d:%d:%d.%d:%d:%d", st.Dev, st.Ino, st.Size, st.Ctim.Sec, st.Ctim.Nsec, offset, size)
+	return hex.EncodeToString(h.Sum(nil))[:32], nil
+}
+
+// Path returns the mount point of the shared mount key.
+func (p *Pool) Path(key string) string {
+	return filepath.Join(p.Dir, key)
+}
+
+// inHostNamespace runs fn on a dedicated thread joining the host mount
+// namespace. A thread can join a mount namespace only if it doesn't share
+// its file system information, so the thread stops sharing it and is
+// destroyed once fn returns by keeping it locked.
+func (p *Pool) inHostNamespace(escalate bool, fn func() error) error {
+	errCh := make(chan error, 1)
+
+	go func() {
+		runtime.LockOSThread()
+
+		if escalate {
+			if err := priv.Escalate(); err != nil {
+				errCh <- fmt.Errorf("while escalating privileges: %s", err)
+				return
+			}
+		}
+		if err := unix.Unshare(unix.CLONE_FS); err != nil {
+			errCh <- fmt.Errorf("while unsharing file system information: %s", err)
+			return
+		}
+		if err := unix.Setns(p.NsFd, unix.CLONE_NEWNS); err != nil {
+			errCh <- fmt.Errorf("while joining host mount namespace: %s", err)
+			return
+		}
+		errCh <- fn()
+	}()
+
+	return <-errCh
+}
+
+// isMountPoint returns whether path is the mount point of a filesystem
+// other than the filesystem of its parent directory.
+func isMountPoint(path string) (bool, error) {
+	var st, parent syscall.Stat_t
+
+	if err := syscall.Stat(path, &st); os.IsNotExist(err) {
+		return false, nil
+	} else if err != nil {
+		return false, err
+	}
+	if err := syscall.Stat(filepath.Dir(path), &parent); err != nil {
+		return false, err
+	}
+	return st.Dev != parent.Dev, nil
+}
+
+// Visible returns whether the shared mount key is visible from the
+// current mount namespace, the pool directory must have been a shared
+// mount point when the mount namespace was created.
+func (p *Pool) Visible(key string) bool {
+	mounted, err := isMountPoint(p.Path(key))
+	return err == nil && mounted
+}
+
+// lock takes the pool lock and returns the unlock function.
+func (p *Pool) lock() (func(), error) {
+	var f *os.File
+	var err error
+
+	// the pool directory is only writable by root
+	priv.Escalate()
+	if err = os.MkdirAll(p.Dir, 0700); err == nil {
+		f, err = os.OpenFile(filepath.Join(p.Dir, lockFile), os.O_RDONLY|os.O_CREATE, 0600)
+	}
+	priv.Drop()
+	if err != nil {
+		return nil, fmt.Errorf("while opening pool lock: %s", err)
+	}
+	if err := syscall.Flock(int(f.Fd()), syscall.LOCK_EX); err != nil {
+		f.Close()
+		return nil, fmt.Errorf("while locking pool: %s", err)
+	}
+	return func() { f.Close() }, nil
+}
+
+// Ref is a reference on a shared mount held until Release is called or
+// until the process exits.
+type Ref struct {
+	pool *Pool
+	key  string
+	file *os.File
+}
+
+// Acquire takes a reference on the shared mount key. If there is no
+// shared mount for key, mount is called to create it with Mount in the
+// host mount namespace.
+func (p *Pool) Acquire(key string, mount func(target string) error) (*Ref, error) {
+	unlock, err := p.lock()
+	if err != nil {
+		return nil, err
+	}
+	defer unlock()
+
+	priv.Escalate()
+	f, err := os.OpenFile(p.Path(key)+refSuffix, os.O_RDONLY|os.O_CREATE, 0600)
+	priv.Drop()
+	if err != nil {
+		return nil, fmt.Errorf("while opening shared mount reference: %s", err)
+	}
+	if err := syscall.Flock(int(f.Fd()), syscall.LOCK_SH); err != nil {
+		f.Close()
+		return nil, fmt.Errorf("while locking shared mount reference: %s", err)
+	}
+
+	target := p.Path(key)
+
+	mounted := false
+	err = p.inHostNamespace(true, func() (err error) {
+		mounted, err = isMountPoint(target)
+		return err
+	})
+	if err == nil && !mounted {
+		err = mount(target)
+	}
+	if err != nil {
+		f.Close()
+		return nil, err
+	}
+
+	return &Ref{pool: p, key: key, file: f}, nil
+}
+
+// Release drops the reference and tears down the shared mount if this was
+// the last reference.
+func (r *Ref) Release() error {
+	defer r.file.Close()
+
+	unlock, err := r.pool.lock()
+	if err != nil {
+		return err
+	}
+	defer unlock()
+
+	if err := syscall.Flock(int(r.file.Fd()), syscall.LOCK_EX|syscall.LOCK_NB); err == syscall.EWOULDBLOCK {
+		// the shared mount is used by other containers
+		return nil
+	} else if err != nil {
+		return fmt.Errorf("while locking shared mount reference: %s", err)
+	}
+
+	target := r.pool.Path(r.key)
+
+	return r.pool.inHostNamespace(true, func() error {
+		// the mount copies propagated to container mount namespaces
+		// are unused, a lazy unmount doesn't fail if one is busy
+		if err := syscall.Unmount(target, syscall.MNT_DETACH); err != nil && err != syscall.EINVAL {
+			return fmt.Errorf("while unmounting shared mount %s: %s", target, err)
+		}
+		os.Remove(target)
+		os.Remove(target + refSuffix)
+		return nil
+	})
+}
+
+// Mount mounts the filesystem source as the shared mount key in the host
+// mount namespace, it must be called by a privileged process.
+func (p *Pool) Mount(key, source, filesystem string, flags uintptr, data string) error {
+	target := p.Path(key)
+
+	return p.inHostNamespace(false, func() error {
+		if err := p.setShared(); err != nil {
+			return err
+		}
+		if err := os.Mkdir(target, 0700); err != nil && !os.IsExist(err) {
+			return fmt.Errorf("while creating shared mount point %s: %s", target, err)
+		}
+		if err := syscall.Mount(source, target, filesystem, flags, data); err != nil {
+			os.Remove(target)
+			return fmt.Errorf("while mounting %s on %s: %s", source, target, err)
+		}
+		return nil
+	})
+}
+
+// setShared makes the pool directory a shared mount point, so the shared
+// mounts propagate to the mount namespaces created afterward.
+func (p *Pool) setShared() error {
+	dir, err := filepath.EvalSymlinks(p.Dir)
+	if err != nil {
+		return fmt.Errorf("while resolving pool directory %s: %s", p.Dir, err)
+	}
+	entries, err := proc.GetMountInfoEntry("/proc/thread-self/mountinfo")
+	if err != nil {
+		return fmt.Errorf("while reading mount information: %s", err)
+	}
+
+	mountPoint, shared := false, false
+	for _, e := range entries {
+		if e.Point == dir {
+			mountPoint = true
+			shared = strings.Contains(e.Fields, "shared:")
+		}
+	}
+	if shared {
+		return nil
+	}
+	if !mountPoint {
+		if err := syscall.Mount(dir, dir, "", syscall.MS_BIND, ""); err != nil {
+			return fmt.Errorf("while binding pool directory %s: %s", dir, err)
+		}
+	}
+	if err := syscall.Mount("", dir, "", syscall.MS_SHARED, ""); err != nil {
+		return fmt.Errorf("while setting pool directory %s as shared: %s", dir, err)
+	}
+	return nil
+}
@@ -0,0 +1,321 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package pool
+
+import (
+	"bufio"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync"
+	"syscall"
+	"testing"
+	"time"
+
+	"github.com/sylabs/singularity/internal/pkg/test"
+	"github.com/sylabs/singularity/pkg/util/loop"
+)
+
+const testImage = "../../../../../pkg/image/testdata/squashfs.v4"
+
+// newTestPool returns a pool in dir using the current mount namespace as
+// the host mount namespace and its cleanup function.
+func newTestPool(t testing.TB, dir string) (*Pool, func()) {
+	fd, err := syscall.Open("/proc/self/ns/mnt", syscall.O_RDONLY|syscall.O_CLOEXEC, 0)
+	if err != nil {
+		t.Fatalf("unexpected error while opening mount namespace: %s", err)
+	}
+	p := &Pool{Dir: filepath.Join(dir, "pool"), NsFd: fd}
+
+	return p, func() {
+		// the pool directory is bound on itself by the first mount
+		syscall.Unmount(p.Dir, syscall.MNT_DETACH)
+		syscall.Close(fd)
+	}
+}
+
+func TestKey(t *testing.T) {
+	dir, err := ioutil.TempDir("", "pool-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	image := filepath.Join(dir, "image")
+	if err := ioutil.WriteFile(image, []byte("image"), 0600); err != nil {
+		t.Fatal(err)
+	}
+
+	key, err := Key(image, 0, 0)
+	if err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	if k, _ := Key(image, 0, 0); k != key {
+		t.Errorf("unexpected key %s for the same image instead of %s", k, key)
+	}
+	if k, _ := Key(image, 4096, 0); k == key {
+		t.Errorf("unexpected identical key for another partition")
+	}
+
+	time.Sleep(10 * time.Millisecond)
+	if err := ioutil.WriteFile(image, []byte("modified"), 0600); err != nil {
+		t.Fatal(err)
+	}
+	if k, _ := Key(image, 0, 0); k == key {
+		t.Errorf("unexpected identical key for a modified image")
+	}
+
+	if _, err := Key(filepath.Join(dir, "missing"), 0, 0); err == nil {
+		t.Errorf("unexpected success with a missing image")
+	}
+}
+
+func TestPool(t *testing.T) {
+	test.EnsurePrivilege(t)
+
+	dir, err := ioutil.TempDir("", "pool-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	p, cleanup := newTestPool(t, dir)
+	defer cleanup()
+
+	const key = "test"
+
+	mounts := 0
+	mount := func(target string) error {
+		if target != p.Path(key) {
+			t.Errorf("unexpected shared mount target %s", target)
+		}
+		mounts++
+		return p.Mount(key, "tmpfs", "tmpfs", syscall.MS_RDONLY, "")
+	}
+
+	refs := make([]*Ref, 3)
+	for i := range refs {
+		refs[i], err = p.Acquire(key, mount)
+		if err != nil {
+			t.Fatalf("unexpected error while acquiring shared mount: %s", err)
+		}
+	}
+	if mounts != 1 {
+		t.Errorf("shared mount created %d times", mounts)
+	}
+	if !p.Visible(key) {
+		t.Fatalf("shared mount not visible")
+	}
+
+	for i, ref := range refs {
+		if err := ref.Release(); err != nil {
+			t.Fatalf("unexpected error while releasing shared mount: %s", err)
+		}
+		last := i == len(refs)-1
+		if p.Visible(key) == last {
+			t.Errorf("unexpected shared mount visibility after %d releases", i+1)
+		}
+	}
+	if _, err := os.Stat(p.Path(key) + refSuffix); !os.IsNotExist(err) {
+		t.Errorf("reference file not removed: %v", err)
+	}
+
+	// a failing mount doesn't leave a reference
+	if _, err := p.Acquire(key, func(string) error {
+		return p.Mount(key, "none", "nonexistentfs", 0, "")
+	}); err == nil {
+		t.Errorf("unexpected success with a failing mount")
+	}
+	if p.Visible(key) {
+		t.Errorf("unexpected shared mount after a failing mount")
+	}
+}
+
+// closeLoopDevices closes all loop device file descriptors kept open by
+// AttachFromFile, auto-clear loop devices are then released by the kernel
+// once unmounted.
+func closeLoopDevices(b *testing.B) {
+	fds, err := ioutil.ReadDir("/proc/self/fd")
+	if err != nil {
+		b.Fatal(err)
+	}
+	for _, fd := range fds {
+		link, err := os.Readlink(filepath.Join("/proc/self/fd", fd.Name()))
+		if err != nil || !strings.HasPrefix(link, "/dev/loop") || link == "/dev/loop-control" {
+			continue
+		}
+		var n int
+		if _, err := fmt.Sscanf(fd.Name(), "%d", &n); err == nil {
+			syscall.Close(n)
+		}
+	}
+}
+
+// slab returns the kernel slab memory in kB, where the superblocks, inodes
+// and dentries of mounted filesystems are allocated.
+func slab(b *testing.B) int64 {
+	f, err := os.Open("/proc/meminfo")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer f.Close()
+
+	scanner := bufio.NewScanner(f)
+	for scanner.Scan() {
+		var kb int64
+		if _, err := fmt.Sscanf(scanner.Text(), "Slab: %d kB", &kb); err == nil {
+			return kb
+		}
+	}
+	b.Fatalf("no slab memory found in /proc/meminfo")
+	return 0
+}
+
+// attachImage attaches the image to a read-only loop device like the
+// container engine does and returns its path.
+func attachImage(image string) (string, error) {
+	dev := &loop.Device{
+		MaxLoopDevices: 256,
+		Info: &loop.Info64{
+			Flags: loop.FlagsAutoClear | loop.FlagsReadOnly,
+		},
+	}
+	number := -1
+	if err := dev.AttachFromPath(image, os.O_RDONLY, &number); err != nil {
+		return "", err
+	}
+	return fmt.Sprintf("/dev/loop%d", number), nil
+}
+
+// BenchmarkLaunch measures the image mount step of concurrent container
+// launches from the same image, with an image mount per container or with
+// a shared mount bound in each container. It reports the time and the
+// kernel memory used per launch as concurrency rises.
+func BenchmarkLaunch(b *testing.B) {
+	if os.Getuid() != 0 {
+		b.Skip("benchmark must be run with privilege")
+	}
+
+	dir, err := ioutil.TempDir("", "pool-bench-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	loop.SharedIndexDir = filepath.Join(dir, "index")
+
+	data, err := ioutil.ReadFile(testImage)
+	if err != nil {
+		b.Fatal(err)
+	}
+	image := filepath.Join(dir, "image.sqfs")
+	if err := ioutil.WriteFile(image, data, 0600); err != nil {
+		b.Fatal(err)
+	}
+
+	p, cleanup := newTestPool(b, dir)
+	defer cleanup()
+
+	key, err := Key(image, 0, 0)
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	private := func(target string) (func() error, error) {
+		path, err := attachImage(image)
+		if err != nil {
+			return nil, err
+		}
+		if err := syscall.Mount(path, target, "squashfs", syscall.MS_RDONLY, ""); err != nil {
+			return nil, err
+		}
+		return func() error { return syscall.Unmount(target, syscall.MNT_DETACH) }, nil
+	}
+
+	shared := func(target string) (func() error, error) {
+		ref, err := p.Acquire(key, func(string) error {
+			path, err := attachImage(image)
+			if err != nil {
+				return err
+			}
+			return p.Mount(key, path, "squashfs", syscall.MS_RDONLY|syscall.MS_NOSUID|syscall.MS_NODEV, "")
+		})
+		if err != nil {
+			return nil, err
+		}
+		if err := syscall.Mount(p.Path(key), target, "", syscall.MS_BIND, ""); err != nil {
+			ref.Release()
+			return nil, err
+		}
+		return func() error {
+			if err := syscall.Unmount(target, syscall.MNT_DETACH); err != nil {
+				return err
+			}
+			return ref.Release()
+		}, nil
+	}
+
+	for _, n := range []int{1, 8, 32, 128} {
+		targets := make([]string, n)
+		for i := range targets {
+			targets[i] = filepath.Join(dir, fmt.Sprintf("rootfs%d", i))
+			if err := os.MkdirAll(targets[i], 0700); err != nil {
+				b.Fatal(err)
+			}
+		}
+
+		for _, mode := range []struct {
+			name  string
+			mount func(string) (func() error, error)
+		}{
+			{"private", private},
+			{"shared", shared},
+		} {
+			b.Run(fmt.Sprintf("%s-%d", mode.name, n), func(b *testing.B) {
+				var elapsed time.Duration
+				var slabKB int64
+
+				b.ResetTimer()
+				for i := 0; i < b.N; i++ {
+					var wg sync.WaitGroup
+
+					base := slab(b)
+					start := time.Now()
+					teardown := make([]func() error, n)
+					for j := range targets {
+						wg.Add(1)
+						go func(j int) {
+							defer wg.Done()
+
+							var err error
+							if teardown[j], err = mode.mount(targets[j]); err != nil {
+								b.Error(err)
+							}
+						}(j)
+					}
+					wg.Wait()
+					elapsed += time.Since(start)
+
+					b.StopTimer()
+					slabKB += slab(b) - base
+					closeLoopDevices(b)
+					for _, fn := range teardown {
+						if fn == nil {
+							continue
+						}
+						if err := fn(); err != nil {
+							b.Error(err)
+						}
+					}
+					b.StartTimer()
+				}
+				b.ReportMetric(float64(elapsed.Nanoseconds())/float64(b.N*n), "ns/launch")
+				b.ReportMetric(float64(slabKB)/float64(b.N*n), "slab-kB/launch")
+			})
+		}
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -6,7 +6,6 @@
 package starter
 
 import (
-	"encoding/json"
 	"fmt"
 	"io"
 	"os"
@@ -15,6 +14,7 @@ import (
 
 	"github.com/sylabs/singularity/internal/pkg/buildcfg"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/internal/pkg/util/trace"
 	"github.com/sylabs/singularity/pkg/runtime/engine/config"
 	"golang.org/x/sys/unix"
 )
@@ -127,7 +127,7 @@ func (c *Command) init(config *config.Common, ops ...CommandOp) error {
 		return fmt.Errorf("%s not found, please check your installation", c.path)
 	}
 
-	data, err := json.Marshal(config)
+	data, err := config.MarshalBinary()
 	if err != nil {
 		return fmt.Errorf("while marshaling config: %s", err)
 	}
@@ -138,6 +138,9 @@ func (c *Command) init(config *config.Common, ops ...CommandOp) error {
 	}
 
 	env := []string{sylog.GetEnvVar(), fmt.Sprintf("PIPE_EXEC_FD=%d", pipeFd)}
+	if trace.Enabled() {
+		env = append(env, trace.EnvVar())
+	}
 	c.env = append(c.env, env...)
 
 	return nil
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -12,9 +12,16 @@ import (
 	"golang.org/x/sys/unix"
 )
 
-// sendData sets a socket communication channel between caller and starter
-// binary in order to pass engine JSON configuration data to starter.
+// sendData passes the engine configuration data to starter through a
+// memfd, or through a socket communication channel between caller and
+// starter binary if the kernel doesn't support memfd.
 func sendData(data []byte) (int, error) {
+	if fd, err := memfdData(data); err == nil {
+		return fd, nil
+	} else if err != unix.ENOSYS {
+		return -1, err
+	}
+
 	fd, err := unix.Socketpair(unix.AF_UNIX, unix.SOCK_STREAM|unix.SOCK_CLOEXEC, 0)
 	if err != nil {
 		return -1, fmt.Errorf("failed to create socket communication pipe: %s", err)
@@ -41,3 +48,28 @@ func sendData(data []byte) (int, error) {
 
 	return pipeFd, nil
 }
+
+// memfdData returns a memfd holding data, unlike a socket its capacity
+// is not limited by the socket buffer size, so the whole configuration
+// is written before starter is executed whatever its size.
+func memfdData(data []byte) (int, error) {
+	fd, err := unix.MemfdCreate("engine-config", unix.MFD_CLOEXEC)
+	if err != nil {
+		return -1, err
+	}
+	defer unix.Close(fd)
+
+	for b := data; len(b) > 0; {
+		n, err := unix.Write(fd, b)
+		if err != nil {
+			return -1, fmt.Errorf("failed to write data to memfd: %s", err)
+		}
+		b = b[n:]
+	}
+
+	dataFd, err := unix.Dup(fd)
+	if err != nil {
+		return -1, fmt.Errorf("failed to duplicate memfd file descriptor: %s", err)
+	}
+	return dataFd, nil
+}
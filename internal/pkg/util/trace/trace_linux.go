@@ -0,0 +1,164 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// Package trace records the duration of the container startup phases into
+// a timeline shared by the CLI and all starter processes, in the Chrome
+// trace event format readable by chrome://tracing or Perfetto.
+//
+// The trace file is a JSON array of complete events opened by Start, each
+// process appends its events with a single write to the file opened in
+// append mode. The array is never closed as processes don't know which
+// one records the last event, the trace event format allows it. Event
+// timestamps come from the monotonic clock shared by all processes,
+// including the C starter code, see cmd/starter/c/trace.c.
+package trace
+
+import (
+	"encoding/json"
+	"fmt"
+	"os"
+	"syscall"
+
+	"golang.org/x/sys/unix"
+)
+
+// EnvFd is the environment variable passing the trace file descriptor
+// to starter. It is only read and validated by the starter constructor,
+// the starter processes get the file descriptor from the starter
+// configuration with SetFd.
+const EnvFd = "SINGULARITY_TRACE_FD"
+
+// fd is the trace file descriptor, -1 when tracing is disabled.
+var fd = -1
+
+// event is a trace event, see the trace event format specification.
+type event struct {
+	Name     string            `json:"name"`
+	Category string            `json:"cat,omitempty"`
+	Phase    string            `json:"ph"`
+	Ts       int64             `json:"ts"`
+	Dur      *int64            `json:"dur,omitempty"`
+	Pid      int               `json:"pid"`
+	Tid      int               `json:"tid"`
+	Args     map[string]string `json:"args,omitempty"`
+}
+
+// Start creates the trace file at path and enables tracing for the current
+// process and for the starter processes it executes, the trace file is
+// inherited by them through the environment variable returned by EnvVar.
+func Start(path string) error {
+	f, err := os.OpenFile(path, os.O_WRONLY|os.O_CREATE|os.O_TRUNC|os.O_APPEND, 0644)
+	if err != nil {
+		return fmt.Errorf("while creating trace file: %s", err)
+	}
+	if _, err := f.WriteString("[\n"); err != nil {
+		f.Close()
+		return fmt.Errorf("while writing trace file: %s", err)
+	}
+	// the file must not be closed by the garbage collector, the file
+	// descriptor is used directly from now
+	newFd, err := unix.FcntlInt(f.Fd(), unix.F_DUPFD, 3)
+	f.Close()
+	if err != nil {
+		return fmt.Errorf("while duplicating trace file descriptor: %s", err)
+	}
+
+	fd = newFd
+	SetProcessName("singularity")
+
+	return nil
+}
+
+// SetFd enables tracing to the file descriptor fd validated by starter,
+// a negative value leaves tracing disabled.
+func SetFd(traceFd int) {
+	if traceFd >= 0 {
+		fd = traceFd
+	}
+}
+
+// EnvVar returns the environment variable passing the trace file to
+// starter, or an empty string if tracing is disabled.
+func EnvVar() string {
+	if fd < 0 {
+		return ""
+	}
+	return fmt.Sprintf("%s=%d", EnvFd, fd)
+}
+
+// Enabled returns whether tracing is enabled.
+func Enabled() bool {
+	return fd >= 0
+}
+
+// now returns the monotonic clock time in microseconds, like trace_now
+// in starter.
+func now() int64 {
+	var ts unix.Timespec
+	if err := unix.ClockGettime(unix.CLOCK_MONOTONIC, &ts); err != nil {
+		return 0
+	}
+	return ts.Nano() / 1000
+}
+
+func write(e *event) {
+	e.Pid = os.Getpid()
+	e.Tid = syscall.Gettid()
+
+	b, err := json.Marshal(e)
+	if err != nil {
+		return
+	}
+	b = append(b, ',', '\n')
+	for {
+		if _, err := syscall.Write(fd, b); err != syscall.EINTR {
+			return
+		}
+	}
+}
+
+// SetProcessName names the current process in the timeline.
+func SetProcessName(name string) {
+	if fd < 0 {
+		return
+	}
+	write(&event{
+		Name:  "process_name",
+		Phase: "M",
+		Args:  map[string]string{"name": name},
+	})
+}
+
+// Region is a startup phase being recorded.
+type Region struct {
+	name  string
+	start int64
+}
+
+// Begin starts the recording of the phase name, recorded in the timeline
+// once End is called:
+//
+//	defer trace.Begin("phase").End()
+func Begin(name string) Region {
+	if fd < 0 {
+		return Region{}
+	}
+	return Region{name: name, start: now()}
+}
+
+// End records the phase in the timeline.
+func (r Region) End() {
+	if fd < 0 || r.start == 0 {
+		return
+	}
+	dur := now() - r.start
+	write(&event{
+		Name:     r.name,
+		Category: "singularity",
+		Phase:    "X",
+		Ts:       r.start,
+		Dur:      &dur,
+	})
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package trace
+
+import (
+	"encoding/json"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"syscall"
+	"testing"
+)
+
+func TestTrace(t *testing.T) {
+	dir, err := ioutil.TempDir("", "trace-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	if Enabled() {
+		t.Fatalf("unexpected enabled tracing")
+	}
+	// regions are ignored while tracing is disabled
+	Begin("disabled").End()
+
+	path := filepath.Join(dir, "trace.json")
+	if err := Start(path); err != nil {
+		t.Fatalf("unexpected error while starting trace: %s", err)
+	}
+	defer func() {
+		syscall.Close(fd)
+		fd = -1
+	}()
+
+	if !Enabled() || EnvVar() == "" {
+		t.Fatalf("tracing is not enabled")
+	}
+
+	outer := Begin("outer")
+	Begin("inner").End()
+	outer.End()
+
+	b, err := ioutil.ReadFile(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	// the event array is never terminated, close it like an appended
+	// empty event for the JSON parser
+	var events []event
+	if err := json.Unmarshal(append(b, []byte("{}]")...), &events); err != nil {
+		t.Fatalf("unexpected error while decoding trace %s: %s", b, err)
+	}
+	events = events[:len(events)-1]
+
+	if len(events) != 3 {
+		t.Fatalf("unexpected trace events %+v", events)
+	}
+	if events[0].Phase != "M" || events[0].Args["name"] != "singularity" {
+		t.Errorf("unexpected process name event %+v", events[0])
+	}
+	inner, outerEvent := events[1], events[2]
+	if inner.Name != "inner" || outerEvent.Name != "outer" || inner.Phase != "X" || outerEvent.Dur == nil || inner.Dur == nil {
+		t.Fatalf("unexpected region events %+v %+v", inner, outerEvent)
+	}
+	if inner.Ts < outerEvent.Ts || inner.Ts+*inner.Dur > outerEvent.Ts+*outerEvent.Dur {
+		t.Errorf("inner region is not nested in outer region")
+	}
+	if inner.Pid != os.Getpid() {
+		t.Errorf("unexpected pid %d", inner.Pid)
+	}
+}
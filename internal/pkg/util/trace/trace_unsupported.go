@@ -0,0 +1,41 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// +build !linux
+
+package trace
+
+import (
+	"fmt"
+)
+
+// Start returns an error, tracing is only supported on Linux.
+func Start(path string) error {
+	return fmt.Errorf("tracing is only supported on Linux")
+}
+
+// EnvVar returns an empty string, tracing is only supported on Linux.
+func EnvVar() string {
+	return ""
+}
+
+// Enabled returns false, tracing is only supported on Linux.
+func Enabled() bool {
+	return false
+}
+
+// SetProcessName does nothing, tracing is only supported on Linux.
+func SetProcessName(name string) {}
+
+// Region is a startup phase being recorded.
+type Region struct{}
+
+// Begin does nothing, tracing is only supported on Linux.
+func Begin(name string) Region {
+	return Region{}
+}
+
+// End does nothing, tracing is only supported on Linux.
+func (r Region) End() {}
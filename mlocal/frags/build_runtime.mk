@@ -47,6 +47,22 @@ $(sessiondir_INSTALL):
 
 INSTALLFILES += $(sessiondir_INSTALL)
 
+# pooldir
+pooldir_INSTALL := $(DESTDIR)$(LOCALSTATEDIR)/singularity/mnt/pool
+$(pooldir_INSTALL):
+	@echo " INSTALL" $@
+	$(V)umask 0022 && mkdir -p -m 0700 $@
+
+INSTALLFILES += $(pooldir_INSTALL)
+
+# netnspooldir
+netnspooldir_INSTALL := $(DESTDIR)$(LOCALSTATEDIR)/singularity/netns
+$(netnspooldir_INSTALL):
+	@echo " INSTALL" $@
+	$(V)umask 0022 && mkdir -p -m 0755 $@
+
+INSTALLFILES += $(netnspooldir_INSTALL)
+
 
 # run-singularity script
 run_singularity := $(SOURCEDIR)/scripts/run-singularity
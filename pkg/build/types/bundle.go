@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -17,6 +17,7 @@ import (
 	"github.com/sylabs/singularity/internal/pkg/sylog"
 	"github.com/sylabs/singularity/internal/pkg/util/fs"
 	"github.com/sylabs/singularity/pkg/util/crypt"
+	"github.com/sylabs/singularity/pkg/util/fs/squashfs"
 	"golang.org/x/sys/unix"
 )
 
@@ -30,6 +31,11 @@ type Bundle struct {
 
 	RootfsPath string `json:"rootfsPath"` // where actual fs to chroot will appear
 	TmpDir     string `json:"tmpPath"`    // where temp files required during build will appear
+
+	// RootfsTree is the in-memory root filesystem merged from the image
+	// layers when Opts.StreamRootfs is set, RootfsPath then only holds
+	// the files added by the build to merge on top of it.
+	RootfsTree *squashfs.Tree `json:"-"`
 }
 
 // Options defines build time behavior to be executed on the bundle.
@@ -70,6 +76,13 @@ type Options struct {
 	// To warn when the above is needed, we need to know if the target of this
 	// bundle will be a sandbox
 	SandboxTarget bool
+	// MksquashfsArgs are additional mksquashfs options used to create the
+	// squashfs filesystem of a SIF image.
+	MksquashfsArgs []string `json:"mksquashfsArgs"`
+	// StreamRootfs allows the conveyor packer to provide the root filesystem
+	// as RootfsTree instead of extracting it in RootfsPath, it's only set
+	// for SIF builds which don't run scripts or copy files in the rootfs.
+	StreamRootfs bool `json:"streamRootfs"`
 }
 
 // NewEncryptedBundle creates an Encrypted Bundle environment.
@@ -100,6 +113,9 @@ func (b *Bundle) RunSection(s string) bool {
 // Remove cleans up any bundle files.
 func (b *Bundle) Remove() error {
 	var errors []string
+	if b.RootfsTree != nil {
+		b.RootfsTree.Close()
+	}
 	for _, dir := range []string{b.TmpDir, b.RootfsPath} {
 		if err := fs.ForceRemoveAll(dir); err != nil {
 			errors = append(errors, fmt.Sprintf("could not remove %q: %v", dir, err))
@@ -0,0 +1,512 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package client
+
+import (
+	"bytes"
+	"context"
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"hash"
+	"io"
+	"io/ioutil"
+	"net/http"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	useragent "github.com/sylabs/singularity/pkg/util/user-agent"
+)
+
+const (
+	// ConcurrencyEnv specifies the number of connections used to download
+	// an image when the server supports range requests.
+	ConcurrencyEnv = "SINGULARITY_DOWNLOAD_CONCURRENCY"
+
+	// DefaultConcurrency is the default number of connections used to
+	// download an image.
+	DefaultConcurrency = 4
+
+	// DefaultPartSize is the default size of the ranges downloaded by
+	// each connection.
+	DefaultPartSize = 8 << 20
+
+	// partRetries is the number of attempts to download a range before
+	// giving up.
+	partRetries = 3
+)
+
+// ErrDigest is returned when the downloaded content doesn't match the
+// expected digest.
+var ErrDigest = errors.New("downloaded content does not match the expected digest")
+
+// DownloadOptions holds the options of a download.
+type DownloadOptions struct {
+	// Concurrency is the number of connections used to download ranges
+	// of the file, zero means the value of ConcurrencyEnv or
+	// DefaultConcurrency is used.
+	Concurrency int
+	// PartSize is the size of the downloaded ranges, zero means
+	// DefaultPartSize is used.
+	PartSize int64
+	// Header holds additional headers sent with the first request, like
+	// an authorization token. They are not sent to the location the
+	// server redirects to.
+	Header http.Header
+	// Digest is the expected hex encoded sha256 digest of the file, the
+	// partial download is discarded if it doesn't match.
+	Digest string
+	// Progress, if set, is called once the size of the file is known and
+	// returns a writer receiving the content of the file in order.
+	Progress func(size int64) io.Writer
+}
+
+// downloadState records the ranges already downloaded in a partial file,
+// a download is only resumed if the remote file is unchanged.
+type downloadState struct {
+	Size      int64  `json:"size"`
+	PartSize  int64  `json:"partSize"`
+	Validator string `json:"validator"`
+	Done      []bool `json:"done"`
+}
+
+// partPaths returns the paths of the hidden partial file and of its state
+// stored along the destination, a download into the image cache is then
+// resumed by the next pull.
+func partPaths(dst string) (string, string) {
+	dir, name := filepath.Split(dst)
+	part := filepath.Join(dir, "."+name+".part")
+	return part, part + ".state"
+}
+
+func readState(path string) *downloadState {
+	b, err := ioutil.ReadFile(path)
+	if err != nil {
+		return nil
+	}
+	s := new(downloadState)
+	if err := json.Unmarshal(b, s); err != nil {
+		return nil
+	}
+	return s
+}
+
+func writeState(path string, s *downloadState) error {
+	b, err := json.Marshal(s)
+	if err != nil {
+		return err
+	}
+	tmp := path + ".tmp"
+	if err := ioutil.WriteFile(tmp, b, 0600); err != nil {
+		return err
+	}
+	return os.Rename(tmp, path)
+}
+
+// parseContentRange returns the complete length of a "bytes a-b/length"
+// Content-Range header value.
+func parseContentRange(value string) (int64, error) {
+	i := strings.LastIndexByte(value, '/')
+	if !strings.HasPrefix(value, "bytes ") || i < 0 {
+		return 0, fmt.Errorf("invalid Content-Range %q", value)
+	}
+	size, err := strconv.ParseInt(value[i+1:], 10, 64)
+	if err != nil || size < 0 {
+		return 0, fmt.Errorf("invalid Content-Range %q", value)
+	}
+	return size, nil
+}
+
+// download is a file download in progress.
+type download struct {
+	ctx    context.Context
+	client *http.Client
+	opts   *DownloadOptions
+
+	part      *os.File
+	statePath string
+
+	mu    sync.Mutex
+	state *downloadState
+
+	hash     hash.Hash
+	progress io.Writer
+}
+
+// get sends a GET request for the given range of the file, a negative
+// start requests the whole file.
+func (d *download) get(url string, header http.Header, start, end int64) (*http.Response, error) {
+	req, err := http.NewRequest(http.MethodGet, url, nil)
+	if err != nil {
+		return nil, err
+	}
+	for k, v := range header {
+		req.Header[k] = v
+	}
+	req.Header.Set("User-Agent", useragent.Value())
+	if start >= 0 {
+		req.Header.Set("Range", fmt.Sprintf("bytes=%d-%d", start, end))
+	}
+
+	res, err := d.client.Do(req.WithContext(d.ctx))
+	if err != nil {
+		return nil, err
+	}
+	if res.StatusCode == http.StatusOK || res.StatusCode == http.StatusPartialContent {
+		return res, nil
+	}
+	defer res.Body.Close()
+
+	// an empty file has no satisfiable range
+	if res.StatusCode == http.StatusRequestedRangeNotSatisfiable && start == 0 {
+		return d.get(url, header, -1, 0)
+	}
+
+	if res.StatusCode == http.StatusNotFound {
+		return nil, fmt.Errorf("the requested image was not found")
+	}
+	buf := new(bytes.Buffer)
+	buf.ReadFrom(io.LimitReader(res.Body, 4096))
+	return nil, fmt.Errorf("download did not succeed: %d %s", res.StatusCode, buf.String())
+}
+
+// setDone records that the part i was written to the partial file.
+func (d *download) setDone(i int) {
+	d.mu.Lock()
+	defer d.mu.Unlock()
+
+	d.state.Done[i] = true
+	if err := writeState(d.statePath, d.state); err != nil {
+		sylog.Debugf("Could not record download state: %s", err)
+	}
+}
+
+// sum feeds the next part of the file to the hash and to the progress
+// writer.
+func (d *download) sum(p []byte) {
+	d.hash.Write(p)
+	if d.progress != nil {
+		d.progress.Write(p)
+	}
+}
+
+// fetchPart downloads the part i of the file into buf and writes it in the
+// partial file, body is the response to a request for this part if one was
+// already sent.
+func (d *download) fetchPart(url string, header http.Header, i int, buf []byte, body io.ReadCloser) error {
+	start := int64(i) * d.state.PartSize
+
+	var err error
+	for attempt := 0; attempt < partRetries; attempt++ {
+		if attempt > 0 {
+			sylog.Debugf("Retrying download of range %d-%d: %s", start, start+int64(len(buf))-1, err)
+			select {
+			case <-d.ctx.Done():
+				return d.ctx.Err()
+			case <-time.After(time.Duration(attempt) * time.Second):
+			}
+		}
+		if body == nil {
+			var res *http.Response
+			res, err = d.get(url, header, start, start+int64(len(buf))-1)
+			if err != nil {
+				continue
+			}
+			if res.StatusCode != http.StatusPartialContent {
+				res.Body.Close()
+				return fmt.Errorf("server ignored range request")
+			}
+			body = res.Body
+		}
+		_, err = io.ReadFull(body, buf)
+		body.Close()
+		body = nil
+		if err == nil {
+			break
+		}
+	}
+	if err != nil {
+		return err
+	}
+
+	if _, err := d.part.WriteAt(buf, start); err != nil {
+		return err
+	}
+	d.setDone(i)
+	return nil
+}
+
+// fetchParts downloads the missing parts of the file with concurrent range
+// requests. The parts are hashed in order as they arrive, parts downloaded
+// by a previous attempt are read back from the partial file.
+func (d *download) fetchParts(url string, header http.Header, first io.ReadCloser) error {
+	size, partSize := d.state.Size, d.state.PartSize
+	parts := len(d.state.Done)
+	resumed := append([]bool(nil), d.state.Done...)
+	if parts == 0 || resumed[0] {
+		first.Close()
+		first = nil
+	}
+
+	partLen := func(i int) int64 {
+		if end := int64(i+1) * partSize; end < size {
+			return partSize
+		}
+		return size - int64(i)*partSize
+	}
+
+	concurrency := d.opts.Concurrency
+	if concurrency > parts {
+		concurrency = parts
+	}
+
+	ctx, cancel := context.WithCancel(d.ctx)
+	defer cancel()
+	d.ctx = ctx
+
+	// a worker takes a buffer before taking a part and the buffer is
+	// only released once the part is hashed, the part expected by the
+	// hasher is then always being downloaded
+	buffers := make(chan []byte, concurrency)
+	for i := 0; i < concurrency; i++ {
+		buffers <- make([]byte, partSize)
+	}
+	ready := make([]chan []byte, parts)
+	jobs := make(chan int, parts)
+	for i := 0; i < parts; i++ {
+		ready[i] = make(chan []byte, 1)
+		if !resumed[i] {
+			jobs <- i
+		}
+	}
+	close(jobs)
+
+	var (
+		wg       sync.WaitGroup
+		errOnce  sync.Once
+		firstErr error
+	)
+	fail := func(err error) {
+		errOnce.Do(func() {
+			firstErr = err
+			cancel()
+		})
+	}
+
+	for w := 0; w < concurrency; w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for {
+				var buf []byte
+				select {
+				case buf = <-buffers:
+				case <-ctx.Done():
+					return
+				}
+				i, ok := <-jobs
+				if !ok {
+					return
+				}
+				var body io.ReadCloser
+				if i == 0 {
+					body, first = first, nil
+				}
+				buf = buf[:partLen(i)]
+				if err := d.fetchPart(url, header, i, buf, body); err != nil {
+					fail(err)
+					return
+				}
+				ready[i] <- buf
+			}
+		}()
+	}
+
+	readBuf := make([]byte, partSize)
+ordered:
+	for i := 0; i < parts; i++ {
+		if resumed[i] {
+			buf := readBuf[:partLen(i)]
+			if _, err := d.part.ReadAt(buf, int64(i)*partSize); err != nil {
+				fail(err)
+				break
+			}
+			d.sum(buf)
+			continue
+		}
+		select {
+		case buf := <-ready[i]:
+			d.sum(buf)
+			buffers <- buf[:cap(buf)]
+		case <-ctx.Done():
+			fail(ctx.Err())
+			break ordered
+		}
+	}
+
+	cancel()
+	wg.Wait()
+	if first != nil {
+		first.Close()
+	}
+	return firstErr
+}
+
+// fetchAll downloads the whole file from body, when the server doesn't
+// support range requests.
+func (d *download) fetchAll(body io.Reader) error {
+	if err := d.part.Truncate(0); err != nil {
+		return err
+	}
+	w := io.MultiWriter(d.part, d.hash)
+	if d.progress != nil {
+		w = io.MultiWriter(w, d.progress)
+	}
+	_, err := io.Copy(w, body)
+	return err
+}
+
+// Download downloads the file at url into dst and returns the hex encoded
+// sha256 digest of its content, computed while the file is downloaded.
+// When the server supports range requests, ranges of the file are
+// downloaded over concurrent connections into a hidden partial file stored
+// along dst, which is kept if the download fails so that the next download
+// of the same file into dst resumes it. dst is only created once the
+// download is complete and verified.
+func Download(ctx context.Context, client *http.Client, url, dst string, opts *DownloadOptions) (string, error) {
+	var o DownloadOptions
+	if opts != nil {
+		o = *opts
+	}
+	if o.Concurrency <= 0 {
+		o.Concurrency = DefaultConcurrency
+		if v := os.Getenv(ConcurrencyEnv); v != "" {
+			n, err := strconv.Atoi(v)
+			if err != nil || n <= 0 {
+				return "", fmt.Errorf("invalid value %q for %s", v, ConcurrencyEnv)
+			}
+			o.Concurrency = n
+		}
+	}
+	if o.PartSize <= 0 {
+		o.PartSize = DefaultPartSize
+	}
+	if client == nil {
+		client = http.DefaultClient
+	}
+
+	partPath, statePath := partPaths(dst)
+	d := &download{
+		ctx:       ctx,
+		client:    client,
+		opts:      &o,
+		statePath: statePath,
+		hash:      sha256.New(),
+	}
+
+	sylog.Debugf("Pulling from URL: %s", url)
+
+	// the first part is requested along with the file size, the server
+	// replies with the whole file if it doesn't support range requests
+	res, err := d.get(url, o.Header, 0, o.PartSize-1)
+	if err != nil {
+		return "", err
+	}
+	defer res.Body.Close()
+
+	// Perms are 777 *prior* to umask
+	d.part, err = os.OpenFile(partPath, os.O_CREATE|os.O_RDWR, 0777)
+	if err != nil {
+		return "", err
+	}
+	defer func() {
+		if d.part != nil {
+			d.part.Close()
+		}
+	}()
+
+	if res.StatusCode == http.StatusOK {
+		sylog.Debugf("Server does not support range requests, downloading %s over one connection", url)
+		os.Remove(statePath)
+		if o.Progress != nil {
+			d.progress = o.Progress(res.ContentLength)
+		}
+		err = d.fetchAll(res.Body)
+	} else {
+		var size int64
+		size, err = parseContentRange(res.Header.Get("Content-Range"))
+		if err != nil {
+			return "", err
+		}
+		validator := res.Header.Get("ETag")
+		if validator == "" {
+			validator = res.Header.Get("Last-Modified")
+		}
+		parts := int((size + o.PartSize - 1) / o.PartSize)
+
+		d.state = readState(statePath)
+		if fi, err := d.part.Stat(); d.state == nil || err != nil || fi.Size() != size ||
+			validator == "" || d.state.Validator != validator ||
+			d.state.Size != size || d.state.PartSize != o.PartSize || len(d.state.Done) != parts {
+			d.state = &downloadState{
+				Size:      size,
+				PartSize:  o.PartSize,
+				Validator: validator,
+				Done:      make([]bool, parts),
+			}
+			if err := d.part.Truncate(0); err != nil {
+				return "", err
+			}
+			if err := d.part.Truncate(size); err != nil {
+				return "", err
+			}
+		} else {
+			sylog.Infof("Resuming partial download of %s", filepath.Base(dst))
+		}
+
+		if o.Progress != nil {
+			d.progress = o.Progress(size)
+		}
+
+		// the following ranges are requested from the location the
+		// server redirected to, the initial headers are only sent to
+		// the same location
+		partURL, header := res.Request.URL.String(), o.Header
+		if partURL != url {
+			header = nil
+		}
+		err = d.fetchParts(partURL, header, res.Body)
+	}
+	if err != nil {
+		return "", err
+	}
+
+	digest := hex.EncodeToString(d.hash.Sum(nil))
+	if o.Digest != "" && digest != o.Digest {
+		os.Remove(partPath)
+		os.Remove(statePath)
+		return "", ErrDigest
+	}
+
+	err = d.part.Close()
+	d.part = nil
+	if err != nil {
+		return "", err
+	}
+	if err := os.Rename(partPath, dst); err != nil {
+		return "", err
+	}
+	os.Remove(statePath)
+
+	return digest, nil
+}
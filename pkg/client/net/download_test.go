@@ -0,0 +1,250 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package client
+
+import (
+	"bytes"
+	"context"
+	"crypto/sha256"
+	"encoding/hex"
+	"io"
+	"io/ioutil"
+	"math/rand"
+	"net/http"
+	"net/http/httptest"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	useragent "github.com/sylabs/singularity/pkg/util/user-agent"
+)
+
+const testPartSize = 64 << 10
+
+// testServer serves content with range support, it fails the requests
+// for the ranges starting at the offsets in fail.
+type testServer struct {
+	content  []byte
+	ranges   bool
+	fail     map[string]bool
+	requests int32
+}
+
+func (s *testServer) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	atomic.AddInt32(&s.requests, 1)
+
+	if r.URL.Path == "/redirect" {
+		if r.Header.Get("Authorization") != "Bearer token" {
+			w.WriteHeader(http.StatusUnauthorized)
+			return
+		}
+		http.Redirect(w, r, "/image", http.StatusFound)
+		return
+	}
+	if r.URL.Path != "/image" {
+		w.WriteHeader(http.StatusNotFound)
+		return
+	}
+
+	rng := r.Header.Get("Range")
+	if !s.ranges {
+		r.Header.Del("Range")
+	} else if s.fail[strings.SplitN(strings.TrimPrefix(rng, "bytes="), "-", 2)[0]] {
+		w.WriteHeader(http.StatusServiceUnavailable)
+		return
+	}
+	w.Header().Set("ETag", `"v1"`)
+	http.ServeContent(w, r, "image", time.Time{}, bytes.NewReader(s.content))
+}
+
+func TestMain(m *testing.M) {
+	useragent.InitValue("singularity", "3.0.0-alpha.1-303-gaed8d30-dirty")
+
+	os.Exit(m.Run())
+}
+
+func TestDownload(t *testing.T) {
+	dir, err := ioutil.TempDir("", "download-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	content := make([]byte, 10*testPartSize+123)
+	rand.Read(content)
+	sum := sha256.Sum256(content)
+	digest := hex.EncodeToString(sum[:])
+
+	tests := []struct {
+		name     string
+		content  []byte
+		ranges   bool
+		path     string
+		digest   string
+		requests int32
+		err      bool
+	}{
+		{
+			name:     "ranges",
+			content:  content,
+			ranges:   true,
+			path:     "/image",
+			digest:   digest,
+			requests: 11,
+		},
+		{
+			name:     "redirect",
+			content:  content,
+			ranges:   true,
+			path:     "/redirect",
+			requests: 12,
+		},
+		{
+			name:     "no range support",
+			content:  content,
+			path:     "/image",
+			digest:   digest,
+			requests: 1,
+		},
+		{
+			name:     "empty",
+			ranges:   true,
+			path:     "/image",
+			requests: 1,
+		},
+		{
+			name:     "bad digest",
+			content:  content,
+			ranges:   true,
+			path:     "/image",
+			digest:   "0",
+			requests: 11,
+			err:      true,
+		},
+		{
+			name:     "not found",
+			ranges:   true,
+			path:     "/missing",
+			requests: 1,
+			err:      true,
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			s := &testServer{content: tt.content, ranges: tt.ranges}
+			srv := httptest.NewServer(s)
+			defer srv.Close()
+
+			dst := filepath.Join(dir, tt.name)
+			var progress bytes.Buffer
+			opts := &DownloadOptions{
+				PartSize: testPartSize,
+				Header:   http.Header{"Authorization": []string{"Bearer token"}},
+				Digest:   tt.digest,
+				Progress: func(size int64) io.Writer {
+					if size != int64(len(tt.content)) {
+						t.Errorf("unexpected size %d", size)
+					}
+					return &progress
+				},
+			}
+
+			d, err := Download(context.Background(), nil, srv.URL+tt.path, dst, opts)
+			if n := atomic.LoadInt32(&s.requests); n != tt.requests {
+				t.Errorf("%d requests instead of %d", n, tt.requests)
+			}
+			if tt.err {
+				if err == nil {
+					t.Fatalf("unexpected success")
+				}
+				if _, err := os.Stat(dst); !os.IsNotExist(err) {
+					t.Errorf("destination created")
+				}
+				return
+			}
+			if err != nil {
+				t.Fatalf("unexpected error: %s", err)
+			}
+
+			sum := sha256.Sum256(tt.content)
+			if d != hex.EncodeToString(sum[:]) {
+				t.Errorf("unexpected digest %s", d)
+			}
+			b, err := ioutil.ReadFile(dst)
+			if err != nil {
+				t.Fatal(err)
+			}
+			if !bytes.Equal(b, tt.content) {
+				t.Errorf("downloaded content differs")
+			}
+			if !bytes.Equal(progress.Bytes(), tt.content) {
+				t.Errorf("progress content differs")
+			}
+			part, state := partPaths(dst)
+			for _, p := range []string{part, state} {
+				if _, err := os.Stat(p); !os.IsNotExist(err) {
+					t.Errorf("%s not removed", p)
+				}
+			}
+		})
+	}
+}
+
+func TestDownloadResume(t *testing.T) {
+	dir, err := ioutil.TempDir("", "download-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	content := make([]byte, 10*testPartSize)
+	rand.Read(content)
+
+	// the download of the third part fails, the other parts are kept
+	s := &testServer{
+		content: content,
+		ranges:  true,
+		fail:    map[string]bool{"131072": true},
+	}
+	srv := httptest.NewServer(s)
+	defer srv.Close()
+
+	dst := filepath.Join(dir, "image")
+	opts := &DownloadOptions{PartSize: testPartSize, Concurrency: 2}
+
+	if _, err := Download(context.Background(), nil, srv.URL+"/image", dst, opts); err == nil {
+		t.Fatalf("unexpected success")
+	}
+	part, _ := partPaths(dst)
+	if _, err := os.Stat(part); err != nil {
+		t.Fatalf("partial download not kept: %s", err)
+	}
+
+	s = &testServer{content: content, ranges: true}
+	srv = httptest.NewServer(s)
+	defer srv.Close()
+
+	d, err := Download(context.Background(), nil, srv.URL+"/image", dst, opts)
+	if err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	sum := sha256.Sum256(content)
+	if d != hex.EncodeToString(sum[:]) {
+		t.Errorf("unexpected digest %s", d)
+	}
+	if b, _ := ioutil.ReadFile(dst); !bytes.Equal(b, content) {
+		t.Errorf("downloaded content differs")
+	}
+	// the first request and at most the parts not completed before the
+	// failure
+	if n := atomic.LoadInt32(&s.requests); n >= 10 {
+		t.Errorf("download not resumed: %d requests", n)
+	}
+}
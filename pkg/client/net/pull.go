@@ -6,17 +6,15 @@
 package client
 
 import (
-	"bytes"
+	"context"
 	"fmt"
 	"io"
 	"net/http"
-	"os"
 	"regexp"
 	"strings"
 	"time"
 
 	"github.com/sylabs/singularity/internal/pkg/sylog"
-	useragent "github.com/sylabs/singularity/pkg/util/user-agent"
 	"gopkg.in/cheggaaa/pb.v1"
 )
 
@@ -31,7 +29,9 @@ func IsNetPullRef(libraryRef string) bool {
 }
 
 // DownloadImage will retrieve an image from the Container Library,
-// saving it into the specified file
+// saving it into the specified file. The image is downloaded over
+// concurrent connections when the server supports range requests, an
+// interrupted download is resumed by the next call.
 func DownloadImage(filePath string, libraryURL string) error {
 
 	if !IsNetPullRef(libraryURL) {
@@ -44,70 +44,31 @@ func DownloadImage(filePath string, libraryURL string) error {
 	}
 
 	url := libraryURL
-	sylog.Debugf("Pulling from URL: %s\n", url)
 
 	client := &http.Client{
 		Timeout: pullTimeout * time.Second,
 	}
 
-	req, err := http.NewRequest(http.MethodGet, url, nil)
-	if err != nil {
-		return err
-	}
-
-	req.Header.Set("User-Agent", useragent.Value())
-
-	res, err := client.Do(req)
-	if err != nil {
-		return err
+	var bar *pb.ProgressBar
+	opts := &DownloadOptions{
+		Progress: func(size int64) io.Writer {
+			bar = pb.New64(size).SetUnits(pb.U_BYTES)
+			if sylog.GetLevel() < 0 {
+				bar.NotPrint = true
+			}
+			bar.ShowTimeLeft = true
+			bar.ShowSpeed = true
+			bar.Start()
+			return bar
+		},
 	}
-	defer res.Body.Close()
-
-	if res.StatusCode == http.StatusNotFound {
-		return fmt.Errorf("the requested image was not found in the library")
-	}
-
-	if res.StatusCode != http.StatusOK {
-		buf := new(bytes.Buffer)
-		buf.ReadFrom(res.Body)
-		s := buf.String()
-		return fmt.Errorf("Download did not succeed: %d %s\n\t",
-			res.StatusCode, s)
-	}
-
-	sylog.Debugf("OK response received, beginning body download\n")
 
-	// Perms are 777 *prior* to umask
-	out, err := os.OpenFile(filePath, os.O_CREATE|os.O_TRUNC|os.O_WRONLY, 0777)
-	if err != nil {
+	if _, err := Download(context.Background(), client, url, filePath, opts); err != nil {
 		return err
 	}
-	defer out.Close()
-
-	sylog.Debugf("Created output file: %s\n", filePath)
-
-	bodySize := res.ContentLength
-	bar := pb.New(int(bodySize)).SetUnits(pb.U_BYTES)
-	if sylog.GetLevel() < 0 {
-		bar.NotPrint = true
-	}
-	bar.ShowTimeLeft = true
-	bar.ShowSpeed = true
-	bar.Start()
-
-	// create proxy reader
-	bodyProgress := bar.NewProxyReader(res.Body)
-
-	// Write the body to file
-	_, err = io.Copy(out, bodyProgress)
-	if err != nil {
-		return err
-	}
-
 	bar.Finish()
 
 	sylog.Debugf("Download complete\n")
 
 	return nil
-
 }
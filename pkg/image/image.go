@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -93,6 +93,24 @@ type Image struct {
 	Writable   bool      `json:"writable"`
 	Partitions []Section `json:"partitions"`
 	Sections   []Section `json:"sections"`
+
+	// header holds the first bytes of the image file read once by
+	// Init for all format initializers
+	header []byte
+}
+
+// readHeader returns the first bufferSize bytes of the image file, the
+// buffer read by Init is shared by format initializers to not read the
+// image header again for each format.
+func (i *Image) readHeader() ([]byte, error) {
+	if i.header != nil {
+		return i.header, nil
+	}
+	b := make([]byte, bufferSize)
+	if n, err := i.File.ReadAt(b, 0); n != bufferSize {
+		return nil, debugErrorf("can't read first %d bytes: %v", bufferSize, err)
+	}
+	return b, nil
 }
 
 // AuthorizedPath checks if image is in a path supplied in paths
@@ -217,6 +235,11 @@ func ResolvePath(path string) (string, error) {
 }
 
 // Init initializes an image object based on given path.
+//
+// The image is opened once in read-only mode and its header is read once
+// for all registered formats, the image is re-opened only if a format
+// requires write access, as opening and reading an image is costly on
+// network filesystems.
 func Init(path string, writable bool) (*Image, error) {
 	sylog.Debugf("Image format detection")
 
@@ -230,6 +253,23 @@ func Init(path string, writable bool) (*Image, error) {
 		Name: filepath.Base(resolvedPath),
 	}
 
+	img.File, err = os.OpenFile(resolvedPath, os.O_RDONLY, 0)
+	if err != nil {
+		return nil, ErrUnknownFormat
+	}
+	openMode := os.O_RDONLY
+
+	fileinfo, err := img.File.Stat()
+	if err != nil {
+		_ = img.File.Close()
+		return nil, err
+	}
+	if !fileinfo.IsDir() {
+		if header, err := img.readHeader(); err == nil {
+			img.header = header
+		}
+	}
+
 	for _, rf := range registeredFormats {
 		sylog.Debugf("Check for %s image format", rf.name)
 
@@ -245,20 +285,21 @@ func Init(path string, writable bool) (*Image, error) {
 			}
 		}
 
-		img.File, err = os.OpenFile(resolvedPath, mode, 0)
-		if err != nil {
-			continue
-		}
-		fileinfo, err := img.File.Stat()
-		if err != nil {
+		// a file opened in read-write mode is also suitable for
+		// formats opened in read-only mode
+		if mode != openMode && openMode == os.O_RDONLY {
+			f, err := os.OpenFile(resolvedPath, mode, 0)
+			if err != nil {
+				continue
+			}
 			_ = img.File.Close()
-			return nil, err
+			img.File = f
+			openMode = mode
 		}
 
 		err = rf.format.initializer(img, fileinfo)
 		if _, ok := err.(debugError); ok {
 			sylog.Debugf("%s format initializer returned: %v", rf.name, err)
-			_ = img.File.Close()
 			continue
 		} else if err != nil {
 			_ = img.File.Close()
@@ -273,8 +314,11 @@ func Init(path string, writable bool) (*Image, error) {
 
 		img.Source = fmt.Sprintf("/proc/self/fd/%d", img.File.Fd())
 		img.Fd = img.File.Fd()
+		img.header = nil
 
 		return img, nil
 	}
+
+	_ = img.File.Close()
 	return nil, ErrUnknownFormat
 }
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -17,7 +17,9 @@ import (
 	"path/filepath"
 	"strconv"
 	"strings"
+	"syscall"
 	"testing"
+	"unsafe"
 
 	"github.com/sylabs/singularity/internal/pkg/buildcfg"
 	"github.com/sylabs/singularity/internal/pkg/test"
@@ -473,3 +475,101 @@ func TestAuthorizedGroup(t *testing.T) {
 		})
 	}
 }
+
+// inotifyCounter counts the opens and reads of a file between two calls
+// of count with an inotify watch. Close events are watched too as inotify
+// merges identical consecutive events.
+type inotifyCounter struct {
+	fd  int
+	buf []byte
+}
+
+func newInotifyCounter(path string) (*inotifyCounter, error) {
+	fd, err := syscall.InotifyInit1(syscall.IN_CLOEXEC | syscall.IN_NONBLOCK)
+	if err != nil {
+		return nil, err
+	}
+	if _, err := syscall.InotifyAddWatch(fd, path, syscall.IN_OPEN|syscall.IN_ACCESS|syscall.IN_CLOSE); err != nil {
+		syscall.Close(fd)
+		return nil, err
+	}
+	return &inotifyCounter{fd: fd, buf: make([]byte, 64*syscall.SizeofInotifyEvent)}, nil
+}
+
+func (c *inotifyCounter) count() (opens, reads int) {
+	for {
+		n, err := syscall.Read(c.fd, c.buf)
+		if err != nil || n <= 0 {
+			return opens, reads
+		}
+		for off := 0; off+syscall.SizeofInotifyEvent <= n; {
+			e := (*syscall.InotifyEvent)(unsafe.Pointer(&c.buf[off]))
+			if e.Mask&syscall.IN_OPEN != 0 {
+				opens++
+			}
+			if e.Mask&syscall.IN_ACCESS != 0 {
+				reads++
+			}
+			off += syscall.SizeofInotifyEvent + int(e.Len)
+		}
+	}
+}
+
+func (c *inotifyCounter) close() {
+	syscall.Close(c.fd)
+}
+
+// BenchmarkInit measures the image format detection and reports the
+// number of open and read system calls done on the image per Init call,
+// an image in an unknown format is probed by all registered formats.
+func BenchmarkInit(b *testing.B) {
+	dir, err := ioutil.TempDir("", "image-init-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	unknown := filepath.Join(dir, "unknown.img")
+	if err := ioutil.WriteFile(unknown, make([]byte, 4096), 0644); err != nil {
+		b.Fatal(err)
+	}
+
+	images := []struct {
+		name    string
+		path    string
+		wantErr bool
+	}{
+		{"sandbox", dir, false},
+		{"squashfs", "./testdata/squashfs.v4", false},
+		{"unknown", unknown, true},
+	}
+
+	for _, im := range images {
+		b.Run(im.name, func(b *testing.B) {
+			c, err := newInotifyCounter(im.path)
+			if err != nil {
+				b.Skipf("inotify not available: %s", err)
+			}
+			defer c.close()
+
+			opens, reads := 0, 0
+			for i := 0; i < b.N; i++ {
+				img, err := Init(im.path, false)
+				if (err != nil) != im.wantErr {
+					b.Fatalf("unexpected error: %v", err)
+				}
+				if img != nil {
+					img.File.Close()
+				}
+
+				b.StopTimer()
+				o, r := c.count()
+				opens += o
+				reads += r
+				b.StartTimer()
+			}
+			b.ReportMetric(float64(opens)/float64(b.N), "opens/op")
+			b.ReportMetric(float64(reads)/float64(b.N), "reads/op")
+		})
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -47,9 +47,9 @@ func (f *sifFormat) initializer(img *Image, fi os.FileInfo) error {
 	if fi.IsDir() {
 		return debugError("not a sif file image")
 	}
-	b := make([]byte, bufferSize)
-	if n, err := img.File.Read(b); err != nil || n != bufferSize {
-		return debugErrorf("can't read first %d bytes: %v", bufferSize, err)
+	b, err := img.readHeader()
+	if err != nil {
+		return err
 	}
 	if !bytes.Contains(b, []byte(sif.HdrMagic)) {
 		return debugError("SIF magic not found")
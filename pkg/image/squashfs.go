@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -136,9 +136,9 @@ func (f *squashfsFormat) initializer(img *Image, fileinfo os.FileInfo) error {
 	if fileinfo.IsDir() {
 		return debugError("not a squashfs image")
 	}
-	b := make([]byte, bufferSize)
-	if n, err := img.File.Read(b); err != nil || n != bufferSize {
-		return debugErrorf("can't read first %d bytes: %v", bufferSize, err)
+	b, err := img.readHeader()
+	if err != nil {
+		return err
 	}
 	offset, err := CheckSquashfsHeader(b)
 	if err != nil {
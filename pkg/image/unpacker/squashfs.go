@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -12,6 +12,9 @@ import (
 	"os"
 	"os/exec"
 	"path/filepath"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/pkg/util/fs/squashfs"
 )
 
 // Squashfs represents a squashfs unpacker.
@@ -32,6 +35,16 @@ func (s *Squashfs) HasUnsquashfs() bool {
 }
 
 func (s *Squashfs) extract(files []string, reader io.Reader, dest string) error {
+	// extract in-process when the archive can be read at random
+	// offsets, this avoids staging a temporary copy of the archive
+	if ra, ok := reader.(io.ReaderAt); ok {
+		r, err := squashfs.NewReader(ra)
+		if err == nil {
+			return r.Extract(files, dest)
+		}
+		sylog.Debugf("Falling back to unsquashfs: %s", err)
+	}
+
 	if !s.HasUnsquashfs() {
 		return fmt.Errorf("could not extract squashfs data, unsquashfs not found")
 	}
@@ -7,7 +7,9 @@ package unpacker
 
 import (
 	"bufio"
+	"io"
 	"io/ioutil"
+	"math"
 	"os"
 	"os/exec"
 	"path/filepath"
@@ -30,6 +32,12 @@ func createArchive(t *testing.T) *os.File {
 	return f
 }
 
+// readerOnly hides the io.ReaderAt interface of the archive
+// to force extraction with unsquashfs.
+func readerOnly(f *os.File) io.Reader {
+	return bufio.NewReader(io.NewSectionReader(f, 0, math.MaxInt64))
+}
+
 func isExist(path string) bool {
 	_, err := os.Stat(path)
 	return !os.IsNotExist(err)
@@ -56,15 +64,25 @@ func TestSquashfs(t *testing.T) {
 
 	// test with an empty unsquashfs path
 	s.UnsquashfsPath = ""
-	if err := s.ExtractAll(archive, dir); err == nil {
+	if err := s.ExtractAll(readerOnly(archive), dir); err == nil {
 		t.Errorf("unexpected success with empty unsquashfs path")
 	}
 	// test with a bad unsquashfs path
 	s.UnsquashfsPath = "/unsquashfs-no-exists"
-	if err := s.ExtractAll(archive, dir); err == nil {
+	if err := s.ExtractAll(readerOnly(archive), dir); err == nil {
 		t.Errorf("unexpected success with bad unsquashfs path")
 	}
 
+	// in-process extraction doesn't require unsquashfs
+	if err := s.ExtractFiles([]string{"squashfs.go"}, archive, dir); err != nil {
+		t.Error(err)
+	}
+	path := filepath.Join(dir, "squashfs.go")
+	if !isExist(path) {
+		t.Errorf("extraction failed, %s is missing", path)
+	}
+	os.Remove(path)
+
 	s.UnsquashfsPath = savedPath
 
 	// extract all into temporary folder
@@ -73,7 +91,7 @@ func TestSquashfs(t *testing.T) {
 	}
 
 	// check if squashfs.go was extracted
-	path := filepath.Join(dir, "squashfs.go")
+	path = filepath.Join(dir, "squashfs.go")
 	if !isExist(path) {
 		t.Errorf("extraction failed, %s is missing", path)
 	}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -13,6 +13,7 @@ import (
 	"sort"
 	"strconv"
 	"strings"
+	"sync"
 	"time"
 
 	"golang.org/x/sys/unix"
@@ -430,6 +431,14 @@ func (m *Setup) SetEnvPath(envPath string) {
 	m.envPath = envPath
 }
 
+// setNetNS sets the network namespace path passed to CNI plugins.
+func (m *Setup) setNetNS(netNS string) {
+	m.netNS = netNS
+	for _, rc := range m.runtimeConf {
+		rc.NetNS = netNS
+	}
+}
+
 // AddNetworks brings up networks interface in container
 func (m *Setup) AddNetworks(ctx context.Context) error {
 	return m.command(ctx, "ADD")
@@ -440,6 +449,48 @@ func (m *Setup) DelNetworks(ctx context.Context) error {
 	return m.command(ctx, "DEL")
 }
 
+// concurrently runs fn for each network configuration index, indexes
+// of networks with the same name are passed sequentially in order as
+// their plugins share the same IPAM state. It returns the error returned
+// by fn for each index.
+func (m *Setup) concurrently(fn func(i int) error) []error {
+	errs := make([]error, len(m.networkConfList))
+	groups := make(map[string][]int)
+	names := make([]string, 0, len(m.networkConfList))
+
+	for i, conf := range m.networkConfList {
+		if _, ok := groups[conf.Name]; !ok {
+			names = append(names, conf.Name)
+		}
+		groups[conf.Name] = append(groups[conf.Name], i)
+	}
+
+	var wg sync.WaitGroup
+
+	for _, name := range names {
+		wg.Add(1)
+		go func(indexes []int) {
+			defer wg.Done()
+			for _, i := range indexes {
+				errs[i] = fn(i)
+			}
+		}(groups[name])
+	}
+	wg.Wait()
+
+	return errs
+}
+
+// firstError returns the first non nil error of errs.
+func firstError(errs []error) error {
+	for _, err := range errs {
+		if err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
 func (m *Setup) command(ctx context.Context, command string) error {
 	if m.envPath != "" {
 		backupEnv := os.Environ()
@@ -455,25 +506,29 @@ func (m *Setup) command(ctx context.Context, command string) error {
 	ctx, cancel := context.WithTimeout(ctx, 5*time.Second)
 	defer cancel()
 
+	// plugin chains of distinct networks are independent and run
+	// concurrently
 	if command == "ADD" {
 		m.result = make([]types.Result, len(m.networkConfList))
-		for i := 0; i < len(m.networkConfList); i++ {
-			var err error
-			if m.result[i], err = config.AddNetworkList(ctx, m.networkConfList[i], m.runtimeConf[i]); err != nil {
-				for j := i - 1; j >= 0; j-- {
-					if err := config.DelNetworkList(ctx, m.networkConfList[j], m.runtimeConf[j]); err != nil {
-						return err
-					}
+		errs := m.concurrently(func(i int) (err error) {
+			m.result[i], err = config.AddNetworkList(ctx, m.networkConfList[i], m.runtimeConf[i])
+			return err
+		})
+		if err := firstError(errs); err != nil {
+			// tear down networks successfully added
+			m.concurrently(func(i int) error {
+				if errs[i] != nil {
+					return nil
 				}
-				return err
-			}
+				return config.DelNetworkList(ctx, m.networkConfList[i], m.runtimeConf[i])
+			})
+			return err
 		}
 	} else if command == "DEL" {
-		for i := 0; i < len(m.networkConfList); i++ {
-			if err := config.DelNetworkList(ctx, m.networkConfList[i], m.runtimeConf[i]); err != nil {
-				return err
-			}
-		}
+		errs := m.concurrently(func(i int) error {
+			return config.DelNetworkList(ctx, m.networkConfList[i], m.runtimeConf[i])
+		})
+		return firstError(errs)
 	}
 	return nil
 }
@@ -0,0 +1,537 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package network
+
+import (
+	"context"
+	"crypto/rand"
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"runtime"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"syscall"
+	"unsafe"
+
+	"github.com/containernetworking/cni/libcni"
+	"github.com/containernetworking/cni/pkg/types"
+	"github.com/containernetworking/cni/pkg/types/current"
+	"golang.org/x/sys/unix"
+)
+
+const (
+	poolFillLock   = ".fill"
+	poolEntryLock  = "lock"
+	poolEntryNs    = "ns"
+	poolEntrySetup = "setup.json"
+	poolEntryUsed  = "used"
+
+	nsfsMagic = 0x6e736673
+)
+
+// NsPool is a directory of network namespaces configured in advance for
+// a list of networks, a container joins one of them in place of creating
+// its network namespace and running the CNI plugins at startup.
+//
+// Each pool entry is a network namespace bound in the entry directory of
+// the host mount namespace along with the CNI results of its networks. A
+// container claims an entry by holding the exclusive lock of the entry for
+// its lifetime, the entry is marked as used once joined and is torn down
+// by the container cleanup, network namespaces are never reused. The
+// entries of containers which didn't clean up are torn down by the next
+// pool fill.
+type NsPool struct {
+	// Dir is the root-owned pool directory.
+	Dir string
+	// Size is the number of entries kept available for a list of
+	// networks.
+	Size int
+	// NsFd is a file descriptor referencing the host mount namespace
+	// where network namespaces are bound, the current mount namespace
+	// is used if NsFd is 0.
+	NsFd int
+
+	wg      sync.WaitGroup
+	mu      sync.Mutex
+	err     error
+	stopped int32
+}
+
+// poolSetup is the content of the setup file of a pool entry.
+type poolSetup struct {
+	ContainerID string            `json:"containerID"`
+	Results     []*current.Result `json:"results"`
+}
+
+// PoolKey identifies a list of networks by the names and the content of
+// their configuration, any modification of the CNI configuration changes
+// the key. It returns an empty key if the networks can't be pooled, only
+// bridge and ptp networks are pooled.
+func PoolKey(networks []string, cniPath *CNIPath) (string, error) {
+	if cniPath == nil || cniPath.Conf == "" {
+		return "", ErrNoCNIConfig
+	}
+	if len(networks) == 0 {
+		return "", nil
+	}
+
+	h := sha256.New()
+
+	for _, network := range networks {
+		conf, err := libcni.LoadConfList(cniPath.Conf, network)
+		if err != nil {
+			return "", err
+		}
+		if len(conf.Plugins) == 0 {
+			return "", nil
+		}
+		switch conf.Plugins[0].Network.Type {
+		case "bridge", "ptp":
+		default:
+			return "", nil
+		}
+		fmt.Fprintf(h, "%s:%d:", conf.Name, len(conf.Bytes))
+		h.Write(conf.Bytes)
+	}
+	return hex.EncodeToString(h.Sum(nil))[:32], nil
+}
+
+// tryLock opens path and takes its exclusive lock, it returns -1 if the
+// lock is held by another process.
+func tryLock(path string) (int, error) {
+	fd, err := syscall.Open(path, syscall.O_RDONLY|syscall.O_CLOEXEC, 0)
+	if err != nil {
+		return -1, err
+	}
+	if err := syscall.Flock(fd, syscall.LOCK_EX|syscall.LOCK_NB); err == syscall.EWOULDBLOCK {
+		syscall.Close(fd)
+		return -1, nil
+	} else if err != nil {
+		syscall.Close(fd)
+		return -1, err
+	}
+	return fd, nil
+}
+
+// isNsfs returns whether path is a bound namespace.
+func isNsfs(path string) bool {
+	var st unix.Statfs_t
+
+	if err := unix.Statfs(path, &st); err != nil {
+		return false
+	}
+	return st.Type == nsfsMagic
+}
+
+// available returns whether the pool entry can be claimed, it's called
+// with the entry lock held.
+func available(entry string) bool {
+	if _, err := os.Stat(filepath.Join(entry, poolEntryUsed)); !os.IsNotExist(err) {
+		return false
+	}
+	if _, err := os.Stat(filepath.Join(entry, poolEntrySetup)); err != nil {
+		return false
+	}
+	return isNsfs(filepath.Join(entry, poolEntryNs))
+}
+
+// entries returns the entry directories of the pool key, directories of
+// entries being created start with a dot.
+func (p *NsPool) entries(key string) ([]string, error) {
+	dir := filepath.Join(p.Dir, key)
+
+	list, err := ioutil.ReadDir(dir)
+	if os.IsNotExist(err) {
+		return nil, nil
+	} else if err != nil {
+		return nil, fmt.Errorf("while reading network namespace pool: %s", err)
+	}
+
+	entries := make([]string, 0, len(list))
+	for _, fi := range list {
+		if fi.IsDir() {
+			entries = append(entries, filepath.Join(dir, fi.Name()))
+		}
+	}
+	return entries, nil
+}
+
+// Claim takes an available entry of the pool key and returns the path of
+// its network namespace and the file descriptor holding the entry lock,
+// the lock must be held until the entry is released. It returns an empty
+// path if the pool has no available entry. Claim doesn't require any
+// privileges.
+func (p *NsPool) Claim(key string) (string, int, error) {
+	entries, err := p.entries(key)
+	if err != nil {
+		return "", -1, err
+	}
+	for _, entry := range entries {
+		if strings.HasPrefix(filepath.Base(entry), ".") {
+			continue
+		}
+		fd, err := tryLock(filepath.Join(entry, poolEntryLock))
+		if err != nil || fd < 0 {
+			continue
+		}
+		if available(entry) {
+			return filepath.Join(entry, poolEntryNs), fd, nil
+		}
+		syscall.Close(fd)
+	}
+	return "", -1, nil
+}
+
+// Restore returns the network setup of the pool entry joined by the
+// container, nsPath references the network namespace of the container.
+// The entry is marked as used.
+func (p *NsPool) Restore(entry string, networks []string, nsPath string, cniPath *CNIPath) (*Setup, error) {
+	if filepath.Dir(filepath.Dir(entry)) != filepath.Clean(p.Dir) {
+		return nil, fmt.Errorf("%s is not a network namespace pool entry", entry)
+	}
+
+	b, err := ioutil.ReadFile(filepath.Join(entry, poolEntrySetup))
+	if err != nil {
+		return nil, fmt.Errorf("while reading pooled network setup: %s", err)
+	}
+	ps := new(poolSetup)
+	if err := json.Unmarshal(b, ps); err != nil {
+		return nil, fmt.Errorf("while decoding pooled network setup: %s", err)
+	}
+	if len(ps.Results) != len(networks) {
+		return nil, fmt.Errorf("pooled network setup doesn't match requested networks")
+	}
+
+	setup, err := NewSetup(networks, ps.ContainerID, nsPath, cniPath)
+	if err != nil {
+		return nil, err
+	}
+	setup.result = make([]types.Result, len(ps.Results))
+	for i, res := range ps.Results {
+		setup.result[i] = res
+	}
+
+	f, err := os.OpenFile(filepath.Join(entry, poolEntryUsed), os.O_CREATE|os.O_RDONLY, 0600)
+	if err != nil {
+		return nil, fmt.Errorf("while marking network namespace pool entry as used: %s", err)
+	}
+	f.Close()
+
+	return setup, nil
+}
+
+// Release tears down the network setup of the pool entry and removes the
+// entry, the entry lock must be held by the caller.
+func (p *NsPool) Release(ctx context.Context, setup *Setup, entry string) error {
+	fd, err := p.openNetNS(filepath.Join(entry, poolEntryNs))
+	if err != nil {
+		p.remove(entry)
+		return err
+	}
+	setup.setNetNS(fmt.Sprintf("/proc/%d/fd/%d", os.Getpid(), fd))
+	err = setup.DelNetworks(ctx)
+	syscall.Close(fd)
+
+	if rerr := p.remove(entry); err == nil {
+		err = rerr
+	}
+	return err
+}
+
+// Fill adds entries to the pool key from a goroutine until the pool has
+// Size available entries or Stop is called, Wait returns once the fills
+// return. Networks are configured with the CNI plugin search path envPath.
+func (p *NsPool) Fill(key string, networks []string, cniPath *CNIPath, envPath string) {
+	p.wg.Add(1)
+
+	go func() {
+		defer p.wg.Done()
+
+		if err := p.fill(key, networks, cniPath, envPath); err != nil {
+			p.mu.Lock()
+			p.err = err
+			p.mu.Unlock()
+		}
+	}()
+}
+
+// Stop makes the pool fills started by Fill return once the entry being
+// added is configured, the remaining entries are added by the next fill.
+// An entry can't be interrupted without leaking the resources allocated
+// by the CNI plugins.
+func (p *NsPool) Stop() {
+	atomic.StoreInt32(&p.stopped, 1)
+}
+
+// Wait waits until the pool fills started by Fill return and returns the
+// last fill error.
+func (p *NsPool) Wait() error {
+	p.wg.Wait()
+
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	return p.err
+}
+
+func (p *NsPool) fill(key string, networks []string, cniPath *CNIPath, envPath string) error {
+	dir := filepath.Join(p.Dir, key)
+
+	if err := mkdirAll(dir); err != nil {
+		return err
+	}
+
+	lockPath := filepath.Join(dir, poolFillLock)
+	if err := createFile(lockPath); err != nil {
+		return err
+	}
+	// a pool key is filled by one process at a time
+	fd, err := tryLock(lockPath)
+	if err != nil {
+		return fmt.Errorf("while locking network namespace pool: %s", err)
+	} else if fd < 0 {
+		return nil
+	}
+	defer syscall.Close(fd)
+
+	entries, err := p.entries(key)
+	if err != nil {
+		return err
+	}
+
+	count := 0
+	for _, entry := range entries {
+		// entries being created are left by an interrupted fill
+		if strings.HasPrefix(filepath.Base(entry), ".") {
+			p.remove(entry)
+			continue
+		}
+		fd, err := tryLock(filepath.Join(entry, poolEntryLock))
+		if err != nil || fd < 0 {
+			continue
+		}
+		if available(entry) {
+			count++
+		} else {
+			// used entry of a container which didn't clean up
+			p.reap(entry, networks, cniPath, envPath)
+		}
+		syscall.Close(fd)
+	}
+
+	for ; count < p.Size && atomic.LoadInt32(&p.stopped) == 0; count++ {
+		if err := p.add(dir, networks, cniPath, envPath); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// add creates a pool entry in dir.
+func (p *NsPool) add(dir string, networks []string, cniPath *CNIPath, envPath string) error {
+	b := make([]byte, 8)
+	if _, err := rand.Read(b); err != nil {
+		return fmt.Errorf("while generating network namespace pool entry ID: %s", err)
+	}
+	id := hex.EncodeToString(b)
+
+	tmp := filepath.Join(dir, "."+id)
+	if err := mkdirAll(tmp); err != nil {
+		return err
+	}
+	for _, name := range []string{poolEntryLock, poolEntryNs} {
+		if err := createFile(filepath.Join(tmp, name)); err != nil {
+			p.remove(tmp)
+			return err
+		}
+	}
+
+	fd, err := p.newNetNS(filepath.Join(tmp, poolEntryNs))
+	if err != nil {
+		p.remove(tmp)
+		return err
+	}
+	defer syscall.Close(fd)
+
+	nsPath := fmt.Sprintf("/proc/%d/fd/%d", os.Getpid(), fd)
+	setup, err := NewSetup(networks, "netns-pool-"+id, nsPath, cniPath)
+	if err != nil {
+		p.remove(tmp)
+		return err
+	}
+	setup.SetEnvPath(envPath)
+
+	if err := setup.AddNetworks(context.Background()); err != nil {
+		p.remove(tmp)
+		return err
+	}
+
+	ps := &poolSetup{
+		ContainerID: setup.containerID,
+		Results:     make([]*current.Result, len(setup.result)),
+	}
+	for i, res := range setup.result {
+		if ps.Results[i], err = current.NewResultFromResult(res); err != nil {
+			break
+		}
+	}
+	if err == nil {
+		var b []byte
+		if b, err = json.Marshal(ps); err == nil {
+			err = ioutil.WriteFile(filepath.Join(tmp, poolEntrySetup), b, 0600)
+		}
+	}
+	if err == nil {
+		err = os.Rename(tmp, filepath.Join(dir, id))
+	}
+	if err != nil {
+		setup.DelNetworks(context.Background())
+		p.remove(tmp)
+		return fmt.Errorf("while adding network namespace pool entry: %s", err)
+	}
+	return nil
+}
+
+// reap tears down a used pool entry left by a container which didn't
+// clean up, it's called with the entry lock held.
+func (p *NsPool) reap(entry string, networks []string, cniPath *CNIPath, envPath string) {
+	b, err := ioutil.ReadFile(filepath.Join(entry, poolEntrySetup))
+	if err == nil {
+		ps := new(poolSetup)
+		if err := json.Unmarshal(b, ps); err == nil {
+			if setup, err := NewSetup(networks, ps.ContainerID, "", cniPath); err == nil {
+				setup.SetEnvPath(envPath)
+				p.Release(context.Background(), setup, entry)
+				return
+			}
+		}
+	}
+	p.remove(entry)
+}
+
+// remove unbinds the network namespace of the pool entry and removes the
+// entry directory.
+func (p *NsPool) remove(entry string) error {
+	err := p.inHostNamespace(func() error {
+		err := unix.Unmount(filepath.Join(entry, poolEntryNs), unix.MNT_DETACH)
+		if err != nil && err != unix.EINVAL && err != unix.ENOENT {
+			return fmt.Errorf("while unbinding pooled network namespace: %s", err)
+		}
+		return nil
+	})
+	if err != nil {
+		return err
+	}
+	return os.RemoveAll(entry)
+}
+
+// openNetNS opens the pooled network namespace bound at path.
+func (p *NsPool) openNetNS(path string) (int, error) {
+	fd := -1
+
+	err := p.inHostNamespace(func() (err error) {
+		if !isNsfs(path) {
+			return fmt.Errorf("%s is not a network namespace", path)
+		}
+		fd, err = syscall.Open(path, syscall.O_RDONLY|syscall.O_CLOEXEC, 0)
+		return err
+	})
+	return fd, err
+}
+
+// newNetNS creates a network namespace with the loopback interface up,
+// binds it at path and returns a file descriptor referencing it.
+func (p *NsPool) newNetNS(path string) (int, error) {
+	fd := -1
+
+	err := p.inHostNamespace(func() error {
+		if err := unix.Unshare(unix.CLONE_NEWNET); err != nil {
+			return fmt.Errorf("while creating network namespace: %s", err)
+		}
+		if err := loopbackUp(); err != nil {
+			return err
+		}
+		self := fmt.Sprintf("/proc/self/task/%d/ns/net", unix.Gettid())
+		if err := unix.Mount(self, path, "", unix.MS_BIND, ""); err != nil {
+			return fmt.Errorf("while binding network namespace: %s", err)
+		}
+		var err error
+		fd, err = syscall.Open(self, syscall.O_RDONLY|syscall.O_CLOEXEC, 0)
+		return err
+	})
+	return fd, err
+}
+
+// inHostNamespace runs fn on a dedicated thread joining the host mount
+// namespace, the thread is destroyed once fn returns by keeping it locked
+// as fn may change its namespaces.
+func (p *NsPool) inHostNamespace(fn func() error) error {
+	errCh := make(chan error, 1)
+
+	go func() {
+		runtime.LockOSThread()
+
+		if p.NsFd > 0 {
+			if err := unix.Unshare(unix.CLONE_FS); err != nil {
+				errCh <- fmt.Errorf("while unsharing file system information: %s", err)
+				return
+			}
+			if err := unix.Setns(p.NsFd, unix.CLONE_NEWNS); err != nil {
+				errCh <- fmt.Errorf("while joining host mount namespace: %s", err)
+				return
+			}
+		}
+		errCh <- fn()
+	}()
+
+	return <-errCh
+}
+
+// loopbackUp brings up the loopback interface of the current network
+// namespace.
+func loopbackUp() error {
+	fd, err := unix.Socket(unix.AF_INET, unix.SOCK_DGRAM|unix.SOCK_CLOEXEC, 0)
+	if err != nil {
+		return fmt.Errorf("while creating socket: %s", err)
+	}
+	defer unix.Close(fd)
+
+	// struct ifreq with the interface name followed by its flags
+	var req [40]byte
+	copy(req[:unix.IFNAMSIZ], "lo")
+	*(*uint16)(unsafe.Pointer(&req[unix.IFNAMSIZ])) = unix.IFF_UP
+
+	_, _, errno := unix.Syscall(unix.SYS_IOCTL, uintptr(fd), unix.SIOCSIFFLAGS, uintptr(unsafe.Pointer(&req[0])))
+	if errno != 0 {
+		return fmt.Errorf("while bringing up loopback interface: %s", errno)
+	}
+	return nil
+}
+
+// mkdirAll creates the directory path accessible by root only, the pool
+// is only used by root containers and a user able to lock the pool
+// entries would prevent their claim.
+func mkdirAll(path string) error {
+	if err := os.MkdirAll(path, 0700); err != nil {
+		return fmt.Errorf("while creating network namespace pool directory: %s", err)
+	}
+	return os.Chmod(path, 0700)
+}
+
+// createFile creates the file path accessible by root only.
+func createFile(path string) error {
+	f, err := os.OpenFile(path, os.O_CREATE|os.O_RDONLY, 0600)
+	if err != nil {
+		return fmt.Errorf("while creating %s: %s", path, err)
+	}
+	defer f.Close()
+	return f.Chmod(0600)
+}
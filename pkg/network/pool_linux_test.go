@@ -0,0 +1,218 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// +build integration_test
+
+package network
+
+import (
+	"context"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"strings"
+	"syscall"
+	"testing"
+
+	"github.com/sylabs/singularity/internal/pkg/test"
+)
+
+// bundledConfFiles are the network configurations shipped in etc/network
+// which can be pooled.
+var bundledConfFiles = []string{"00_bridge.conflist", "10_ptp.conflist"}
+
+// bundledCNIPath returns a CNI path with the bundled bridge and ptp network
+// configurations and a cleanup function.
+func bundledCNIPath(t testing.TB) (*CNIPath, func()) {
+	dir, err := ioutil.TempDir("", "bundled_conf_")
+	if err != nil {
+		t.Fatal(err)
+	}
+	for _, file := range bundledConfFiles {
+		b, err := ioutil.ReadFile(filepath.Join("..", "..", "etc", "network", file))
+		if err == nil {
+			err = ioutil.WriteFile(filepath.Join(dir, file), b, 0644)
+		}
+		if err != nil {
+			os.RemoveAll(dir)
+			t.Fatal(err)
+		}
+	}
+	return &CNIPath{Conf: dir, Plugin: defaultCNIPluginPath}, func() { os.RemoveAll(dir) }
+}
+
+// testNetNS creates a network namespace standing for the network namespace
+// of a container and returns its path and a cleanup function.
+func testNetNS(t testing.TB, dir string) (string, func()) {
+	p := &NsPool{}
+	path := filepath.Join(dir, "netns")
+
+	if err := createFile(path); err != nil {
+		t.Fatal(err)
+	}
+	fd, err := p.newNetNS(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	return fmt.Sprintf("/proc/%d/fd/%d", os.Getpid(), fd), func() {
+		syscall.Close(fd)
+		syscall.Unmount(path, syscall.MNT_DETACH)
+		os.Remove(path)
+	}
+}
+
+func TestNsPool(t *testing.T) {
+	test.EnsurePrivilege(t)
+
+	cniPath, cleanup := bundledCNIPath(t)
+	defer cleanup()
+
+	dir, err := ioutil.TempDir("", "netns_pool_")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	if key, err := PoolKey([]string{"bridge", "ptp"}, cniPath); err != nil || key == "" {
+		t.Fatalf("unexpected pool key %q for bridge and ptp networks: %v", key, err)
+	}
+	if key, _ := PoolKey(testNetworks[:1], &CNIPath{Conf: defaultCNIConfPath}); key != "" {
+		t.Errorf("unexpected pool key for network %s", testNetworks[0])
+	}
+
+	networks := []string{"ptp"}
+	key, err := PoolKey(networks, cniPath)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	p := &NsPool{Dir: filepath.Join(dir, "pool"), Size: 1}
+	if nsPath, _, err := p.Claim(key); err != nil || nsPath != "" {
+		t.Fatalf("unexpected entry %q claimed from empty pool: %v", nsPath, err)
+	}
+
+	p.Fill(key, networks, cniPath, "/bin:/sbin:/usr/bin:/usr/sbin")
+	if err := p.Wait(); err != nil {
+		t.Fatalf("unexpected error while filling pool: %s", err)
+	}
+
+	nsPath, fd, err := p.Claim(key)
+	if err != nil || nsPath == "" {
+		t.Fatalf("unexpected error while claiming pool entry: %v", err)
+	}
+	defer syscall.Close(fd)
+
+	if other, _, _ := p.Claim(key); other != "" {
+		t.Errorf("unexpected entry %q claimed twice", other)
+	}
+
+	entry := filepath.Dir(nsPath)
+	setup, err := p.Restore(entry, networks, nsPath, cniPath)
+	if err != nil {
+		t.Fatalf("unexpected error while restoring pooled network setup: %s", err)
+	}
+	ip, err := setup.GetNetworkIP("ptp", "4")
+	if err != nil {
+		t.Errorf("unexpected error while getting IP of pooled network: %s", err)
+	} else if !strings.HasPrefix(ip.String(), "10.23.") {
+		t.Errorf("unexpected IP %s for ptp network", ip)
+	}
+
+	setup.SetEnvPath("/bin:/sbin:/usr/bin:/usr/sbin")
+	if err := p.Release(context.Background(), setup, entry); err != nil {
+		t.Errorf("unexpected error while releasing pool entry: %s", err)
+	}
+	if _, err := os.Stat(entry); !os.IsNotExist(err) {
+		t.Errorf("pool entry %s not removed", entry)
+	}
+
+	// a stopped pool isn't filled anymore
+	p.Stop()
+	p.Fill(key, networks, cniPath, "/bin:/sbin:/usr/bin:/usr/sbin")
+	if err := p.Wait(); err != nil {
+		t.Fatalf("unexpected error while filling stopped pool: %s", err)
+	}
+	if nsPath, _, err := p.Claim(key); err != nil || nsPath != "" {
+		t.Errorf("unexpected entry %q claimed from stopped pool: %v", nsPath, err)
+	}
+}
+
+// BenchmarkNetworkSetup measures the network setup latency of a container
+// with the bundled network configurations, either by running the CNI
+// plugins of one or two networks or by restoring the setup of a network
+// namespace configured in advance from the pool.
+func BenchmarkNetworkSetup(b *testing.B) {
+	const envPath = "/bin:/sbin:/usr/bin:/usr/sbin"
+
+	cniPath, cleanup := bundledCNIPath(b)
+	defer cleanup()
+
+	dir, err := ioutil.TempDir("", "netns_bench_")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	for _, networks := range [][]string{{"bridge"}, {"bridge", "ptp"}} {
+		b.Run(strings.Join(networks, "+"), func(b *testing.B) {
+			nsPath, cleanup := testNetNS(b, dir)
+			defer cleanup()
+
+			for i := 0; i < b.N; i++ {
+				setup, err := NewSetup(networks, "", nsPath, cniPath)
+				if err != nil {
+					b.Fatal(err)
+				}
+				setup.SetEnvPath(envPath)
+				if err := setup.AddNetworks(context.Background()); err != nil {
+					b.Fatal(err)
+				}
+
+				b.StopTimer()
+				if err := setup.DelNetworks(context.Background()); err != nil {
+					b.Fatal(err)
+				}
+				b.StartTimer()
+			}
+		})
+	}
+
+	b.Run("pool", func(b *testing.B) {
+		networks := []string{"bridge"}
+		key, err := PoolKey(networks, cniPath)
+		if err != nil {
+			b.Fatal(err)
+		}
+		p := &NsPool{Dir: filepath.Join(dir, "pool"), Size: 1}
+
+		for i := 0; i < b.N; i++ {
+			b.StopTimer()
+			p.Fill(key, networks, cniPath, envPath)
+			if err := p.Wait(); err != nil {
+				b.Fatal(err)
+			}
+			b.StartTimer()
+
+			nsPath, fd, err := p.Claim(key)
+			if err != nil || nsPath == "" {
+				b.Fatalf("no pool entry claimed: %v", err)
+			}
+			entry := filepath.Dir(nsPath)
+			setup, err := p.Restore(entry, networks, nsPath, cniPath)
+			if err != nil {
+				b.Fatal(err)
+			}
+
+			b.StopTimer()
+			setup.SetEnvPath(envPath)
+			if err := p.Release(context.Background(), setup, entry); err != nil {
+				b.Fatal(err)
+			}
+			syscall.Close(fd)
+			b.StartTimer()
+		}
+	})
+}
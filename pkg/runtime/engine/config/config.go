@@ -1,10 +1,12 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
 
 package config
 
+//go:generate "${GO_TOOL}" run settergen/gen.go
+
 // Common provides the basis for all engine configs. Anything that can not be
 // properly described through the OCI config can be stored as a generic JSON []byte.
 type Common struct {
@@ -17,7 +19,8 @@ type Common struct {
 // EngineConfig is a generic interface to represent the implementations of an EngineConfig.
 type EngineConfig interface{}
 
-// FileConfig describes the singularity.conf file options
+// FileConfig describes the singularity.conf file options, the directive
+// table in setters.go must be regenerated after any change of its fields.
 type FileConfig struct {
 	AllowSetuid             bool     `default:"yes" authorized:"yes,no" directive:"allow setuid"`
 	AllowPidNs              bool     `default:"yes" authorized:"yes,no" directive:"allow pid ns"`
@@ -41,6 +44,8 @@ type FileConfig struct {
 	AlwaysUseNv             bool     `default:"no" authorized:"yes,no" directive:"always use nv"`
 	AlwaysUseRocm           bool     `default:"no" authorized:"yes,no" directive:"always use rocm"`
 	SharedLoopDevices       bool     `default:"no" authorized:"yes,no" directive:"shared loop devices"`
+	SharedImageMounts       bool     `default:"no" authorized:"yes,no" directive:"shared image mounts"`
+	SharedInstanceMonitor   bool     `default:"no" authorized:"yes,no" directive:"shared instance monitor"`
 	MaxLoopDevices          uint     `default:"256" directive:"max loop devices"`
 	SessiondirMaxSize       uint     `default:"16" directive:"sessiondir max size"`
 	MountDev                string   `default:"yes" authorized:"yes,no,minimal" directive:"mount dev"`
@@ -53,6 +58,7 @@ type FileConfig struct {
 	MemoryFSType            string   `default:"tmpfs" authorized:"tmpfs,ramfs" directive:"memory fs type"`
 	CniConfPath             string   `directive:"cni configuration path"`
 	CniPluginPath           string   `directive:"cni plugin path"`
+	NetnsPoolSize           uint     `default:"0" directive:"network namespace pool size"`
 	MksquashfsPath          string   `directive:"mksquashfs path"`
 	CryptsetupPath          string   `directive:"cryptsetup path"`
 }
@@ -295,6 +301,17 @@ memory fs type = {{ .MemoryFSType }}
 # Defines path from where CNI executable plugins are stored
 #cni plugin path =
 {{ if ne .CniPluginPath "" }}cni plugin path = {{ .CniPluginPath }}{{ end }}
+
+# NETWORK NAMESPACE POOL SIZE: [INT]
+# DEFAULT: 0
+# Number of network namespaces configured in advance for each combination
+# of bridge and ptp networks requested with --net, a privileged container
+# joins one of them instead of running the CNI plugins at startup. Pooled
+# network namespaces hold an IP address of their networks while unused and
+# are never reused once joined. Containers requesting network arguments
+# configure their own network namespace. Set to 0 to disable the pool
+network namespace pool size = {{ .NetnsPoolSize }}
+
 # MKSQUASHFS PATH: [STRING]
 # DEFAULT: Undefined
 # This allows the administrator to specify the location for mksquashfs if it is not
@@ -314,4 +331,22 @@ memory fs type = {{ .MemoryFSType }}
 # Allow to share same images associated with loop devices to minimize loop
 # usage and optimize kernel cache (useful for MPI)
 shared loop devices = {{ if eq .SharedLoopDevices true }}yes{{ else }}no{{ end }}
+
+# SHARED IMAGE MOUNTS: [BOOL]
+# DEFAULT: no
+# Allow containers running on this node to share the read-only mount of
+# identical squashfs images instead of mounting them once per container,
+# minimizing loop devices, mounts and page cache usage when many containers
+# are started from the same image (useful for MPI). The shared mounts are
+# created in the pool directory of the host and require "mount slave = yes"
+shared image mounts = {{ if eq .SharedImageMounts true }}yes{{ else }}no{{ end }}
+
+# SHARED INSTANCE MONITOR: [BOOL]
+# DEFAULT: no
+# Allow instances started without the setuid workflow to be monitored by a
+# single process per user instead of one process per instance, minimizing
+# the memory and processes used by many instances. The first instance of a
+# user started on this node keeps monitoring the instances started after
+# it until all of them are stopped. Requires Linux 5.3 or later
+shared instance monitor = {{ if eq .SharedInstanceMonitor true }}yes{{ else }}no{{ end }}
 `
@@ -0,0 +1,98 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package config
+
+import (
+	"bytes"
+	"encoding/binary"
+	"encoding/json"
+	"fmt"
+)
+
+// The binary engine configuration passed to starter starts with a fixed
+// header, see cmd/starter/c/include/starter.h: the magic, the format
+// version and the little-endian 64 bits size of the configuration
+// following the header.
+const (
+	engineConfigMagic   = "SYEC"
+	engineConfigVersion = 1
+	// EngineConfigHeaderSize is the size of the binary engine
+	// configuration header.
+	EngineConfigHeaderSize = len(engineConfigMagic) + 1 + 8
+)
+
+// MarshalBinary encodes c into the versioned and length-prefixed binary
+// format passed to starter. The engine name and the container ID are
+// stored before the engine specific configuration, so that they can be
+// decoded without decoding the engine configuration which is JSON encoded.
+func (c *Common) MarshalBinary() ([]byte, error) {
+	engineConfig, err := json.Marshal(c.EngineConfig)
+	if err != nil {
+		return nil, err
+	}
+
+	size := EngineConfigHeaderSize + 3*binary.MaxVarintLen64
+	size += len(c.EngineName) + len(c.ContainerID) + len(engineConfig)
+
+	b := make([]byte, EngineConfigHeaderSize, size)
+	copy(b, engineConfigMagic)
+	b[len(engineConfigMagic)] = engineConfigVersion
+	b = appendString(b, c.EngineName)
+	b = appendString(b, c.ContainerID)
+	b = appendUvarint(b, uint64(len(engineConfig)))
+	b = append(b, engineConfig...)
+	binary.LittleEndian.PutUint64(b[len(engineConfigMagic)+1:], uint64(len(b)-EngineConfigHeaderSize))
+
+	return b, nil
+}
+
+// UnmarshalBinaryHeader decodes the engine name and the container ID of
+// the binary configuration b into c, the engine specific configuration
+// is returned undecoded for UnmarshalEngineConfig.
+func (c *Common) UnmarshalBinaryHeader(b []byte) ([]byte, error) {
+	if len(b) < EngineConfigHeaderSize || !bytes.HasPrefix(b, []byte(engineConfigMagic)) {
+		return nil, fmt.Errorf("bad engine configuration format")
+	}
+	if v := b[len(engineConfigMagic)]; v != engineConfigVersion {
+		return nil, fmt.Errorf("unsupported engine configuration version %d", v)
+	}
+	size := binary.LittleEndian.Uint64(b[len(engineConfigMagic)+1:])
+	if size != uint64(len(b)-EngineConfigHeaderSize) {
+		return nil, fmt.Errorf("engine configuration size mismatch: %d bytes instead of %d", len(b)-EngineConfigHeaderSize, size)
+	}
+
+	r := &binaryReader{b: b[EngineConfigHeaderSize:]}
+	name := r.string()
+	id := r.string()
+	engineConfig := r.bytes()
+	if r.err == nil && len(r.b) > 0 {
+		r.err = fmt.Errorf("trailing data in engine configuration")
+	}
+	if r.err != nil {
+		return nil, fmt.Errorf("while decoding engine configuration: %s", r.err)
+	}
+
+	c.EngineName = name
+	c.ContainerID = id
+	return engineConfig, nil
+}
+
+// UnmarshalEngineConfig decodes the engine specific configuration returned
+// by UnmarshalBinaryHeader into c.EngineConfig, which is expected to hold a
+// pointer to the zero value of the engine configuration.
+func (c *Common) UnmarshalEngineConfig(engineConfig []byte) error {
+	return json.Unmarshal(engineConfig, &c.EngineConfig)
+}
+
+// UnmarshalBinary decodes the binary configuration b returned by
+// MarshalBinary into c.
+func (c *Common) UnmarshalBinary(b []byte) error {
+	engineConfig, err := c.UnmarshalBinaryHeader(b)
+	if err != nil {
+		return err
+	}
+	return c.UnmarshalEngineConfig(engineConfig)
+}
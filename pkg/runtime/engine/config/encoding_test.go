@@ -0,0 +1,164 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package config
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"fmt"
+	"reflect"
+	"testing"
+)
+
+type testMount struct {
+	Source      string   `json:"source"`
+	Destination string   `json:"destination"`
+	Options     []string `json:"options"`
+}
+
+type testEngineConfig struct {
+	Args   []string          `json:"args"`
+	Env    []string          `json:"env"`
+	Mounts []testMount       `json:"mounts"`
+	Labels map[string]string `json:"labels"`
+}
+
+// newTestCommon returns a configuration of the size of a launch with many
+// binds and environment variables.
+func newTestCommon(binds, env int) *Common {
+	ec := &testEngineConfig{
+		Args:   []string{"/bin/true"},
+		Labels: map[string]string{"org.label-schema.schema-version": "1.0"},
+	}
+	for i := 0; i < binds; i++ {
+		ec.Mounts = append(ec.Mounts, testMount{
+			Source:      fmt.Sprintf("/scratch/project/data-%d", i),
+			Destination: fmt.Sprintf("/data-%d", i),
+			Options:     []string{"rbind", "nosuid", "nodev", "ro"},
+		})
+	}
+	for i := 0; i < env; i++ {
+		ec.Env = append(ec.Env, fmt.Sprintf("VARIABLE_%d=value of the variable %d", i, i))
+	}
+	return &Common{
+		EngineName:   "singularity",
+		ContainerID:  "test",
+		EngineConfig: ec,
+	}
+}
+
+func TestEngineConfigEncoding(t *testing.T) {
+	c := newTestCommon(4, 4)
+
+	b, err := c.MarshalBinary()
+	if err != nil {
+		t.Fatalf("unexpected error while encoding config: %s", err)
+	}
+
+	decoded := &Common{EngineConfig: new(testEngineConfig)}
+	if err := decoded.UnmarshalBinary(b); err != nil {
+		t.Fatalf("unexpected error while decoding config: %s", err)
+	}
+	if !reflect.DeepEqual(decoded, c) {
+		t.Errorf("decoded config doesn't match: %+v", decoded)
+	}
+
+	// the header alone is decoded without touching the engine configuration
+	header := new(Common)
+	ec, err := header.UnmarshalBinaryHeader(b)
+	if err != nil {
+		t.Fatalf("unexpected error while decoding header: %s", err)
+	}
+	if header.EngineName != c.EngineName || header.ContainerID != c.ContainerID || header.EngineConfig != nil {
+		t.Errorf("unexpected header %+v", header)
+	}
+	if raw, _ := json.Marshal(c.EngineConfig); string(raw) != string(ec) {
+		t.Errorf("unexpected engine configuration %s", ec)
+	}
+
+	badVersion := append([]byte(nil), b...)
+	badVersion[len(engineConfigMagic)]++
+	badSize := append([]byte(nil), b...)
+	binary.LittleEndian.PutUint64(badSize[len(engineConfigMagic)+1:], uint64(len(b)))
+	trailing := append(append([]byte(nil), b...), 0)
+	binary.LittleEndian.PutUint64(trailing[len(engineConfigMagic)+1:], uint64(len(b)+1-EngineConfigHeaderSize))
+
+	tests := []struct {
+		name string
+		data []byte
+	}{
+		{"empty", nil},
+		{"json", []byte(`{"engineName":"singularity"}`)},
+		{"bad version", badVersion},
+		{"bad size", badSize},
+		{"truncated", b[:len(b)-1]},
+		{"trailing data", trailing},
+	}
+	for _, tt := range tests {
+		if _, err := new(Common).UnmarshalBinaryHeader(tt.data); err == nil {
+			t.Errorf("unexpected success with %s configuration", tt.name)
+		}
+	}
+}
+
+// BenchmarkEngineConfigDecode compares the configuration decoding done by
+// each stage of starter. Stage 1, stage 2 and the master process decode
+// the whole configuration while the RPC server only needs the engine name.
+func BenchmarkEngineConfigDecode(b *testing.B) {
+	c := newTestCommon(256, 512)
+
+	jsonData, err := json.Marshal(c)
+	if err != nil {
+		b.Fatal(err)
+	}
+	binaryData, err := c.MarshalBinary()
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	// the previous JSON configuration was decoded twice, once to get the
+	// engine name and once for the whole configuration
+	decodeJSON := func() error {
+		name := struct {
+			EngineName string `json:"engineName"`
+		}{}
+		if err := json.Unmarshal(jsonData, &name); err != nil {
+			return err
+		}
+		common := &Common{EngineConfig: new(testEngineConfig)}
+		return json.Unmarshal(jsonData, common)
+	}
+
+	b.Run(fmt.Sprintf("json/stage/%dB", len(jsonData)), func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			if err := decodeJSON(); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+	b.Run(fmt.Sprintf("binary/stage/%dB", len(binaryData)), func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			common := &Common{EngineConfig: new(testEngineConfig)}
+			if err := common.UnmarshalBinary(binaryData); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+	b.Run("json/rpc-server", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			if err := decodeJSON(); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+	b.Run("binary/rpc-server", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			if _, err := new(Common).UnmarshalBinaryHeader(binaryData); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -10,7 +10,6 @@ import (
 	"io"
 	"io/ioutil"
 	"os"
-	"reflect"
 	"regexp"
 	"strconv"
 	"strings"
@@ -50,19 +49,85 @@ func GetDirectives(reader io.Reader) (Directives, error) {
 	return directives, nil
 }
 
+// directive describes a FileConfig field set by a configuration
+// directive, the table of directives is generated from the FileConfig
+// struct tags by settergen.
+type directive struct {
+	name         string
+	defaultValue string
+	authorized   []string
+	// field returns a pointer to the field of c
+	field func(c *FileConfig) interface{}
+}
+
+// set sets the field of config with value.
+func (d *directive) set(config *FileConfig, value []string) error {
+	switch f := d.field(config).(type) {
+	case *bool:
+		if len(value) == 0 {
+			value = []string{""}
+		}
+		if !d.isAuthorized(value[0]) {
+			return fmt.Errorf("value authorized for directive %q are %s", d.name, d.authorized)
+		}
+		*f = value[0] == "yes"
+	case *int:
+		if len(value) == 0 {
+			return fmt.Errorf("no value for directive %q", d.name)
+		}
+		n, err := strconv.ParseInt(value[0], 0, 64)
+		if err != nil {
+			return err
+		}
+		*f = int(n)
+	case *uint:
+		if len(value) == 0 {
+			return fmt.Errorf("no value for directive %q", d.name)
+		}
+		n, err := strconv.ParseUint(value[0], 0, 64)
+		if err != nil {
+			return err
+		}
+		*f = uint(n)
+	case *string:
+		if len(value) == 0 {
+			value = []string{""}
+		}
+		if value[0] != "" && !d.isAuthorized(value[0]) {
+			return fmt.Errorf("value authorized for directive '%s' are %s", d.name, d.authorized)
+		}
+		*f = value[0]
+	case *[]string:
+		*f = make([]string, len(value))
+		for i, val := range value {
+			(*f)[i] = strings.TrimSpace(val)
+		}
+	default:
+		return fmt.Errorf("unsupported type %T for directive %q", f, d.name)
+	}
+	return nil
+}
+
+func (d *directive) isAuthorized(value string) bool {
+	if len(d.authorized) == 0 {
+		return true
+	}
+	for _, a := range d.authorized {
+		if a == value {
+			return true
+		}
+	}
+	return false
+}
+
 // HasDirective returns if the directive is present or not.
 func HasDirective(directive string) bool {
 	if directive == "" {
 		return false
 	}
 
-	config := new(FileConfig)
-	elem := reflect.ValueOf(config).Elem()
-
-	for i := 0; i < elem.NumField(); i++ {
-		typeField := elem.Type().Field(i)
-
-		if typeField.Tag.Get("directive") == directive {
+	for _, d := range fileDirectives {
+		if d.name == directive {
 			return true
 		}
 	}
@@ -75,92 +140,24 @@ func HasDirective(directive string) bool {
 func GetConfig(directives Directives) (*FileConfig, error) {
 	config := new(FileConfig)
 
-	elem := reflect.ValueOf(config).Elem()
-
-	// Iterate over the fields of f and handle each type
-	for i := 0; i < elem.NumField(); i++ {
-		valueField := elem.Field(i)
-		typeField := elem.Type().Field(i)
-
-		dir, ok := typeField.Tag.Lookup("directive")
-		if !ok {
-			return nil, fmt.Errorf("no directive tag found for field %q", typeField.Name)
-		}
-
-		defaultValue := ""
-		if v, ok := typeField.Tag.Lookup("default"); ok {
-			defaultValue = v
-		}
-
-		authorized := []string{}
-		if v, ok := typeField.Tag.Lookup("authorized"); ok {
-			authorized = strings.Split(v, ",")
-		}
+	for i := range fileDirectives {
+		d := &fileDirectives[i]
 
 		value := []string{}
-		if len(directives[dir]) > 0 {
-			for _, dv := range directives[dir] {
+		if len(directives[d.name]) > 0 {
+			for _, dv := range directives[d.name] {
 				if dv != "" {
 					value = append(value, strings.Split(dv, ",")...)
 				}
 			}
 		} else {
-			if defaultValue != "" {
-				value = append(value, strings.Split(defaultValue, ",")...)
+			if d.defaultValue != "" {
+				value = append(value, strings.Split(d.defaultValue, ",")...)
 			}
 		}
 
-		switch typeField.Type.Kind() {
-		case reflect.Bool:
-			found := false
-			for _, a := range authorized {
-				if a == value[0] {
-					found = true
-					break
-				}
-			}
-			if !found && len(authorized) > 0 {
-				return nil, fmt.Errorf("value authorized for directive %q are %s", dir, authorized)
-			}
-			valueField.SetBool(value[0] == "yes")
-		case reflect.Int, reflect.Int8, reflect.Int16, reflect.Int32, reflect.Int64:
-			n, err := strconv.ParseInt(value[0], 0, 64)
-			if err != nil {
-				return nil, err
-			}
-			valueField.SetInt(n)
-		case reflect.Uint, reflect.Uint8, reflect.Uint16, reflect.Uint32, reflect.Uint64:
-			n, err := strconv.ParseUint(value[0], 0, 64)
-			if err != nil {
-				return nil, err
-			}
-			valueField.SetUint(n)
-		case reflect.String:
-			if len(value) == 0 {
-				value = []string{""}
-			}
-			found := false
-			for _, a := range authorized {
-				if a == value[0] {
-					found = true
-					break
-				}
-			}
-			if !found && len(authorized) > 0 && value[0] != "" {
-				return nil, fmt.Errorf("value authorized for directive '%s' are %s", dir, authorized)
-			}
-			valueField.SetString(value[0])
-		case reflect.Slice:
-			l := len(value)
-			v := reflect.MakeSlice(typeField.Type, l, l)
-			valueField.Set(v)
-
-			switch t := valueField.Interface().(type) {
-			case []string:
-				for i, val := range value {
-					t[i] = strings.TrimSpace(val)
-				}
-			}
+		if err := d.set(config, value); err != nil {
+			return nil, err
 		}
 	}
 
@@ -168,6 +165,11 @@ func GetConfig(directives Directives) (*FileConfig, error) {
 }
 
 // ParseFile parses configuration file with the specified path.
+//
+// A configuration file owned by root is compiled into a binary snapshot
+// stored along it by the first parse run as root, the following parses
+// restore the configuration from the snapshot as long as the file inode,
+// size and modification time are unchanged.
 func ParseFile(filepath string) (*FileConfig, error) {
 	if filepath == "" {
 		// grab the default configuration
@@ -180,12 +182,29 @@ func ParseFile(filepath string) (*FileConfig, error) {
 	}
 	defer c.Close()
 
+	key, rootOwned := rootSnapshotKey(c)
+	if rootOwned {
+		if config, err := readSnapshot(filepath, key); err == nil {
+			return config, nil
+		}
+	}
+
 	directives, err := GetDirectives(c)
 	if err != nil {
 		return nil, fmt.Errorf("while parsing data: %s", err)
 	}
 
-	return GetConfig(directives)
+	config, err := GetConfig(directives)
+	if err != nil {
+		return nil, err
+	}
+
+	// a failure is not fatal, the file is parsed again next time
+	if rootOwned && os.Geteuid() == 0 {
+		writeSnapshot(filepath, key, config)
+	}
+
+	return config, nil
 }
 
 // Generate executes the default template asset on FileConfig object if
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -11,6 +11,7 @@ import (
 	"io/ioutil"
 	"os"
 	"reflect"
+	"strings"
 	"testing"
 )
 
@@ -32,6 +33,7 @@ func TestParser(t *testing.T) {
 	}
 	configFile := f.Name()
 	defer os.Remove(configFile)
+	defer os.Remove(snapshotPath(configFile))
 
 	defaultConfig, err := GetConfig(nil)
 	if err != nil {
@@ -148,3 +150,37 @@ func TestHasDirective(t *testing.T) {
 		t.Errorf("'fake directive' should not be present")
 	}
 }
+
+// TestDirectives ensures the generated directive table matches the
+// FileConfig struct tags, it must be regenerated otherwise.
+func TestDirectives(t *testing.T) {
+	typ := reflect.TypeOf(FileConfig{})
+
+	if len(fileDirectives) != typ.NumField() {
+		t.Fatalf("%d directives for %d fields, setters.go must be regenerated", len(fileDirectives), typ.NumField())
+	}
+
+	config := new(FileConfig)
+	elem := reflect.ValueOf(config).Elem()
+
+	for i, d := range fileDirectives {
+		f := typ.Field(i)
+
+		if d.name != f.Tag.Get("directive") {
+			t.Errorf("directive %q instead of %q for field %s", d.name, f.Tag.Get("directive"), f.Name)
+		}
+		if d.defaultValue != f.Tag.Get("default") {
+			t.Errorf("default value %q instead of %q for field %s", d.defaultValue, f.Tag.Get("default"), f.Name)
+		}
+		var authorized []string
+		if v, ok := f.Tag.Lookup("authorized"); ok {
+			authorized = strings.Split(v, ",")
+		}
+		if !reflect.DeepEqual(d.authorized, authorized) {
+			t.Errorf("authorized values %v instead of %v for field %s", d.authorized, authorized, f.Name)
+		}
+		if d.field(config) != elem.Field(i).Addr().Interface() {
+			t.Errorf("directive %q doesn't set field %s", d.name, f.Name)
+		}
+	}
+}
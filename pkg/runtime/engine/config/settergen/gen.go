@@ -0,0 +1,140 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// settergen generates the directive table of the FileConfig fields
+// from their struct tags, the parser uses it to set the fields without
+// reflection.
+package main
+
+import (
+	"bytes"
+	"fmt"
+	"go/ast"
+	"go/format"
+	"go/parser"
+	"go/token"
+	"io/ioutil"
+	"os"
+	"reflect"
+	"strconv"
+	"strings"
+	"text/template"
+)
+
+// supported field types, they must be handled by the type switches of
+// directive.set and of the snapshot encoding in the config package
+var supportedTypes = map[string]bool{
+	"bool":     true,
+	"int":      true,
+	"uint":     true,
+	"string":   true,
+	"[]string": true,
+}
+
+type field struct {
+	Name       string
+	Directive  string
+	Default    string
+	Authorized []string
+}
+
+var tmpl = template.Must(template.New("setters").Funcs(template.FuncMap{
+	"quote": strconv.Quote,
+}).Parse(`// Code generated by settergen/gen.go; DO NOT EDIT.
+
+package config
+
+// fileDirectives lists the FileConfig fields with their directive name,
+// default value and authorized values, in the FileConfig declaration order.
+var fileDirectives = []directive{
+{{- range . }}
+	{
+		name:         {{ quote .Directive }},
+		defaultValue: {{ quote .Default }},
+		{{- if .Authorized }}
+		authorized:   []string{ {{- range $i, $a := .Authorized }}{{ if $i }}, {{ end }}{{ quote $a }}{{ end -}} },
+		{{- end }}
+		field:        func(c *FileConfig) interface{} { return &c.{{ .Name }} },
+	},
+{{- end }}
+}
+`))
+
+func fields(src, typeName string) ([]field, error) {
+	fset := token.NewFileSet()
+	f, err := parser.ParseFile(fset, src, nil, 0)
+	if err != nil {
+		return nil, err
+	}
+
+	obj := f.Scope.Lookup(typeName)
+	if obj == nil {
+		return nil, fmt.Errorf("type %s not found in %s", typeName, src)
+	}
+	st, ok := obj.Decl.(*ast.TypeSpec).Type.(*ast.StructType)
+	if !ok {
+		return nil, fmt.Errorf("%s is not a struct", typeName)
+	}
+
+	var res []field
+	for _, fl := range st.Fields.List {
+		var typ bytes.Buffer
+		if err := format.Node(&typ, fset, fl.Type); err != nil {
+			return nil, err
+		}
+		if !supportedTypes[typ.String()] {
+			return nil, fmt.Errorf("unsupported type %s for field %s", typ.String(), fl.Names[0].Name)
+		}
+		if fl.Tag == nil {
+			return nil, fmt.Errorf("no directive tag found for field %q", fl.Names[0].Name)
+		}
+		tag, err := strconv.Unquote(fl.Tag.Value)
+		if err != nil {
+			return nil, err
+		}
+		st := reflect.StructTag(tag)
+
+		dir, ok := st.Lookup("directive")
+		if !ok {
+			return nil, fmt.Errorf("no directive tag found for field %q", fl.Names[0].Name)
+		}
+		var authorized []string
+		if v, ok := st.Lookup("authorized"); ok {
+			authorized = strings.Split(v, ",")
+		}
+		for _, n := range fl.Names {
+			res = append(res, field{
+				Name:       n.Name,
+				Directive:  dir,
+				Default:    st.Get("default"),
+				Authorized: authorized,
+			})
+		}
+	}
+	return res, nil
+}
+
+func main() {
+	fl, err := fields("config.go", "FileConfig")
+	if err != nil {
+		fmt.Fprintf(os.Stderr, "settergen: %s\n", err)
+		os.Exit(1)
+	}
+
+	var buf bytes.Buffer
+	if err := tmpl.Execute(&buf, fl); err != nil {
+		fmt.Fprintf(os.Stderr, "settergen: %s\n", err)
+		os.Exit(1)
+	}
+	src, err := format.Source(buf.Bytes())
+	if err != nil {
+		fmt.Fprintf(os.Stderr, "settergen: %s\n", err)
+		os.Exit(1)
+	}
+	if err := ioutil.WriteFile("setters.go", src, 0644); err != nil {
+		fmt.Fprintf(os.Stderr, "settergen: %s\n", err)
+		os.Exit(1)
+	}
+}
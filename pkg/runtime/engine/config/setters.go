@@ -0,0 +1,231 @@
+// Code generated by settergen/gen.go; DO NOT EDIT.
+
+package config
+
+// fileDirectives lists the FileConfig fields with their directive name,
+// default value and authorized values, in the FileConfig declaration order.
+var fileDirectives = []directive{
+	{
+		name:         "allow setuid",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.AllowSetuid },
+	},
+	{
+		name:         "allow pid ns",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.AllowPidNs },
+	},
+	{
+		name:         "config passwd",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.ConfigPasswd },
+	},
+	{
+		name:         "config group",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.ConfigGroup },
+	},
+	{
+		name:         "config resolv_conf",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.ConfigResolvConf },
+	},
+	{
+		name:         "mount proc",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.MountProc },
+	},
+	{
+		name:         "mount sys",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.MountSys },
+	},
+	{
+		name:         "mount devpts",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.MountDevPts },
+	},
+	{
+		name:         "mount home",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.MountHome },
+	},
+	{
+		name:         "mount tmp",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.MountTmp },
+	},
+	{
+		name:         "mount hostfs",
+		defaultValue: "no",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.MountHostfs },
+	},
+	{
+		name:         "user bind control",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.UserBindControl },
+	},
+	{
+		name:         "enable fusemount",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.EnableFusemount },
+	},
+	{
+		name:         "enable underlay",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.EnableUnderlay },
+	},
+	{
+		name:         "mount slave",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.MountSlave },
+	},
+	{
+		name:         "allow container squashfs",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.AllowContainerSquashfs },
+	},
+	{
+		name:         "allow container extfs",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.AllowContainerExtfs },
+	},
+	{
+		name:         "allow container dir",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.AllowContainerDir },
+	},
+	{
+		name:         "allow container encrypted",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.AllowContainerEncrypted },
+	},
+	{
+		name:         "always use nv",
+		defaultValue: "no",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.AlwaysUseNv },
+	},
+	{
+		name:         "always use rocm",
+		defaultValue: "no",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.AlwaysUseRocm },
+	},
+	{
+		name:         "shared loop devices",
+		defaultValue: "no",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.SharedLoopDevices },
+	},
+	{
+		name:         "shared image mounts",
+		defaultValue: "no",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.SharedImageMounts },
+	},
+	{
+		name:         "shared instance monitor",
+		defaultValue: "no",
+		authorized:   []string{"yes", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.SharedInstanceMonitor },
+	},
+	{
+		name:         "max loop devices",
+		defaultValue: "256",
+		field:        func(c *FileConfig) interface{} { return &c.MaxLoopDevices },
+	},
+	{
+		name:         "sessiondir max size",
+		defaultValue: "16",
+		field:        func(c *FileConfig) interface{} { return &c.SessiondirMaxSize },
+	},
+	{
+		name:         "mount dev",
+		defaultValue: "yes",
+		authorized:   []string{"yes", "no", "minimal"},
+		field:        func(c *FileConfig) interface{} { return &c.MountDev },
+	},
+	{
+		name:         "enable overlay",
+		defaultValue: "try",
+		authorized:   []string{"yes", "no", "try"},
+		field:        func(c *FileConfig) interface{} { return &c.EnableOverlay },
+	},
+	{
+		name:         "bind path",
+		defaultValue: "/etc/localtime,/etc/hosts",
+		field:        func(c *FileConfig) interface{} { return &c.BindPath },
+	},
+	{
+		name:         "limit container owners",
+		defaultValue: "",
+		field:        func(c *FileConfig) interface{} { return &c.LimitContainerOwners },
+	},
+	{
+		name:         "limit container groups",
+		defaultValue: "",
+		field:        func(c *FileConfig) interface{} { return &c.LimitContainerGroups },
+	},
+	{
+		name:         "limit container paths",
+		defaultValue: "",
+		field:        func(c *FileConfig) interface{} { return &c.LimitContainerPaths },
+	},
+	{
+		name:         "root default capabilities",
+		defaultValue: "full",
+		authorized:   []string{"full", "file", "no"},
+		field:        func(c *FileConfig) interface{} { return &c.RootDefaultCapabilities },
+	},
+	{
+		name:         "memory fs type",
+		defaultValue: "tmpfs",
+		authorized:   []string{"tmpfs", "ramfs"},
+		field:        func(c *FileConfig) interface{} { return &c.MemoryFSType },
+	},
+	{
+		name:         "cni configuration path",
+		defaultValue: "",
+		field:        func(c *FileConfig) interface{} { return &c.CniConfPath },
+	},
+	{
+		name:         "cni plugin path",
+		defaultValue: "",
+		field:        func(c *FileConfig) interface{} { return &c.CniPluginPath },
+	},
+	{
+		name:         "network namespace pool size",
+		defaultValue: "0",
+		field:        func(c *FileConfig) interface{} { return &c.NetnsPoolSize },
+	},
+	{
+		name:         "mksquashfs path",
+		defaultValue: "",
+		field:        func(c *FileConfig) interface{} { return &c.MksquashfsPath },
+	},
+	{
+		name:         "cryptsetup path",
+		defaultValue: "",
+		field:        func(c *FileConfig) interface{} { return &c.CryptsetupPath },
+	},
+}
@@ -0,0 +1,336 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package config
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"hash/crc32"
+	"io"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"syscall"
+)
+
+// snapshotMagic identifies a configuration snapshot, the version byte
+// must be bumped on any change of the encoding.
+var snapshotMagic = []byte("SCFG\x01")
+
+// snapshotSuffix is the suffix of the hidden file storing the snapshot of
+// a configuration file, along the configuration file.
+const snapshotSuffix = ".snapshot"
+
+// maxSnapshotSize bounds the size of a snapshot file.
+const maxSnapshotSize = 1 << 20
+
+const (
+	kindBool byte = iota + 1
+	kindInt
+	kindUint
+	kindString
+	kindStrings
+)
+
+func fieldKind(f interface{}) byte {
+	switch f.(type) {
+	case *bool:
+		return kindBool
+	case *int:
+		return kindInt
+	case *uint:
+		return kindUint
+	case *string:
+		return kindString
+	case *[]string:
+		return kindStrings
+	}
+	return 0
+}
+
+// snapshotSchema is a checksum of the directive table, a snapshot encoded
+// by a build with different fields is rejected.
+var snapshotSchema = func() uint32 {
+	h := crc32.NewIEEE()
+	c := new(FileConfig)
+	for _, d := range fileDirectives {
+		io.WriteString(h, d.name)
+		h.Write([]byte{0, fieldKind(d.field(c))})
+	}
+	return h.Sum32()
+}()
+
+// MarshalBinary encodes the configuration into a compact binary snapshot
+// restored with UnmarshalBinary, this is much cheaper than parsing the
+// configuration file again.
+func (c *FileConfig) MarshalBinary() ([]byte, error) {
+	b := make([]byte, 0, 512)
+	b = append(b, snapshotMagic...)
+	b = appendUvarint(b, uint64(snapshotSchema))
+
+	for _, d := range fileDirectives {
+		switch f := d.field(c).(type) {
+		case *bool:
+			if *f {
+				b = append(b, 1)
+			} else {
+				b = append(b, 0)
+			}
+		case *int:
+			b = appendVarint(b, int64(*f))
+		case *uint:
+			b = appendUvarint(b, uint64(*f))
+		case *string:
+			b = appendString(b, *f)
+		case *[]string:
+			b = appendUvarint(b, uint64(len(*f)))
+			for _, s := range *f {
+				b = appendString(b, s)
+			}
+		default:
+			return nil, fmt.Errorf("unsupported type %T for directive %q", f, d.name)
+		}
+	}
+	return b, nil
+}
+
+// UnmarshalBinary restores the configuration from a snapshot returned by
+// MarshalBinary, c is left untouched if the snapshot is invalid.
+func (c *FileConfig) UnmarshalBinary(data []byte) error {
+	if !bytes.HasPrefix(data, snapshotMagic) {
+		return fmt.Errorf("bad configuration snapshot magic")
+	}
+	r := &binaryReader{b: data[len(snapshotMagic):]}
+	if schema := r.uvarint(); r.err == nil && schema != uint64(snapshotSchema) {
+		return fmt.Errorf("configuration snapshot doesn't match the configuration fields")
+	}
+
+	config := new(FileConfig)
+	for _, d := range fileDirectives {
+		switch f := d.field(config).(type) {
+		case *bool:
+			*f = r.byte() == 1
+		case *int:
+			*f = int(r.varint())
+		case *uint:
+			*f = uint(r.uvarint())
+		case *string:
+			*f = r.string()
+		case *[]string:
+			n := r.uvarint()
+			if n > uint64(len(r.b)) {
+				r.fail()
+				break
+			}
+			*f = make([]string, n)
+			for i := range *f {
+				(*f)[i] = r.string()
+			}
+		default:
+			return fmt.Errorf("unsupported type %T for directive %q", f, d.name)
+		}
+	}
+	if r.err == nil && len(r.b) > 0 {
+		r.err = fmt.Errorf("trailing data in configuration snapshot")
+	}
+	if r.err != nil {
+		return r.err
+	}
+
+	*c = *config
+	return nil
+}
+
+func appendUvarint(b []byte, v uint64) []byte {
+	var buf [binary.MaxVarintLen64]byte
+	return append(b, buf[:binary.PutUvarint(buf[:], v)]...)
+}
+
+func appendVarint(b []byte, v int64) []byte {
+	var buf [binary.MaxVarintLen64]byte
+	return append(b, buf[:binary.PutVarint(buf[:], v)]...)
+}
+
+func appendString(b []byte, s string) []byte {
+	return append(appendUvarint(b, uint64(len(s))), s...)
+}
+
+// binaryReader decodes a snapshot or an engine configuration, the first
+// decoding error is recorded and the following reads return zero values.
+type binaryReader struct {
+	b   []byte
+	err error
+}
+
+func (r *binaryReader) fail() {
+	if r.err == nil {
+		r.err = fmt.Errorf("unexpected end of data")
+	}
+	r.b = nil
+}
+
+func (r *binaryReader) byte() byte {
+	if len(r.b) == 0 {
+		r.fail()
+		return 0
+	}
+	v := r.b[0]
+	r.b = r.b[1:]
+	return v
+}
+
+func (r *binaryReader) uvarint() uint64 {
+	v, n := binary.Uvarint(r.b)
+	if n <= 0 {
+		r.fail()
+		return 0
+	}
+	r.b = r.b[n:]
+	return v
+}
+
+func (r *binaryReader) varint() int64 {
+	v, n := binary.Varint(r.b)
+	if n <= 0 {
+		r.fail()
+		return 0
+	}
+	r.b = r.b[n:]
+	return v
+}
+
+func (r *binaryReader) bytes() []byte {
+	n := r.uvarint()
+	if n > uint64(len(r.b)) {
+		r.fail()
+		return nil
+	}
+	b := r.b[:n:n]
+	r.b = r.b[n:]
+	return b
+}
+
+func (r *binaryReader) string() string {
+	return string(r.bytes())
+}
+
+// snapshotKey identifies the version of a configuration file a snapshot
+// was compiled from, any modification of the file changes its change
+// time, which unlike the modification time can't be set back by user
+// space, a replacement changes its inode.
+type snapshotKey struct {
+	dev   uint64
+	ino   uint64
+	size  int64
+	mtime int64
+	ctime int64
+}
+
+func (k snapshotKey) append(b []byte) []byte {
+	b = appendUvarint(b, k.dev)
+	b = appendUvarint(b, k.ino)
+	b = appendVarint(b, k.size)
+	b = appendVarint(b, k.mtime)
+	return appendVarint(b, k.ctime)
+}
+
+// rootSnapshotKey returns the snapshot key of the opened configuration
+// file f, the returned boolean is false if the file is not owned by root,
+// snapshots are only used for configuration files owned by root.
+func rootSnapshotKey(f *os.File) (snapshotKey, bool) {
+	fi, err := f.Stat()
+	if err != nil {
+		return snapshotKey{}, false
+	}
+	st, ok := fi.Sys().(*syscall.Stat_t)
+	if !ok || st.Uid != 0 || !fi.Mode().IsRegular() {
+		return snapshotKey{}, false
+	}
+	return snapshotKey{
+		dev:   uint64(st.Dev),
+		ino:   st.Ino,
+		size:  fi.Size(),
+		mtime: fi.ModTime().UnixNano(),
+		ctime: st.Ctim.Nano(),
+	}, true
+}
+
+func snapshotPath(path string) string {
+	dir, name := filepath.Split(path)
+	return filepath.Join(dir, "."+name+snapshotSuffix)
+}
+
+// readSnapshot returns the configuration stored in the snapshot of the
+// configuration file at path if the snapshot was compiled from the file
+// version identified by key. The snapshot must be owned by root and
+// writable only by root.
+func readSnapshot(path string, key snapshotKey) (*FileConfig, error) {
+	f, err := os.Open(snapshotPath(path))
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	fi, err := f.Stat()
+	if err != nil {
+		return nil, err
+	}
+	st, ok := fi.Sys().(*syscall.Stat_t)
+	if !ok || st.Uid != 0 || fi.Mode()&0022 != 0 || !fi.Mode().IsRegular() {
+		return nil, fmt.Errorf("%s must be owned and only writable by root", f.Name())
+	}
+	if fi.Size() > maxSnapshotSize {
+		return nil, fmt.Errorf("%s is too large", f.Name())
+	}
+
+	b, err := ioutil.ReadAll(f)
+	if err != nil {
+		return nil, err
+	}
+	prefix := key.append(nil)
+	if !bytes.HasPrefix(b, prefix) {
+		return nil, fmt.Errorf("%s is outdated", f.Name())
+	}
+
+	config := new(FileConfig)
+	if err := config.UnmarshalBinary(b[len(prefix):]); err != nil {
+		return nil, err
+	}
+	return config, nil
+}
+
+// writeSnapshot stores the snapshot of config, compiled from the version
+// of the configuration file at path identified by key.
+func writeSnapshot(path string, key snapshotKey, config *FileConfig) error {
+	data, err := config.MarshalBinary()
+	if err != nil {
+		return err
+	}
+	b := append(key.append(nil), data...)
+
+	// write in a temporary file renamed once complete, concurrent
+	// readers only see a complete snapshot
+	dst := snapshotPath(path)
+	f, err := ioutil.TempFile(filepath.Dir(dst), filepath.Base(dst)+".")
+	if err != nil {
+		return err
+	}
+	_, err = f.Write(b)
+	if err == nil {
+		err = f.Chmod(0644)
+	}
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Rename(f.Name(), dst)
+	}
+	if err != nil {
+		os.Remove(f.Name())
+	}
+	return err
+}
@@ -0,0 +1,150 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package config
+
+import (
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"reflect"
+	"testing"
+	"time"
+
+	"github.com/sylabs/singularity/internal/pkg/test"
+)
+
+func TestSnapshot(t *testing.T) {
+	directives := Directives{
+		"max loop devices":       {"42"},
+		"mount dev":              {"minimal"},
+		"bind path":              {"/etc/hosts", "/opt,/srv"},
+		"limit container owners": {"root"},
+	}
+	config, err := GetConfig(directives)
+	if err != nil {
+		t.Fatalf("unexpected error while getting config: %s", err)
+	}
+
+	b, err := config.MarshalBinary()
+	if err != nil {
+		t.Fatalf("unexpected error while encoding config: %s", err)
+	}
+
+	restored := new(FileConfig)
+	if err := restored.UnmarshalBinary(b); err != nil {
+		t.Fatalf("unexpected error while decoding config: %s", err)
+	}
+	if !reflect.DeepEqual(restored, config) {
+		t.Errorf("restored config doesn't match: %+v", restored)
+	}
+
+	// any truncation or trailing data is rejected
+	for i := 0; i < len(b); i++ {
+		if err := restored.UnmarshalBinary(b[:i]); err == nil {
+			t.Fatalf("unexpected success with a snapshot truncated at %d bytes", i)
+		}
+	}
+	if err := restored.UnmarshalBinary(append(b, 0)); err == nil {
+		t.Errorf("unexpected success with trailing data")
+	}
+	if !reflect.DeepEqual(restored, config) {
+		t.Errorf("config modified by invalid snapshots")
+	}
+}
+
+func TestParseFileSnapshot(t *testing.T) {
+	test.EnsurePrivilege(t)
+
+	dir, err := ioutil.TempDir("", "config-snapshot-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	path := filepath.Join(dir, "singularity.conf")
+	if err := ioutil.WriteFile(path, []byte("max loop devices = 42\n"), 0644); err != nil {
+		t.Fatal(err)
+	}
+
+	config, err := ParseFile(path)
+	if err != nil {
+		t.Fatalf("unexpected error while parsing %s: %s", path, err)
+	}
+	if config.MaxLoopDevices != 42 {
+		t.Fatalf("bad value for MaxLoopDevices: %v", config.MaxLoopDevices)
+	}
+	if _, err := os.Stat(snapshotPath(path)); err != nil {
+		t.Fatalf("snapshot not written: %s", err)
+	}
+
+	// replace the snapshot content to check it's reused
+	f, err := os.Open(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	key, ok := rootSnapshotKey(f)
+	f.Close()
+	if !ok {
+		t.Fatalf("configuration file not owned by root")
+	}
+	config.MaxLoopDevices = 24
+	if err := writeSnapshot(path, key, config); err != nil {
+		t.Fatalf("unexpected error while writing snapshot: %s", err)
+	}
+
+	config, err = ParseFile(path)
+	if err != nil {
+		t.Fatalf("unexpected error while parsing %s: %s", path, err)
+	}
+	if config.MaxLoopDevices != 24 {
+		t.Errorf("snapshot not used")
+	}
+
+	// a modification of the configuration file invalidates the snapshot
+	mtime := time.Now().Add(time.Second)
+	if err := os.Chtimes(path, mtime, mtime); err != nil {
+		t.Fatal(err)
+	}
+	config, err = ParseFile(path)
+	if err != nil {
+		t.Fatalf("unexpected error while parsing %s: %s", path, err)
+	}
+	if config.MaxLoopDevices != 42 {
+		t.Errorf("outdated snapshot used")
+	}
+
+	// an in-place modification keeping the size and restoring the
+	// modification time invalidates the snapshot
+	fi, err := os.Stat(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if err := ioutil.WriteFile(path, []byte("max loop devices = 43\n"), 0644); err != nil {
+		t.Fatal(err)
+	}
+	if err := os.Chtimes(path, fi.ModTime(), fi.ModTime()); err != nil {
+		t.Fatal(err)
+	}
+	config, err = ParseFile(path)
+	if err != nil {
+		t.Fatalf("unexpected error while parsing %s: %s", path, err)
+	}
+	if config.MaxLoopDevices != 43 {
+		t.Errorf("outdated snapshot used after an in-place modification")
+	}
+
+	// a snapshot writable by other users is ignored
+	config.MaxLoopDevices = 24
+	if err := writeSnapshot(path, key, config); err != nil {
+		t.Fatalf("unexpected error while writing snapshot: %s", err)
+	}
+	if err := os.Chmod(snapshotPath(path), 0666); err != nil {
+		t.Fatal(err)
+	}
+	if _, err := readSnapshot(path, key); err == nil {
+		t.Errorf("unexpected success with a snapshot writable by others")
+	}
+}
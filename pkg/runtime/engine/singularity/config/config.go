@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -32,6 +32,7 @@ type JSONConfig struct {
 	LibrariesPath     []string      `json:"librariesPath,omitempty"`
 	ImageList         []image.Image `json:"imageList,omitempty"`
 	OpenFd            []int         `json:"openFd,omitempty"`
+	CacheLockFds      []int         `json:"cacheLockFds,omitempty"`
 	TargetGID         []int         `json:"targetGID,omitempty"`
 	Image             string        `json:"image"`
 	Workdir           string        `json:"workdir,omitempty"`
@@ -50,6 +51,7 @@ type JSONConfig struct {
 	SessionLayer      string        `json:"sessionLayer,omitempty"`
 	EncryptionKey     []byte        `json:"encryptionKey,omitempty"`
 	TargetUID         int           `json:"targetUID,omitempty"`
+	ExecAgentFd       int           `json:"execAgentFd,omitempty"`
 	WritableImage     bool          `json:"writableImage,omitempty"`
 	WritableTmpfs     bool          `json:"writableTmpfs,omitempty"`
 	Contain           bool          `json:"container,omitempty"`
@@ -260,6 +262,18 @@ func (e *EngineConfig) GetBootInstance() bool {
 	return e.JSON.BootInstance
 }
 
+// SetExecAgentFd sets the file descriptor of the listening socket
+// served by the instance exec agent.
+func (e *EngineConfig) SetExecAgentFd(fd int) {
+	e.JSON.ExecAgentFd = fd
+}
+
+// GetExecAgentFd returns the file descriptor of the listening socket
+// served by the instance exec agent, zero means no exec agent.
+func (e *EngineConfig) GetExecAgentFd() int {
+	return e.JSON.ExecAgentFd
+}
+
 // SetAddCaps sets bounding/effective/permitted/inheritable/ambient capabilities to add.
 func (e *EngineConfig) SetAddCaps(caps string) {
 	e.JSON.AddCaps = caps
@@ -400,6 +414,18 @@ func (e *EngineConfig) GetOpenFd() []int {
 	return e.JSON.OpenFd
 }
 
+// SetCacheLockFds sets the file descriptors of the lock files held on the
+// cache entries used by the container.
+func (e *EngineConfig) SetCacheLockFds(fds []int) {
+	e.JSON.CacheLockFds = fds
+}
+
+// GetCacheLockFds returns the file descriptors of the lock files held on
+// the cache entries used by the container.
+func (e *EngineConfig) GetCacheLockFds() []int {
+	return e.JSON.CacheLockFds
+}
+
 // SetWritableTmpfs sets writable tmpfs flag.
 func (e *EngineConfig) SetWritableTmpfs(writable bool) {
 	e.JSON.WritableTmpfs = writable
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -16,6 +16,8 @@ import (
 	"github.com/sylabs/singularity/internal/pkg/cgroups"
 	"github.com/sylabs/singularity/internal/pkg/runtime/engine/config/oci"
 	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"github.com/sylabs/singularity/internal/pkg/util/env"
+	"github.com/sylabs/singularity/internal/pkg/util/fs/pool"
 	"github.com/sylabs/singularity/pkg/network"
 	"github.com/sylabs/singularity/pkg/runtime/engine/config"
 )
@@ -29,6 +31,37 @@ type EngineConfig struct {
 	Cgroups   *cgroups.Manager           `json:"-"`
 	CryptDev  string                     `json:"-"`
 	Plugin    map[string]json.RawMessage `json:"plugin"` // Plugin is the raw JSON representation of the plugin configurations
+	// FileSnapshot is the binary snapshot of File parsed by stage 1, the
+	// following stages restore File from it with RestoreFile.
+	FileSnapshot []byte `json:"fileSnapshot,omitempty"`
+	// HostMountNsFd is the file descriptor of the host mount namespace
+	// opened by stage 1 when images are mounted in the shared mount pool
+	// or when the network namespace pool is used.
+	HostMountNsFd int `json:"hostMountNsFd,omitempty"`
+	// EclCacheKeys are the ECL verification cache keys of the images
+	// verified by stage 1, recorded by the master process.
+	EclCacheKeys []string `json:"eclCacheKeys,omitempty"`
+	// SharedMounts are the references on the shared mounts used by the
+	// container, released by the master process during cleanup.
+	SharedMounts []*pool.Ref `json:"-"`
+	// StaticEnv is the environment resolved at build time read from the
+	// container image, it's used by the exec action in place of sourcing
+	// the environment scripts.
+	StaticEnv *env.StaticEnv `json:"staticEnv,omitempty"`
+	// InstanceMonitor is set by stage 1 when the instance process can be
+	// handed off to the instance monitor of the user by the master process.
+	InstanceMonitor bool `json:"instanceMonitor,omitempty"`
+	// NetnsPoolEntry is the network namespace pool entry joined by the
+	// container, claimed by stage 1 with the lock file descriptor
+	// NetnsPoolFd held by the master process.
+	NetnsPoolEntry string `json:"netnsPoolEntry,omitempty"`
+	NetnsPoolFd    int    `json:"netnsPoolFd,omitempty"`
+	// NetnsPool is the network namespace pool filled by the master
+	// process.
+	NetnsPool *network.NsPool `json:"-"`
+	// Cgroup is the cgroup created by stage 1 with the cgroup v2 unified
+	// hierarchy, starter creates the container process into it.
+	Cgroup string `json:"cgroup,omitempty"`
 }
 
 // FuseInfo stores the FUSE-related information required or provided by
@@ -52,6 +85,31 @@ func NewConfig() *EngineConfig {
 	return ret
 }
 
+// SnapshotFile records the binary snapshot of File for the following
+// stages, it must be called by stage 1 once File is parsed.
+func (e *EngineConfig) SnapshotFile() error {
+	b, err := e.File.MarshalBinary()
+	if err != nil {
+		return err
+	}
+	e.FileSnapshot = b
+	return nil
+}
+
+// RestoreFile restores File from the snapshot recorded by stage 1, the
+// stages following stage 1 don't need to parse singularity.conf again.
+func (e *EngineConfig) RestoreFile() error {
+	if len(e.FileSnapshot) == 0 {
+		return errors.New("no configuration snapshot recorded by stage 1")
+	}
+	file := new(config.FileConfig)
+	if err := file.UnmarshalBinary(e.FileSnapshot); err != nil {
+		return err
+	}
+	e.File = file
+	return nil
+}
+
 // GetPluginConfig retrieves the configuration for the named plugin
 func (e *EngineConfig) GetPluginConfig(plugin string, cfg interface{}) error {
 	if tmp, found := e.Plugin[plugin]; found {
@@ -0,0 +1,180 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package signing
+
+import (
+	"bytes"
+	"crypto/sha512"
+	"encoding/binary"
+	"encoding/hex"
+	"fmt"
+	"io"
+	"runtime"
+	"strconv"
+	"sync"
+	"sync/atomic"
+
+	"github.com/sylabs/sif/pkg/sif"
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+)
+
+const (
+	// sifHashPrefix prefixes the SHA-384 digest of the concatenated
+	// data objects, computed sequentially.
+	sifHashPrefix = "SIFHASH:\n"
+	// sifTreeHashPrefix prefixes the block size and the root digest of
+	// the block digests of the data objects, computed in parallel.
+	sifTreeHashPrefix = "SIFHASH-TREE:\n"
+
+	// hashBlockSize is the size of the blocks hashed independently.
+	hashBlockSize = 4 << 20
+	// minHashBlockSize and maxHashBlockSize bound the block size read
+	// from a signature.
+	minHashBlockSize = 4 << 10
+	maxHashBlockSize = 32 << 20
+	// maxHashMemory bounds the memory used by the block buffers of the
+	// workers.
+	maxHashMemory = 256 << 20
+)
+
+// hashWorkers is the number of goroutines reading and hashing blocks.
+var hashWorkers = runtime.NumCPU()
+
+// computeLegacyHashStr generates the hash string of the data object(s) in
+// the format used by signatures created before block hashing.
+func computeLegacyHashStr(fimg *sif.FileImage, descr []*sif.Descriptor) string {
+	hash := sha512.New384()
+	for _, v := range descr {
+		hash.Write(v.GetData(fimg))
+	}
+	sum := hash.Sum(nil)
+
+	return fmt.Sprintf("%s%x", sifHashPrefix, sum)
+}
+
+// computeTreeHash returns the root digest of the data object(s). Each data
+// object is split in blocks of blockSize bytes hashed in parallel, the
+// root digest is the SHA-384 digest of the size and the block digests of
+// each data object.
+func computeTreeHash(r io.ReaderAt, descr []*sif.Descriptor, blockSize int64) ([]byte, error) {
+	type block struct {
+		offset int64
+		size   int64
+	}
+
+	var blocks []block
+	for _, d := range descr {
+		for off := int64(0); off < d.Filelen; off += blockSize {
+			size := d.Filelen - off
+			if size > blockSize {
+				size = blockSize
+			}
+			blocks = append(blocks, block{d.Fileoff + off, size})
+		}
+	}
+
+	digests := make([]byte, len(blocks)*sha512.Size384)
+
+	workers := hashWorkers
+	if workers > len(blocks) {
+		workers = len(blocks)
+	}
+	if limit := int(maxHashMemory / blockSize); workers > limit {
+		workers = limit
+	}
+
+	var wg sync.WaitGroup
+	var next int64 = -1
+	var once sync.Once
+	var readErr error
+
+	for w := 0; w < workers; w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+
+			buf := make([]byte, blockSize)
+			for {
+				i := atomic.AddInt64(&next, 1)
+				if i >= int64(len(blocks)) {
+					return
+				}
+				b := buf[:blocks[i].size]
+				if _, err := r.ReadAt(b, blocks[i].offset); err != nil {
+					once.Do(func() { readErr = err })
+					// stop the other workers
+					atomic.StoreInt64(&next, int64(len(blocks)))
+					return
+				}
+				sum := sha512.Sum384(b)
+				copy(digests[i*sha512.Size384:], sum[:])
+			}
+		}()
+	}
+	wg.Wait()
+
+	if readErr != nil {
+		return nil, fmt.Errorf("while reading data object: %s", readErr)
+	}
+
+	hash := sha512.New384()
+	size := make([]byte, 8)
+	for _, d := range descr {
+		n := (d.Filelen + blockSize - 1) / blockSize * sha512.Size384
+		binary.LittleEndian.PutUint64(size, uint64(d.Filelen))
+		hash.Write(size)
+		hash.Write(digests[:n])
+		digests = digests[n:]
+	}
+	return hash.Sum(nil), nil
+}
+
+// computeHashStr generates a hash from data object(s) and generates a string
+// to be stored in the signature block. The block hash format is only used
+// if blockHash is set, signatures in this format can't be verified by
+// versions prior to its introduction.
+func computeHashStr(fimg *sif.FileImage, descr []*sif.Descriptor, blockHash bool) (string, error) {
+	if !blockHash {
+		return computeLegacyHashStr(fimg, descr), nil
+	}
+	sum, err := computeTreeHash(fimg.Fp, descr, hashBlockSize)
+	if err != nil {
+		return "", err
+	}
+	return fmt.Sprintf("%s%d\n%x", sifTreeHashPrefix, hashBlockSize, sum), nil
+}
+
+// checkHashStr verifies the hash string of a signature block against the
+// data object(s), the hash is computed in the format of the hash string.
+func checkHashStr(fimg *sif.FileImage, descr []*sif.Descriptor, hashStr []byte) error {
+	hashStr = bytes.TrimRight(hashStr, "\n")
+
+	var computed []byte
+
+	if bytes.HasPrefix(hashStr, []byte(sifTreeHashPrefix)) {
+		fields := bytes.Split(hashStr[len(sifTreeHashPrefix):], []byte("\n"))
+		if len(fields) != 2 {
+			return fmt.Errorf("malformed block hash")
+		}
+		blockSize, err := strconv.ParseInt(string(fields[0]), 10, 64)
+		if err != nil || blockSize < minHashBlockSize || blockSize > maxHashBlockSize {
+			return fmt.Errorf("bad hash block size %q", fields[0])
+		}
+		sum, err := computeTreeHash(fimg.Fp, descr, blockSize)
+		if err != nil {
+			return err
+		}
+		computed = []byte(fmt.Sprintf("%s%d\n%s", sifTreeHashPrefix, blockSize, hex.EncodeToString(sum)))
+	} else {
+		computed = []byte(computeLegacyHashStr(fimg, descr))
+	}
+	sylog.Debugf("Verifying hash: %s\n", computed)
+
+	if !bytes.Equal(hashStr, computed) {
+		return fmt.Errorf("hash differs")
+	}
+	return nil
+}
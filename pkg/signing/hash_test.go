@@ -0,0 +1,202 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package signing
+
+import (
+	"crypto/rand"
+	"crypto/sha512"
+	"encoding/binary"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"testing"
+
+	uuid "github.com/satori/go.uuid"
+	"github.com/sylabs/sif/pkg/sif"
+)
+
+// createTestSIF creates a SIF image in dir with a single generic data
+// object containing data.
+func createTestSIF(t testing.TB, dir string, data []byte) string {
+	dataPath := filepath.Join(dir, "data")
+	if err := ioutil.WriteFile(dataPath, data, 0600); err != nil {
+		t.Fatal(err)
+	}
+	f, err := os.Open(dataPath)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer f.Close()
+
+	path := filepath.Join(dir, "image.sif")
+	cinfo := sif.CreateInfo{
+		Pathname:   path,
+		Launchstr:  sif.HdrLaunch,
+		Sifversion: sif.HdrVersion,
+		ID:         uuid.NewV4(),
+		InputDescr: []sif.DescriptorInput{
+			{
+				Datatype: sif.DataGeneric,
+				Groupid:  sif.DescrDefaultGroup,
+				Link:     sif.DescrUnusedLink,
+				Fname:    "data",
+				Fp:       f,
+				Size:     int64(len(data)),
+			},
+		},
+	}
+
+	fimg, err := sif.CreateContainer(cinfo)
+	if err != nil {
+		t.Fatalf("failed to create SIF image: %s", err)
+	}
+	fimg.UnloadContainer()
+
+	return path
+}
+
+func loadTestSIF(t testing.TB, path string) (*sif.FileImage, []*sif.Descriptor) {
+	fimg, err := sif.LoadContainer(path, true)
+	if err != nil {
+		t.Fatalf("failed to load SIF image: %s", err)
+	}
+	d, _, err := fimg.GetFromDescrID(1)
+	if err != nil {
+		t.Fatalf("failed to get data object: %s", err)
+	}
+	return &fimg, []*sif.Descriptor{d}
+}
+
+func TestHashStr(t *testing.T) {
+	dir, err := ioutil.TempDir("", "signing-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	// two full blocks and a partial block
+	data := make([]byte, 2*hashBlockSize+123)
+	if _, err := rand.Read(data); err != nil {
+		t.Fatal(err)
+	}
+	path := createTestSIF(t, dir, data)
+
+	fimg, descr := loadTestSIF(t, path)
+	defer fimg.UnloadContainer()
+
+	// the root digest is the digest of the data object size followed by
+	// the digests of each block
+	root := sha512.New384()
+	binary.Write(root, binary.LittleEndian, uint64(len(data)))
+	for off := 0; off < len(data); off += hashBlockSize {
+		end := off + hashBlockSize
+		if end > len(data) {
+			end = len(data)
+		}
+		sum := sha512.Sum384(data[off:end])
+		root.Write(sum[:])
+	}
+	expected := fmt.Sprintf("%s%d\n%x", sifTreeHashPrefix, hashBlockSize, root.Sum(nil))
+
+	defaultWorkers := hashWorkers
+	defer func() { hashWorkers = defaultWorkers }()
+
+	for _, workers := range []int{1, 2, 8} {
+		hashWorkers = workers
+		sifhash, err := computeHashStr(fimg, descr, true)
+		if err != nil {
+			t.Fatalf("unexpected error with %d workers: %s", workers, err)
+		}
+		if sifhash != expected {
+			t.Errorf("unexpected hash with %d workers: %s", workers, sifhash)
+		}
+	}
+
+	legacy := computeLegacyHashStr(fimg, descr)
+	if legacy != fmt.Sprintf("%s%x", sifHashPrefix, sha512.Sum384(data)) {
+		t.Errorf("unexpected legacy hash %s", legacy)
+	}
+	// the legacy format is used by default
+	if sifhash, err := computeHashStr(fimg, descr, false); err != nil || sifhash != legacy {
+		t.Errorf("unexpected default hash %s: %v", sifhash, err)
+	}
+
+	tests := []struct {
+		name    string
+		hash    string
+		success bool
+	}{
+		{"block hash", expected + "\n", true},
+		{"legacy hash", legacy + "\n", true},
+		{"other block size", fmt.Sprintf("%s%d\n%x", sifTreeHashPrefix, hashBlockSize/2, root.Sum(nil)), false},
+		{"block size too small", fmt.Sprintf("%s%d\n%x", sifTreeHashPrefix, 1, root.Sum(nil)), false},
+		{"malformed block hash", sifTreeHashPrefix + "abc", false},
+		{"empty", "", false},
+	}
+	for _, tt := range tests {
+		err := checkHashStr(fimg, descr, []byte(tt.hash))
+		if tt.success && err != nil {
+			t.Errorf("unexpected error with %s: %s", tt.name, err)
+		} else if !tt.success && err == nil {
+			t.Errorf("unexpected success with %s", tt.name)
+		}
+	}
+
+	// corrupt the last block of the data object
+	f, err := os.OpenFile(path, os.O_WRONLY, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	_, err = f.WriteAt([]byte{^data[len(data)-1]}, descr[0].Fileoff+int64(len(data))-1)
+	f.Close()
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	corrupted, descr := loadTestSIF(t, path)
+	defer corrupted.UnloadContainer()
+
+	if err := checkHashStr(corrupted, descr, []byte(expected)); err == nil {
+		t.Errorf("unexpected success with corrupted data and block hash")
+	}
+	if err := checkHashStr(corrupted, descr, []byte(legacy)); err == nil {
+		t.Errorf("unexpected success with corrupted data and legacy hash")
+	}
+}
+
+// BenchmarkHashStr compares the sequential hash of the signatures created
+// before block hashing with the block hash, for several data object sizes.
+func BenchmarkHashStr(b *testing.B) {
+	dir, err := ioutil.TempDir("", "signing-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	for _, size := range []int{16 << 20, 128 << 20, 512 << 20} {
+		path := createTestSIF(b, dir, make([]byte, size))
+		fimg, descr := loadTestSIF(b, path)
+
+		b.Run(fmt.Sprintf("sifhash/%dMiB", size>>20), func(b *testing.B) {
+			b.SetBytes(int64(size))
+			for i := 0; i < b.N; i++ {
+				computeLegacyHashStr(fimg, descr)
+			}
+		})
+		b.Run(fmt.Sprintf("tree/%dMiB", size>>20), func(b *testing.B) {
+			b.SetBytes(int64(size))
+			for i := 0; i < b.N; i++ {
+				if _, err := computeHashStr(fimg, descr, true); err != nil {
+					b.Fatal(err)
+				}
+			}
+		})
+
+		fimg.UnloadContainer()
+		os.Remove(path)
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -8,7 +8,6 @@ package signing
 import (
 	"bytes"
 	"context"
-	"crypto/sha512"
 	"encoding/binary"
 	"encoding/hex"
 	"encoding/json"
@@ -58,18 +57,6 @@ type signatureLink struct {
 	groupIndex []int // The descriptor index per/group signature.
 }
 
-// computeHashStr generates a hash from data object(s) and generates a string
-// to be stored in the signature block.
-func computeHashStr(fimg *sif.FileImage, descr []*sif.Descriptor) string {
-	hash := sha512.New384()
-	for _, v := range descr {
-		hash.Write(v.GetData(fimg))
-	}
-	sum := hash.Sum(nil)
-
-	return fmt.Sprintf("SIFHASH:\n%x", sum)
-}
-
 // sifAddSignature adds a signature block to a SIF file
 func sifAddSignature(fimg *sif.FileImage, groupid, link uint32, fingerprint [20]byte, signature []byte) error {
 	// data we need to create a signature descriptor
@@ -162,7 +149,7 @@ func descrToSign(fimg *sif.FileImage, id uint32, isGroup, signAll bool) ([]*sif.
 // Sign takes the path of a container and generates an OpenPGP signature block for
 // its system partition. Sign uses the private keys found in the default
 // location.
-func Sign(cpath string, id uint32, isGroup, signAll bool, keyIdx int) error {
+func Sign(cpath string, id uint32, isGroup, signAll bool, keyIdx int, blockHash bool) error {
 	keyring := sypgp.NewHandle("")
 
 	// Load a private key usable for signing
@@ -214,13 +201,16 @@ func Sign(cpath string, id uint32, isGroup, signAll bool, keyIdx int) error {
 	for _, de := range descr {
 		sylog.Debugf("Signing %s partition...", de.Datatype)
 
-		sifhash := ""
+		var sifhash string
 		if isGroup {
 			// If we are signing a group, then include all the descriptors.
-			sifhash = computeHashStr(&fimg, descr)
+			sifhash, err = computeHashStr(&fimg, descr, blockHash)
 		} else {
 			// Otherwise, just sign one partition at a time.
-			sifhash = computeHashStr(&fimg, []*sif.Descriptor{de})
+			sifhash, err = computeHashStr(&fimg, []*sif.Descriptor{de}, blockHash)
+		}
+		if err != nil {
+			return fmt.Errorf("could not compute hash: %s", err)
 		}
 		sylog.Debugf("Signing hash: %s\n", sifhash)
 
@@ -431,20 +421,16 @@ func Verify(ctx context.Context, cpath, keyServiceURI string, id uint32, isGroup
 	// Loop through the signature link, and find the signatures and
 	// corresponding partition.
 	for _, part := range sigsLink {
-		sifhash := ""
+		var signedPart []*sif.Descriptor
 		if isGroup {
 			// If we are verifying a group, then collect all
 			// the group partitions.
-			var groupPart []*sif.Descriptor
-
 			for _, d := range part.groupIndex {
-				groupPart = append(groupPart, &fimg.DescrArr[d])
+				signedPart = append(signedPart, &fimg.DescrArr[d])
 			}
-			sifhash = computeHashStr(&fimg, groupPart)
 		} else {
-			sifhash = computeHashStr(&fimg, []*sif.Descriptor{&fimg.DescrArr[part.dataIndex]})
+			signedPart = []*sif.Descriptor{&fimg.DescrArr[part.dataIndex]}
 		}
-		sylog.Debugf("Verifying hash: %s\n", sifhash)
 
 		dataCheck := true
 		// get the entity fingerprint for the signature block
@@ -498,9 +484,10 @@ func Verify(ctx context.Context, cpath, keyServiceURI string, id uint32, isGroup
 			author += fmt.Sprintf("%-18s %s\n", prefix, i)
 		}
 
-		// (2) Verify data integrity by comparing hashes
-		if !bytes.Equal(bytes.TrimRight(block.Plaintext, "\n"), []byte(sifhash)) {
-			sylog.Verbosef("%s key (%s) hash differs, data may be corrupted", red("error:"), fingerprint)
+		// (2) Verify data integrity by comparing hashes, the hash is
+		// computed in the format of the signed hash
+		if err := checkHashStr(&fimg, signedPart, block.Plaintext); err != nil {
+			sylog.Verbosef("%s key (%s) %s, data may be corrupted", red("error:"), fingerprint, err)
 			author += fmt.Sprintf("%-18s system partition hash differs, data may be corrupted\n", red("[FAIL]"))
 			dataCheck = false
 			fail = true
@@ -1,4 +1,4 @@
-// Copyright (c) 2018, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -7,14 +7,31 @@ package copy
 
 import (
 	"io"
+	"net"
 	"sync"
 )
 
+// OverflowPolicy defines what happens when data written to a buffered
+// writer doesn't fit in its buffer.
+type OverflowPolicy int
+
+const (
+	// DropOnOverflow drops data not fitting in the buffer, the writer
+	// receives data again once its buffer has been drained.
+	DropOnOverflow OverflowPolicy = iota
+	// DisconnectOnOverflow removes the writer and closes it if it
+	// implements io.Closer.
+	DisconnectOnOverflow
+)
+
 // MultiWriter creates a writer that duplicates its writes to all the provided writers,
-// writers can be added / removed dynamically.
+// writers can be added / removed dynamically. Writers added with Add receive data
+// synchronously, writers added with AddBuffered receive data from a goroutine so
+// a slow writer doesn't block the other writers.
 type MultiWriter struct {
-	mutex   sync.Mutex
-	writers []io.Writer
+	mutex    sync.Mutex
+	writers  []io.Writer
+	buffered []*bufferedWriter
 }
 
 // Write implements the standard Write interface to duplicate data to all writers.
@@ -35,6 +52,13 @@ func (mw *MultiWriter) Write(p []byte) (n int, err error) {
 		}
 	}
 
+	for i := 0; i < len(mw.buffered); i++ {
+		if !mw.buffered[i].push(p) {
+			mw.buffered = append(mw.buffered[:i], mw.buffered[i+1:]...)
+			i--
+		}
+	}
+
 	return l, nil
 }
 
@@ -48,7 +72,23 @@ func (mw *MultiWriter) Add(writer io.Writer) {
 	mw.mutex.Unlock()
 }
 
-// Del removes a writer.
+// AddBuffered adds a writer receiving data through a ring buffer of
+// size bytes, data is written by a goroutine with as few write calls
+// as possible, policy defines what happens when the buffer is full.
+func (mw *MultiWriter) AddBuffered(writer io.Writer, size int, policy OverflowPolicy) {
+	if writer == nil || size <= 0 {
+		return
+	}
+	bw := newBufferedWriter(writer, size, policy)
+	go bw.run()
+
+	mw.mutex.Lock()
+	mw.buffered = append(mw.buffered, bw)
+	mw.mutex.Unlock()
+}
+
+// Del removes a writer, data not yet written to a buffered writer is
+// discarded.
 func (mw *MultiWriter) Del(writer io.Writer) {
 	mw.mutex.Lock()
 	for i, w := range mw.writers {
@@ -57,5 +97,120 @@ func (mw *MultiWriter) Del(writer io.Writer) {
 			break
 		}
 	}
+	for i, bw := range mw.buffered {
+		if writer == bw.w {
+			mw.buffered = append(mw.buffered[:i], mw.buffered[i+1:]...)
+			bw.close(false)
+			break
+		}
+	}
 	mw.mutex.Unlock()
 }
+
+// bufferedWriter writes the data stored in its ring buffer to w.
+type bufferedWriter struct {
+	w      io.Writer
+	policy OverflowPolicy
+
+	mutex      sync.Mutex
+	cond       *sync.Cond
+	buf        []byte
+	head       int // offset of buffered data
+	n          int // size of buffered data
+	closed     bool
+	disconnect bool
+	dropped    int64
+
+	vec [2][]byte
+}
+
+func newBufferedWriter(w io.Writer, size int, policy OverflowPolicy) *bufferedWriter {
+	bw := &bufferedWriter{
+		w:      w,
+		policy: policy,
+		buf:    make([]byte, size),
+	}
+	bw.cond = sync.NewCond(&bw.mutex)
+	return bw
+}
+
+// push copies p in the ring buffer, it returns false if the writer
+// has been closed and must be removed.
+func (bw *bufferedWriter) push(p []byte) bool {
+	bw.mutex.Lock()
+	defer bw.mutex.Unlock()
+
+	if bw.closed {
+		return false
+	}
+	if len(p) > len(bw.buf)-bw.n {
+		if bw.policy == DisconnectOnOverflow {
+			bw.closed = true
+			bw.disconnect = true
+			bw.cond.Signal()
+			return false
+		}
+		bw.dropped += int64(len(p))
+		return true
+	}
+
+	tail := (bw.head + bw.n) % len(bw.buf)
+	c := copy(bw.buf[tail:], p)
+	copy(bw.buf, p[c:])
+	bw.n += len(p)
+	bw.cond.Signal()
+
+	return true
+}
+
+// close stops the writer goroutine, the underlying writer is closed
+// if disconnect is true.
+func (bw *bufferedWriter) close(disconnect bool) {
+	bw.mutex.Lock()
+	bw.closed = true
+	bw.disconnect = disconnect
+	bw.cond.Signal()
+	bw.mutex.Unlock()
+}
+
+// run writes buffered data until the writer is closed or a write fails,
+// both parts of the buffered data are written with a single writev
+// call when the underlying writer is a network connection.
+func (bw *bufferedWriter) run() {
+	for {
+		bw.mutex.Lock()
+		for bw.n == 0 && !bw.closed {
+			bw.cond.Wait()
+		}
+		if bw.closed {
+			disconnect := bw.disconnect
+			bw.mutex.Unlock()
+			if c, ok := bw.w.(io.Closer); ok && disconnect {
+				c.Close()
+			}
+			return
+		}
+		head, n := bw.head, bw.n
+		bw.mutex.Unlock()
+
+		// data beyond head+n is only written by push once
+		// the buffer is released below
+		vec := bw.vec[:0]
+		if end := head + n; end <= len(bw.buf) {
+			vec = append(vec, bw.buf[head:end])
+		} else {
+			vec = append(vec, bw.buf[head:], bw.buf[:end-len(bw.buf)])
+		}
+		buffers := net.Buffers(vec)
+		written, err := buffers.WriteTo(bw.w)
+
+		bw.mutex.Lock()
+		bw.head = (head + int(written)) % len(bw.buf)
+		bw.n -= int(written)
+		if err != nil {
+			// removed from MultiWriter by the next push
+			bw.closed = true
+		}
+		bw.mutex.Unlock()
+	}
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2019-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -7,7 +7,15 @@ package copy
 
 import (
 	"bytes"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"net"
+	"os"
+	"path/filepath"
+	"sync"
 	"testing"
+	"time"
 
 	"github.com/sylabs/singularity/internal/pkg/test"
 )
@@ -81,3 +89,246 @@ func TestMultiWriter(t *testing.T) {
 
 	mw.Del(buf2)
 }
+
+// blockingWriter blocks writes until unblock is closed.
+type blockingWriter struct {
+	unblock chan struct{}
+	closed  chan struct{}
+	buf     bytes.Buffer
+}
+
+func newBlockingWriter() *blockingWriter {
+	return &blockingWriter{
+		unblock: make(chan struct{}),
+		closed:  make(chan struct{}),
+	}
+}
+
+func (w *blockingWriter) Write(p []byte) (int, error) {
+	<-w.unblock
+	return w.buf.Write(p)
+}
+
+func (w *blockingWriter) Close() error {
+	close(w.closed)
+	return nil
+}
+
+// notifyWriter notifies done once size bytes have been written.
+type notifyWriter struct {
+	mutex sync.Mutex
+	buf   bytes.Buffer
+	size  int
+	done  chan struct{}
+}
+
+func (w *notifyWriter) Write(p []byte) (int, error) {
+	w.mutex.Lock()
+	defer w.mutex.Unlock()
+
+	n, err := w.buf.Write(p)
+	if w.buf.Len() == w.size {
+		close(w.done)
+	}
+	return n, err
+}
+
+func TestMultiWriterBuffered(t *testing.T) {
+	test.DropPrivilege(t)
+	defer test.ResetPrivilege(t)
+
+	const (
+		bufferSize = 64
+		writes     = 100
+	)
+
+	mw := &MultiWriter{}
+
+	synchronous := new(bytes.Buffer)
+	mw.Add(synchronous)
+
+	fast := &notifyWriter{size: writes * 4, done: make(chan struct{})}
+	mw.AddBuffered(fast, writes*4, DropOnOverflow)
+
+	dropped := newBlockingWriter()
+	mw.AddBuffered(dropped, bufferSize, DropOnOverflow)
+
+	disconnected := newBlockingWriter()
+	mw.AddBuffered(disconnected, bufferSize, DisconnectOnOverflow)
+
+	// a blocked writer doesn't block writes
+	for i := 0; i < writes; i++ {
+		n, err := mw.Write([]byte("test"))
+		if err != nil {
+			t.Fatalf("unexpected error: %s", err)
+		}
+		if n != 4 {
+			t.Fatalf("wrong number of bytes written")
+		}
+	}
+
+	// synchronous writers get everything
+	if synchronous.Len() != writes*4 {
+		t.Errorf("synchronous writer got %d bytes instead of %d", synchronous.Len(), writes*4)
+	}
+
+	select {
+	case <-fast.done:
+	case <-time.After(5 * time.Second):
+		t.Fatalf("buffered writer got %d bytes instead of %d", fast.buf.Len(), writes*4)
+	}
+
+	select {
+	case <-disconnected.closed:
+	case <-time.After(5 * time.Second):
+		t.Fatalf("blocked writer not disconnected")
+	}
+
+	mw.mutex.Lock()
+	if len(mw.buffered) != 2 {
+		t.Errorf("found %d buffered writers instead of 2", len(mw.buffered))
+	}
+	mw.mutex.Unlock()
+
+	close(dropped.unblock)
+	close(disconnected.unblock)
+
+	mw.Del(dropped)
+	mw.Del(fast)
+
+	mw.mutex.Lock()
+	if len(mw.buffered) != 0 {
+		t.Errorf("found %d buffered writers instead of 0", len(mw.buffered))
+	}
+	mw.mutex.Unlock()
+
+	select {
+	case <-dropped.closed:
+		t.Errorf("writer closed by Del")
+	default:
+	}
+}
+
+// BenchmarkMultiWriter measures the container output throughput with
+// one stalled attached client and several fast attached clients reading
+// from unix sockets, with clients written synchronously or through ring
+// buffers. The time includes the delivery of buffered data to the fast
+// clients.
+func BenchmarkMultiWriter(b *testing.B) {
+	dir, err := ioutil.TempDir("", "writer-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	l, err := net.Listen("unix", filepath.Join(dir, "attach.sock"))
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer l.Close()
+
+	// connect returns a client connection and the server connection
+	// where container output is written
+	connect := func() (net.Conn, net.Conn) {
+		client, err := net.Dial("unix", l.Addr().String())
+		if err != nil {
+			b.Fatal(err)
+		}
+		server, err := l.Accept()
+		if err != nil {
+			b.Fatal(err)
+		}
+		return client, server
+	}
+
+	data := bytes.Repeat([]byte("x"), 4096)
+
+	for _, fast := range []int{1, 4, 16} {
+		for _, mode := range []string{"sync", "buffered"} {
+			b.Run(fmt.Sprintf("%s/fast-%d", mode, fast), func(b *testing.B) {
+				var conns []net.Conn
+				var buffered []*bufferedWriter
+
+				mw := &MultiWriter{}
+				mw.Add(ioutil.Discard)
+
+				add := func(c net.Conn) {
+					if mode == "sync" {
+						mw.Add(c)
+						return
+					}
+					mw.AddBuffered(c, 1<<20, DropOnOverflow)
+					buffered = append(buffered, mw.buffered[len(mw.buffered)-1])
+				}
+
+				// the stalled client never reads, once the socket
+				// buffer is full synchronous writes block until
+				// the write deadline
+				stalled, server := connect()
+				conns = append(conns, stalled, server)
+				server.SetWriteDeadline(time.Now().Add(time.Second))
+				add(server)
+
+				var wg sync.WaitGroup
+				for i := 0; i < fast; i++ {
+					client, server := connect()
+					conns = append(conns, client, server)
+					add(server)
+					wg.Add(1)
+					go func() {
+						defer wg.Done()
+						io.Copy(ioutil.Discard, client)
+					}()
+				}
+
+				// container output is read from a pipe like
+				// the engine does
+				r, w, err := os.Pipe()
+				if err != nil {
+					b.Fatal(err)
+				}
+				go func() {
+					for i := 0; i < b.N; i++ {
+						w.Write(data)
+					}
+					w.Close()
+				}()
+
+				b.SetBytes(int64(len(data)))
+				b.ResetTimer()
+				for {
+					if _, err := io.Copy(mw, r); err == nil {
+						break
+					}
+					// the stalled client reached its write deadline
+					mw.Del(server)
+				}
+				r.Close()
+				if mode == "buffered" {
+					// wait until fast clients have been sent their
+					// buffered data
+					var dropped int64
+					for _, bw := range buffered[1:] {
+						for {
+							bw.mutex.Lock()
+							n := bw.n
+							bw.mutex.Unlock()
+							if n == 0 {
+								break
+							}
+							time.Sleep(100 * time.Microsecond)
+						}
+						dropped += bw.dropped
+					}
+					b.ReportMetric(100*float64(dropped)/float64(b.N*fast*len(data)), "%dropped")
+				}
+				b.StopTimer()
+
+				for _, c := range conns {
+					c.Close()
+				}
+				wg.Wait()
+			})
+		}
+	}
+}
@@ -0,0 +1,349 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"bytes"
+	"compress/zlib"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"sync"
+)
+
+// Decompressor decompresses the block src into dst and returns the
+// number of decompressed bytes, the decompressed block must fit in dst.
+type Decompressor func(dst, src []byte) (int, error)
+
+// decompressors maps squashfs compression identifiers to their
+// decompressor, compressors relying on external libraries register
+// themselves in their own source file.
+var decompressors = map[uint16]Decompressor{
+	GzipCompression: zlibDecompress,
+	LzoCompression:  lzoDecompress,
+	Lz4Compression:  lz4Decompress,
+}
+
+var errOutputOverrun = fmt.Errorf("decompressed block exceeds block size")
+var errInputOverrun = fmt.Errorf("truncated compressed block")
+
+// checkOptions returns ErrUnsupportedCompression if compressor options
+// stored after the super block require features not handled in-process.
+func checkOptions(compression uint16, options []byte) error {
+	switch compression {
+	case XzCompression:
+		// dictionary size followed by the filters bit mask, only
+		// the default LZMA2 filter chain is supported
+		if len(options) >= 8 && binary.LittleEndian.Uint32(options[4:]) != 0 {
+			return ErrUnsupportedCompression
+		}
+	case Lz4Compression:
+		// only the legacy LZ4 block format exists
+		if len(options) >= 4 && binary.LittleEndian.Uint32(options) != 1 {
+			return ErrUnsupportedCompression
+		}
+	}
+	return nil
+}
+
+// readBlockFull reads a decompressed stream into dst and returns an
+// error if the stream doesn't fit in dst.
+func readBlockFull(r io.Reader, dst []byte) (int, error) {
+	n, err := io.ReadFull(r, dst)
+	if err == io.EOF || err == io.ErrUnexpectedEOF {
+		return n, nil
+	} else if err != nil {
+		return n, err
+	}
+
+	var b [1]byte
+	if m, err := r.Read(b[:]); m > 0 {
+		return n, errOutputOverrun
+	} else if err != nil && err != io.EOF {
+		return n, err
+	}
+	return n, nil
+}
+
+var zlibReaders sync.Pool
+
+func zlibDecompress(dst, src []byte) (int, error) {
+	var zr io.ReadCloser
+	var err error
+
+	if r := zlibReaders.Get(); r != nil {
+		zr = r.(io.ReadCloser)
+		err = zr.(zlib.Resetter).Reset(bytes.NewReader(src), nil)
+	} else {
+		zr, err = zlib.NewReader(bytes.NewReader(src))
+	}
+	if err != nil {
+		return 0, err
+	}
+	defer zlibReaders.Put(zr)
+
+	return readBlockFull(zr, dst)
+}
+
+// lz4Decompress decompresses a raw LZ4 block.
+func lz4Decompress(dst, src []byte) (int, error) {
+	si, di := 0, 0
+
+	for si < len(src) {
+		token := src[si]
+		si++
+
+		literals := int(token >> 4)
+		if literals == 15 {
+			for {
+				if si >= len(src) {
+					return di, errInputOverrun
+				}
+				b := src[si]
+				si++
+				literals += int(b)
+				if b != 255 {
+					break
+				}
+			}
+		}
+		if si+literals > len(src) {
+			return di, errInputOverrun
+		}
+		if di+literals > len(dst) {
+			return di, errOutputOverrun
+		}
+		di += copy(dst[di:], src[si:si+literals])
+		si += literals
+
+		// last sequence contains only literals
+		if si == len(src) {
+			break
+		}
+
+		if si+2 > len(src) {
+			return di, errInputOverrun
+		}
+		offset := int(src[si]) | int(src[si+1])<<8
+		si += 2
+		if offset == 0 || offset > di {
+			return di, fmt.Errorf("corrupted lz4 block: bad match offset")
+		}
+
+		length := int(token & 15)
+		if length == 15 {
+			for {
+				if si >= len(src) {
+					return di, errInputOverrun
+				}
+				b := src[si]
+				si++
+				length += int(b)
+				if b != 255 {
+					break
+				}
+			}
+		}
+		length += 4
+		if di+length > len(dst) {
+			return di, errOutputOverrun
+		}
+
+		if offset >= length {
+			copy(dst[di:di+length], dst[di-offset:])
+			di += length
+		} else {
+			// overlapping match repeats the last offset bytes
+			for end := di + length; di < end; di++ {
+				dst[di] = dst[di-offset]
+			}
+		}
+	}
+
+	return di, nil
+}
+
+// lzoDecompress decompresses a LZO1X block, this is a port of the
+// lzo1x_decompress_safe implementation found in the Linux kernel.
+func lzoDecompress(dst, src []byte) (int, error) {
+	var t, next, mpos int
+
+	ip, op := 0, 0
+	state := 0
+
+	if len(src) < 3 {
+		return 0, errInputOverrun
+	}
+
+	// zeroRun decodes a run length encoded as a series of zero bytes
+	// followed by a non-zero byte
+	zeroRun := func(base int) (int, error) {
+		start := ip
+		for {
+			if ip >= len(src) {
+				return 0, errInputOverrun
+			}
+			if src[ip] != 0 {
+				break
+			}
+			ip++
+		}
+		zeros := ip - start
+		n := zeros*255 + base + int(src[ip])
+		ip++
+		return n, nil
+	}
+
+	copyLiterals := func(n int) error {
+		if ip+n > len(src) {
+			return errInputOverrun
+		}
+		if op+n > len(dst) {
+			return errOutputOverrun
+		}
+		copy(dst[op:op+n], src[ip:ip+n])
+		ip += n
+		op += n
+		return nil
+	}
+
+	// first byte may encode an initial literal run
+	literalsOnly := false
+	if src[ip] > 17 {
+		t = int(src[ip]) - 17
+		ip++
+		if t < 4 {
+			next = t
+			literalsOnly = true
+		} else {
+			if err := copyLiterals(t); err != nil {
+				return op, err
+			}
+			state = 4
+		}
+	}
+
+	for {
+		if literalsOnly {
+			literalsOnly = false
+			goto matchNext
+		}
+		if ip >= len(src) {
+			return op, errInputOverrun
+		}
+		t = int(src[ip])
+		ip++
+
+		if t < 16 {
+			if state == 0 {
+				if t == 0 {
+					n, err := zeroRun(15)
+					if err != nil {
+						return op, err
+					}
+					t = n
+				}
+				if err := copyLiterals(t + 3); err != nil {
+					return op, err
+				}
+				state = 4
+				continue
+			}
+			if ip >= len(src) {
+				return op, errInputOverrun
+			}
+			if state != 4 {
+				next = t & 3
+				mpos = op - 1 - t>>2 - int(src[ip])<<2
+				ip++
+				if mpos < 0 {
+					return op, fmt.Errorf("corrupted lzo block: lookbehind overrun")
+				}
+				if op+2 > len(dst) {
+					return op, errOutputOverrun
+				}
+				dst[op] = dst[mpos]
+				dst[op+1] = dst[mpos+1]
+				op += 2
+				goto matchNext
+			}
+			next = t & 3
+			mpos = op - (1 + 0x0800) - t>>2 - int(src[ip])<<2
+			ip++
+			t = 3
+		} else if t >= 64 {
+			if ip >= len(src) {
+				return op, errInputOverrun
+			}
+			next = t & 3
+			mpos = op - 1 - (t>>2)&7 - int(src[ip])<<3
+			ip++
+			t = t>>5 - 1 + 2
+		} else if t >= 32 {
+			t = t&31 + 2
+			if t == 2 {
+				n, err := zeroRun(31)
+				if err != nil {
+					return op, err
+				}
+				t += n
+			}
+			if ip+2 > len(src) {
+				return op, errInputOverrun
+			}
+			next = int(binary.LittleEndian.Uint16(src[ip:]))
+			ip += 2
+			mpos = op - 1 - next>>2
+			next &= 3
+		} else {
+			mpos = op - (t&8)<<11
+			t = t&7 + 2
+			if t == 2 {
+				n, err := zeroRun(7)
+				if err != nil {
+					return op, err
+				}
+				t += n
+			}
+			if ip+2 > len(src) {
+				return op, errInputOverrun
+			}
+			next = int(binary.LittleEndian.Uint16(src[ip:]))
+			ip += 2
+			mpos -= next >> 2
+			next &= 3
+			if mpos == op {
+				// end of stream marker
+				if t != 3 {
+					return op, fmt.Errorf("corrupted lzo block: bad end of stream")
+				}
+				if ip != len(src) {
+					return op, fmt.Errorf("corrupted lzo block: input not consumed")
+				}
+				return op, nil
+			}
+			mpos -= 0x4000
+		}
+
+		if mpos < 0 {
+			return op, fmt.Errorf("corrupted lzo block: lookbehind overrun")
+		}
+		if op+t > len(dst) {
+			return op, errOutputOverrun
+		}
+		// match may overlap the output, copy byte by byte
+		for end := op + t; op < end; op++ {
+			dst[op] = dst[mpos]
+			mpos++
+		}
+
+	matchNext:
+		state = next
+		if err := copyLiterals(next); err != nil {
+			return op, err
+		}
+	}
+}
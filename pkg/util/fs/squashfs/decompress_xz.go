@@ -0,0 +1,34 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"bytes"
+
+	"github.com/ulikunitz/xz"
+	"github.com/ulikunitz/xz/lzma"
+)
+
+func init() {
+	decompressors[XzCompression] = xzDecompress
+	decompressors[LzmaCompression] = lzmaDecompress
+}
+
+func xzDecompress(dst, src []byte) (int, error) {
+	r, err := xz.NewReader(bytes.NewReader(src))
+	if err != nil {
+		return 0, err
+	}
+	return readBlockFull(r, dst)
+}
+
+func lzmaDecompress(dst, src []byte) (int, error) {
+	r, err := lzma.NewReader(bytes.NewReader(src))
+	if err != nil {
+		return 0, err
+	}
+	return readBlockFull(r, dst)
+}
@@ -0,0 +1,425 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"fmt"
+	"os"
+	"path"
+	"path/filepath"
+	"runtime"
+	"strings"
+	"sync"
+	"sync/atomic"
+
+	"github.com/sylabs/singularity/internal/pkg/sylog"
+	"golang.org/x/sys/unix"
+)
+
+// maximum number of data blocks decompressed by a single job
+const jobBlocks = 32
+
+// extractor extracts filesystem entries, the filesystem tree is walked
+// sequentially while file data blocks are decompressed and written
+// by a pool of workers.
+type extractor struct {
+	r    *Reader
+	root bool
+
+	jobs chan *dataJob
+	wg   sync.WaitGroup
+
+	errOnce sync.Once
+	err     error
+	failed  int32
+
+	// inode number to path of extracted hard linked files
+	links map[uint32]string
+	// directories attributes are applied once the tree is extracted
+	dirs []*extractedDir
+}
+
+type extractedDir struct {
+	path   string
+	inode  *inode
+	xattrs []xattr
+}
+
+// dataFile is a regular file being written by data jobs, the last
+// job writing into the file closes it and applies its attributes.
+type dataFile struct {
+	file    *os.File
+	inode   *inode
+	xattrs  []xattr
+	pending int32
+}
+
+// dataJob writes a range of data blocks and/or the fragment tail of a file.
+type dataJob struct {
+	file     *dataFile
+	pos      int64
+	first    int
+	sizes    []uint32
+	fragment bool
+}
+
+// Extract extracts the entries matching the provided paths, or the whole
+// filesystem if no path is provided, into the destination directory.
+// Paths are relative to the filesystem root and may contain shell
+// patterns, a matching directory is extracted with its content. Data
+// blocks are decompressed in parallel across all available CPUs.
+func (r *Reader) Extract(files []string, dest string) error {
+	var patterns [][]string
+
+	for _, f := range files {
+		f = path.Clean("/" + f)
+		if f == "/" {
+			patterns = nil
+			break
+		}
+		patterns = append(patterns, strings.Split(f[1:], "/"))
+	}
+
+	root, err := r.readInode(r.sb.RootInode)
+	if err != nil {
+		return fmt.Errorf("failed to read root inode: %s", err)
+	}
+	if root.typ != dirType && root.typ != extDirType {
+		return fmt.Errorf("root inode is not a directory")
+	}
+	if err := os.MkdirAll(dest, 0700); err != nil {
+		return err
+	}
+
+	e := &extractor{
+		r:     r,
+		root:  os.Geteuid() == 0,
+		jobs:  make(chan *dataJob, runtime.NumCPU()*4),
+		links: make(map[uint32]string),
+	}
+	for i := 0; i < runtime.NumCPU(); i++ {
+		e.wg.Add(1)
+		go e.worker()
+	}
+
+	err = e.extractDir(root, dest, patterns, true)
+
+	close(e.jobs)
+	e.wg.Wait()
+
+	if err != nil {
+		return err
+	} else if e.err != nil {
+		return e.err
+	}
+
+	// apply directories attributes, children first
+	for i := len(e.dirs) - 1; i >= 0; i-- {
+		d := e.dirs[i]
+		if err := e.setAttributes(d.path, d.inode, d.xattrs); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+func (e *extractor) setError(err error) {
+	e.errOnce.Do(func() {
+		e.err = err
+		atomic.StoreInt32(&e.failed, 1)
+	})
+}
+
+// extractDir creates the directory and extracts its entries matching
+// patterns, a nil patterns list extracts all entries.
+func (e *extractor) extractDir(in *inode, dir string, patterns [][]string, exists bool) error {
+	if !exists {
+		if fi, err := os.Lstat(dir); err == nil && !fi.IsDir() {
+			if err := os.Remove(dir); err != nil {
+				return err
+			}
+		}
+		if err := os.Mkdir(dir, 0700); err != nil && !os.IsExist(err) {
+			return err
+		}
+	}
+
+	xattrs, err := e.r.readXattrs(in.xattr)
+	if err != nil {
+		return fmt.Errorf("failed to read extended attributes of %s: %s", dir, err)
+	}
+	e.dirs = append(e.dirs, &extractedDir{path: dir, inode: in, xattrs: xattrs})
+
+	entries, err := e.r.readDir(in)
+	if err != nil {
+		return fmt.Errorf("failed to read directory %s: %s", dir, err)
+	}
+
+	for _, entry := range entries {
+		if atomic.LoadInt32(&e.failed) != 0 {
+			return nil
+		}
+
+		sub, match := matchEntry(entry.name, patterns)
+		if !match && len(sub) == 0 {
+			continue
+		}
+
+		child, err := e.r.readInode(entry.ref)
+		if err != nil {
+			return fmt.Errorf("failed to read inode of %s: %s", filepath.Join(dir, entry.name), err)
+		}
+		p := filepath.Join(dir, entry.name)
+
+		if child.typ == dirType || child.typ == extDirType {
+			if match {
+				sub = nil
+			}
+			if err := e.extractDir(child, p, sub, false); err != nil {
+				return err
+			}
+		} else if match {
+			if err := e.extractEntry(child, p); err != nil {
+				return err
+			}
+		}
+	}
+	return nil
+}
+
+// matchEntry returns if the entry name matches a complete pattern and
+// the remaining patterns to apply to its children.
+func matchEntry(name string, patterns [][]string) ([][]string, bool) {
+	if patterns == nil {
+		return nil, true
+	}
+
+	var sub [][]string
+	for _, p := range patterns {
+		if ok, _ := path.Match(p[0], name); !ok {
+			continue
+		}
+		if len(p) == 1 {
+			return nil, true
+		}
+		sub = append(sub, p[1:])
+	}
+	return sub, false
+}
+
+// extractEntry extracts a non directory entry.
+func (e *extractor) extractEntry(in *inode, p string) error {
+	if _, err := os.Lstat(p); err == nil {
+		if err := os.RemoveAll(p); err != nil {
+			return err
+		}
+	}
+
+	xattrs, err := e.r.readXattrs(in.xattr)
+	if err != nil {
+		return fmt.Errorf("failed to read extended attributes of %s: %s", p, err)
+	}
+
+	switch in.typ {
+	case fileType, extFileType:
+		return e.extractFile(in, p, xattrs)
+	case symlinkType, extSymlinkType:
+		if err := os.Symlink(in.target, p); err != nil {
+			return err
+		}
+	case blockDevType, charDevType, extBlockDevType, extCharDevType, fifoType, extFifoType:
+		mode := uint32(unix.S_IFIFO)
+		if in.typ == blockDevType || in.typ == extBlockDevType {
+			mode = unix.S_IFBLK
+		} else if in.typ == charDevType || in.typ == extCharDevType {
+			mode = unix.S_IFCHR
+		}
+		if mode != unix.S_IFIFO && !e.root {
+			sylog.Warningf("Could not create device %s, extraction requires privileges", p)
+			return nil
+		}
+		major := (in.rdev >> 8) & 0xfff
+		minor := (in.rdev & 0xff) | ((in.rdev >> 12) & 0xfff00)
+		if err := unix.Mknod(p, mode|0600, int(unix.Mkdev(major, minor))); err != nil {
+			return fmt.Errorf("failed to create %s: %s", p, err)
+		}
+	case socketType, extSocketType:
+		sylog.Debugf("Ignoring socket %s", p)
+		return nil
+	}
+
+	return e.setAttributes(p, in, xattrs)
+}
+
+// extractFile creates the regular file and queues its data jobs, or
+// creates a hard link if the inode was already extracted.
+func (e *extractor) extractFile(in *inode, p string, xattrs []xattr) error {
+	if in.nlink > 1 {
+		if target, ok := e.links[in.number]; ok {
+			return os.Link(target, p)
+		}
+		e.links[in.number] = p
+	}
+
+	f, err := os.OpenFile(p, os.O_WRONLY|os.O_CREATE|os.O_TRUNC, 0600)
+	if err != nil {
+		return err
+	}
+	// truncate to the final size, sparse blocks are left as holes
+	if err := f.Truncate(int64(in.size)); err != nil {
+		f.Close()
+		return err
+	}
+
+	file := &dataFile{file: f, inode: in, xattrs: xattrs}
+
+	var jobs []*dataJob
+
+	pos := int64(in.blocksStart)
+	for first := 0; first < len(in.blockSizes); first += jobBlocks {
+		last := first + jobBlocks
+		if last > len(in.blockSizes) {
+			last = len(in.blockSizes)
+		}
+		job := &dataJob{file: file, pos: pos, first: first, sizes: in.blockSizes[first:last]}
+		for _, s := range job.sizes {
+			pos += int64(s &^ uncompressedBlock)
+		}
+		jobs = append(jobs, job)
+	}
+	if in.fragment != invalidFragment {
+		if len(jobs) > 0 {
+			jobs[len(jobs)-1].fragment = true
+		} else {
+			jobs = append(jobs, &dataJob{file: file, fragment: true})
+		}
+	}
+
+	if len(jobs) == 0 {
+		// empty file
+		f.Close()
+		return e.setAttributes(p, in, xattrs)
+	}
+
+	file.pending = int32(len(jobs))
+	for _, job := range jobs {
+		e.jobs <- job
+	}
+	return nil
+}
+
+func (e *extractor) worker() {
+	defer e.wg.Done()
+
+	buf := make([]byte, e.r.sb.BlockSize)
+
+	for job := range e.jobs {
+		if atomic.LoadInt32(&e.failed) == 0 {
+			if err := e.writeJob(job, buf); err != nil {
+				e.setError(fmt.Errorf("failed to extract %s: %s", job.file.file.Name(), err))
+			}
+		}
+
+		f := job.file
+		if atomic.AddInt32(&f.pending, -1) == 0 {
+			err := f.file.Close()
+			if err == nil && atomic.LoadInt32(&e.failed) == 0 {
+				err = e.setAttributes(f.file.Name(), f.inode, f.xattrs)
+			}
+			if err != nil {
+				e.setError(err)
+			}
+		}
+	}
+}
+
+// writeJob decompresses the job data blocks and writes them in file.
+func (e *extractor) writeJob(job *dataJob, buf []byte) error {
+	blockSize := int64(e.r.sb.BlockSize)
+	f := job.file
+
+	if len(job.sizes) > 0 {
+		var length int64
+		for _, s := range job.sizes {
+			length += int64(s &^ uncompressedBlock)
+		}
+
+		src := make([]byte, length)
+		if _, err := e.r.r.ReadAt(src, job.pos); err != nil {
+			return err
+		}
+
+		offset := int64(job.first) * blockSize
+		for _, s := range job.sizes {
+			size := s &^ uncompressedBlock
+			if size == 0 {
+				// sparse block
+				offset += blockSize
+				continue
+			}
+			if size > e.r.sb.BlockSize {
+				return fmt.Errorf("corrupted data block size")
+			}
+			data, err := e.r.blockData(src[:size], s, buf)
+			if err != nil {
+				return err
+			}
+			src = src[size:]
+			if _, err := f.file.WriteAt(data, offset); err != nil {
+				return err
+			}
+			offset += blockSize
+		}
+	}
+
+	if job.fragment {
+		in := f.inode
+		tail := in.size - uint64(len(in.blockSizes))*uint64(blockSize)
+		block, err := e.r.fragmentBlock(in.fragment)
+		if err != nil {
+			return err
+		}
+		end := uint64(in.fragOffset) + tail
+		if end > uint64(len(block)) {
+			return fmt.Errorf("corrupted fragment reference")
+		}
+		if _, err := f.file.WriteAt(block[in.fragOffset:end], int64(in.size-tail)); err != nil {
+			return err
+		}
+	}
+
+	return nil
+}
+
+// setAttributes applies ownership, permissions, extended attributes and
+// modification time of the inode to the extracted path, ownership is
+// only restored when running as root.
+func (e *extractor) setAttributes(p string, in *inode, xattrs []xattr) error {
+	symlink := in.typ == symlinkType || in.typ == extSymlinkType
+
+	if e.root {
+		if err := os.Lchown(p, int(in.uid), int(in.gid)); err != nil {
+			return fmt.Errorf("failed to change owner of %s: %s", p, err)
+		}
+	}
+	if !symlink {
+		if err := unix.Chmod(p, uint32(in.mode&07777)); err != nil {
+			return fmt.Errorf("failed to change mode of %s: %s", p, err)
+		}
+	}
+	for _, x := range xattrs {
+		if err := unix.Lsetxattr(p, x.name, x.value, 0); err != nil {
+			sylog.Debugf("Could not set extended attribute %s on %s: %s", x.name, p, err)
+		}
+	}
+
+	mtime := unix.NsecToTimespec(int64(in.mtime) * 1e9)
+	ts := []unix.Timespec{mtime, mtime}
+	if err := unix.UtimesNanoAt(unix.AT_FDCWD, p, ts, unix.AT_SYMLINK_NOFOLLOW); err != nil {
+		return fmt.Errorf("failed to set modification time of %s: %s", p, err)
+	}
+	return nil
+}
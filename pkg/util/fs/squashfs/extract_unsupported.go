@@ -0,0 +1,18 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// +build !linux
+
+package squashfs
+
+import (
+	"fmt"
+)
+
+// Extract extracts the entries matching the provided paths, or the whole
+// filesystem if no path is provided, into the destination directory.
+func (r *Reader) Extract(files []string, dest string) error {
+	return fmt.Errorf("unsupported on this platform")
+}
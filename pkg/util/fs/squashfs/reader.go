@@ -0,0 +1,590 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"encoding/binary"
+	"fmt"
+	"io"
+	"strings"
+	"sync"
+)
+
+// maximum number of decompressed fragment blocks kept in memory
+const maxCachedFragments = 64
+
+// Reader provides read access to a squashfs v4 filesystem stored
+// in an io.ReaderAt, no temporary copy of the filesystem is required.
+type Reader struct {
+	r          io.ReaderAt
+	sb         superblock
+	decompress Decompressor
+
+	ids             []uint32
+	fragments       []fragmentEntry
+	xattrIDs        []xattrIDEntry
+	xattrTableStart uint64
+
+	// metadata blocks are only accessed by the filesystem walker
+	metadata map[int64]*metadataBlock
+
+	// fragment blocks are shared between data workers
+	fragmentMutex sync.Mutex
+	fragmentCache map[uint32]*fragmentBlock
+}
+
+type metadataBlock struct {
+	data []byte
+	next int64
+}
+
+type fragmentBlock struct {
+	once sync.Once
+	data []byte
+	err  error
+}
+
+// inode is the decoded representation of all squashfs inode types.
+type inode struct {
+	typ    uint16
+	mode   uint16
+	uid    uint32
+	gid    uint32
+	mtime  uint32
+	number uint32
+	nlink  uint32
+	xattr  uint32
+
+	// directory
+	dirBlock  uint32
+	dirOffset uint16
+	dirSize   uint32
+
+	// regular file
+	blocksStart uint64
+	size        uint64
+	fragment    uint32
+	fragOffset  uint32
+	blockSizes  []uint32
+
+	// symbolic link
+	target string
+
+	// block and character devices
+	rdev uint32
+}
+
+type dirEntry struct {
+	name string
+	ref  uint64
+}
+
+type xattr struct {
+	name  string
+	value []byte
+}
+
+// NewReader parses the squashfs super block and lookup tables read
+// from r and returns a Reader.
+func NewReader(r io.ReaderAt) (*Reader, error) {
+	sr := &Reader{
+		r:             r,
+		metadata:      make(map[int64]*metadataBlock),
+		fragmentCache: make(map[uint32]*fragmentBlock),
+	}
+
+	sb := &sr.sb
+	if err := binary.Read(io.NewSectionReader(r, 0, superSize), binary.LittleEndian, sb); err != nil {
+		return nil, fmt.Errorf("failed to read squashfs super block: %s", err)
+	}
+	if sb.Magic != magic {
+		return nil, fmt.Errorf("not a squashfs filesystem")
+	}
+	if sb.Major != 4 {
+		return nil, fmt.Errorf("squashfs version %d.%d is not supported", sb.Major, sb.Minor)
+	}
+	if sb.BlockLog < 12 || sb.BlockLog > 20 || sb.BlockSize != 1<<sb.BlockLog {
+		return nil, fmt.Errorf("corrupted squashfs super block: bad block size %d", sb.BlockSize)
+	}
+
+	decompress, ok := decompressors[sb.Compression]
+	if !ok {
+		return nil, ErrUnsupportedCompression
+	}
+	sr.decompress = decompress
+
+	if sb.Flags&flagCompressorOptions != 0 {
+		block, err := sr.readMetadataBlock(superSize)
+		if err != nil {
+			return nil, fmt.Errorf("failed to read compressor options: %s", err)
+		}
+		if err := checkOptions(sb.Compression, block.data); err != nil {
+			return nil, err
+		}
+	}
+
+	ids, err := sr.readTable(sb.IDTableStart, int(sb.IDCount), 4)
+	if err != nil {
+		return nil, fmt.Errorf("failed to read id table: %s", err)
+	}
+	sr.ids = make([]uint32, sb.IDCount)
+	for i := range sr.ids {
+		sr.ids[i] = binary.LittleEndian.Uint32(ids[i*4:])
+	}
+
+	frags, err := sr.readTable(sb.FragmentTableStart, int(sb.Fragments), 16)
+	if err != nil {
+		return nil, fmt.Errorf("failed to read fragment table: %s", err)
+	}
+	sr.fragments = make([]fragmentEntry, sb.Fragments)
+	for i := range sr.fragments {
+		sr.fragments[i].Start = binary.LittleEndian.Uint64(frags[i*16:])
+		sr.fragments[i].Size = binary.LittleEndian.Uint32(frags[i*16+8:])
+	}
+
+	if sb.Flags&flagNoXattrs == 0 && sb.XattrIDTableStart != ^uint64(0) {
+		hdr := xattrTableHeader{}
+		section := io.NewSectionReader(r, int64(sb.XattrIDTableStart), 16)
+		if err := binary.Read(section, binary.LittleEndian, &hdr); err != nil {
+			return nil, fmt.Errorf("failed to read xattr table: %s", err)
+		}
+		entries, err := sr.readTable(sb.XattrIDTableStart+16, int(hdr.IDs), 16)
+		if err != nil {
+			return nil, fmt.Errorf("failed to read xattr id table: %s", err)
+		}
+		sr.xattrTableStart = hdr.TableStart
+		sr.xattrIDs = make([]xattrIDEntry, hdr.IDs)
+		for i := range sr.xattrIDs {
+			sr.xattrIDs[i].Ref = binary.LittleEndian.Uint64(entries[i*16:])
+			sr.xattrIDs[i].Count = binary.LittleEndian.Uint32(entries[i*16+8:])
+			sr.xattrIDs[i].Size = binary.LittleEndian.Uint32(entries[i*16+12:])
+		}
+	}
+
+	return sr, nil
+}
+
+// BlockSize returns the data block size of the filesystem.
+func (r *Reader) BlockSize() int {
+	return int(r.sb.BlockSize)
+}
+
+// readMetadataBlock reads and decompresses the metadata block located
+// at position pos.
+func (r *Reader) readMetadataBlock(pos int64) (*metadataBlock, error) {
+	var hdr [2]byte
+
+	if _, err := r.r.ReadAt(hdr[:], pos); err != nil {
+		return nil, err
+	}
+	h := binary.LittleEndian.Uint16(hdr[:])
+	size := int(h &^ uncompressedMetadata)
+	if size == 0 || size > metadataSize {
+		return nil, fmt.Errorf("corrupted metadata block at offset %d", pos)
+	}
+
+	src := make([]byte, size)
+	if _, err := r.r.ReadAt(src, pos+2); err != nil {
+		return nil, err
+	}
+
+	block := &metadataBlock{data: src, next: pos + 2 + int64(size)}
+	if h&uncompressedMetadata == 0 {
+		dst := make([]byte, metadataSize)
+		n, err := r.decompress(dst, src)
+		if err != nil {
+			return nil, fmt.Errorf("failed to decompress metadata block at offset %d: %s", pos, err)
+		}
+		block.data = dst[:n]
+	}
+	return block, nil
+}
+
+// metadataBlock returns the metadata block located at position pos
+// from the cache or reads it.
+func (r *Reader) metadataBlock(pos int64) (*metadataBlock, error) {
+	if block, ok := r.metadata[pos]; ok {
+		return block, nil
+	}
+	block, err := r.readMetadataBlock(pos)
+	if err != nil {
+		return nil, err
+	}
+	r.metadata[pos] = block
+	return block, nil
+}
+
+// readTable reads count entries of entrySize bytes from a table stored
+// in metadata blocks referenced by the array of block positions located
+// at start.
+func (r *Reader) readTable(start uint64, count int, entrySize int) ([]byte, error) {
+	if count == 0 {
+		return nil, nil
+	}
+	size := count * entrySize
+	blocks := (size + metadataSize - 1) / metadataSize
+
+	index := make([]byte, blocks*8)
+	if _, err := r.r.ReadAt(index, int64(start)); err != nil {
+		return nil, err
+	}
+
+	table := make([]byte, 0, size)
+	for i := 0; i < blocks; i++ {
+		block, err := r.readMetadataBlock(int64(binary.LittleEndian.Uint64(index[i*8:])))
+		if err != nil {
+			return nil, err
+		}
+		table = append(table, block.data...)
+	}
+	if len(table) < size {
+		return nil, fmt.Errorf("table truncated")
+	}
+	return table[:size], nil
+}
+
+// metadataReader reads a metadata stream across metadata blocks.
+type metadataReader struct {
+	r      *Reader
+	block  *metadataBlock
+	offset int
+}
+
+// newMetadataReader returns a reader positioned at the metadata reference
+// ref relative to the table starting at start.
+func (r *Reader) newMetadataReader(start uint64, ref uint64) (*metadataReader, error) {
+	block, err := r.metadataBlock(int64(start + ref>>16))
+	if err != nil {
+		return nil, err
+	}
+	offset := int(ref & 0xffff)
+	if offset > len(block.data) {
+		return nil, fmt.Errorf("corrupted metadata reference")
+	}
+	return &metadataReader{r: r, block: block, offset: offset}, nil
+}
+
+func (m *metadataReader) Read(p []byte) (int, error) {
+	n := 0
+	for n < len(p) {
+		if m.offset == len(m.block.data) {
+			block, err := m.r.metadataBlock(m.block.next)
+			if err != nil {
+				return n, err
+			}
+			m.block = block
+			m.offset = 0
+		}
+		c := copy(p[n:], m.block.data[m.offset:])
+		m.offset += c
+		n += c
+	}
+	return n, nil
+}
+
+// readInode reads the inode referenced by ref.
+func (r *Reader) readInode(ref uint64) (*inode, error) {
+	m, err := r.newMetadataReader(r.sb.InodeTableStart, ref)
+	if err != nil {
+		return nil, err
+	}
+
+	hdr := inodeHeader{}
+	if err := binary.Read(m, binary.LittleEndian, &hdr); err != nil {
+		return nil, err
+	}
+	if int(hdr.UID) >= len(r.ids) || int(hdr.GID) >= len(r.ids) {
+		return nil, fmt.Errorf("corrupted inode %d: bad uid/gid index", hdr.Number)
+	}
+
+	in := &inode{
+		typ:    hdr.Type,
+		mode:   hdr.Mode,
+		uid:    r.ids[hdr.UID],
+		gid:    r.ids[hdr.GID],
+		mtime:  hdr.Mtime,
+		number: hdr.Number,
+		nlink:  1,
+		xattr:  invalidXattr,
+	}
+
+	switch hdr.Type {
+	case dirType:
+		d := dirInode{}
+		if err := binary.Read(m, binary.LittleEndian, &d); err != nil {
+			return nil, err
+		}
+		in.nlink = d.Nlink
+		in.dirBlock = d.BlockIndex
+		in.dirOffset = d.Offset
+		in.dirSize = uint32(d.Size)
+	case extDirType:
+		d := extDirInode{}
+		if err := binary.Read(m, binary.LittleEndian, &d); err != nil {
+			return nil, err
+		}
+		in.nlink = d.Nlink
+		in.dirBlock = d.BlockIndex
+		in.dirOffset = d.Offset
+		in.dirSize = d.Size
+		in.xattr = d.Xattr
+	case fileType:
+		f := fileInode{}
+		if err := binary.Read(m, binary.LittleEndian, &f); err != nil {
+			return nil, err
+		}
+		in.blocksStart = uint64(f.BlocksStart)
+		in.size = uint64(f.Size)
+		in.fragment = f.Fragment
+		in.fragOffset = f.Offset
+	case extFileType:
+		f := extFileInode{}
+		if err := binary.Read(m, binary.LittleEndian, &f); err != nil {
+			return nil, err
+		}
+		in.nlink = f.Nlink
+		in.blocksStart = f.BlocksStart
+		in.size = f.Size
+		in.fragment = f.Fragment
+		in.fragOffset = f.Offset
+		in.xattr = f.Xattr
+	case symlinkType, extSymlinkType:
+		s := symlinkInode{}
+		if err := binary.Read(m, binary.LittleEndian, &s); err != nil {
+			return nil, err
+		}
+		if s.Size > 4096 {
+			return nil, fmt.Errorf("corrupted inode %d: symlink target too long", hdr.Number)
+		}
+		target := make([]byte, s.Size)
+		if _, err := io.ReadFull(m, target); err != nil {
+			return nil, err
+		}
+		in.nlink = s.Nlink
+		in.target = string(target)
+		if hdr.Type == extSymlinkType {
+			if err := binary.Read(m, binary.LittleEndian, &in.xattr); err != nil {
+				return nil, err
+			}
+		}
+	case blockDevType, charDevType, extBlockDevType, extCharDevType:
+		d := devInode{}
+		if err := binary.Read(m, binary.LittleEndian, &d); err != nil {
+			return nil, err
+		}
+		in.nlink = d.Nlink
+		in.rdev = d.Rdev
+		if hdr.Type == extBlockDevType || hdr.Type == extCharDevType {
+			if err := binary.Read(m, binary.LittleEndian, &in.xattr); err != nil {
+				return nil, err
+			}
+		}
+	case fifoType, socketType, extFifoType, extSocketType:
+		if err := binary.Read(m, binary.LittleEndian, &in.nlink); err != nil {
+			return nil, err
+		}
+		if hdr.Type == extFifoType || hdr.Type == extSocketType {
+			if err := binary.Read(m, binary.LittleEndian, &in.xattr); err != nil {
+				return nil, err
+			}
+		}
+	default:
+		return nil, fmt.Errorf("corrupted inode %d: unknown type %d", hdr.Number, hdr.Type)
+	}
+
+	if hdr.Type == fileType || hdr.Type == extFileType {
+		if in.fragment != invalidFragment && int(in.fragment) >= len(r.fragments) {
+			return nil, fmt.Errorf("corrupted inode %d: bad fragment index", hdr.Number)
+		}
+		in.blockSizes = make([]uint32, r.blockCount(in))
+		if err := binary.Read(m, binary.LittleEndian, in.blockSizes); err != nil {
+			return nil, err
+		}
+	}
+
+	return in, nil
+}
+
+// blockCount returns the number of data blocks of a regular file, the
+// file tail stored in a fragment is not part of the data blocks.
+func (r *Reader) blockCount(in *inode) int {
+	count := in.size >> r.sb.BlockLog
+	if in.fragment == invalidFragment && in.size&uint64(r.sb.BlockSize-1) != 0 {
+		count++
+	}
+	return int(count)
+}
+
+// readDir returns the entries of the directory inode.
+func (r *Reader) readDir(in *inode) ([]dirEntry, error) {
+	// directory size includes the implicit . and .. entries
+	size := int(in.dirSize) - 3
+	if size <= 0 {
+		return nil, nil
+	}
+
+	m, err := r.newMetadataReader(r.sb.DirectoryTableStart, uint64(in.dirBlock)<<16|uint64(in.dirOffset))
+	if err != nil {
+		return nil, err
+	}
+
+	var entries []dirEntry
+
+	for read := 0; read < size; {
+		hdr := dirHeader{}
+		if err := binary.Read(m, binary.LittleEndian, &hdr); err != nil {
+			return nil, err
+		}
+		read += 12
+		if hdr.Count >= maxDirEntries {
+			return nil, fmt.Errorf("corrupted directory inode %d", in.number)
+		}
+
+		for i := uint32(0); i <= hdr.Count; i++ {
+			e := dirEntryHeader{}
+			if err := binary.Read(m, binary.LittleEndian, &e); err != nil {
+				return nil, err
+			}
+			name := make([]byte, int(e.NameSize)+1)
+			if _, err := io.ReadFull(m, name); err != nil {
+				return nil, err
+			}
+			read += 8 + len(name)
+
+			n := string(name)
+			if n == "." || n == ".." || strings.ContainsRune(n, '/') || strings.ContainsRune(n, 0) {
+				return nil, fmt.Errorf("corrupted directory inode %d: bad entry name %q", in.number, n)
+			}
+			entries = append(entries, dirEntry{
+				name: n,
+				ref:  uint64(hdr.Start)<<16 | uint64(e.Offset),
+			})
+		}
+	}
+
+	return entries, nil
+}
+
+// readXattrs returns the extended attributes referenced by the xattr index.
+func (r *Reader) readXattrs(index uint32) ([]xattr, error) {
+	if index == invalidXattr {
+		return nil, nil
+	}
+	if int(index) >= len(r.xattrIDs) {
+		return nil, fmt.Errorf("corrupted xattr index %d", index)
+	}
+
+	id := r.xattrIDs[index]
+	m, err := r.newMetadataReader(r.xattrTableStart, id.Ref)
+	if err != nil {
+		return nil, err
+	}
+
+	xattrs := make([]xattr, 0, id.Count)
+	for i := uint32(0); i < id.Count; i++ {
+		key := xattrKey{}
+		if err := binary.Read(m, binary.LittleEndian, &key); err != nil {
+			return nil, err
+		}
+		prefix := int(key.Type & xattrPrefixMask)
+		if prefix >= len(xattrPrefixes) {
+			return nil, fmt.Errorf("corrupted xattr: unknown type %d", key.Type)
+		}
+		name := make([]byte, key.Size)
+		if _, err := io.ReadFull(m, name); err != nil {
+			return nil, err
+		}
+		value, err := readXattrValue(m)
+		if err != nil {
+			return nil, err
+		}
+		if key.Type&xattrValueOOL != 0 {
+			// value is stored out of line, read it from its reference
+			if len(value) != 8 {
+				return nil, fmt.Errorf("corrupted xattr: bad value reference")
+			}
+			ool, err := r.newMetadataReader(r.xattrTableStart, binary.LittleEndian.Uint64(value))
+			if err != nil {
+				return nil, err
+			}
+			if value, err = readXattrValue(ool); err != nil {
+				return nil, err
+			}
+		}
+		xattrs = append(xattrs, xattr{
+			name:  xattrPrefixes[prefix] + string(name),
+			value: value,
+		})
+	}
+
+	return xattrs, nil
+}
+
+func readXattrValue(m *metadataReader) ([]byte, error) {
+	var size uint32
+
+	if err := binary.Read(m, binary.LittleEndian, &size); err != nil {
+		return nil, err
+	}
+	if size > 64*1024 {
+		return nil, fmt.Errorf("corrupted xattr: value too large")
+	}
+	value := make([]byte, size)
+	if _, err := io.ReadFull(m, value); err != nil {
+		return nil, err
+	}
+	return value, nil
+}
+
+// fragmentBlock returns the decompressed fragment block at index.
+func (r *Reader) fragmentBlock(index uint32) ([]byte, error) {
+	r.fragmentMutex.Lock()
+	frag, ok := r.fragmentCache[index]
+	if !ok {
+		if len(r.fragmentCache) >= maxCachedFragments {
+			for k := range r.fragmentCache {
+				delete(r.fragmentCache, k)
+				break
+			}
+		}
+		frag = &fragmentBlock{}
+		r.fragmentCache[index] = frag
+	}
+	r.fragmentMutex.Unlock()
+
+	frag.once.Do(func() {
+		entry := r.fragments[index]
+		frag.data, frag.err = r.readBlock(int64(entry.Start), entry.Size, make([]byte, r.sb.BlockSize))
+	})
+	return frag.data, frag.err
+}
+
+// readBlock reads the data block located at pos with its on-disk size
+// word and returns its decompressed content stored in buf.
+func (r *Reader) readBlock(pos int64, size uint32, buf []byte) ([]byte, error) {
+	length := size &^ uncompressedBlock
+	if length > r.sb.BlockSize {
+		return nil, fmt.Errorf("corrupted data block at offset %d", pos)
+	}
+	src := make([]byte, length)
+	if _, err := r.r.ReadAt(src, pos); err != nil {
+		return nil, err
+	}
+	return r.blockData(src, size, buf)
+}
+
+// blockData returns the decompressed content of the data block src
+// stored in buf, or src itself if the block is not compressed.
+func (r *Reader) blockData(src []byte, size uint32, buf []byte) ([]byte, error) {
+	if size&uncompressedBlock != 0 {
+		return src, nil
+	}
+	n, err := r.decompress(buf, src)
+	if err != nil {
+		return nil, fmt.Errorf("failed to decompress data block: %s", err)
+	}
+	return buf[:n], nil
+}
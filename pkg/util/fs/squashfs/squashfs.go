@@ -0,0 +1,186 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// Package squashfs provides an in-process implementation of the squashfs v4
+// filesystem format.
+package squashfs
+
+import (
+	"errors"
+)
+
+// Compression identifiers as stored in the super block.
+const (
+	GzipCompression = 1
+	LzmaCompression = 2
+	LzoCompression  = 3
+	XzCompression   = 4
+	Lz4Compression  = 5
+	ZstdCompression = 6
+)
+
+const (
+	magic        = 0x73717368
+	superSize    = 96
+	metadataSize = 8192
+
+	invalidFragment = 0xffffffff
+	invalidXattr    = 0xffffffff
+
+	uncompressedBlock    = 1 << 24
+	uncompressedMetadata = 1 << 15
+
+	// maximum number of entries in a directory header
+	maxDirEntries = 256
+)
+
+// super block flags
+const (
+	flagNoXattrs          = 0x0200
+	flagCompressorOptions = 0x0400
+)
+
+// inode types
+const (
+	dirType = iota + 1
+	fileType
+	symlinkType
+	blockDevType
+	charDevType
+	fifoType
+	socketType
+	extDirType
+	extFileType
+	extSymlinkType
+	extBlockDevType
+	extCharDevType
+	extFifoType
+	extSocketType
+)
+
+// xattr name prefixes indexed by xattr type
+var xattrPrefixes = []string{"user.", "trusted.", "security."}
+
+const (
+	xattrPrefixMask = 0xff
+	xattrValueOOL   = 0x100
+)
+
+// ErrUnsupportedCompression is returned when the filesystem is compressed
+// with an algorithm or with compressor options not handled in-process.
+var ErrUnsupportedCompression = errors.New("unsupported squashfs compression")
+
+// superblock represents a squashfs v4 super block.
+type superblock struct {
+	Magic               uint32
+	Inodes              uint32
+	MkfsTime            uint32
+	BlockSize           uint32
+	Fragments           uint32
+	Compression         uint16
+	BlockLog            uint16
+	Flags               uint16
+	IDCount             uint16
+	Major               uint16
+	Minor               uint16
+	RootInode           uint64
+	BytesUsed           uint64
+	IDTableStart        uint64
+	XattrIDTableStart   uint64
+	InodeTableStart     uint64
+	DirectoryTableStart uint64
+	FragmentTableStart  uint64
+	ExportTableStart    uint64
+}
+
+type inodeHeader struct {
+	Type   uint16
+	Mode   uint16
+	UID    uint16
+	GID    uint16
+	Mtime  uint32
+	Number uint32
+}
+
+type dirInode struct {
+	BlockIndex uint32
+	Nlink      uint32
+	Size       uint16
+	Offset     uint16
+	Parent     uint32
+}
+
+type extDirInode struct {
+	Nlink      uint32
+	Size       uint32
+	BlockIndex uint32
+	Parent     uint32
+	IndexCount uint16
+	Offset     uint16
+	Xattr      uint32
+}
+
+type fileInode struct {
+	BlocksStart uint32
+	Fragment    uint32
+	Offset      uint32
+	Size        uint32
+}
+
+type extFileInode struct {
+	BlocksStart uint64
+	Size        uint64
+	Sparse      uint64
+	Nlink       uint32
+	Fragment    uint32
+	Offset      uint32
+	Xattr       uint32
+}
+
+type symlinkInode struct {
+	Nlink uint32
+	Size  uint32
+}
+
+type devInode struct {
+	Nlink uint32
+	Rdev  uint32
+}
+
+type dirHeader struct {
+	Count uint32
+	Start uint32
+	Inode uint32
+}
+
+type dirEntryHeader struct {
+	Offset      uint16
+	InodeOffset int16
+	Type        uint16
+	NameSize    uint16
+}
+
+type fragmentEntry struct {
+	Start  uint64
+	Size   uint32
+	Unused uint32
+}
+
+type xattrIDEntry struct {
+	Ref   uint64
+	Count uint32
+	Size  uint32
+}
+
+type xattrTableHeader struct {
+	TableStart uint64
+	IDs        uint32
+	Unused     uint32
+}
+
+type xattrKey struct {
+	Type uint16
+	Size uint16
+}
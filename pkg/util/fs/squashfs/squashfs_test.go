@@ -0,0 +1,119 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+func TestExtract(t *testing.T) {
+	tests := []struct {
+		name    string
+		path    string
+		success bool
+	}{
+		{
+			name:    "gzip",
+			path:    "../../../image/testdata/squashfs.v4",
+			success: true,
+		},
+		{
+			name:    "lzo",
+			path:    "../../../image/testdata/squashfs.lzo",
+			success: true,
+		},
+		{
+			name:    "v3",
+			path:    "../../../image/testdata/squashfs.v3",
+			success: false,
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			f, err := os.Open(tt.path)
+			if err != nil {
+				t.Fatal(err)
+			}
+			defer f.Close()
+
+			r, err := NewReader(f)
+			if err != nil && tt.success {
+				t.Fatalf("unexpected error: %s", err)
+			} else if err == nil && !tt.success {
+				t.Fatalf("unexpected success")
+			} else if err != nil {
+				return
+			}
+
+			dir, err := ioutil.TempDir("", "squashfs-")
+			if err != nil {
+				t.Fatal(err)
+			}
+			defer os.RemoveAll(dir)
+
+			if err := r.Extract(nil, dir); err != nil {
+				t.Fatalf("unexpected error: %s", err)
+			}
+			b, err := ioutil.ReadFile(filepath.Join(dir, "examplefile"))
+			if err != nil {
+				t.Fatal(err)
+			}
+			if string(b) != "Example File Contents\n" {
+				t.Errorf("unexpected content %q", b)
+			}
+		})
+	}
+}
+
+func TestLz4Decompress(t *testing.T) {
+	tests := []struct {
+		name    string
+		block   []byte
+		output  string
+		success bool
+	}{
+		{
+			name:    "literals",
+			block:   append([]byte{0x30}, "abc"...),
+			output:  "abc",
+			success: true,
+		},
+		{
+			name:    "overlapping match",
+			block:   append(append([]byte{0x44}, "abcd\x04\x00\x30"...), "xyz"...),
+			output:  "abcdabcdabcdxyz",
+			success: true,
+		},
+		{
+			name:    "bad offset",
+			block:   append([]byte{0x44}, "abcd\x08\x00"...),
+			success: false,
+		},
+		{
+			name:    "truncated",
+			block:   append([]byte{0x50}, "abc"...),
+			success: false,
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			dst := make([]byte, 64)
+			n, err := lz4Decompress(dst, tt.block)
+			if err != nil && tt.success {
+				t.Fatalf("unexpected error: %s", err)
+			} else if err == nil && !tt.success {
+				t.Fatalf("unexpected success")
+			} else if err == nil && string(dst[:n]) != tt.output {
+				t.Fatalf("unexpected output %q instead of %q", dst[:n], tt.output)
+			}
+		})
+	}
+}
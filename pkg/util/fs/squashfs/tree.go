@@ -0,0 +1,319 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"fmt"
+	"io"
+	"os"
+	"path"
+	"path/filepath"
+	"sort"
+	"strings"
+	"syscall"
+	"time"
+)
+
+// File describes an entry of a Tree.
+type File struct {
+	// Mode holds the file type and permission bits.
+	Mode os.FileMode
+	UID  uint32
+	GID  uint32
+	// Mtime is the modification time.
+	Mtime time.Time
+	// Size is the size of a regular file.
+	Size int64
+	// Target is the target of a symbolic link.
+	Target string
+	// Rdev is the device number of block and character devices.
+	Rdev uint64
+	// Xattrs holds the extended attributes, only the user, trusted and
+	// security namespaces are stored.
+	Xattrs map[string][]byte
+	// Open returns the content of a regular file, it is called once
+	// when the filesystem is created and must return Size bytes.
+	Open func() (io.ReadCloser, error)
+}
+
+type treeNode struct {
+	file     *File
+	children map[string]*treeNode
+}
+
+// Tree is an in-memory directory tree used to create a filesystem from
+// other sources than a directory, e.g. by merging archives. Regular files
+// are only read when the filesystem is created. Entries are named by their
+// slash separated path relative to the tree root.
+type Tree struct {
+	root    *treeNode
+	closers []io.Closer
+}
+
+// NewTree returns a tree with an empty root directory.
+func NewTree() *Tree {
+	return &Tree{
+		root: &treeNode{
+			file:     &File{Mode: os.ModeDir | 0755, Mtime: time.Unix(0, 0)},
+			children: make(map[string]*treeNode),
+		},
+	}
+}
+
+// splitPath returns the components of name, "." and "/" are the root.
+func splitPath(name string) []string {
+	name = strings.TrimPrefix(path.Clean("/"+name), "/")
+	if name == "" {
+		return nil
+	}
+	return strings.Split(name, "/")
+}
+
+// lookup returns the node of name, nil if it doesn't exist. With create
+// set, missing directories are created with a default mode.
+func (t *Tree) lookup(parts []string, create bool) *treeNode {
+	n := t.root
+	for _, p := range parts {
+		if n.children == nil {
+			return nil
+		}
+		c, ok := n.children[p]
+		if !ok {
+			if !create {
+				return nil
+			}
+			c = &treeNode{
+				file:     &File{Mode: os.ModeDir | 0755, Mtime: time.Unix(0, 0)},
+				children: make(map[string]*treeNode),
+			}
+			n.children[p] = c
+		}
+		n = c
+	}
+	return n
+}
+
+// maxSymlinks is the number of symbolic links followed when resolving a
+// name, like the kernel limit.
+const maxSymlinks = 40
+
+// resolve returns name with the symbolic links of the tree found in its
+// parent directories resolved, and in name itself with follow set. Like in
+// a chroot, absolute targets and ".." are resolved from the tree root.
+func (t *Tree) resolve(name string, follow bool) string {
+	var resolved []string
+
+	parts := splitPath(name)
+	links := 0
+	for len(parts) > 0 {
+		p := parts[0]
+		parts = parts[1:]
+
+		switch p {
+		case "", ".":
+			continue
+		case "..":
+			if len(resolved) > 0 {
+				resolved = resolved[:len(resolved)-1]
+			}
+			continue
+		}
+
+		if len(parts) > 0 || follow {
+			// the full slice expression prevents append from
+			// modifying resolved
+			n := t.lookup(append(resolved[:len(resolved):len(resolved)], p), false)
+			if n != nil && n.file.Mode&os.ModeSymlink != 0 && links < maxSymlinks {
+				links++
+				if path.IsAbs(n.file.Target) {
+					resolved = nil
+				}
+				parts = append(strings.Split(n.file.Target, "/"), parts...)
+				continue
+			}
+		}
+		resolved = append(resolved, p)
+	}
+	return strings.Join(resolved, "/")
+}
+
+// Get returns the entry name, nil if it doesn't exist.
+func (t *Tree) Get(name string) *File {
+	if n := t.lookup(splitPath(name), false); n != nil {
+		return n.file
+	}
+	return nil
+}
+
+// ReadDir returns the sorted entry names of the directory name.
+func (t *Tree) ReadDir(name string) []string {
+	n := t.lookup(splitPath(name), false)
+	if n == nil || n.children == nil {
+		return nil
+	}
+	names := make([]string, 0, len(n.children))
+	for c := range n.children {
+		names = append(names, c)
+	}
+	sort.Strings(names)
+	return names
+}
+
+// Put adds f as name, missing parent directories are created. A directory
+// replacing a directory keeps its entries, any other existing entry is
+// replaced.
+func (t *Tree) Put(name string, f *File) error {
+	parts := splitPath(name)
+	if len(parts) == 0 {
+		if !f.Mode.IsDir() {
+			return fmt.Errorf("root must be a directory")
+		}
+		t.root.file = f
+		return nil
+	}
+	parent := t.lookup(parts[:len(parts)-1], true)
+	if parent == nil || parent.children == nil {
+		return fmt.Errorf("%s: parent is not a directory", name)
+	}
+
+	base := parts[len(parts)-1]
+	if old, ok := parent.children[base]; ok && old.children != nil && f.Mode.IsDir() {
+		old.file = f
+		return nil
+	}
+	n := &treeNode{file: f}
+	if f.Mode.IsDir() {
+		n.children = make(map[string]*treeNode)
+	}
+	parent.children[base] = n
+	return nil
+}
+
+// Link adds name as a hard link to the existing entry target.
+func (t *Tree) Link(name, target string) error {
+	f := t.Get(target)
+	if f == nil {
+		return fmt.Errorf("%s: hard link target %s not found", name, target)
+	}
+	if f.Mode.IsDir() {
+		return fmt.Errorf("%s: hard link target %s is a directory", name, target)
+	}
+	return t.Put(name, f)
+}
+
+// Remove removes the entry name and its children if it's a directory.
+func (t *Tree) Remove(name string) {
+	parts := splitPath(name)
+	if len(parts) == 0 {
+		t.root.children = make(map[string]*treeNode)
+		return
+	}
+	if parent := t.lookup(parts[:len(parts)-1], false); parent != nil && parent.children != nil {
+		delete(parent.children, parts[len(parts)-1])
+	}
+}
+
+// AddCloser registers c to be closed by Close, typically the source of
+// the content of regular files.
+func (t *Tree) AddCloser(c io.Closer) {
+	t.closers = append(t.closers, c)
+}
+
+// Close closes the registered sources, the content of the regular files
+// can't be read afterward.
+func (t *Tree) Close() error {
+	var err error
+	for _, c := range t.closers {
+		if cerr := c.Close(); err == nil {
+			err = cerr
+		}
+	}
+	t.closers = nil
+	return err
+}
+
+// Walk calls fn for each entry of the tree, parent directories first.
+func (t *Tree) Walk(fn func(name string, f *File) error) error {
+	return t.walk("", t.root, fn)
+}
+
+func (t *Tree) walk(name string, n *treeNode, fn func(string, *File) error) error {
+	if err := fn(name, n.file); err != nil {
+		return err
+	}
+	names := make([]string, 0, len(n.children))
+	for c := range n.children {
+		names = append(names, c)
+	}
+	sort.Strings(names)
+	for _, c := range names {
+		if err := t.walk(path.Join(name, c), n.children[c], fn); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// MergeDir adds the content of the directory dir to the tree, existing
+// directories keep their metadata and other existing entries are replaced.
+// Like when copying dir over the tree, the content of a directory is merged
+// into the target of a symbolic link to a directory of the tree, e.g. the
+// files of etc into private/etc if etc is a link to it. Hard links within
+// dir are preserved, extended attributes are not merged. Regular files are
+// read from dir when the filesystem is created.
+func (t *Tree) MergeDir(dir string) error {
+	links := make(map[[2]uint64]string)
+
+	return filepath.Walk(dir, func(p string, fi os.FileInfo, err error) error {
+		if err != nil {
+			return err
+		}
+		rel, err := filepath.Rel(dir, p)
+		if err != nil {
+			return err
+		}
+		name := filepath.ToSlash(rel)
+		st, ok := fi.Sys().(*syscall.Stat_t)
+		if !ok {
+			return fmt.Errorf("could not get file information of %s", p)
+		}
+
+		if fi.IsDir() {
+			if n := t.lookup(splitPath(t.resolve(name, true)), false); n != nil && n.children != nil {
+				return nil
+			}
+		}
+		name = t.resolve(name, false)
+
+		if !fi.IsDir() && st.Nlink > 1 {
+			key := [2]uint64{uint64(st.Dev), uint64(st.Ino)}
+			if target, ok := links[key]; ok {
+				return t.Link(name, target)
+			}
+			links[key] = name
+		}
+
+		f := &File{
+			Mode:  fi.Mode(),
+			UID:   st.Uid,
+			GID:   st.Gid,
+			Mtime: fi.ModTime(),
+			Rdev:  uint64(st.Rdev),
+		}
+		switch {
+		case fi.Mode().IsRegular():
+			f.Size = fi.Size()
+			f.Open = func() (io.ReadCloser, error) {
+				return os.Open(p)
+			}
+		case fi.Mode()&os.ModeSymlink != 0:
+			if f.Target, err = os.Readlink(p); err != nil {
+				return err
+			}
+		}
+		return t.Put(name, f)
+	})
+}
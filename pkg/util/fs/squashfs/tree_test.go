@@ -0,0 +1,122 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"reflect"
+	"testing"
+)
+
+func TestTree(t *testing.T) {
+	tree := NewTree()
+
+	file := &File{Mode: 0644}
+	if err := tree.Put("a/b/file", file); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	if f := tree.Get("a/b"); f == nil || !f.Mode.IsDir() {
+		t.Fatalf("parent directory not created")
+	}
+	if err := tree.Put("a/b/file/c", file); err == nil {
+		t.Errorf("unexpected success with a file as parent")
+	}
+
+	// a directory replacing a directory keeps its entries
+	dir := &File{Mode: os.ModeDir | 0700}
+	if err := tree.Put("./a/b/", dir); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	if tree.Get("a/b") != dir || tree.Get("a/b/file") != file {
+		t.Errorf("directory entries not kept")
+	}
+
+	if err := tree.Link("a/link", "a/b/file"); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	if tree.Get("a/link") != file {
+		t.Errorf("hard link doesn't share the file")
+	}
+	if err := tree.Link("a/link2", "a/b"); err == nil {
+		t.Errorf("unexpected success with a directory hard link")
+	}
+	if err := tree.Link("a/link2", "missing"); err == nil {
+		t.Errorf("unexpected success with a missing target")
+	}
+
+	if names := tree.ReadDir("a"); !reflect.DeepEqual(names, []string{"b", "link"}) {
+		t.Errorf("unexpected entries %v", names)
+	}
+
+	// a file replacing a directory removes its entries
+	if err := tree.Put("a/b", file); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	if tree.Get("a/b/file") != nil {
+		t.Errorf("directory entries kept")
+	}
+
+	tree.Remove("a")
+	if tree.Get("a/link") != nil || tree.Get("a") != nil {
+		t.Errorf("directory not removed")
+	}
+	if names := tree.ReadDir("/"); len(names) != 0 {
+		t.Errorf("unexpected entries %v", names)
+	}
+	if err := tree.Put("/", file); err == nil {
+		t.Errorf("unexpected success with a file as root")
+	}
+}
+
+func TestMergeDirSymlink(t *testing.T) {
+	dir, err := ioutil.TempDir("", "squashfs-tree-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	for _, name := range []string{"etc/sub/file", "abs/file", "loop/file", "link/file"} {
+		if err := os.MkdirAll(filepath.Join(dir, filepath.Dir(name)), 0755); err != nil {
+			t.Fatal(err)
+		}
+		if err := ioutil.WriteFile(filepath.Join(dir, name), nil, 0644); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	tree := NewTree()
+	existing := &File{Mode: 0644}
+	tree.Put("private/etc/existing", existing)
+	tree.Put("etc", &File{Mode: os.ModeSymlink | 0777, Target: "private/etc"})
+	tree.Put("abs", &File{Mode: os.ModeSymlink | 0777, Target: "/private/../private/etc"})
+	tree.Put("loop", &File{Mode: os.ModeSymlink | 0777, Target: "loop"})
+	tree.Put("link", &File{Mode: os.ModeSymlink | 0777, Target: "private/etc/existing"})
+
+	if err := tree.MergeDir(dir); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+
+	// directories are merged into the symbolic link targets
+	for _, name := range []string{"private/etc/sub/file", "private/etc/file"} {
+		if f := tree.Get(name); f == nil || !f.Mode.IsRegular() {
+			t.Errorf("%s not merged into the symbolic link target", name)
+		}
+	}
+	if tree.Get("private/etc/existing") != existing {
+		t.Errorf("symbolic link target entries not kept")
+	}
+	if f := tree.Get("etc"); f == nil || f.Mode&os.ModeSymlink == 0 {
+		t.Errorf("symbolic link to a directory replaced")
+	}
+	// other symbolic links are replaced
+	for _, name := range []string{"loop/file", "link/file"} {
+		if f := tree.Get(name); f == nil || !f.Mode.IsRegular() {
+			t.Errorf("%s not merged", name)
+		}
+	}
+}
@@ -0,0 +1,1056 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"bytes"
+	"compress/zlib"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"os"
+	"path"
+	"path/filepath"
+	"runtime"
+	"sort"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"golang.org/x/sys/unix"
+)
+
+// DefaultBlockSize is the data block size used by default, this is
+// the mksquashfs default.
+const DefaultBlockSize = 128 * 1024
+
+// WriterOptions holds options to create a squashfs filesystem.
+type WriterOptions struct {
+	// BlockSize is the data block size, a power of two between 4KiB
+	// and 1MiB, DefaultBlockSize is used if zero.
+	BlockSize int
+	// AllRoot stores all entries as owned by root.
+	AllRoot bool
+	// Processors is the number of goroutines compressing data blocks,
+	// the number of available CPUs is used if zero.
+	Processors int
+}
+
+// WriteStats reports statistics about a created filesystem.
+type WriteStats struct {
+	// Inodes is the number of inodes stored in the filesystem.
+	Inodes int
+	// BytesIn is the amount of file data read from the source.
+	BytesIn int64
+	// BytesOut is the filesystem size including the final padding.
+	BytesOut int64
+}
+
+// writer builds a squashfs filesystem, file data blocks are compressed
+// in parallel and written in order right after the super block, the
+// metadata tables are built in memory and written at the end.
+type writer struct {
+	w         io.WriterAt
+	offset    int64
+	pos       int64
+	opts      WriterOptions
+	blockSize int
+	blockLog  uint16
+
+	root  *node
+	files []*node
+	count uint32
+
+	links     map[devIno]*node
+	ids       []uint32
+	idIndex   map[uint32]uint16
+	xattrs    [][]xattr
+	xattrKeys map[string]uint32
+	fragments []fragmentEntry
+
+	bytesIn int64
+}
+
+type devIno struct {
+	dev uint64
+	ino uint64
+}
+
+// node is an inode to store, hard linked files share the same node.
+type node struct {
+	path   string
+	typ    uint16
+	mode   uint16
+	uid    uint16
+	gid    uint16
+	mtime  uint32
+	number uint32
+	nlink  uint32
+	xattr  uint32
+	parent *node
+
+	// directory
+	entries   []entry
+	dirBlock  uint32
+	dirOffset uint16
+	dirSize   uint32
+
+	// regular file, open is set for tree entries
+	open        func() (io.ReadCloser, error)
+	size        uint64
+	blocksStart uint64
+	blockSizes  []uint32
+	sparse      uint64
+	fragment    uint32
+	fragOffset  uint32
+
+	// symbolic link
+	target string
+
+	// block and character devices
+	rdev uint32
+
+	ref     uint64
+	written bool
+}
+
+type entry struct {
+	name string
+	node *node
+}
+
+// Create creates a gzip compressed squashfs filesystem with the content
+// of the directory src and writes it in w at offset, hard links, sparse
+// files and extended attributes are preserved. Data blocks are compressed
+// in parallel and written sequentially, w doesn't need to be seekable
+// until the super block is written once all tables are stored. The
+// filesystem size is padded to a multiple of 4KiB like mksquashfs does.
+func Create(w io.WriterAt, offset int64, src string, opts WriterOptions) (*WriteStats, error) {
+	sw, err := newWriter(w, offset, opts)
+	if err != nil {
+		return nil, err
+	}
+
+	st := new(unix.Stat_t)
+	if err := unix.Stat(src, st); err != nil {
+		return nil, fmt.Errorf("could not stat %s: %s", src, err)
+	}
+	if st.Mode&unix.S_IFMT != unix.S_IFDIR {
+		return nil, fmt.Errorf("%s is not a directory", src)
+	}
+	root, err := sw.scan(src, st)
+	if err != nil {
+		return nil, err
+	}
+	return sw.create(root)
+}
+
+// CreateFromTree is like Create but with the content of the in-memory
+// tree t, the regular files content is read with their Open function.
+func CreateFromTree(w io.WriterAt, offset int64, t *Tree, opts WriterOptions) (*WriteStats, error) {
+	sw, err := newWriter(w, offset, opts)
+	if err != nil {
+		return nil, err
+	}
+
+	root, err := sw.scanTree("/", t.root, make(map[*File]*node))
+	if err != nil {
+		return nil, err
+	}
+	return sw.create(root)
+}
+
+func newWriter(w io.WriterAt, offset int64, opts WriterOptions) (*writer, error) {
+	if opts.BlockSize == 0 {
+		opts.BlockSize = DefaultBlockSize
+	}
+	if opts.Processors <= 0 {
+		opts.Processors = runtime.NumCPU()
+	}
+	blockLog := uint16(0)
+	for 1<<blockLog < opts.BlockSize {
+		blockLog++
+	}
+	if blockLog < 12 || blockLog > 20 || 1<<blockLog != opts.BlockSize {
+		return nil, fmt.Errorf("invalid block size %d", opts.BlockSize)
+	}
+
+	return &writer{
+		w:         w,
+		offset:    offset,
+		pos:       superSize,
+		opts:      opts,
+		blockSize: opts.BlockSize,
+		blockLog:  blockLog,
+		links:     make(map[devIno]*node),
+		idIndex:   make(map[uint32]uint16),
+		xattrKeys: make(map[string]uint32),
+	}, nil
+}
+
+// create writes the filesystem of the scanned root directory.
+func (w *writer) create(root *node) (*WriteStats, error) {
+	w.root = root
+	w.number(root)
+
+	if err := w.writeData(); err != nil {
+		return nil, err
+	}
+	sb, err := w.writeTables()
+	if err != nil {
+		return nil, err
+	}
+
+	// pad the filesystem to a multiple of 4KiB
+	size := (w.pos + 4095) &^ 4095
+	if pad := size - w.pos; pad > 0 {
+		if err := w.write(make([]byte, pad)); err != nil {
+			return nil, err
+		}
+	}
+
+	buf := new(bytes.Buffer)
+	binary.Write(buf, binary.LittleEndian, sb)
+	if _, err := w.w.WriteAt(buf.Bytes(), w.offset); err != nil {
+		return nil, fmt.Errorf("failed to write super block: %s", err)
+	}
+
+	return &WriteStats{
+		Inodes:   int(w.count),
+		BytesIn:  w.bytesIn,
+		BytesOut: size,
+	}, nil
+}
+
+// write writes b at the current position.
+func (w *writer) write(b []byte) error {
+	if _, err := w.w.WriteAt(b, w.offset+w.pos); err != nil {
+		return err
+	}
+	w.pos += int64(len(b))
+	return nil
+}
+
+// id returns the id table index of the uid or gid.
+func (w *writer) id(id uint32) (uint16, error) {
+	if w.opts.AllRoot {
+		id = 0
+	}
+	if i, ok := w.idIndex[id]; ok {
+		return i, nil
+	}
+	if len(w.ids) > 0xffff {
+		return 0, fmt.Errorf("too many different uid/gid")
+	}
+	i := uint16(len(w.ids))
+	w.ids = append(w.ids, id)
+	w.idIndex[id] = i
+	return i, nil
+}
+
+// scan creates the node of path p and of its children for directories.
+func (w *writer) scan(p string, st *unix.Stat_t) (*node, error) {
+	format := st.Mode & unix.S_IFMT
+
+	if format != unix.S_IFDIR && st.Nlink > 1 {
+		key := devIno{dev: uint64(st.Dev), ino: uint64(st.Ino)}
+		if n, ok := w.links[key]; ok {
+			n.nlink++
+			return n, nil
+		}
+	}
+
+	// only permission bits are stored, the file type is given
+	// by the inode type
+	n := &node{
+		path:     p,
+		mode:     uint16(st.Mode & 07777),
+		nlink:    1,
+		fragment: invalidFragment,
+		xattr:    invalidXattr,
+	}
+	if st.Mtim.Sec > 0 {
+		n.mtime = uint32(st.Mtim.Sec)
+	}
+
+	var err error
+	if n.uid, err = w.id(st.Uid); err != nil {
+		return nil, err
+	}
+	if n.gid, err = w.id(st.Gid); err != nil {
+		return nil, err
+	}
+	if n.xattr, err = w.readXattrs(p); err != nil {
+		return nil, err
+	}
+
+	switch format {
+	case unix.S_IFDIR:
+		n.typ = dirType
+		n.nlink = 2
+		if err := w.scanDir(n); err != nil {
+			return nil, err
+		}
+	case unix.S_IFREG:
+		n.typ = fileType
+		n.size = uint64(st.Size)
+		w.files = append(w.files, n)
+	case unix.S_IFLNK:
+		n.typ = symlinkType
+		if n.target, err = os.Readlink(p); err != nil {
+			return nil, err
+		}
+	case unix.S_IFBLK, unix.S_IFCHR:
+		n.typ = blockDevType
+		if format == unix.S_IFCHR {
+			n.typ = charDevType
+		}
+		major := unix.Major(uint64(st.Rdev))
+		minor := unix.Minor(uint64(st.Rdev))
+		n.rdev = (minor & 0xff) | (major&0xfff)<<8 | (minor&^0xff)<<12
+	case unix.S_IFIFO:
+		n.typ = fifoType
+	case unix.S_IFSOCK:
+		n.typ = socketType
+	default:
+		return nil, fmt.Errorf("unknown file type for %s", p)
+	}
+
+	if format != unix.S_IFDIR && st.Nlink > 1 {
+		w.links[devIno{dev: uint64(st.Dev), ino: uint64(st.Ino)}] = n
+	}
+	return n, nil
+}
+
+// scanDir scans the directory entries sorted by name.
+func (w *writer) scanDir(n *node) error {
+	d, err := os.Open(n.path)
+	if err != nil {
+		return err
+	}
+	names, err := d.Readdirnames(-1)
+	d.Close()
+	if err != nil {
+		return fmt.Errorf("could not read directory %s: %s", n.path, err)
+	}
+	sort.Strings(names)
+
+	n.entries = make([]entry, 0, len(names))
+	for _, name := range names {
+		p := filepath.Join(n.path, name)
+		st := new(unix.Stat_t)
+		if err := unix.Lstat(p, st); err != nil {
+			return fmt.Errorf("could not stat %s: %s", p, err)
+		}
+		child, err := w.scan(p, st)
+		if err != nil {
+			return err
+		}
+		if child.typ == dirType {
+			child.parent = n
+			n.nlink++
+		}
+		n.entries = append(n.entries, entry{name: name, node: child})
+	}
+	return nil
+}
+
+// scanTree creates the node of the tree entry p and of its children for
+// directories, files maps the tree files to their node for hard links.
+func (w *writer) scanTree(p string, tn *treeNode, files map[*File]*node) (*node, error) {
+	f := tn.file
+	if n, ok := files[f]; ok {
+		n.nlink++
+		return n, nil
+	}
+
+	n := &node{
+		path:     p,
+		mode:     uint16(f.Mode.Perm()),
+		nlink:    1,
+		fragment: invalidFragment,
+		xattr:    invalidXattr,
+	}
+	if f.Mode&os.ModeSetuid != 0 {
+		n.mode |= unix.S_ISUID
+	}
+	if f.Mode&os.ModeSetgid != 0 {
+		n.mode |= unix.S_ISGID
+	}
+	if f.Mode&os.ModeSticky != 0 {
+		n.mode |= unix.S_ISVTX
+	}
+	if sec := f.Mtime.Unix(); sec > 0 {
+		n.mtime = uint32(sec)
+	}
+
+	var err error
+	if n.uid, err = w.id(f.UID); err != nil {
+		return nil, err
+	}
+	if n.gid, err = w.id(f.GID); err != nil {
+		return nil, err
+	}
+
+	var set []xattr
+	for name, value := range f.Xattrs {
+		for _, prefix := range xattrPrefixes {
+			if strings.HasPrefix(name, prefix) {
+				set = append(set, xattr{name: name, value: value})
+				break
+			}
+		}
+	}
+	if len(set) > 0 {
+		sort.Slice(set, func(i, j int) bool { return set[i].name < set[j].name })
+		n.xattr = w.xattrIndex(set)
+	}
+
+	switch {
+	case f.Mode.IsDir():
+		n.typ = dirType
+		n.nlink = 2
+		names := make([]string, 0, len(tn.children))
+		for name := range tn.children {
+			names = append(names, name)
+		}
+		sort.Strings(names)
+		n.entries = make([]entry, 0, len(names))
+		for _, name := range names {
+			child, err := w.scanTree(path.Join(p, name), tn.children[name], files)
+			if err != nil {
+				return nil, err
+			}
+			if child.typ == dirType {
+				child.parent = n
+				n.nlink++
+			}
+			n.entries = append(n.entries, entry{name: name, node: child})
+		}
+		return n, nil
+	case f.Mode.IsRegular():
+		n.typ = fileType
+		n.size = uint64(f.Size)
+		n.open = f.Open
+		if n.size > 0 && n.open == nil {
+			return nil, fmt.Errorf("no content for %s", p)
+		}
+		w.files = append(w.files, n)
+	case f.Mode&os.ModeSymlink != 0:
+		n.typ = symlinkType
+		n.target = f.Target
+	case f.Mode&os.ModeDevice != 0:
+		n.typ = blockDevType
+		if f.Mode&os.ModeCharDevice != 0 {
+			n.typ = charDevType
+		}
+		major := unix.Major(f.Rdev)
+		minor := unix.Minor(f.Rdev)
+		n.rdev = (minor & 0xff) | (major&0xfff)<<8 | (minor&^0xff)<<12
+	case f.Mode&os.ModeNamedPipe != 0:
+		n.typ = fifoType
+	case f.Mode&os.ModeSocket != 0:
+		n.typ = socketType
+	default:
+		return nil, fmt.Errorf("unknown file type for %s", p)
+	}
+
+	files[f] = n
+	return n, nil
+}
+
+// readXattrs returns the index of the extended attributes set of path p.
+func (w *writer) readXattrs(p string) (uint32, error) {
+	size, err := unix.Llistxattr(p, nil)
+	if err == unix.ENOTSUP || size <= 0 {
+		return invalidXattr, nil
+	} else if err != nil {
+		return 0, fmt.Errorf("could not list extended attributes of %s: %s", p, err)
+	}
+	list := make([]byte, size)
+	size, err = unix.Llistxattr(p, list)
+	if err != nil {
+		return 0, fmt.Errorf("could not list extended attributes of %s: %s", p, err)
+	}
+
+	var names []string
+	for _, name := range strings.Split(string(list[:size]), "\x00") {
+		for _, prefix := range xattrPrefixes {
+			if strings.HasPrefix(name, prefix) {
+				names = append(names, name)
+				break
+			}
+		}
+	}
+	if len(names) == 0 {
+		return invalidXattr, nil
+	}
+	sort.Strings(names)
+
+	set := make([]xattr, 0, len(names))
+	for _, name := range names {
+		size, err := unix.Lgetxattr(p, name, nil)
+		if err != nil {
+			return 0, fmt.Errorf("could not read extended attribute %s of %s: %s", name, p, err)
+		}
+		value := make([]byte, size)
+		if size, err = unix.Lgetxattr(p, name, value); err != nil {
+			return 0, fmt.Errorf("could not read extended attribute %s of %s: %s", name, p, err)
+		}
+		set = append(set, xattr{name: name, value: value[:size]})
+	}
+	return w.xattrIndex(set), nil
+}
+
+// xattrIndex returns the index of the extended attributes set sorted
+// by name, identical sets are stored once.
+func (w *writer) xattrIndex(set []xattr) uint32 {
+	var key strings.Builder
+	for _, x := range set {
+		fmt.Fprintf(&key, "%d:%s%d:%s", len(x.name), x.name, len(x.value), x.value)
+	}
+
+	if index, ok := w.xattrKeys[key.String()]; ok {
+		return index
+	}
+	index := uint32(len(w.xattrs))
+	w.xattrs = append(w.xattrs, set)
+	w.xattrKeys[key.String()] = index
+	return index
+}
+
+// number assigns inode numbers, children are numbered before their
+// parent directory as they are written in this order.
+func (w *writer) number(n *node) {
+	for _, e := range n.entries {
+		if e.node.typ == dirType {
+			w.number(e.node)
+		} else if e.node.number == 0 {
+			w.count++
+			e.node.number = w.count
+		}
+	}
+	w.count++
+	n.number = w.count
+}
+
+// dataBlock is a data block or a fragment block being compressed.
+type dataBlock struct {
+	node  *node
+	index int
+	data  []byte
+	out   *bytes.Buffer
+	size  uint32
+	done  chan struct{}
+}
+
+// writeData compresses and writes the data blocks of all regular files
+// in scan order followed by their fragment blocks, the tail of files is
+// packed in fragment blocks.
+func (w *writer) writeData() error {
+	var failed int32
+	var readErr, writeErr error
+
+	queue := make(chan *dataBlock, w.opts.Processors*4)
+	work := make(chan *dataBlock, w.opts.Processors*4)
+
+	dataPool := sync.Pool{New: func() interface{} { return make([]byte, w.blockSize) }}
+	outPool := sync.Pool{New: func() interface{} { return new(bytes.Buffer) }}
+	zero := make([]byte, w.blockSize)
+
+	var wg sync.WaitGroup
+	for i := 0; i < w.opts.Processors; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			zw, _ := zlib.NewWriterLevel(nil, zlib.BestCompression)
+			for b := range work {
+				if b.node != nil && bytes.Equal(b.data, zero) {
+					// sparse block
+					b.size = 0
+				} else if atomic.LoadInt32(&failed) == 0 {
+					b.out = outPool.Get().(*bytes.Buffer)
+					b.out.Reset()
+					zw.Reset(b.out)
+					zw.Write(b.data)
+					zw.Close()
+					if b.out.Len() < len(b.data) {
+						b.size = uint32(b.out.Len())
+					} else {
+						b.size = uint32(len(b.data)) | uncompressedBlock
+					}
+				}
+				close(b.done)
+			}
+		}()
+	}
+
+	// blocks are written in order by this goroutine
+	written := make(chan struct{})
+	go func() {
+		defer close(written)
+		for b := range queue {
+			<-b.done
+			if atomic.LoadInt32(&failed) == 0 {
+				if err := w.writeBlock(b); err != nil {
+					writeErr = err
+					atomic.StoreInt32(&failed, 1)
+				}
+			}
+			if b.out != nil {
+				outPool.Put(b.out)
+			}
+			if cap(b.data) == w.blockSize {
+				dataPool.Put(b.data[:w.blockSize])
+			}
+		}
+	}()
+
+	send := func(b *dataBlock) {
+		b.done = make(chan struct{})
+		queue <- b
+		work <- b
+	}
+
+	fragment := dataPool.Get().([]byte)[:0]
+	fragments := uint32(0)
+
+	for _, n := range w.files {
+		if atomic.LoadInt32(&failed) != 0 {
+			break
+		}
+		if err := w.readFile(n, &fragment, &fragments, &dataPool, send); err != nil {
+			readErr = err
+			atomic.StoreInt32(&failed, 1)
+		}
+	}
+	if len(fragment) > 0 && atomic.LoadInt32(&failed) == 0 {
+		send(&dataBlock{data: fragment, index: -1})
+	}
+
+	close(queue)
+	close(work)
+	wg.Wait()
+	<-written
+
+	if readErr != nil {
+		return readErr
+	} else if writeErr != nil {
+		return fmt.Errorf("failed to write data block: %s", writeErr)
+	}
+	return nil
+}
+
+// readFile reads the file data, full blocks are queued for compression
+// and the tail is packed in the current fragment block.
+func (w *writer) readFile(n *node, fragment *[]byte, fragments *uint32, pool *sync.Pool, send func(*dataBlock)) error {
+	if n.size == 0 {
+		return nil
+	}
+
+	var f io.ReadCloser
+	var err error
+	if n.open != nil {
+		f, err = n.open()
+	} else {
+		f, err = os.Open(n.path)
+	}
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+
+	blocks := int(n.size >> w.blockLog)
+	tail := int(n.size & uint64(w.blockSize-1))
+	n.blockSizes = make([]uint32, blocks)
+
+	for i := 0; i < blocks; i++ {
+		data := pool.Get().([]byte)
+		if _, err := io.ReadFull(f, data); err != nil {
+			return fmt.Errorf("could not read %s: %s", n.path, err)
+		}
+		send(&dataBlock{node: n, index: i, data: data})
+	}
+	if tail > 0 {
+		if len(*fragment)+tail > w.blockSize {
+			send(&dataBlock{data: *fragment, index: -1})
+			*fragment = pool.Get().([]byte)[:0]
+			*fragments++
+		}
+		start := len(*fragment)
+		*fragment = (*fragment)[:start+tail]
+		if _, err := io.ReadFull(f, (*fragment)[start:]); err != nil {
+			return fmt.Errorf("could not read %s: %s", n.path, err)
+		}
+		n.fragment = *fragments
+		n.fragOffset = uint32(start)
+	}
+	w.bytesIn += int64(n.size)
+	return nil
+}
+
+// writeBlock writes a compressed block and records its location.
+func (w *writer) writeBlock(b *dataBlock) error {
+	start := uint64(w.pos)
+
+	if b.size != 0 {
+		data := b.data
+		if b.size&uncompressedBlock == 0 {
+			data = b.out.Bytes()
+		}
+		if err := w.write(data); err != nil {
+			return err
+		}
+	}
+
+	if b.node == nil {
+		w.fragments = append(w.fragments, fragmentEntry{Start: start, Size: b.size})
+		return nil
+	}
+	if b.index == 0 {
+		b.node.blocksStart = start
+	}
+	b.node.blockSizes[b.index] = b.size
+	if b.size == 0 {
+		b.node.sparse += uint64(w.blockSize)
+	}
+	return nil
+}
+
+// metadataWriter packs a metadata stream into compressed metadata blocks.
+type metadataWriter struct {
+	buf []byte
+	out bytes.Buffer
+	zw  *zlib.Writer
+	zb  bytes.Buffer
+}
+
+func newMetadataWriter() *metadataWriter {
+	zw, _ := zlib.NewWriterLevel(nil, zlib.BestCompression)
+	return &metadataWriter{zw: zw}
+}
+
+// ref returns the reference of the current position in the stream.
+func (m *metadataWriter) ref() uint64 {
+	return uint64(m.out.Len())<<16 | uint64(len(m.buf))
+}
+
+func (m *metadataWriter) Write(p []byte) (int, error) {
+	m.buf = append(m.buf, p...)
+	for len(m.buf) >= metadataSize {
+		m.flush(m.buf[:metadataSize])
+		m.buf = append(m.buf[:0], m.buf[metadataSize:]...)
+	}
+	return len(p), nil
+}
+
+func (m *metadataWriter) flush(block []byte) {
+	m.zb.Reset()
+	m.zw.Reset(&m.zb)
+	m.zw.Write(block)
+	m.zw.Close()
+
+	var hdr [2]byte
+	data := m.zb.Bytes()
+	if len(data) < len(block) {
+		binary.LittleEndian.PutUint16(hdr[:], uint16(len(data)))
+	} else {
+		binary.LittleEndian.PutUint16(hdr[:], uint16(len(block))|uncompressedMetadata)
+		data = block
+	}
+	m.out.Write(hdr[:])
+	m.out.Write(data)
+}
+
+// bytes flushes the pending data and returns the metadata blocks.
+func (m *metadataWriter) bytes() []byte {
+	if len(m.buf) > 0 {
+		m.flush(m.buf)
+		m.buf = m.buf[:0]
+	}
+	return m.out.Bytes()
+}
+
+// writeMetadata writes the inodes and directory listings of the directory
+// n and of its children, children inodes are written first as directory
+// listings reference them.
+func (w *writer) writeMetadata(inodes, dirs *metadataWriter, n *node) {
+	for _, e := range n.entries {
+		if e.node.typ == dirType {
+			w.writeMetadata(inodes, dirs, e.node)
+		} else if !e.node.written {
+			w.writeInode(inodes, e.node)
+		}
+	}
+	w.writeDir(dirs, n)
+	w.writeInode(inodes, n)
+}
+
+// writeDir writes the listing of the directory n, entries are grouped
+// under headers sharing the same inode metadata block.
+func (w *writer) writeDir(m *metadataWriter, n *node) {
+	ref := m.ref()
+	n.dirBlock = uint32(ref >> 16)
+	n.dirOffset = uint16(ref)
+
+	size := 0
+	for i := 0; i < len(n.entries); {
+		base := n.entries[i].node
+		block := uint32(base.ref >> 16)
+
+		j := i + 1
+		for ; j < len(n.entries) && j-i < maxDirEntries; j++ {
+			c := n.entries[j].node
+			delta := int64(c.number) - int64(base.number)
+			if uint32(c.ref>>16) != block || delta > 32767 || delta < -32768 {
+				break
+			}
+		}
+
+		binary.Write(m, binary.LittleEndian, dirHeader{
+			Count: uint32(j - i - 1),
+			Start: block,
+			Inode: base.number,
+		})
+		size += 12
+		for _, e := range n.entries[i:j] {
+			binary.Write(m, binary.LittleEndian, dirEntryHeader{
+				Offset:      uint16(e.node.ref),
+				InodeOffset: int16(int64(e.node.number) - int64(base.number)),
+				Type:        e.node.typ,
+				NameSize:    uint16(len(e.name) - 1),
+			})
+			m.Write([]byte(e.name))
+			size += 8 + len(e.name)
+		}
+		i = j
+	}
+
+	// size includes the implicit . and .. entries
+	n.dirSize = uint32(size + 3)
+}
+
+// writeInode writes the inode n, the extended inode type is used only
+// when a field doesn't fit in the basic inode type.
+func (w *writer) writeInode(m *metadataWriter, n *node) {
+	n.ref = m.ref()
+	n.written = true
+
+	ext := n.xattr != invalidXattr
+	switch n.typ {
+	case dirType:
+		ext = ext || n.dirSize > 0xffff
+	case fileType:
+		ext = ext || n.nlink > 1 || n.sparse > 0 || n.size > 0xffffffff || n.blocksStart > 0xffffffff
+	}
+	typ := n.typ
+	if ext {
+		typ += extDirType - dirType
+	}
+
+	parent := w.count + 1
+	if n.parent != nil {
+		parent = n.parent.number
+	}
+
+	binary.Write(m, binary.LittleEndian, inodeHeader{
+		Type:   typ,
+		Mode:   n.mode,
+		UID:    n.uid,
+		GID:    n.gid,
+		Mtime:  n.mtime,
+		Number: n.number,
+	})
+
+	switch typ {
+	case dirType:
+		binary.Write(m, binary.LittleEndian, dirInode{
+			BlockIndex: n.dirBlock,
+			Nlink:      n.nlink,
+			Size:       uint16(n.dirSize),
+			Offset:     n.dirOffset,
+			Parent:     parent,
+		})
+	case extDirType:
+		binary.Write(m, binary.LittleEndian, extDirInode{
+			Nlink:      n.nlink,
+			Size:       n.dirSize,
+			BlockIndex: n.dirBlock,
+			Parent:     parent,
+			Offset:     n.dirOffset,
+			Xattr:      n.xattr,
+		})
+	case fileType:
+		binary.Write(m, binary.LittleEndian, fileInode{
+			BlocksStart: uint32(n.blocksStart),
+			Fragment:    n.fragment,
+			Offset:      n.fragOffset,
+			Size:        uint32(n.size),
+		})
+		binary.Write(m, binary.LittleEndian, n.blockSizes)
+	case extFileType:
+		binary.Write(m, binary.LittleEndian, extFileInode{
+			BlocksStart: n.blocksStart,
+			Size:        n.size,
+			Sparse:      n.sparse,
+			Nlink:       n.nlink,
+			Fragment:    n.fragment,
+			Offset:      n.fragOffset,
+			Xattr:       n.xattr,
+		})
+		binary.Write(m, binary.LittleEndian, n.blockSizes)
+	case symlinkType, extSymlinkType:
+		binary.Write(m, binary.LittleEndian, symlinkInode{
+			Nlink: n.nlink,
+			Size:  uint32(len(n.target)),
+		})
+		m.Write([]byte(n.target))
+	case blockDevType, charDevType, extBlockDevType, extCharDevType:
+		binary.Write(m, binary.LittleEndian, devInode{
+			Nlink: n.nlink,
+			Rdev:  n.rdev,
+		})
+	default:
+		binary.Write(m, binary.LittleEndian, n.nlink)
+	}
+
+	if ext && typ != extDirType && typ != extFileType {
+		binary.Write(m, binary.LittleEndian, n.xattr)
+	}
+}
+
+// writeTableBlocks writes a table as metadata blocks and returns the
+// positions of these blocks.
+func (w *writer) writeTableBlocks(table []byte) ([]uint64, error) {
+	m := newMetadataWriter()
+	start := uint64(w.pos)
+
+	var index []uint64
+	for i := 0; i < len(table); i += metadataSize {
+		end := i + metadataSize
+		if end > len(table) {
+			end = len(table)
+		}
+		index = append(index, start+uint64(m.out.Len()))
+		m.Write(table[i:end])
+	}
+	return index, w.write(m.bytes())
+}
+
+// writeTable writes a table as metadata blocks followed by the array of
+// the metadata blocks positions and returns the position of this array.
+func (w *writer) writeTable(table []byte) (uint64, error) {
+	index, err := w.writeTableBlocks(table)
+	if err != nil {
+		return 0, err
+	}
+
+	indexStart := uint64(w.pos)
+	buf := new(bytes.Buffer)
+	binary.Write(buf, binary.LittleEndian, index)
+	return indexStart, w.write(buf.Bytes())
+}
+
+// writeTables writes the inode, directory, fragment, id and xattr tables
+// and returns the resulting super block.
+func (w *writer) writeTables() (*superblock, error) {
+	sb := &superblock{
+		Magic:             magic,
+		Inodes:            w.count,
+		MkfsTime:          uint32(time.Now().Unix()),
+		BlockSize:         uint32(w.blockSize),
+		Fragments:         uint32(len(w.fragments)),
+		Compression:       GzipCompression,
+		BlockLog:          w.blockLog,
+		IDCount:           uint16(len(w.ids)),
+		Major:             4,
+		XattrIDTableStart: ^uint64(0),
+		ExportTableStart:  ^uint64(0),
+	}
+
+	inodes := newMetadataWriter()
+	dirs := newMetadataWriter()
+	w.writeMetadata(inodes, dirs, w.root)
+	sb.RootInode = w.root.ref
+
+	sb.InodeTableStart = uint64(w.pos)
+	if err := w.write(inodes.bytes()); err != nil {
+		return nil, fmt.Errorf("failed to write inode table: %s", err)
+	}
+	sb.DirectoryTableStart = uint64(w.pos)
+	if err := w.write(dirs.bytes()); err != nil {
+		return nil, fmt.Errorf("failed to write directory table: %s", err)
+	}
+
+	var err error
+
+	buf := new(bytes.Buffer)
+	binary.Write(buf, binary.LittleEndian, w.fragments)
+	if sb.FragmentTableStart, err = w.writeTable(buf.Bytes()); err != nil {
+		return nil, fmt.Errorf("failed to write fragment table: %s", err)
+	}
+
+	buf.Reset()
+	binary.Write(buf, binary.LittleEndian, w.ids)
+	if sb.IDTableStart, err = w.writeTable(buf.Bytes()); err != nil {
+		return nil, fmt.Errorf("failed to write id table: %s", err)
+	}
+
+	if len(w.xattrs) == 0 {
+		sb.Flags |= flagNoXattrs
+	} else if sb.XattrIDTableStart, err = w.writeXattrTable(); err != nil {
+		return nil, fmt.Errorf("failed to write xattr table: %s", err)
+	}
+
+	sb.BytesUsed = uint64(w.pos)
+	return sb, nil
+}
+
+// writeXattrTable writes the extended attributes key/value pairs followed
+// by the xattr id table and returns the position of the xattr table header.
+func (w *writer) writeXattrTable() (uint64, error) {
+	kv := newMetadataWriter()
+	ids := make([]xattrIDEntry, len(w.xattrs))
+
+	for i, set := range w.xattrs {
+		ids[i].Ref = kv.ref()
+		ids[i].Count = uint32(len(set))
+		for _, x := range set {
+			for t, prefix := range xattrPrefixes {
+				if !strings.HasPrefix(x.name, prefix) {
+					continue
+				}
+				name := x.name[len(prefix):]
+				binary.Write(kv, binary.LittleEndian, xattrKey{Type: uint16(t), Size: uint16(len(name))})
+				kv.Write([]byte(name))
+				binary.Write(kv, binary.LittleEndian, uint32(len(x.value)))
+				kv.Write(x.value)
+				ids[i].Size += uint32(len(x.name) + 1 + len(x.value))
+				break
+			}
+		}
+	}
+
+	tableStart := uint64(w.pos)
+	if err := w.write(kv.bytes()); err != nil {
+		return 0, err
+	}
+
+	buf := new(bytes.Buffer)
+	binary.Write(buf, binary.LittleEndian, ids)
+	index, err := w.writeTableBlocks(buf.Bytes())
+	if err != nil {
+		return 0, err
+	}
+
+	// the xattr id table index is preceded by a header
+	hdrStart := uint64(w.pos)
+	hdr := new(bytes.Buffer)
+	binary.Write(hdr, binary.LittleEndian, xattrTableHeader{TableStart: tableStart, IDs: uint32(len(ids))})
+	binary.Write(hdr, binary.LittleEndian, index)
+	return hdrStart, w.write(hdr.Bytes())
+}
@@ -0,0 +1,312 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+package squashfs
+
+import (
+	"bytes"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"math/rand"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/sylabs/sif/pkg/sif"
+	"github.com/sylabs/singularity/pkg/image/packer"
+	"golang.org/x/sys/unix"
+)
+
+// createTree populates dir with all supported file types.
+func createTree(t *testing.T, dir string) {
+	random := make([]byte, 3*DefaultBlockSize+123)
+	rand.Read(random)
+
+	files := map[string][]byte{
+		"empty":             nil,
+		"small":             []byte("small file\n"),
+		"block":             bytes.Repeat([]byte("b"), DefaultBlockSize),
+		"random":            random,
+		"sparse":            append(make([]byte, 2*DefaultBlockSize), "tail"...),
+		"dir/sub/nested":    []byte("nested\n"),
+		"dir/sub/hardlink1": []byte("hard linked\n"),
+	}
+	for i := 0; i < 300; i++ {
+		files[fmt.Sprintf("many/file%03d", i)] = []byte(fmt.Sprintf("%d\n", i))
+	}
+
+	for name, content := range files {
+		p := filepath.Join(dir, name)
+		if err := os.MkdirAll(filepath.Dir(p), 0755); err != nil {
+			t.Fatal(err)
+		}
+		if err := ioutil.WriteFile(p, content, 0640); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if err := os.Link(filepath.Join(dir, "dir/sub/hardlink1"), filepath.Join(dir, "hardlink2")); err != nil {
+		t.Fatal(err)
+	}
+	if err := os.Symlink("dir/sub/nested", filepath.Join(dir, "symlink")); err != nil {
+		t.Fatal(err)
+	}
+	if err := unix.Mkfifo(filepath.Join(dir, "fifo"), 0600); err != nil {
+		t.Fatal(err)
+	}
+	if err := os.Chmod(filepath.Join(dir, "dir"), 0700); err != nil {
+		t.Fatal(err)
+	}
+	// extended attributes may not be supported by the underlying filesystem
+	unix.Lsetxattr(filepath.Join(dir, "small"), "user.test", []byte("value"), 0)
+}
+
+// compareTree compares the source and the extracted trees.
+func compareTree(t *testing.T, src, dst string) {
+	err := filepath.Walk(src, func(p string, fi os.FileInfo, err error) error {
+		if err != nil {
+			return err
+		}
+		rel, _ := filepath.Rel(src, p)
+		extracted := filepath.Join(dst, rel)
+
+		efi, err := os.Lstat(extracted)
+		if err != nil {
+			return err
+		}
+		if efi.Mode() != fi.Mode() {
+			return fmt.Errorf("%s: mode %s instead of %s", rel, efi.Mode(), fi.Mode())
+		}
+		if !fi.IsDir() && efi.ModTime().Unix() != fi.ModTime().Unix() {
+			return fmt.Errorf("%s: modification time differs", rel)
+		}
+
+		switch {
+		case fi.Mode().IsRegular():
+			a, _ := ioutil.ReadFile(p)
+			b, err := ioutil.ReadFile(extracted)
+			if err != nil {
+				return err
+			}
+			if !bytes.Equal(a, b) {
+				return fmt.Errorf("%s: content differs", rel)
+			}
+		case fi.Mode()&os.ModeSymlink != 0:
+			a, _ := os.Readlink(p)
+			b, err := os.Readlink(extracted)
+			if err != nil {
+				return err
+			}
+			if a != b {
+				return fmt.Errorf("%s: link target %s instead of %s", rel, b, a)
+			}
+		}
+		return nil
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	a, err := os.Stat(filepath.Join(dst, "dir/sub/hardlink1"))
+	if err != nil {
+		t.Fatal(err)
+	}
+	b, err := os.Stat(filepath.Join(dst, "hardlink2"))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !os.SameFile(a, b) {
+		t.Errorf("hard link not preserved")
+	}
+
+	var value [16]byte
+	if n, err := unix.Lgetxattr(filepath.Join(src, "small"), "user.test", value[:]); err == nil {
+		m, err := unix.Lgetxattr(filepath.Join(dst, "small"), "user.test", value[:])
+		if err != nil || string(value[:m]) != string(value[:n]) {
+			t.Errorf("extended attribute not preserved")
+		}
+	}
+}
+
+func TestCreate(t *testing.T) {
+	tmpDir, err := ioutil.TempDir("", "squashfs-writer-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(tmpDir)
+
+	src := filepath.Join(tmpDir, "src")
+	createTree(t, src)
+
+	tests := []struct {
+		name   string
+		offset int64
+		opts   WriterOptions
+	}{
+		{
+			name: "default",
+		},
+		{
+			name:   "offset",
+			offset: 4096,
+			opts:   WriterOptions{Processors: 1},
+		},
+		{
+			name: "small blocks",
+			opts: WriterOptions{BlockSize: 4096, AllRoot: true},
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			image, err := ioutil.TempFile(tmpDir, "image-")
+			if err != nil {
+				t.Fatal(err)
+			}
+			defer os.Remove(image.Name())
+			defer image.Close()
+
+			stats, err := Create(image, tt.offset, src, tt.opts)
+			if err != nil {
+				t.Fatalf("unexpected error: %s", err)
+			}
+			if stats.BytesOut%4096 != 0 {
+				t.Errorf("filesystem size %d is not padded", stats.BytesOut)
+			}
+
+			r, err := NewReader(io.NewSectionReader(image, tt.offset, stats.BytesOut))
+			if err != nil {
+				t.Fatalf("unexpected error: %s", err)
+			}
+
+			dst := filepath.Join(tmpDir, "dst-"+tt.name)
+			defer os.RemoveAll(dst)
+
+			if err := r.Extract(nil, dst); err != nil {
+				t.Fatalf("unexpected error: %s", err)
+			}
+			compareTree(t, src, dst)
+		})
+	}
+
+	if _, err := Create(nil, 0, src, WriterOptions{BlockSize: 1000}); err == nil {
+		t.Errorf("unexpected success with an invalid block size")
+	}
+}
+
+func TestCreateFromTree(t *testing.T) {
+	tmpDir, err := ioutil.TempDir("", "squashfs-writer-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(tmpDir)
+
+	src := filepath.Join(tmpDir, "src")
+	createTree(t, src)
+
+	// the merged directories keep the tree metadata, other entries
+	// are replaced
+	tree := NewTree()
+	tree.Put("dir", &File{Mode: os.ModeDir | 0700})
+	tree.Put("small", &File{Mode: os.ModeDir | 0755})
+	tree.Put("removed", &File{Mode: 0644, Size: 1, Open: func() (io.ReadCloser, error) {
+		return ioutil.NopCloser(bytes.NewReader([]byte("x"))), nil
+	}})
+	if err := tree.MergeDir(src); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	tree.Remove("removed")
+
+	var value [16]byte
+	if n, err := unix.Lgetxattr(filepath.Join(src, "small"), "user.test", value[:]); err == nil {
+		tree.Get("small").Xattrs = map[string][]byte{
+			"user.test":    value[:n],
+			"system.posix": []byte("ignored"),
+		}
+	}
+
+	image, err := ioutil.TempFile(tmpDir, "image-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer image.Close()
+
+	stats, err := CreateFromTree(image, 0, tree, WriterOptions{})
+	if err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	r, err := NewReader(io.NewSectionReader(image, 0, stats.BytesOut))
+	if err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	dst := filepath.Join(tmpDir, "dst")
+	if err := r.Extract(nil, dst); err != nil {
+		t.Fatalf("unexpected error: %s", err)
+	}
+	compareTree(t, src, dst)
+
+	if _, err := os.Lstat(filepath.Join(dst, "removed")); !os.IsNotExist(err) {
+		t.Errorf("removed entry extracted")
+	}
+}
+
+// BenchmarkCreate compares the in-process writer with mksquashfs on the
+// root filesystem of the busybox test image.
+func BenchmarkCreate(b *testing.B) {
+	tmpDir, err := ioutil.TempDir("", "squashfs-bench-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(tmpDir)
+
+	fimg, err := sif.LoadContainer("../../../../e2e/testdata/busybox.sif", true)
+	if err != nil {
+		b.Fatal(err)
+	}
+	part, _, err := fimg.GetPartPrimSys()
+	if err != nil {
+		b.Fatal(err)
+	}
+	r, err := NewReader(io.NewSectionReader(fimg.Fp, part.Fileoff, part.Filelen))
+	if err != nil {
+		b.Fatal(err)
+	}
+	rootfs := filepath.Join(tmpDir, "rootfs")
+	err = r.Extract(nil, rootfs)
+	fimg.UnloadContainer()
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	image := filepath.Join(tmpDir, "image")
+
+	b.Run("native", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			f, err := os.Create(image)
+			if err != nil {
+				b.Fatal(err)
+			}
+			stats, err := Create(f, 0, rootfs, WriterOptions{AllRoot: true})
+			f.Close()
+			if err != nil {
+				b.Fatal(err)
+			}
+			b.SetBytes(stats.BytesIn)
+		}
+	})
+
+	b.Run("mksquashfs", func(b *testing.B) {
+		s := packer.NewSquashfs()
+		if !s.HasMksquashfs() {
+			b.Skip("mksquashfs not found")
+		}
+		for i := 0; i < b.N; i++ {
+			err := s.Create([]string{rootfs}, image, []string{"-noappend", "-all-root", "-comp", "gzip", "-quiet"})
+			if err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
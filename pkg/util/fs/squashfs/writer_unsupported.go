@@ -0,0 +1,43 @@
+// Copyright (c) 2020, Sylabs Inc. All rights reserved.
+// This software is licensed under a 3-clause BSD license. Please consult the
+// LICENSE.md file distributed with the sources of this project regarding your
+// rights to use or distribute this software.
+
+// +build !linux
+
+package squashfs
+
+import (
+	"fmt"
+	"io"
+)
+
+// DefaultBlockSize is the data block size used by default, this is
+// the mksquashfs default.
+const DefaultBlockSize = 128 * 1024
+
+// WriterOptions holds options to create a squashfs filesystem.
+type WriterOptions struct {
+	BlockSize  int
+	AllRoot    bool
+	Processors int
+}
+
+// WriteStats reports statistics about a created filesystem.
+type WriteStats struct {
+	Inodes   int
+	BytesIn  int64
+	BytesOut int64
+}
+
+// Create creates a squashfs filesystem with the content of the directory
+// src and writes it in w at offset.
+func Create(w io.WriterAt, offset int64, src string, opts WriterOptions) (*WriteStats, error) {
+	return nil, fmt.Errorf("unsupported on this platform")
+}
+
+// CreateFromTree creates a squashfs filesystem with the content of the
+// in-memory tree t and writes it in w at offset.
+func CreateFromTree(w io.WriterAt, offset int64, t *Tree, opts WriterOptions) (*WriteStats, error) {
+	return nil, fmt.Errorf("unsupported on this platform")
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2018-2019, Sylabs Inc. All rights reserved.
+// Copyright (c) 2018-2020, Sylabs Inc. All rights reserved.
 // This software is licensed under a 3-clause BSD license. Please consult the
 // LICENSE.md file distributed with the sources of this project regarding your
 // rights to use or distribute this software.
@@ -6,21 +6,37 @@
 package loop
 
 import (
+	"errors"
 	"fmt"
 	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
 	"syscall"
 	"time"
 	"unsafe"
 
+	"github.com/sylabs/singularity/internal/pkg/sylog"
 	"github.com/sylabs/singularity/pkg/util/fs/lock"
 )
 
+// SharedIndexDir is the node-local directory where attached loop devices
+// are recorded, entries are keyed by image device, inode, offset, size
+// limit and read-only flag so a shared attachment doesn't require to probe
+// every loop device. Each recorded loop device is linked to its entry, so
+// that the stale entry of a reused loop device is removed when the loop
+// device is recorded again.
+var SharedIndexDir = "/var/run/singularity/loop"
+
+// loopControlPath is the path of the loop control device.
+var loopControlPath = "/dev/loop-control"
+
+// errNoLoopControl is returned when the loop control device is not usable.
+var errNoLoopControl = errors.New("loop control device not available")
+
 // AttachFromFile finds a free loop device, opens it, and stores file descriptor
 // provided by image file pointer
 func (loop *Device) AttachFromFile(image *os.File, mode int, number *int) error {
-	var path string
-	var loopFd int
-
 	if image == nil {
 		return fmt.Errorf("empty file pointer")
 	}
@@ -34,6 +50,130 @@ func (loop *Device) AttachFromFile(image *os.File, mode int, number *int) error
 	// cast to uint64 as st.Dev is uint32 on MIPS
 	imageDev := uint64(st.Dev)
 
+	// the index entry lock only serializes attachments of the same image
+	recordIndex := false
+	index, err := openIndexEntry(imageDev, imageIno, loop.Info)
+	if err != nil {
+		sylog.Debugf("Loop device index not available: %s", err)
+	} else {
+		defer index.close()
+
+		loopFd, device := loop.lookupIndex(index, imageDev, imageIno, mode)
+		if loopFd >= 0 && loop.Shared {
+			// keep the reference to the loop device file descriptor to
+			// be sure that the loop device won't be released between this
+			// check and the mount of the filesystem
+			*number = device
+			return nil
+		} else if loopFd >= 0 {
+			// keep the recorded loop device for shared attachments
+			syscall.Close(loopFd)
+		} else {
+			recordIndex = true
+		}
+	}
+
+	loopFd, err := loop.attachFree(image, mode, number)
+	if err == nil {
+		err = loop.setStatus(loopFd)
+	}
+	if err != nil {
+		if recordIndex {
+			// the recorded loop device, if any, is stale
+			index.remove()
+		}
+		if err == errNoLoopControl {
+			return loop.attachScan(image, imageDev, imageIno, mode, number)
+		}
+		return err
+	}
+
+	if recordIndex {
+		if err := index.record(*number); err != nil {
+			sylog.Debugf("Could not record loop device %d in index: %s", *number, err)
+		}
+	}
+
+	return nil
+}
+
+// lookupIndex opens the loop device recorded in the index entry and
+// returns its file descriptor and number if it's still associated with
+// the image and the requested loop device information, otherwise it
+// returns -1.
+func (loop *Device) lookupIndex(index *indexEntry, imageDev, imageIno uint64, mode int) (int, int) {
+	device, ok := index.device()
+	if !ok || device >= loop.MaxLoopDevices {
+		return -1, -1
+	}
+
+	loopFd, err := syscall.Open(fmt.Sprintf("/dev/loop%d", device), mode|syscall.O_CLOEXEC, 0600)
+	if err != nil {
+		return -1, -1
+	}
+
+	status, err := GetStatusFromFd(uintptr(loopFd))
+	if err != nil || !loop.match(status, imageDev, imageIno) {
+		syscall.Close(loopFd)
+		return -1, -1
+	}
+
+	return loopFd, device
+}
+
+// attachFree asks the loop control device for a free loop device and
+// associates the image with it. No lock is required as LOOP_SET_FD
+// returns EBUSY when another process acquired the same loop device
+// in the meantime, in which case the next free loop device is requested.
+func (loop *Device) attachFree(image *os.File, mode int, number *int) (int, error) {
+	ctlFd, err := syscall.Open(loopControlPath, syscall.O_RDWR|syscall.O_CLOEXEC, 0)
+	if err != nil {
+		return -1, errNoLoopControl
+	}
+	defer syscall.Close(ctlFd)
+
+	for retry := 0; retry < loop.MaxLoopDevices; retry++ {
+		device, _, esys := syscall.Syscall(syscall.SYS_IOCTL, uintptr(ctlFd), CmdGetFree, 0)
+		if esys != 0 {
+			return -1, fmt.Errorf("failed to get a free loop device: %s", esys.Error())
+		}
+		if int(device) >= loop.MaxLoopDevices {
+			break
+		}
+
+		path, err := createDevice(int(device))
+		if err != nil {
+			return -1, err
+		}
+
+		loopFd, err := syscall.Open(path, mode|syscall.O_CLOEXEC, 0600)
+		if err != nil {
+			return -1, fmt.Errorf("failed to open loop device %s: %s", path, err)
+		}
+
+		_, _, esys = syscall.Syscall(syscall.SYS_IOCTL, uintptr(loopFd), CmdSetFd, image.Fd())
+		if esys == 0 {
+			*number = int(device)
+			return loopFd, nil
+		}
+		syscall.Close(loopFd)
+
+		if esys != syscall.EBUSY {
+			return -1, fmt.Errorf("failed to associate image with loop device %s: %s", path, esys.Error())
+		}
+	}
+
+	return -1, fmt.Errorf("no loop devices available")
+}
+
+// attachScan finds a free loop device by probing each loop device
+// sequentially while holding an exclusive lock on /dev, it's used
+// when the loop control device is not available.
+func (loop *Device) attachScan(image *os.File, imageDev, imageIno uint64, mode int, number *int) error {
+	var path string
+	var loopFd int
+	var err error
+
 	fd, err := lock.Exclusive("/dev")
 	if err != nil {
 		return err
@@ -56,17 +196,8 @@ func (loop *Device) AttachFromFile(image *os.File, mode int, number *int) error
 			return fmt.Errorf("no loop devices available")
 		}
 
-		path = fmt.Sprintf("/dev/loop%d", device)
-		if fi, err := os.Stat(path); err != nil {
-			dev := int((7 << 8) | (device & 0xff) | ((device & 0xfff00) << 12))
-			esys := syscall.Mknod(path, syscall.S_IFBLK|0660, dev)
-			if errno, ok := esys.(syscall.Errno); ok {
-				if errno != syscall.EEXIST {
-					return esys
-				}
-			}
-		} else if fi.Mode()&os.ModeDevice == 0 {
-			return fmt.Errorf("%s is not a block device", path)
+		if path, err = createDevice(device); err != nil {
+			return err
 		}
 
 		if loopFd, err = syscall.Open(path, mode, 0600); err != nil {
@@ -85,9 +216,7 @@ func (loop *Device) AttachFromFile(image *os.File, mode int, number *int) error
 				syscall.Close(loopFd)
 				continue
 			}
-			if status.Inode == imageIno && status.Device == imageDev &&
-				status.Flags&FlagsReadOnly == loop.Info.Flags&FlagsReadOnly &&
-				status.Offset == loop.Info.Offset && status.SizeLimit == loop.Info.SizeLimit {
+			if loop.match(status, imageDev, imageIno) {
 				// keep the reference to the loop device file descriptor to
 				// be sure that the loop device won't be released between this
 				// check and the mount of the filesystem
@@ -108,6 +237,12 @@ func (loop *Device) AttachFromFile(image *os.File, mode int, number *int) error
 		return fmt.Errorf("failed to set close-on-exec on loop device %s: %s", path, err.Error())
 	}
 
+	return loop.setStatus(loopFd)
+}
+
+// setStatus applies loop device information to the freshly associated
+// loop device referenced by loopFd.
+func (loop *Device) setStatus(loopFd int) error {
 	maxRetries := 5
 	for i := 0; i < maxRetries; i++ {
 		if _, _, err := syscall.Syscall(syscall.SYS_IOCTL, uintptr(loopFd), CmdSetStatus64, uintptr(unsafe.Pointer(loop.Info))); err != 0 {
@@ -126,10 +261,157 @@ func (loop *Device) AttachFromFile(image *os.File, mode int, number *int) error
 		}
 		break
 	}
-
 	return nil
 }
 
+// match returns if the loop device status corresponds to the image
+// and to the requested loop device information.
+func (loop *Device) match(status *Info64, imageDev, imageIno uint64) bool {
+	return status.Inode == imageIno && status.Device == imageDev &&
+		status.Flags&FlagsReadOnly == loop.Info.Flags&FlagsReadOnly &&
+		status.Offset == loop.Info.Offset && status.SizeLimit == loop.Info.SizeLimit
+}
+
+// createDevice creates the loop device node if it doesn't exist and
+// returns its path.
+func createDevice(device int) (string, error) {
+	path := fmt.Sprintf("/dev/loop%d", device)
+	if fi, err := os.Stat(path); err != nil {
+		dev := int((7 << 8) | (device & 0xff) | ((device & 0xfff00) << 12))
+		esys := syscall.Mknod(path, syscall.S_IFBLK|0660, dev)
+		if errno, ok := esys.(syscall.Errno); ok {
+			if errno != syscall.EEXIST {
+				return "", esys
+			}
+		}
+	} else if fi.Mode()&os.ModeDevice == 0 {
+		return "", fmt.Errorf("%s is not a block device", path)
+	}
+	return path, nil
+}
+
+// indexEntry is a locked entry of the loop device index.
+type indexEntry struct {
+	file *os.File
+}
+
+func indexName(imageDev, imageIno uint64, info *Info64) string {
+	return fmt.Sprintf("%d-%d-%d-%d-%d", imageDev, imageIno, info.Offset, info.SizeLimit, info.Flags&FlagsReadOnly)
+}
+
+// openIndexEntry opens and locks the index entry corresponding to the image
+// and loop device information, the lock is held until the entry is closed.
+func openIndexEntry(imageDev, imageIno uint64, info *Info64) (*indexEntry, error) {
+	if err := os.MkdirAll(SharedIndexDir, 0700); err != nil {
+		return nil, err
+	}
+
+	path := filepath.Join(SharedIndexDir, indexName(imageDev, imageIno, info))
+	for {
+		file, err := os.OpenFile(path, os.O_RDWR|os.O_CREATE, 0600)
+		if err != nil {
+			return nil, err
+		}
+		e, err := lockIndexEntry(file, syscall.LOCK_EX)
+		if err != nil {
+			file.Close()
+			return nil, err
+		} else if e != nil {
+			return e, nil
+		}
+		// removed by another process before it was locked
+		file.Close()
+	}
+}
+
+// lockIndexEntry locks the opened index entry file, it returns nil if the
+// entry was removed in the meantime.
+func lockIndexEntry(file *os.File, how int) (*indexEntry, error) {
+	if err := syscall.Flock(int(file.Fd()), how); err != nil {
+		return nil, err
+	}
+	fi, err := file.Stat()
+	if err != nil {
+		syscall.Flock(int(file.Fd()), syscall.LOCK_UN)
+		return nil, err
+	}
+	if pfi, err := os.Stat(file.Name()); err != nil || !os.SameFile(fi, pfi) {
+		syscall.Flock(int(file.Fd()), syscall.LOCK_UN)
+		return nil, nil
+	}
+	return &indexEntry{file: file}, nil
+}
+
+// device returns the loop device number recorded in the index entry.
+func (e *indexEntry) device() (int, bool) {
+	b := make([]byte, 16)
+	n, _ := e.file.ReadAt(b, 0)
+	device, err := strconv.Atoi(strings.TrimSpace(string(b[:n])))
+	if err != nil {
+		return -1, false
+	}
+	return device, true
+}
+
+// record stores the loop device number in the index entry and links the
+// loop device to the entry. The entry previously linked to the same loop
+// device is stale, the loop device being now associated with the image of
+// this entry, and is removed.
+func (e *indexEntry) record(device int) error {
+	if err := e.file.Truncate(0); err != nil {
+		return err
+	}
+	if _, err := e.file.WriteAt([]byte(strconv.Itoa(device)), 0); err != nil {
+		return err
+	}
+
+	link := filepath.Join(SharedIndexDir, fmt.Sprintf("loop%d", device))
+	name := filepath.Base(e.file.Name())
+	if prev, err := os.Readlink(link); err == nil && prev != name {
+		removeStaleEntry(filepath.Join(SharedIndexDir, prev), device)
+	}
+
+	tmp := fmt.Sprintf("%s.%d", link, os.Getpid())
+	os.Remove(tmp)
+	if err := os.Symlink(name, tmp); err != nil {
+		return err
+	}
+	return os.Rename(tmp, link)
+}
+
+// removeStaleEntry removes the index entry at path if it still records the
+// loop device, an entry locked by another process is left to it.
+func removeStaleEntry(path string, device int) {
+	file, err := os.OpenFile(path, os.O_RDWR, 0)
+	if err != nil {
+		return
+	}
+	e, err := lockIndexEntry(file, syscall.LOCK_EX|syscall.LOCK_NB)
+	if err != nil || e == nil {
+		file.Close()
+		return
+	}
+	defer e.close()
+
+	if d, ok := e.device(); ok && d == device {
+		sylog.Debugf("Removing stale loop device index entry %s", filepath.Base(path))
+		e.remove()
+	}
+}
+
+// remove removes the index entry, it must be called before close.
+func (e *indexEntry) remove() {
+	if err := os.Remove(e.file.Name()); err != nil {
+		sylog.Debugf("Could not remove loop device index entry: %s", err)
+	}
+}
+
+// close releases the lock and closes the index entry.
+func (e *indexEntry) close() {
+	syscall.Flock(int(e.file.Fd()), syscall.LOCK_UN)
+	e.file.Close()
+}
+
 // AttachFromPath finds a free loop device, opens it, and stores file descriptor
 // of opened image path
 func (loop *Device) AttachFromPath(image string, mode int, number *int) error {
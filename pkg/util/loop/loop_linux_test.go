@@ -7,7 +7,11 @@ package loop
 
 import (
 	"fmt"
+	"io/ioutil"
 	"os"
+	"path/filepath"
+	"strings"
+	"sync"
 	"syscall"
 	"testing"
 
@@ -19,6 +23,14 @@ func TestLoop(t *testing.T) {
 
 	var i1 *Info64
 
+	indexDir, err := ioutil.TempDir("", "loop-index-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(indexDir)
+	defer func(dir string) { SharedIndexDir = dir }(SharedIndexDir)
+	SharedIndexDir = indexDir
+
 	info := &Info64{
 		Flags: FlagsAutoClear | FlagsReadOnly,
 	}
@@ -88,6 +100,34 @@ func TestLoop(t *testing.T) {
 		t.Errorf("not attached to the same loop block device /dev/loop%d", loopOne)
 	}
 
+	// Shared loop device must be resolved from the index, the index
+	// holds its entry and the link from the loop device to the entry
+	entries, err := ioutil.ReadDir(indexDir)
+	if err != nil {
+		t.Error(err)
+	} else if len(entries) != 2 {
+		t.Errorf("unexpected number of index entries: %d", len(entries))
+	}
+
+	// the entry previously linked to the next free loop device is removed
+	// when this loop device is recorded for another image
+	ctlFd, err := syscall.Open(loopControlPath, syscall.O_RDWR, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	next, _, esys := syscall.Syscall(syscall.SYS_IOCTL, uintptr(ctlFd), CmdGetFree, 0)
+	syscall.Close(ctlFd)
+	if esys != 0 {
+		t.Fatalf("failed to get a free loop device: %s", esys)
+	}
+	stale := filepath.Join(indexDir, "0-0-0-0-1")
+	if err := ioutil.WriteFile(stale, []byte(fmt.Sprint(next)), 0600); err != nil {
+		t.Error(err)
+	}
+	if err := os.Symlink("0-0-0-0-1", filepath.Join(indexDir, fmt.Sprintf("loop%d", next))); err != nil {
+		t.Error(err)
+	}
+
 	loopTwo = -1
 	if err := loopDev.AttachFromPath("/etc/group", os.O_RDONLY, &loopTwo); err != nil {
 		t.Error(err)
@@ -95,6 +135,19 @@ func TestLoop(t *testing.T) {
 	if loopOne == loopTwo {
 		t.Errorf("attached to the same loop block device /dev/loop%d", loopOne)
 	}
+	if loopTwo != int(next) {
+		t.Fatalf("attached to /dev/loop%d instead of the free loop device /dev/loop%d", loopTwo, next)
+	}
+
+	if _, err := os.Stat(stale); !os.IsNotExist(err) {
+		t.Errorf("stale index entry not removed")
+	}
+	entries, err = ioutil.ReadDir(indexDir)
+	if err != nil {
+		t.Error(err)
+	} else if len(entries) != 4 {
+		t.Errorf("unexpected number of index entries: %d", len(entries))
+	}
 
 	// With MaxLoopDevices set to zero
 	loopDev.MaxLoopDevices = 0
@@ -102,3 +155,89 @@ func TestLoop(t *testing.T) {
 		t.Errorf("unexpected success with MaxLoopDevices = 0")
 	}
 }
+
+// closeLoopDevices closes all loop device file descriptors kept open by
+// AttachFromFile, auto-clear loop devices are then released by the kernel.
+func closeLoopDevices(b *testing.B) {
+	fds, err := ioutil.ReadDir("/proc/self/fd")
+	if err != nil {
+		b.Fatal(err)
+	}
+	for _, fd := range fds {
+		link, err := os.Readlink(filepath.Join("/proc/self/fd", fd.Name()))
+		if err != nil || !strings.HasPrefix(link, "/dev/loop") || link == loopControlPath {
+			continue
+		}
+		var n int
+		if _, err := fmt.Sscanf(fd.Name(), "%d", &n); err == nil {
+			syscall.Close(n)
+		}
+	}
+}
+
+func benchmarkAttach(b *testing.B, images []string) {
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		var wg sync.WaitGroup
+
+		for _, image := range images {
+			wg.Add(1)
+			go func(image string) {
+				defer wg.Done()
+
+				loopDev := &Device{
+					MaxLoopDevices: 256,
+					Info: &Info64{
+						Flags: FlagsAutoClear | FlagsReadOnly,
+					},
+				}
+				number := -1
+				if err := loopDev.AttachFromPath(image, os.O_RDONLY, &number); err != nil {
+					b.Error(err)
+				}
+			}(image)
+		}
+		wg.Wait()
+
+		b.StopTimer()
+		closeLoopDevices(b)
+		b.StartTimer()
+	}
+}
+
+func BenchmarkAttachConcurrent(b *testing.B) {
+	if os.Getuid() != 0 {
+		b.Skip("benchmark must be run with privilege")
+	}
+
+	dir, err := ioutil.TempDir("", "loop-bench-")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	defer func(dir string) { SharedIndexDir = dir }(SharedIndexDir)
+	SharedIndexDir = filepath.Join(dir, "index")
+
+	images := make([]string, 64)
+	for i := range images {
+		images[i] = filepath.Join(dir, fmt.Sprintf("image%d", i))
+		if err := ioutil.WriteFile(images[i], make([]byte, 1024*1024), 0600); err != nil {
+			b.Fatal(err)
+		}
+	}
+
+	defaultControlPath := loopControlPath
+	defer func() { loopControlPath = defaultControlPath }()
+
+	for _, n := range []int{1, 8, 64} {
+		loopControlPath = defaultControlPath
+		b.Run(fmt.Sprintf("loop-control-%d", n), func(b *testing.B) {
+			benchmarkAttach(b, images[:n])
+		})
+		// force the fallback on the /dev locked scan
+		loopControlPath = filepath.Join(dir, "loop-control")
+		b.Run(fmt.Sprintf("scan-%d", n), func(b *testing.B) {
+			benchmarkAttach(b, images[:n])
+		})
+	}
+}